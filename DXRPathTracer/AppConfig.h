@@ -10,4 +10,6 @@
 
 #define EnableSkyModel_ (1)
 #define EnableEmbree_ (0)
-#define EnableDXR_ (1)
\ No newline at end of file
+#define EnableDXR_ (1)
+#define EnableCompressedBVH8_ (0)
+#define EnableCompactVertices_ (0)
\ No newline at end of file
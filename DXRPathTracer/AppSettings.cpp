@@ -26,6 +26,13 @@ static const char* ClusterRasterizationModesLabels[] =
     "Conservative",
 };
 
+static const char* SampleModesLabels[] =
+{
+    "Correlated Multi-Jittered",
+    "Owen-Scrambled Sobol",
+    "Blue-Noise Sobol",
+};
+
 namespace AppSettings
 {
     static SettingsContainer Settings;
@@ -46,6 +53,7 @@ namespace AppSettings
     BoolSetting ClampRoughness;
     BoolSetting AvoidCausticPaths;
     IntSetting SqrtNumSamples;
+    SampleModesSetting SampleMode;
     IntSetting MaxPathLength;
     IntSetting MaxAnyHitPathLength;
     FloatSetting Exposure;
@@ -138,6 +146,9 @@ namespace AppSettings
         SqrtNumSamples.Initialize("SqrtNumSamples", "Path Tracing", "Sqrt Num Samples", "The square root of the number of per-pixel sample rays to use for path tracing", 4, 1, 100);
         Settings.AddSetting(&SqrtNumSamples);
 
+        SampleMode.Initialize("SampleMode", "Path Tracing", "Sample Mode", "The sequence used to generate the random samples for each pixel and bounce", SampleModes::Sobol, 3, SampleModesLabels);
+        Settings.AddSetting(&SampleMode);
+
         MaxPathLength.Initialize("MaxPathLength", "Path Tracing", "Max Path Length", "Maximum path length (bounces) to use for path tracing", 3, 2, 8);
         Settings.AddSetting(&MaxPathLength);
 
@@ -229,6 +240,7 @@ namespace AppSettings
         cbData.ClampRoughness = ClampRoughness;
         cbData.AvoidCausticPaths = AvoidCausticPaths;
         cbData.SqrtNumSamples = SqrtNumSamples;
+        cbData.SampleMode = SampleMode;
         cbData.MaxPathLength = MaxPathLength;
         cbData.MaxAnyHitPathLength = MaxAnyHitPathLength;
         cbData.Exposure = Exposure;
@@ -26,6 +26,18 @@ enum ClusterRasterizationModes
     Conservative
 }
 
+enum SampleModes
+{
+    [EnumLabel("Correlated Multi-Jittered")]
+    CMJ,
+
+    [EnumLabel("Owen-Scrambled Sobol")]
+    Sobol,
+
+    [EnumLabel("Blue-Noise Sobol")]
+    BlueNoise,
+}
+
 enum DepthSortModes
 {
     None,
@@ -133,6 +145,9 @@ public class Settings
         [DisplayName("Sqrt Num Samples")]
         int SqrtNumSamples = 4;
 
+        [HelpText("The sequence used to generate the random samples for each pixel and bounce")]
+        SampleModes SampleMode = SampleModes.Sobol;
+
         [HelpText("Maximum path length (bounces) to use for path tracing")]
         [MinValue(2)]
         [MaxValue(MaxPathLengthSetting)]
@@ -41,6 +41,17 @@ enum class ClusterRasterizationModes
 
 typedef EnumSettingT<ClusterRasterizationModes> ClusterRasterizationModesSetting;
 
+enum class SampleModes
+{
+    CMJ = 0,
+    Sobol = 1,
+    BlueNoise = 2,
+
+    NumValues
+};
+
+typedef EnumSettingT<SampleModes> SampleModesSetting;
+
 namespace AppSettings
 {
     static const uint64 ClusterTileSize = 16;
@@ -70,6 +81,7 @@ namespace AppSettings
     extern BoolSetting ClampRoughness;
     extern BoolSetting AvoidCausticPaths;
     extern IntSetting SqrtNumSamples;
+    extern SampleModesSetting SampleMode;
     extern IntSetting MaxPathLength;
     extern IntSetting MaxAnyHitPathLength;
     extern FloatSetting Exposure;
@@ -105,6 +117,7 @@ namespace AppSettings
         bool32 ClampRoughness;
         bool32 AvoidCausticPaths;
         int32 SqrtNumSamples;
+        int32 SampleMode;
         int32 MaxPathLength;
         int32 MaxAnyHitPathLength;
         float Exposure;
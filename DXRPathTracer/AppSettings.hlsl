@@ -11,6 +11,7 @@ struct AppSettings_Layout
     bool ClampRoughness;
     bool AvoidCausticPaths;
     int SqrtNumSamples;
+    int SampleMode;
     int MaxPathLength;
     int MaxAnyHitPathLength;
     float Exposure;
@@ -46,6 +47,10 @@ static const int ClusterRasterizationModes_MSAA4x = 1;
 static const int ClusterRasterizationModes_MSAA8x = 2;
 static const int ClusterRasterizationModes_Conservative = 3;
 
+static const int SampleModes_CMJ = 0;
+static const int SampleModes_Sobol = 1;
+static const int SampleModes_BlueNoise = 2;
+
 static const uint ClusterTileSize = 16;
 static const uint NumZTiles = 16;
 static const uint MaxSpotLights = 32;
@@ -0,0 +1,462 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#include <PCH.h>
+
+#include <Utility.h>
+#include <Timer.h>
+#include <Tasks.h>
+#include <Graphics/BVH.h>
+#include <Graphics/BVH8.h>
+#include <Graphics/TwoLevelBVH.h>
+#include <Graphics/Sampling.h>
+
+#include "BVHBenchmark.h"
+
+using namespace SampleFramework12;
+
+static const uint32 RaysPerTask = 4096;
+static const uint32 NumBenchmarkRuns = 3;
+static const uint32 PacketSize = 8;
+
+// Limits for the number of copies of the scene in the instancing benchmark
+static const uint64 MaxSceneCopies = 4096;
+static const uint64 MaxFlattenedTriangles = 4 * 1024 * 1024;
+
+StaticAssert_(PacketSize * PacketSize <= BVH::MaxPacketSize);
+
+static void GenerateRays(const BVH& bvh, uint32 numRays, Array<BVHRay>& rays)
+{
+    const Array<BVHPrimitive>& primitives = bvh.Primitives();
+
+    Random random;
+    rays.Init(numRays);
+    for(uint32 rayIdx = 0; rayIdx < numRays; ++rayIdx)
+    {
+        // Pick a random point on a random triangle
+        const BVHPrimitive& prim = primitives[random.RandomUint() % primitives.Size()];
+        Float2 barycentrics = random.RandomFloat2();
+        if(barycentrics.x + barycentrics.y > 1.0f)
+            barycentrics = Float2(1.0f - barycentrics.x, 1.0f - barycentrics.y);
+
+        Float3 normal = Float3::Cross(prim.E1, prim.E2);
+        if(normal.Length() < 1e-12f)
+            normal = Float3(0.0f, 1.0f, 0.0f);
+        normal = Float3::Normalize(normal);
+        if(random.RandomFloat() < 0.5f)
+            normal = -normal;
+
+        const Float3 tangent = Float3::Normalize(Float3::Perpendicular(normal));
+        const Float3 bitangent = Float3::Cross(normal, tangent);
+        const Float3x3 tangentToWorld = Float3x3(tangent, bitangent, normal);
+
+        const Float2 dirSample = random.RandomFloat2();
+        const Float3 dirTS = SampleDirectionCosineHemisphere(dirSample.x, dirSample.y);
+
+        BVHRay& ray = rays[rayIdx];
+        ray.Origin = prim.V0 + prim.E1 * barycentrics.x + prim.E2 * barycentrics.y + normal * 0.0001f;
+        ray.Direction = Float3::Normalize(Float3::Transform(dirTS, tangentToWorld));
+        ray.TMin = 0.0f;
+        ray.TMax = FloatMax;
+    }
+}
+
+// Generates a ray through the center of every pixel, the same way that RaygenShader does. The rays
+// are ordered so that each block of PacketSize x PacketSize pixels is contiguous.
+static void GenerateCameraRays(const Float4x4& viewProjection, uint32 width, uint32 height,
+                               Array<BVHRay>& rays, Array<uint32>& packetOffsets)
+{
+    const Float4x4 invViewProjection = Float4x4::Invert(viewProjection);
+    const Float2 dispatchSize = Float2(float(width), float(height));
+    const uint32 numPacketsX = (width + PacketSize - 1) / PacketSize;
+    const uint32 numPacketsY = (height + PacketSize - 1) / PacketSize;
+
+    rays.Init(width * height);
+    packetOffsets.Init(numPacketsX * numPacketsY + 1);
+
+    uint32 rayIdx = 0;
+    for(uint32 packetIdx = 0; packetIdx < numPacketsX * numPacketsY; ++packetIdx)
+    {
+        packetOffsets[packetIdx] = rayIdx;
+
+        const uint32 blockX = (packetIdx % numPacketsX) * PacketSize;
+        const uint32 blockY = (packetIdx / numPacketsX) * PacketSize;
+        for(uint32 y = blockY; y < Min(blockY + PacketSize, height); ++y)
+        {
+            for(uint32 x = blockX; x < Min(blockX + PacketSize, width); ++x)
+            {
+                Float2 rayPixelPos = Float2(x + 0.5f, y + 0.5f);
+                Float2 ncdXY = (rayPixelPos / (dispatchSize * 0.5f)) - Float2(1.0f, 1.0f);
+                ncdXY.y *= -1.0f;
+                Float3 rayStart = Float3::Transform(Float3(ncdXY, 0.0f), invViewProjection);
+                Float3 rayEnd = Float3::Transform(Float3(ncdXY, 1.0f), invViewProjection);
+
+                BVHRay& ray = rays[rayIdx++];
+                ray.Origin = rayStart;
+                ray.Direction = Float3::Normalize(rayEnd - rayStart);
+                ray.TMin = 0.0f;
+                ray.TMax = Float3::Length(rayEnd - rayStart);
+            }
+        }
+    }
+
+    packetOffsets[numPacketsX * numPacketsY] = rayIdx;
+}
+
+// Runs a trace function over a set of rays or packets across the task threads, returning the best time out of several runs
+template<typename TraceFunction> static double TimeTraceRays(uint32 numItems, uint32 itemsPerTask, const TraceFunction& traceFunction)
+{
+    const uint32 numTasks = (numItems + itemsPerTask - 1) / itemsPerTask;
+
+    double bestSeconds = FloatMax;
+    for(uint32 runIdx = 0; runIdx < NumBenchmarkRuns; ++runIdx)
+    {
+        Timer timer;
+        Tasks::ParallelFor(numTasks, [&](enki::TaskSetPartition range, uint32 threadNum)
+        {
+            for(uint32 taskIdx = range.start; taskIdx < range.end; ++taskIdx)
+            {
+                const uint32 itemEnd = Min((taskIdx + 1) * itemsPerTask, numItems);
+                for(uint32 itemIdx = taskIdx * itemsPerTask; itemIdx < itemEnd; ++itemIdx)
+                    traceFunction(itemIdx);
+            }
+        });
+        timer.Update();
+
+        bestSeconds = Min(bestSeconds, timer.ElapsedSecondsD());
+    }
+
+    return bestSeconds;
+}
+
+static double MRaysPerSecond(uint32 numRays, double seconds)
+{
+    return (numRays / seconds) / 1000000.0;
+}
+
+static void RunCameraRayBenchmark(const BVH& bvh, const char* sceneName, const Float4x4& viewProjection, uint32 width, uint32 height)
+{
+    Array<BVHRay> rays;
+    Array<uint32> packetOffsets;
+    GenerateCameraRays(viewProjection, width, height, rays, packetOffsets);
+
+    const uint32 numRays = uint32(rays.Size());
+    const uint32 numPackets = uint32(packetOffsets.Size() - 1);
+
+    Array<BVHHit> hits(numRays);
+    const double singleSeconds = TimeTraceRays(numRays, RaysPerTask, [&](uint32 rayIdx)
+    {
+        bvh.Intersect(rays[rayIdx], hits[rayIdx]);
+    });
+
+    Array<BVHHit> packetHits(numRays);
+    const double packetSeconds = TimeTraceRays(numPackets, RaysPerTask / (PacketSize * PacketSize), [&](uint32 packetIdx)
+    {
+        const uint32 offset = packetOffsets[packetIdx];
+        bvh.IntersectPacket(&rays[offset], packetOffsets[packetIdx + 1] - offset, &packetHits[offset]);
+    });
+
+    uint64 numMismatches = 0;
+    for(uint32 rayIdx = 0; rayIdx < numRays; ++rayIdx)
+    {
+        const BVHHit& hit = hits[rayIdx];
+        const BVHHit& packetHit = packetHits[rayIdx];
+        if(hit.Valid() != packetHit.Valid() || (hit.Valid() && hit.T != packetHit.T))
+            ++numMismatches;
+    }
+
+    WriteLog("BVH benchmark [%s]: %ux%u camera rays, single ray %.2f MRays/s, %ux%u packets %.2f MRays/s (%.2fx), %llu mismatched results",
+             sceneName, width, height, MRaysPerSecond(numRays, singleSeconds), PacketSize, PacketSize,
+             MRaysPerSecond(numRays, packetSeconds), singleSeconds / packetSeconds, numMismatches);
+}
+
+// Compares building the BVH from scratch with loading it from the cache file
+static void RunCacheBenchmark(const Model& model, const BVH& bvh, const char* sceneName)
+{
+    if(model.FileDirectory().length() == 0)
+        return;
+
+    Timer hashTimer;
+    const Hash geometryHash = BVH::GeometryHash(model);
+    hashTimer.Update();
+
+    const std::wstring cachePath = BVH::CacheFilePath(model, geometryHash);
+
+    Timer saveTimer;
+    bvh.SaveToCache(cachePath.c_str(), geometryHash);
+    saveTimer.Update();
+
+    double bestLoadMs = FloatMax;
+    bool loaded = true;
+    bool matches = true;
+    for(uint32 runIdx = 0; runIdx < NumBenchmarkRuns; ++runIdx)
+    {
+        BVH cachedBVH;
+
+        Timer loadTimer;
+        loaded = cachedBVH.LoadFromCache(model, cachePath.c_str(), geometryHash);
+        loadTimer.Update();
+
+        if(loaded)
+        {
+            bestLoadMs = Min(bestLoadMs, loadTimer.ElapsedMillisecondsD());
+            matches = cachedBVH.NumNodes() == bvh.NumNodes() && cachedBVH.NumPrimitives() == bvh.NumPrimitives() &&
+                      memcmp(cachedBVH.Nodes(), bvh.Nodes(), bvh.NumNodes() * sizeof(BVHNode)) == 0 &&
+                      memcmp(cachedBVH.Primitives().Data(), bvh.Primitives().Data(), bvh.Primitives().MemorySize()) == 0;
+        }
+
+        cachedBVH.Shutdown();
+
+        if(loaded == false)
+            break;
+    }
+
+    if(loaded == false)
+    {
+        WriteLog("BVH benchmark [%s]: failed to load the BVH cache file", sceneName);
+        return;
+    }
+
+    const double buildMs = bvh.BuildStats().BuildTimeMs;
+    const double hashMs = hashTimer.ElapsedMillisecondsD();
+    WriteLog("BVH benchmark [%s]: build %.2f ms, cache save %.2f ms, cache load %.2f ms + %.2f ms hashing (%.2fx faster than building)%s",
+             sceneName, buildMs, saveTimer.ElapsedMillisecondsD(), bestLoadMs, hashMs, buildMs / (bestLoadMs + hashMs),
+             matches ? "" : ", cached tree doesn't match!");
+}
+
+// Moves the mesh with the most triangles, and compares refitting the BVH with building it from scratch
+static void RunRefitBenchmark(const Model& model, const BVH& sourceBVH, const char* sceneName)
+{
+    const uint64 numMeshes = model.NumMeshes();
+    uint32 movedMesh = 0;
+    for(uint32 meshIdx = 1; meshIdx < numMeshes; ++meshIdx)
+    {
+        if(model.Meshes()[meshIdx].NumIndices() > model.Meshes()[movedMesh].NumIndices())
+            movedMesh = meshIdx;
+    }
+
+    const Float3 sceneSize = sourceBVH.BoundsMax() - sourceBVH.BoundsMin();
+    const float moveDistances[] = { 0.01f, 0.1f, 0.5f };
+
+    BVH bvh;
+    bvh.Build(model);
+
+    Array<Float4x4> meshTransforms(numMeshes);
+    for(uint64 i = 0; i < ArraySize_(moveDistances); ++i)
+    {
+        meshTransforms[movedMesh] = Float4x4::TranslationMatrix(sceneSize * moveDistances[i]);
+        bvh.Refit(model, &movedMesh, 1, meshTransforms.Data());
+
+        const BVHRefitStats& stats = bvh.RefitStats();
+        WriteLog("BVH benchmark [%s]: moved %llu triangles by %.0f%% of the scene size, refit %llu nodes in %.2f ms (SAH %.2f -> %.2f), "
+                 "rebuilt %llu subtrees with %llu triangles in %.2f ms (SAH %.2f), full build takes %.2f ms",
+                 sceneName, stats.NumChangedPrimitives, moveDistances[i] * 100.0f, stats.NumRefitNodes, stats.RefitTimeMs,
+                 sourceBVH.BuildStats().SAHCost, stats.RefitSAHCost, stats.NumRebuiltSubtrees, stats.NumRebuiltPrimitives,
+                 stats.RebuildTimeMs, stats.SAHCost, sourceBVH.BuildStats().BuildTimeMs);
+    }
+
+    bvh.Shutdown();
+}
+
+// Places copies of every mesh in the scene on a grid with random rotations, and compares a
+// two-level BVH that instances the meshes with flattening all of the copies into a single BVH
+static void RunInstancingBenchmark(const Model& model, const char* sceneName, uint32 numRays)
+{
+    TwoLevelBVH twoLevelBVH;
+    twoLevelBVH.BuildBLASes(model);
+
+    uint64 sceneTriangles = 0;
+    Float3 sceneMin = FloatMax;
+    Float3 sceneMax = -FloatMax;
+    for(uint64 blasIdx = 0; blasIdx < twoLevelBVH.NumBLASes(); ++blasIdx)
+    {
+        const BVH& blas = twoLevelBVH.BLAS(blasIdx);
+        if(blas.NumNodes() == 0)
+            continue;
+
+        sceneTriangles += blas.NumPrimitives();
+        sceneMin = Float3(Min(sceneMin.x, blas.BoundsMin().x), Min(sceneMin.y, blas.BoundsMin().y), Min(sceneMin.z, blas.BoundsMin().z));
+        sceneMax = Float3(Max(sceneMax.x, blas.BoundsMax().x), Max(sceneMax.y, blas.BoundsMax().y), Max(sceneMax.z, blas.BoundsMax().z));
+    }
+
+    // Big scenes get fewer copies, so that the flattened BVH still fits in memory
+    const uint64 numCopies = Clamp<uint64>(MaxFlattenedTriangles / sceneTriangles, 1, MaxSceneCopies);
+    const uint64 gridSize = uint64(std::ceil(std::sqrt(double(numCopies))));
+    const float spacing = Max(sceneMax.x - sceneMin.x, sceneMax.z - sceneMin.z) * 1.25f;
+
+    Random random;
+    for(uint64 copyIdx = 0; copyIdx < numCopies; ++copyIdx)
+    {
+        const Float3 position = Float3(float(copyIdx % gridSize) * spacing, 0.0f, float(copyIdx / gridSize) * spacing);
+        const Float4x4 transform = Float4x4::RotationEuler(0.0f, random.RandomFloat() * Pi2, 0.0f) * Float4x4::TranslationMatrix(position);
+        for(uint32 blasIdx = 0; blasIdx < twoLevelBVH.NumBLASes(); ++blasIdx)
+        {
+            if(twoLevelBVH.BLAS(blasIdx).NumNodes() > 0)
+                twoLevelBVH.AddInstance(blasIdx, transform, 0xFF, uint32(copyIdx));
+        }
+    }
+
+    twoLevelBVH.BuildTLAS();
+
+    BVH flatBVH;
+    Timer flattenTimer;
+    twoLevelBVH.Flatten(flatBVH);
+    flattenTimer.Update();
+
+    Array<BVHRay> rays;
+    GenerateRays(flatBVH, numRays, rays);
+
+    Array<BVHHit> flatHits(numRays);
+    const double flatSeconds = TimeTraceRays(numRays, RaysPerTask, [&](uint32 rayIdx)
+    {
+        flatBVH.Intersect(rays[rayIdx], flatHits[rayIdx]);
+    });
+
+    Array<BVHHit> instancedHits(numRays);
+    const double instancedSeconds = TimeTraceRays(numRays, RaysPerTask, [&](uint32 rayIdx)
+    {
+        twoLevelBVH.Intersect(rays[rayIdx], instancedHits[rayIdx]);
+    });
+
+    // Rays are transformed into each instance's space, so the results should only differ by float precision
+    uint64 numMismatches = 0;
+    for(uint32 rayIdx = 0; rayIdx < numRays; ++rayIdx)
+    {
+        const BVHHit& flatHit = flatHits[rayIdx];
+        const BVHHit& instancedHit = instancedHits[rayIdx];
+        if(flatHit.Valid() != instancedHit.Valid() ||
+           (flatHit.Valid() && std::abs(flatHit.T - instancedHit.T) > 1e-4f * Max(flatHit.T, 1.0f)))
+            ++numMismatches;
+    }
+
+    const double twoLevelMB = twoLevelBVH.MemorySize() / (1024.0 * 1024.0);
+    const double flatMB = flatBVH.MemorySize() / (1024.0 * 1024.0);
+    WriteLog("BVH benchmark [%s]: %llu instances of %llu meshes (%llu triangles), two-level BVH %.2f MB with TLAS built in %.2f ms, "
+             "flattened BVH %.2f MB built in %.2f ms (%.1fx the memory)", sceneName, twoLevelBVH.NumInstances(),
+             twoLevelBVH.NumBLASes(), twoLevelBVH.NumInstancedTriangles(), twoLevelMB, twoLevelBVH.TLASBuildTimeMs(),
+             flatMB, flattenTimer.ElapsedMillisecondsD(), flatMB / twoLevelMB);
+    WriteLog("BVH benchmark [%s]: instanced closest hit %.2f MRays/s, flattened %.2f MRays/s (%.2fx), %llu mismatched results", sceneName,
+             MRaysPerSecond(numRays, instancedSeconds), MRaysPerSecond(numRays, flatSeconds), instancedSeconds / flatSeconds, numMismatches);
+
+    flatBVH.Shutdown();
+    twoLevelBVH.Shutdown();
+}
+
+void RunBVHBenchmark(const Model& model, const char* sceneName, const Float4x4& viewProjection,
+                     uint32 width, uint32 height, uint32 numRays)
+{
+    BVH bvh;
+    bvh.Build(model);
+
+    RunCacheBenchmark(model, bvh, sceneName);
+    RunRefitBenchmark(model, bvh, sceneName);
+    RunInstancingBenchmark(model, sceneName, numRays);
+    RunCameraRayBenchmark(bvh, sceneName, viewProjection, width, height);
+
+    Array<BVHRay> rays;
+    GenerateRays(bvh, numRays, rays);
+
+    Array<BVHHit> hits(numRays);
+    Array<uint8> occluded(numRays, 0);
+
+    const double closestSeconds = TimeTraceRays(numRays, RaysPerTask, [&](uint32 rayIdx)
+    {
+        bvh.Intersect(rays[rayIdx], hits[rayIdx]);
+    });
+
+    const double occlusionSeconds = TimeTraceRays(numRays, RaysPerTask, [&](uint32 rayIdx)
+    {
+        occluded[rayIdx] = uint8(bvh.Occluded(rays[rayIdx]));
+    });
+
+    uint64 numHits = 0;
+    for(uint32 rayIdx = 0; rayIdx < numRays; ++rayIdx)
+        numHits += hits[rayIdx].Valid() ? 1 : 0;
+
+    WriteLog("BVH benchmark [%s]: %llu triangles, %u rays, %.1f%% hit", sceneName, bvh.NumPrimitives(), numRays, numHits * 100.0 / numRays);
+    WriteLog("BVH benchmark [%s]: BVH2 closest hit %.2f MRays/s, occlusion %.2f MRays/s", sceneName,
+             MRaysPerSecond(numRays, closestSeconds), MRaysPerSecond(numRays, occlusionSeconds));
+
+    if(BVH8::Supported() == false)
+    {
+        WriteLog("BVH benchmark [%s]: skipping BVH8, the CPU doesn't support AVX2", sceneName);
+        bvh.Shutdown();
+        return;
+    }
+
+    BVH8 bvh8;
+    bvh8.Build(bvh);
+
+    Array<BVHHit> hits8(numRays);
+    Array<uint8> occluded8(numRays, 0);
+
+    const double closestSeconds8 = TimeTraceRays(numRays, RaysPerTask, [&](uint32 rayIdx)
+    {
+        bvh8.Intersect(rays[rayIdx], hits8[rayIdx]);
+    });
+
+    const double occlusionSeconds8 = TimeTraceRays(numRays, RaysPerTask, [&](uint32 rayIdx)
+    {
+        occluded8[rayIdx] = uint8(bvh8.Occluded(rays[rayIdx]));
+    });
+
+    // Both trees contain the same triangles, so the results should only differ by float precision
+    uint64 numMismatches = 0;
+    for(uint32 rayIdx = 0; rayIdx < numRays; ++rayIdx)
+    {
+        const BVHHit& hit = hits[rayIdx];
+        const BVHHit& hit8 = hits8[rayIdx];
+        if(hit.Valid() != hit8.Valid() || occluded[rayIdx] != occluded8[rayIdx] ||
+           (hit.Valid() && std::abs(hit.T - hit8.T) > 1e-4f * Max(hit.T, 1.0f)))
+            ++numMismatches;
+    }
+
+    WriteLog("BVH benchmark [%s]: BVH8 closest hit %.2f MRays/s (%.2fx), occlusion %.2f MRays/s (%.2fx), %llu mismatched results", sceneName,
+             MRaysPerSecond(numRays, closestSeconds8), closestSeconds / closestSeconds8,
+             MRaysPerSecond(numRays, occlusionSeconds8), occlusionSeconds / occlusionSeconds8, numMismatches);
+
+    CompressedBVH8 compressedBVH8;
+    compressedBVH8.Build(bvh8);
+
+    Array<BVHHit> compressedHits(numRays);
+    Array<uint8> compressedOccluded(numRays, 0);
+
+    const double compressedClosestSeconds = TimeTraceRays(numRays, RaysPerTask, [&](uint32 rayIdx)
+    {
+        compressedBVH8.Intersect(rays[rayIdx], compressedHits[rayIdx]);
+    });
+
+    const double compressedOcclusionSeconds = TimeTraceRays(numRays, RaysPerTask, [&](uint32 rayIdx)
+    {
+        compressedOccluded[rayIdx] = uint8(compressedBVH8.Occluded(rays[rayIdx]));
+    });
+
+    // The quantized boxes are conservative, so only the order that leaves are visited in can change
+    uint64 numCompressedMismatches = 0;
+    for(uint32 rayIdx = 0; rayIdx < numRays; ++rayIdx)
+    {
+        const BVHHit& hit = hits[rayIdx];
+        const BVHHit& compressedHit = compressedHits[rayIdx];
+        if(hit.Valid() != compressedHit.Valid() || occluded[rayIdx] != compressedOccluded[rayIdx] ||
+           (hit.Valid() && std::abs(hit.T - compressedHit.T) > 1e-4f * Max(hit.T, 1.0f)))
+            ++numCompressedMismatches;
+    }
+
+    WriteLog("BVH benchmark [%s]: compressed BVH8 nodes %.2f MB vs. %.2f MB (%llu vs. %llu bytes per node), closest hit %.2f MRays/s (%.2fx BVH8), "
+             "occlusion %.2f MRays/s (%.2fx BVH8), %llu mismatched results", sceneName,
+             compressedBVH8.NodeMemorySize() / (1024.0 * 1024.0), bvh8.NodeMemorySize() / (1024.0 * 1024.0),
+             uint64(sizeof(CompressedBVH8Node)), uint64(sizeof(BVH8Node)),
+             MRaysPerSecond(numRays, compressedClosestSeconds), closestSeconds8 / compressedClosestSeconds,
+             MRaysPerSecond(numRays, compressedOcclusionSeconds), occlusionSeconds8 / compressedOcclusionSeconds, numCompressedMismatches);
+
+    compressedBVH8.Shutdown();
+    bvh8.Shutdown();
+    bvh.Shutdown();
+}
\ No newline at end of file
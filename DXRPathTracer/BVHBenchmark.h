@@ -0,0 +1,27 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include <PCH.h>
+
+#include <Graphics/Model.h>
+
+using namespace SampleFramework12;
+
+// Traces a fixed set of incoherent rays (cosine-distributed rays leaving random points on the
+// scene's surfaces, similar to the secondary bounces in the path tracer) against the binary BVH,
+// BVH8, and compressed BVH8 for a model, and logs the rays/second for closest-hit and occlusion
+// queries. Camera rays for the given view are also traced one at a time and as packets, to compare
+// the two, and the time to load the BVH from its cache file and to refit it after moving a mesh are
+// compared against the time to build it. Finally the scene is instanced many times with a two-level
+// BVH, and its memory and speed are compared against flattening the instances into one BVH.
+void RunBVHBenchmark(const Model& model, const char* sceneName, const Float4x4& viewProjection,
+                     uint32 width, uint32 height, uint32 numRays = 1024 * 1024);
\ No newline at end of file
@@ -0,0 +1,1189 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#include <PCH.h>
+
+#include <Utility.h>
+#include <Timer.h>
+#include <Tasks.h>
+#include <Graphics/Profiler.h>
+#include <Graphics/Sampling.h>
+#include <Graphics/BRDF.h>
+
+#include "CPUPathTracer.h"
+
+using namespace SampleFramework12;
+
+static const float AlphaTestThreshold = 0.35f;
+static const uint32 WavefrontItemsPerTask = 4096;
+static const uint32 SortRadixBits = 10;
+static const uint32 SortKeyBits = 30;
+
+StaticAssert_(CPUPathTracer::PacketSize * CPUPathTracer::PacketSize <= BVH::MaxPacketSize);
+
+// Profiler counters are looked up by pointer, so each bounce needs its own name
+static const char* ExtensionRayCounterNames[] =
+{
+    "Wavefront Extension Rays (Bounce 1)",
+    "Wavefront Extension Rays (Bounce 2)",
+    "Wavefront Extension Rays (Bounce 3)",
+    "Wavefront Extension Rays (Bounce 4)",
+    "Wavefront Extension Rays (Bounce 5)",
+    "Wavefront Extension Rays (Bounce 6)",
+    "Wavefront Extension Rays (Bounce 7)",
+    "Wavefront Extension Rays (Bounce 8)",
+};
+
+static const char* ShadowRayCounterNames[] =
+{
+    "Wavefront Shadow Rays (Bounce 1)",
+    "Wavefront Shadow Rays (Bounce 2)",
+    "Wavefront Shadow Rays (Bounce 3)",
+    "Wavefront Shadow Rays (Bounce 4)",
+    "Wavefront Shadow Rays (Bounce 5)",
+    "Wavefront Shadow Rays (Bounce 6)",
+    "Wavefront Shadow Rays (Bounce 7)",
+    "Wavefront Shadow Rays (Bounce 8)",
+};
+
+StaticAssert_(ArraySize_(ExtensionRayCounterNames) == CPUPathTracer::WavefrontStats::MaxBounces);
+StaticAssert_(ArraySize_(ShadowRayCounterNames) == CPUPathTracer::WavefrontStats::MaxBounces);
+
+static Float3 Reflect(const Float3& i, const Float3& n)
+{
+    return i - 2.0f * Float3::Dot(n, i) * n;
+}
+
+static Float3 Lerp3(const Float3& x, const Float3& y, float s)
+{
+    return x + (y - x) * s;
+}
+
+static Float3 BarycentricLerp(const Float3& v0, const Float3& v1, const Float3& v2, const Float3& barycentrics)
+{
+    return v0 * barycentrics.x + v1 * barycentrics.y + v2 * barycentrics.z;
+}
+
+static Float2 BarycentricLerp(const Float2& v0, const Float2& v1, const Float2& v2, const Float3& barycentrics)
+{
+    return v0 * barycentrics.x + v1 * barycentrics.y + v2 * barycentrics.z;
+}
+
+static uint32 MeshIndex(const Mesh& mesh, uint32 idx)
+{
+    if(mesh.IndexBufferType() == IndexType::Index32Bit)
+        return mesh.Indices32()[idx];
+    else
+        return mesh.Indices()[idx];
+}
+
+// Inserts two zero bits between each of the lower 10 bits
+static uint32 SpreadBits(uint32 x)
+{
+    x &= 0x3FF;
+    x = (x | (x << 16)) & 0x030000FF;
+    x = (x | (x << 8)) & 0x0300F00F;
+    x = (x | (x << 4)) & 0x030C30C3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// The octant of the ray direction goes in the top 3 bits, followed by a 27-bit Morton code of the
+// origin within the scene bounds. Rays that are next to each other after sorting by this key tend
+// to visit the same BVH nodes.
+static uint32 RaySortKey(const BVHRay& ray, const Float3& boundsMin, const Float3& invBoundsSize)
+{
+    const uint32 octant = (ray.Direction.x < 0.0f ? 1 : 0) | (ray.Direction.y < 0.0f ? 2 : 0) | (ray.Direction.z < 0.0f ? 4 : 0);
+
+    const Float3 cell = Float3::Clamp((ray.Origin - boundsMin) * invBoundsSize, 0.0f, 1.0f) * 511.0f;
+    const uint32 morton = SpreadBits(uint32(cell.x)) | (SpreadBits(uint32(cell.y)) << 1) | (SpreadBits(uint32(cell.z)) << 2);
+
+    return (octant << 27) | morton;
+}
+
+// LSD radix sort of values with a sort key in the upper 32 bits. Returns whichever of the two
+// buffers ends up holding the sorted values.
+static const uint64* RadixSort(uint64* values, uint64* scratch, uint64 count)
+{
+    const uint32 numBuckets = 1 << SortRadixBits;
+    for(uint32 shift = 32; shift < 32 + SortKeyBits; shift += SortRadixBits)
+    {
+        uint32 offsets[numBuckets] = { };
+        for(uint64 i = 0; i < count; ++i)
+            ++offsets[(values[i] >> shift) & (numBuckets - 1)];
+
+        uint32 sum = 0;
+        for(uint32 bucket = 0; bucket < numBuckets; ++bucket)
+        {
+            const uint32 bucketCount = offsets[bucket];
+            offsets[bucket] = sum;
+            sum += bucketCount;
+        }
+
+        for(uint64 i = 0; i < count; ++i)
+            scratch[offsets[(values[i] >> shift) & (numBuckets - 1)]++] = values[i];
+
+        std::swap(values, scratch);
+    }
+
+    return values;
+}
+
+// Fills the sort keys for a set of rays, and sorts them. The lower 32 bits of the
+// returned values are the ray indices.
+template<typename GetRay> static const uint64* SortRays(uint64 numRays, const BVH& bvh, Array<uint64>& keys,
+                                                         Array<uint64>& scratch, const GetRay& getRay)
+{
+    if(keys.Size() < numRays)
+    {
+        keys.Init(numRays);
+        scratch.Init(numRays);
+    }
+
+    const Float3 boundsMin = bvh.BoundsMin();
+    const Float3 boundsSize = bvh.BoundsMax() - bvh.BoundsMin();
+    const Float3 invBoundsSize = Float3(1.0f / Max(boundsSize.x, 1e-6f), 1.0f / Max(boundsSize.y, 1e-6f), 1.0f / Max(boundsSize.z, 1e-6f));
+
+    const uint32 numTasks = uint32((numRays + WavefrontItemsPerTask - 1) / WavefrontItemsPerTask);
+    Tasks::ParallelFor(numTasks, [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint64 rayIdx = range.start * uint64(WavefrontItemsPerTask); rayIdx < Min<uint64>(range.end * uint64(WavefrontItemsPerTask), numRays); ++rayIdx)
+            keys[rayIdx] = (uint64(RaySortKey(getRay(rayIdx), boundsMin, invBoundsSize)) << 32) | rayIdx;
+    });
+
+    return RadixSort(keys.Data(), scratch.Data(), numRays);
+}
+
+// Matches CalcLighting() in BRDF.hlsl, which differs from the CPU version in BRDF.h
+// by also applying N dot L
+static Float3 CalcLighting(const Float3& normal, const Float3& lightDir, const Float3& peakIrradiance,
+                           const Float3& diffuseAlbedo, const Float3& specularAlbedo, float roughness,
+                           const Float3& positionWS, const Float3& cameraPosWS, const Float3& msEnergyCompensation)
+{
+    Float3 lighting = diffuseAlbedo * InvPi;
+
+    Float3 view = Float3::Normalize(cameraPosWS - positionWS);
+    const float nDotL = Saturate(Float3::Dot(normal, lightDir));
+    if(nDotL > 0.0f)
+    {
+        Float3 h = Float3::Normalize(view + lightDir);
+
+        Float3 fresnel = Fresnel(specularAlbedo, h, lightDir);
+
+        float specular = GGX_Specular(roughness, normal, h, view, lightDir);
+        lighting += specular * fresnel * msEnergyCompensation;
+    }
+
+    return lighting * nDotL * peakIrradiance;
+}
+
+void CPUPathTracer::Initialize(const Model* model_)
+{
+    Shutdown();
+
+    model = model_;
+    Assert_(model != nullptr);
+
+    bvh.LoadOrBuild(*model);
+
+    // The wide BVH is a lot faster for the incoherent rays we trace after the first bounce,
+    // but needs AVX2
+    useBVH8 = BVH8::Supported();
+    if(useBVH8)
+        bvh8.Build(bvh);
+
+    // Pull the material textures back to the CPU. We decode to FP16 so that sRGB textures
+    // are linearized the same way that the GPU samples them, and emissive can exceed 1
+    const GrowableList<MaterialTexture*>& matTextures = model->MaterialTextures();
+    textureData.Init(matTextures.Count());
+    for(uint64 i = 0; i < matTextures.Count(); ++i)
+        GetTextureData(*matTextures[i]->Texture, textureData[i]);
+
+    const Array<MeshMaterial>& srcMaterials = model->Materials();
+    materials.Init(srcMaterials.Size());
+    for(uint64 matIdx = 0; matIdx < srcMaterials.Size(); ++matIdx)
+    {
+        const MeshMaterial& srcMaterial = srcMaterials[matIdx];
+        MaterialData& material = materials[matIdx];
+        for(uint64 texType = 0; texType < uint64(MaterialTextures::Count); ++texType)
+        {
+            const uint32 texIdx = srcMaterial.TextureIndices[texType];
+            material.Textures[texType] = (srcMaterial.Textures[texType] != nullptr && texIdx < textureData.Size()) ? &textureData[texIdx] : nullptr;
+        }
+
+        // Geometry without an opacity map is flagged as opaque in the GPU acceleration structure
+        material.Opaque = srcMaterial.Textures[uint64(MaterialTextures::Opacity)] == nullptr;
+    }
+
+    const uint64 numMeshes = model->NumMeshes();
+    meshMaterials.Init(numMeshes);
+    for(uint64 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+    {
+        const Mesh& mesh = model->Meshes()[meshIdx];
+        Assert_(mesh.NumMeshParts() == 1);
+        meshMaterials[meshIdx] = mesh.MeshParts()[0].MaterialIdx;
+    }
+
+    threadStats.Init(Tasks::NumThreads());
+    threadQueues.Init(Tasks::NumThreads());
+    pathOffsets.Init(Tasks::NumThreads() + 1, 0);
+    shadowRayOffsets.Init(Tasks::NumThreads() + 1);
+    materialOffsets.Init(materials.Size() + 2);
+}
+
+void CPUPathTracer::Shutdown()
+{
+    bvh.Shutdown();
+    bvh8.Shutdown();
+    for(uint64 i = 0; i < textureData.Size(); ++i)
+        textureData[i].Texels.Shutdown();
+    textureData.Shutdown();
+    materials.Shutdown();
+    meshMaterials.Shutdown();
+    skyTexture.Texels.Shutdown();
+    output.Texels.Shutdown();
+    threadStats.Shutdown();
+    pixelRadiance.Shutdown();
+    paths.Shutdown();
+    pathHits.Shutdown();
+    shadeOrder.Shutdown();
+    shadowRays.Shutdown();
+    shadowRaysOccluded.Shutdown();
+    pathOffsets.Shutdown();
+    shadowRayOffsets.Shutdown();
+    materialOffsets.Shutdown();
+    sortKeys.Shutdown();
+    sortScratch.Shutdown();
+    for(uint64 i = 0; i < threadQueues.Size(); ++i)
+    {
+        threadQueues[i].Paths.Shutdown();
+        threadQueues[i].ShadowRays.Shutdown();
+    }
+    threadQueues.Shutdown();
+    numPaths = 0;
+    numShadowRays = 0;
+    model = nullptr;
+    currSampleIdx = 0;
+}
+
+void CPUPathTracer::SetSkyCubeMap(const Texture& cubeMap)
+{
+    Assert_(cubeMap.Cubemap);
+    GetTextureData(cubeMap, skyTexture);
+}
+
+void CPUPathTracer::Reset(uint32 width, uint32 height)
+{
+    if(output.Width != width || output.Height != height)
+        output.Init(width, height, 1);
+    output.Texels.Fill(Float4(0.0f, 0.0f, 0.0f, 1.0f));
+
+    currSampleIdx = 0;
+    totalRayCount = 0;
+    totalSeconds = 0.0;
+}
+
+void CPUPathTracer::RenderSample(const CPURayTraceConstants& constants)
+{
+    Assert_(model != nullptr);
+    Assert_(output.Width > 0 && output.Height > 0);
+
+    CPUProfileBlock profileBlock("CPU Path Trace");
+
+    rtConstants = &constants;
+
+    settings = { };
+    settings.EnableSun = AppSettings::EnableSun;
+    settings.EnableSky = AppSettings::EnableSky;
+    settings.SunAreaLightApproximation = AppSettings::SunAreaLightApproximation;
+    settings.RenderLights = AppSettings::RenderLights;
+    settings.ClampRoughness = AppSettings::ClampRoughness;
+    settings.AvoidCausticPaths = AppSettings::AvoidCausticPaths;
+    settings.SqrtNumSamples = AppSettings::SqrtNumSamples;
+    settings.SampleMode = AppSettings::SampleMode;
+    settings.MaxPathLength = AppSettings::MaxPathLength;
+    settings.MaxAnyHitPathLength = AppSettings::MaxAnyHitPathLength;
+    settings.EnableAlbedoMaps = AppSettings::EnableAlbedoMaps;
+    settings.EnableNormalMaps = AppSettings::EnableNormalMaps;
+    settings.EnableDiffuse = AppSettings::EnableDiffuse;
+    settings.EnableSpecular = AppSettings::EnableSpecular;
+    settings.EnableDirect = AppSettings::EnableDirect;
+    settings.EnableIndirect = AppSettings::EnableIndirect;
+    settings.EnableIndirectSpecular = AppSettings::EnableIndirectSpecular;
+    settings.ApplyMultiscatteringEnergyCompensation = AppSettings::ApplyMultiscatteringEnergyCompensation;
+    settings.RoughnessScale = AppSettings::RoughnessScale;
+    settings.MetallicScale = AppSettings::MetallicScale;
+    settings.EnableWhiteFurnaceMode = AppSettings::EnableWhiteFurnaceMode;
+
+    for(uint64 i = 0; i < threadStats.Size(); ++i)
+        threadStats[i].NumRays = 0;
+
+    Timer timer;
+
+    if(wavefront)
+    {
+        RenderWavefront();
+    }
+    else
+    {
+        const uint32 numTilesX = (output.Width + TileSize - 1) / TileSize;
+        const uint32 numTilesY = (output.Height + TileSize - 1) / TileSize;
+        Tasks::ParallelFor(numTilesX * numTilesY, [&](enki::TaskSetPartition range, uint32 threadNum)
+        {
+            uint64& numRays = threadStats[threadNum].NumRays;
+            for(uint32 tileIdx = range.start; tileIdx < range.end; ++tileIdx)
+                RenderTile(tileIdx, numRays);
+        });
+    }
+
+    timer.Update();
+
+    lastSampleRayCount = 0;
+    for(uint64 i = 0; i < threadStats.Size(); ++i)
+        lastSampleRayCount += threadStats[i].NumRays;
+    lastSampleSeconds = timer.ElapsedSecondsD();
+
+    totalRayCount += lastSampleRayCount;
+    totalSeconds += lastSampleSeconds;
+
+    rtConstants = nullptr;
+    currSampleIdx += 1;
+}
+
+double CPUPathTracer::LastSampleMRaysPerSecond() const
+{
+    return lastSampleSeconds > 0.0 ? (lastSampleRayCount / lastSampleSeconds) / 1000000.0 : 0.0;
+}
+
+double CPUPathTracer::AverageMRaysPerSecond() const
+{
+    return totalSeconds > 0.0 ? (totalRayCount / totalSeconds) / 1000000.0 : 0.0;
+}
+
+void CPUPathTracer::RenderTile(uint32 tileIdx, uint64& numRays) const
+{
+    const uint32 width = output.Width;
+    const uint32 height = output.Height;
+    const uint32 numTilesX = (width + TileSize - 1) / TileSize;
+    const uint32 tileX = (tileIdx % numTilesX) * TileSize;
+    const uint32 tileY = (tileIdx / numTilesX) * TileSize;
+
+    // Primary rays are generated and traced in square blocks, so that they can go through the BVH as a packet
+    for(uint32 blockY = tileY; blockY < Min(tileY + TileSize, height); blockY += PacketSize)
+    {
+        for(uint32 blockX = tileX; blockX < Min(tileX + TileSize, width); blockX += PacketSize)
+        {
+            BVHRay rays[PacketSize * PacketSize];
+            PrimaryPayload payloads[PacketSize * PacketSize];
+            uint32 numBlockRays = 0;
+
+            for(uint32 y = blockY; y < Min(blockY + PacketSize, height); ++y)
+            {
+                for(uint32 x = blockX; x < Min(blockX + PacketSize, width); ++x)
+                {
+                    GeneratePrimaryRay(x, y, rays[numBlockRays], payloads[numBlockRays]);
+                    ++numBlockRays;
+                }
+            }
+
+            if(primaryRayPackets)
+            {
+                const bool forceOpaque = 1 > uint32(settings.MaxAnyHitPathLength);
+                const BVHHitFilter filter = forceOpaque ? nullptr : AlphaTestFilter;
+
+                BVHHit hits[PacketSize * PacketSize];
+                bvh.IntersectPacket(rays, numBlockRays, hits, filter, this);
+                numRays += numBlockRays;
+
+                for(uint32 rayIdx = 0; rayIdx < numBlockRays; ++rayIdx)
+                    ShadeRadianceRay(rays[rayIdx], hits[rayIdx], payloads[rayIdx], numRays);
+            }
+            else
+            {
+                for(uint32 rayIdx = 0; rayIdx < numBlockRays; ++rayIdx)
+                    TraceRadianceRay(rays[rayIdx], payloads[rayIdx], numRays);
+            }
+
+            for(uint32 rayIdx = 0; rayIdx < numBlockRays; ++rayIdx)
+                AccumulateSample(payloads[rayIdx].PixelIdx, payloads[rayIdx].Radiance);
+        }
+    }
+}
+
+void CPUPathTracer::GeneratePrimaryRay(uint32 x, uint32 y, BVHRay& ray, PrimaryPayload& payload) const
+{
+    const uint32 pixelIdx = y * output.Width + x;
+    const Float2 dispatchSize = Float2(float(output.Width), float(output.Height));
+
+    uint32 sampleSetIdx = 0;
+
+    // Form a primary ray by un-projecting the pixel coordinate using the inverse view * projection matrix
+    Float2 primaryRaySample = SamplePoint(pixelIdx, sampleSetIdx);
+
+    Float2 rayPixelPos = Float2(float(x), float(y)) + primaryRaySample;
+    Float2 ncdXY = (rayPixelPos / (dispatchSize * 0.5f)) - Float2(1.0f, 1.0f);
+    ncdXY.y *= -1.0f;
+    Float3 rayStart = Float3::Transform(Float3(ncdXY, 0.0f), rtConstants->InvViewProjection);
+    Float3 rayEnd = Float3::Transform(Float3(ncdXY, 1.0f), rtConstants->InvViewProjection);
+
+    ray.Origin = rayStart;
+    ray.Direction = Float3::Normalize(rayEnd - rayStart);
+    ray.TMin = 0.0f;
+    ray.TMax = Float3::Length(rayEnd - rayStart);
+
+    payload.Radiance = 0.0f;
+    payload.Roughness = 0.0f;
+    payload.PathLength = 1;
+    payload.PixelIdx = pixelIdx;
+    payload.SampleSetIdx = sampleSetIdx;
+    payload.IsDiffuse = false;
+}
+
+// Updates the progressive result with a new radiance sample
+void CPUPathTracer::AccumulateSample(uint32 pixelIdx, const Float3& sampleRadiance) const
+{
+    Float4* texels = const_cast<Float4*>(output.Texels.Data());
+
+    const Float3 radiance = Float3::Clamp(sampleRadiance, 0.0f, FP16Max);
+
+    const float lerpFactor = currSampleIdx / (currSampleIdx + 1.0f);
+    Float3 currValue = texels[pixelIdx].To3D();
+    Float3 newValue = Lerp3(radiance, currValue, lerpFactor);
+
+    texels[pixelIdx] = Float4(newValue, 1.0f);
+}
+
+void CPUPathTracer::RenderWavefront()
+{
+    const uint64 numPixels = uint64(output.Width) * output.Height;
+    pixelRadiance.Resize(numPixels);
+    pixelRadiance.Fill(0.0f);
+    paths.Resize(numPixels);
+    pathHits.Resize(numPixels);
+    shadeOrder.Resize(numPixels);
+
+    wavefrontStats = WavefrontStats();
+
+    GeneratePrimaryPaths();
+
+    // Each pass through the loop traces and shades one vertex of every path that's still alive
+    for(uint32 pathLength = 1; numPaths > 0; ++pathLength)
+    {
+        Assert_(wavefrontStats.NumBounces < WavefrontStats::MaxBounces);
+        WavefrontBounceStats& bounceStats = wavefrontStats.Bounces[wavefrontStats.NumBounces++];
+        bounceStats.NumExtensionRays = numPaths;
+
+        TraceExtensionRays(pathLength, bounceStats);
+        ShadePaths(bounceStats);
+
+        bounceStats.NumShadowRays = numShadowRays;
+        TraceShadowRays(bounceStats);
+    }
+
+    for(uint64 bounceIdx = 0; bounceIdx < WavefrontStats::MaxBounces; ++bounceIdx)
+    {
+        const WavefrontBounceStats& bounceStats = wavefrontStats.Bounces[bounceIdx];
+        Profiler::GlobalProfiler.SetCounter(ExtensionRayCounterNames[bounceIdx], bounceStats.NumExtensionRays);
+        Profiler::GlobalProfiler.SetCounter(ShadowRayCounterNames[bounceIdx], bounceStats.NumShadowRays);
+    }
+
+    Tasks::ParallelFor(output.Height, [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 y = range.start; y < range.end; ++y)
+            for(uint32 pixelIdx = y * output.Width; pixelIdx < (y + 1) * output.Width; ++pixelIdx)
+                AccumulateSample(pixelIdx, pixelRadiance[pixelIdx]);
+    });
+}
+
+// Primary paths are laid out in square blocks of PacketSize x PacketSize pixels, so that
+// consecutive rays can be traced as a packet
+void CPUPathTracer::GeneratePrimaryPaths()
+{
+    const uint32 width = output.Width;
+    const uint32 height = output.Height;
+    const uint32 numBlocksX = (width + PacketSize - 1) / PacketSize;
+    const uint32 numBlocksY = (height + PacketSize - 1) / PacketSize;
+
+    Tasks::ParallelFor(numBlocksX * numBlocksY, [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 blockIdx = range.start; blockIdx < range.end; ++blockIdx)
+        {
+            const uint32 blockX = (blockIdx % numBlocksX) * PacketSize;
+            const uint32 blockY = (blockIdx / numBlocksX) * PacketSize;
+            const uint32 blockHeight = Min(PacketSize, height - blockY);
+
+            // All blocks in the rows above are full height, and all blocks to the left are full width
+            uint32 pathIdx = blockY * width + blockX * blockHeight;
+            for(uint32 y = blockY; y < blockY + blockHeight; ++y)
+            {
+                for(uint32 x = blockX; x < Min(blockX + PacketSize, width); ++x)
+                {
+                    WavefrontPath& path = paths[pathIdx++];
+                    GeneratePrimaryRay(x, y, path.Ray, path.Payload);
+                    path.Throughput = 1.0f;
+                }
+            }
+        }
+    });
+
+    numPaths = uint64(width) * height;
+}
+
+void CPUPathTracer::TraceExtensionRays(uint32 pathLength, WavefrontBounceStats& stats)
+{
+    // Stop using the any-hit test once we've hit the max path length, since it's *really* expensive
+    const bool forceOpaque = pathLength > uint32(settings.MaxAnyHitPathLength);
+    const BVHHitFilter filter = forceOpaque ? nullptr : AlphaTestFilter;
+
+    if(pathLength == 1)
+    {
+        // Primary rays are coherent already, so they skip the sort
+        CPUProfileBlock profileBlock("Wavefront Extension Trace");
+        Timer timer;
+
+        const uint32 packetSize = PacketSize * PacketSize;
+        const uint32 numPackets = uint32((numPaths + packetSize - 1) / packetSize);
+        Tasks::ParallelFor(numPackets, [&](enki::TaskSetPartition range, uint32 threadNum)
+        {
+            for(uint32 packetIdx = range.start; packetIdx < range.end; ++packetIdx)
+            {
+                const uint32 start = packetIdx * packetSize;
+                const uint32 count = uint32(Min<uint64>(packetSize, numPaths - start));
+                if(primaryRayPackets)
+                {
+                    BVHRay rays[packetSize];
+                    for(uint32 i = 0; i < count; ++i)
+                        rays[i] = paths[start + i].Ray;
+                    bvh.IntersectPacket(rays, count, &pathHits[start], filter, this);
+                }
+                else if(useBVH8)
+                {
+                    for(uint32 i = start; i < start + count; ++i)
+                        bvh8.Intersect(paths[i].Ray, pathHits[i], filter, this);
+                }
+                else
+                {
+                    for(uint32 i = start; i < start + count; ++i)
+                        bvh.Intersect(paths[i].Ray, pathHits[i], filter, this);
+                }
+
+                threadStats[threadNum].NumRays += count;
+            }
+        });
+
+        timer.Update();
+        stats.ExtensionTraceMs = timer.ElapsedMillisecondsD();
+        return;
+    }
+
+    const uint64* sortedPaths = nullptr;
+    {
+        CPUProfileBlock profileBlock("Wavefront Extension Sort");
+        Timer timer;
+
+        sortedPaths = SortRays(numPaths, bvh, sortKeys, sortScratch, [&](uint64 pathIdx) -> const BVHRay&
+        {
+            return paths[pathIdx].Ray;
+        });
+
+        timer.Update();
+        stats.ExtensionSortMs = timer.ElapsedMillisecondsD();
+    }
+
+    {
+        CPUProfileBlock profileBlock("Wavefront Extension Trace");
+        Timer timer;
+
+        const uint32 numTasks = uint32((numPaths + WavefrontItemsPerTask - 1) / WavefrontItemsPerTask);
+        Tasks::ParallelFor(numTasks, [&](enki::TaskSetPartition range, uint32 threadNum)
+        {
+            const uint64 start = range.start * uint64(WavefrontItemsPerTask);
+            const uint64 end = Min<uint64>(range.end * uint64(WavefrontItemsPerTask), numPaths);
+            for(uint64 i = start; i < end; ++i)
+            {
+                const uint32 pathIdx = uint32(sortedPaths[i]);
+                if(useBVH8)
+                    bvh8.Intersect(paths[pathIdx].Ray, pathHits[pathIdx], filter, this);
+                else
+                    bvh.Intersect(paths[pathIdx].Ray, pathHits[pathIdx], filter, this);
+            }
+
+            threadStats[threadNum].NumRays += end - start;
+        });
+
+        timer.Update();
+        stats.ExtensionTraceMs = timer.ElapsedMillisecondsD();
+    }
+}
+
+// Runs the closest-hit and miss shading for every path, and builds the queues
+// of shadow rays and paths for the next bounce
+void CPUPathTracer::ShadePaths(WavefrontBounceStats& stats)
+{
+    CPUProfileBlock profileBlock("Wavefront Shade");
+    Timer timer;
+
+    // Counting sort by material, so that hits which sample the same textures get shaded
+    // together. Misses go in the last bucket.
+    const uint32 numMaterials = uint32(materials.Size());
+    materialOffsets.Fill(0);
+    for(uint64 pathIdx = 0; pathIdx < numPaths; ++pathIdx)
+    {
+        const BVHHit& hit = pathHits[pathIdx];
+        const uint32 bucket = hit.Valid() ? meshMaterials[hit.MeshIdx] : numMaterials;
+        ++materialOffsets[bucket + 1];
+    }
+
+    for(uint32 bucket = 1; bucket < numMaterials + 2; ++bucket)
+        materialOffsets[bucket] += materialOffsets[bucket - 1];
+
+    for(uint64 pathIdx = 0; pathIdx < numPaths; ++pathIdx)
+    {
+        const BVHHit& hit = pathHits[pathIdx];
+        const uint32 bucket = hit.Valid() ? meshMaterials[hit.MeshIdx] : numMaterials;
+        shadeOrder[materialOffsets[bucket]++] = uint32(pathIdx);
+    }
+
+    for(uint64 i = 0; i < threadQueues.Size(); ++i)
+    {
+        threadQueues[i].Paths.RemoveAll();
+        threadQueues[i].ShadowRays.RemoveAll();
+    }
+
+    // Every path belongs to a different pixel, so the radiance can be accumulated without atomics
+    const uint32 numTasks = uint32((numPaths + WavefrontItemsPerTask - 1) / WavefrontItemsPerTask);
+    Tasks::ParallelFor(numTasks, [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        WavefrontThreadQueues& queues = threadQueues[threadNum];
+        for(uint64 i = range.start * uint64(WavefrontItemsPerTask); i < Min<uint64>(range.end * uint64(WavefrontItemsPerTask), numPaths); ++i)
+        {
+            const WavefrontPath& path = paths[shadeOrder[i]];
+            const BVHHit& hit = pathHits[shadeOrder[i]];
+            Float3& radiance = pixelRadiance[path.Payload.PixelIdx];
+
+            if(hit.Valid() == false)
+            {
+                radiance += path.Throughput * MissRadiance(path.Ray, path.Payload.PathLength);
+                continue;
+            }
+
+            SurfaceSample sample;
+            if(SampleSurface(GetHitSurface(hit), GetHitMaterial(hit), path.Ray, path.Payload, sample) == false)
+                continue;
+
+            radiance += path.Throughput * sample.Radiance;
+
+            for(uint32 shadowRayIdx = 0; shadowRayIdx < sample.NumShadowRays; ++shadowRayIdx)
+            {
+                ShadowRay shadowRay = sample.ShadowRays[shadowRayIdx];
+                shadowRay.Radiance *= path.Throughput;
+                queues.ShadowRays.Add(shadowRay);
+            }
+
+            if(sample.ContinuePath)
+            {
+                WavefrontPath nextPath;
+                nextPath.Ray = sample.NextRay;
+                nextPath.Throughput = path.Throughput * sample.Throughput;
+                nextPath.Payload = sample.NextPayload;
+                queues.Paths.Add(nextPath);
+            }
+        }
+    });
+
+    // Gather the per-thread queues into one list of paths and one list of shadow rays
+    for(uint64 i = 0; i < threadQueues.Size(); ++i)
+    {
+        pathOffsets[i + 1] = pathOffsets[i] + threadQueues[i].Paths.Count();
+        shadowRayOffsets[i + 1] = shadowRayOffsets[i] + threadQueues[i].ShadowRays.Count();
+    }
+
+    numPaths = pathOffsets[threadQueues.Size()];
+    numShadowRays = shadowRayOffsets[threadQueues.Size()];
+    if(shadowRays.Size() < numShadowRays)
+    {
+        shadowRays.Init(numShadowRays);
+        shadowRaysOccluded.Init(numShadowRays);
+    }
+
+    Tasks::ParallelFor(uint32(threadQueues.Size()), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 queueIdx = range.start; queueIdx < range.end; ++queueIdx)
+        {
+            const WavefrontThreadQueues& queues = threadQueues[queueIdx];
+            for(uint64 i = 0; i < queues.Paths.Count(); ++i)
+                paths[pathOffsets[queueIdx] + i] = queues.Paths[i];
+            for(uint64 i = 0; i < queues.ShadowRays.Count(); ++i)
+                shadowRays[shadowRayOffsets[queueIdx] + i] = queues.ShadowRays[i];
+        }
+    });
+
+    timer.Update();
+    stats.ShadeMs = timer.ElapsedMillisecondsD();
+}
+
+void CPUPathTracer::TraceShadowRays(WavefrontBounceStats& stats)
+{
+    if(numShadowRays == 0)
+        return;
+
+    const uint64* sortedRays = nullptr;
+    {
+        CPUProfileBlock profileBlock("Wavefront Shadow Sort");
+        Timer timer;
+
+        sortedRays = SortRays(numShadowRays, bvh, sortKeys, sortScratch, [&](uint64 rayIdx) -> const BVHRay&
+        {
+            return shadowRays[rayIdx].Ray;
+        });
+
+        timer.Update();
+        stats.ShadowSortMs = timer.ElapsedMillisecondsD();
+    }
+
+    CPUProfileBlock profileBlock("Wavefront Shadow Trace");
+    Timer timer;
+
+    const uint32 numTasks = uint32((numShadowRays + WavefrontItemsPerTask - 1) / WavefrontItemsPerTask);
+    Tasks::ParallelFor(numTasks, [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        const uint64 start = range.start * uint64(WavefrontItemsPerTask);
+        const uint64 end = Min<uint64>(range.end * uint64(WavefrontItemsPerTask), numShadowRays);
+        for(uint64 i = start; i < end; ++i)
+        {
+            const uint32 rayIdx = uint32(sortedRays[i]);
+            const ShadowRay& shadowRay = shadowRays[rayIdx];
+            const bool forceOpaque = shadowRay.PathLength > uint32(settings.MaxAnyHitPathLength);
+            const BVHHitFilter filter = forceOpaque ? nullptr : AlphaTestFilter;
+            const bool occluded = useBVH8 ? bvh8.Occluded(shadowRay.Ray, filter, this) : bvh.Occluded(shadowRay.Ray, filter, this);
+            shadowRaysOccluded[rayIdx] = uint8(occluded);
+        }
+
+        threadStats[threadNum].NumRays += end - start;
+    });
+
+    // Each thread's queue only has shadow rays for the pixels that it shaded,
+    // so the queues can be accumulated in parallel
+    Tasks::ParallelFor(uint32(threadQueues.Size()), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 queueIdx = range.start; queueIdx < range.end; ++queueIdx)
+        {
+            for(uint64 rayIdx = shadowRayOffsets[queueIdx]; rayIdx < shadowRayOffsets[queueIdx + 1]; ++rayIdx)
+            {
+                if(shadowRaysOccluded[rayIdx] == 0)
+                    pixelRadiance[shadowRays[rayIdx].PixelIdx] += shadowRays[rayIdx].Radiance;
+            }
+        }
+    });
+
+    timer.Update();
+    stats.ShadowTraceMs = timer.ElapsedMillisecondsD();
+}
+
+Float2 CPUPathTracer::SamplePoint(uint32 pixelIdx, uint32& setIdx) const
+{
+    const uint32 dimIdx = setIdx;
+    setIdx += 1;
+    if(settings.SampleMode == int32(SampleModes::Sobol))
+        return SampleSobol2D(currSampleIdx, dimIdx, pixelIdx);
+
+    if(settings.SampleMode == int32(SampleModes::BlueNoise))
+    {
+        const BlueNoiseTiles* tiles = rtConstants->SampleTiles;
+        if(tiles == nullptr || dimIdx >= tiles->NumDims())
+            return SampleSobol2D(currSampleIdx, dimIdx, pixelIdx);
+
+        return tiles->Sample(currSampleIdx, pixelIdx % output.Width, pixelIdx / output.Width, dimIdx);
+    }
+
+    const uint32 totalNumPixels = output.Width * output.Height;
+    const uint32 permutation = dimIdx * totalNumPixels + pixelIdx;
+    return SampleCMJ2D(currSampleIdx, settings.SqrtNumSamples, settings.SqrtNumSamples, permutation);
+}
+
+void CPUPathTracer::TraceRadianceRay(const BVHRay& ray, PrimaryPayload& payload, uint64& numRays) const
+{
+    ++numRays;
+
+    // Stop using the any-hit test once we've hit the max path length, since it's *really* expensive
+    const bool forceOpaque = payload.PathLength > uint32(settings.MaxAnyHitPathLength);
+
+    BVHHit hit;
+    const BVHHitFilter filter = forceOpaque ? nullptr : AlphaTestFilter;
+    if(useBVH8)
+        bvh8.Intersect(ray, hit, filter, this);
+    else
+        bvh.Intersect(ray, hit, filter, this);
+
+    ShadeRadianceRay(ray, hit, payload, numRays);
+}
+
+// Runs the equivalent of the closest-hit or miss shader for a radiance ray
+void CPUPathTracer::ShadeRadianceRay(const BVHRay& ray, const BVHHit& hit, PrimaryPayload& payload, uint64& numRays) const
+{
+    if(hit.Valid())
+    {
+        // Closest hit
+        const MeshVertex hitSurface = GetHitSurface(hit);
+        const MaterialData& material = GetHitMaterial(hit);
+
+        payload.Radiance = PathTrace(hitSurface, material, ray, payload, numRays);
+        return;
+    }
+
+    payload.Radiance = MissRadiance(ray, payload.PathLength);
+}
+
+// Equivalent of the miss shader for radiance rays
+Float3 CPUPathTracer::MissRadiance(const BVHRay& ray, uint32 pathLength) const
+{
+    if(settings.EnableWhiteFurnaceMode)
+        return 1.0f;
+
+    Float3 radiance = settings.EnableSky ? SampleSky(ray.Direction) : Float3(0.0f);
+
+    if(pathLength == 1)
+    {
+        float cosSunAngle = Float3::Dot(ray.Direction, rtConstants->SunDirectionWS);
+        if(cosSunAngle >= rtConstants->CosSunAngularRadius)
+            radiance = rtConstants->SunRenderColor;
+    }
+
+    return radiance;
+}
+
+float CPUPathTracer::TraceShadowRay(const BVHRay& ray, uint32 pathLength, uint64& numRays) const
+{
+    ++numRays;
+
+    const bool forceOpaque = pathLength > uint32(settings.MaxAnyHitPathLength);
+    const BVHHitFilter filter = forceOpaque ? nullptr : AlphaTestFilter;
+    const bool occluded = useBVH8 ? bvh8.Occluded(ray, filter, this) : bvh.Occluded(ray, filter, this);
+    return occluded ? 0.0f : 1.0f;
+}
+
+Float3 CPUPathTracer::PathTrace(const MeshVertex& hitSurface, const MaterialData& material, const BVHRay& incomingRay,
+                                const PrimaryPayload& inPayload, uint64& numRays) const
+{
+    SurfaceSample sample;
+    if(SampleSurface(hitSurface, material, incomingRay, inPayload, sample) == false)
+        return 0.0f;
+
+    Float3 radiance = sample.Radiance;
+    for(uint32 shadowRayIdx = 0; shadowRayIdx < sample.NumShadowRays; ++shadowRayIdx)
+    {
+        const ShadowRay& shadowRay = sample.ShadowRays[shadowRayIdx];
+        radiance += shadowRay.Radiance * TraceShadowRay(shadowRay.Ray, shadowRay.PathLength, numRays);
+    }
+
+    if(sample.ContinuePath)
+    {
+        PrimaryPayload payload = sample.NextPayload;
+        TraceRadianceRay(sample.NextRay, payload, numRays);
+
+        radiance += payload.Radiance * sample.Throughput;
+    }
+
+    return radiance;
+}
+
+// Evaluates the material at a path vertex, and samples the direction for the next ray. Instead
+// of tracing shadow rays, their unoccluded contributions are returned with the sample.
+bool CPUPathTracer::SampleSurface(const MeshVertex& hitSurface, const MaterialData& material, const BVHRay& incomingRay,
+                                  const PrimaryPayload& inPayload, SurfaceSample& sample) const
+{
+    if((!settings.EnableDiffuse && !settings.EnableSpecular) ||
+        (!settings.EnableDirect && !settings.EnableIndirect))
+        return false;
+
+    if(inPayload.PathLength > 1 && !settings.EnableIndirect)
+        return false;
+
+    PrimaryPayload payloadCopy = inPayload;
+
+    Float3x3 tangentToWorld = Float3x3(hitSurface.Tangent, hitSurface.Bitangent, hitSurface.Normal);
+
+    const Float3 positionWS = hitSurface.Position;
+
+    const Float3 incomingRayOriginWS = incomingRay.Origin;
+    const Float3 incomingRayDirWS = incomingRay.Direction;
+
+    Float3 normalWS = hitSurface.Normal;
+    if(settings.EnableNormalMaps)
+    {
+        // Sample the normal map, and convert the normal to world space
+        Float3 normalTS;
+        Float4 normalMapSample = SampleMaterialTexture(material, MaterialTextures::Normal, hitSurface.UV);
+        normalTS.x = normalMapSample.x * 2.0f - 1.0f;
+        normalTS.y = normalMapSample.y * 2.0f - 1.0f;
+        normalTS.z = std::sqrt(1.0f - Saturate(normalTS.x * normalTS.x + normalTS.y * normalTS.y));
+        normalWS = Float3::Normalize(Float3::Transform(normalTS, tangentToWorld));
+
+        tangentToWorld.SetZBasis(normalWS);
+    }
+
+    Float3 baseColor = 1.0f;
+    if(settings.EnableAlbedoMaps && !settings.EnableWhiteFurnaceMode)
+        baseColor = SampleMaterialTexture(material, MaterialTextures::Albedo, hitSurface.UV).To3D();
+
+    const float metallicSample = settings.EnableWhiteFurnaceMode ? 1.0f : SampleMaterialTexture(material, MaterialTextures::Metallic, hitSurface.UV).x;
+    const float metallic = Saturate(metallicSample * settings.MetallicScale);
+
+    const bool enableDiffuse = (settings.EnableDiffuse && metallic < 1.0f) || settings.EnableWhiteFurnaceMode;
+    const bool enableSpecular = (settings.EnableSpecular && (settings.EnableIndirectSpecular ? !(settings.AvoidCausticPaths && inPayload.IsDiffuse) : (inPayload.PathLength == 1)));
+
+    if(enableDiffuse == false && enableSpecular == false)
+        return false;
+
+    const float roughnessSample = settings.EnableWhiteFurnaceMode ? 1.0f : SampleMaterialTexture(material, MaterialTextures::Roughness, hitSurface.UV).x;
+    const float sqrtRoughness = Saturate(roughnessSample * settings.RoughnessScale);
+
+    const Float3 diffuseAlbedo = Lerp3(baseColor, Float3(0.0f), metallic) * (enableDiffuse ? 1.0f : 0.0f);
+    const Float3 specularAlbedo = Lerp3(Float3(0.03f), baseColor, metallic) * (enableSpecular ? 1.0f : 0.0f);
+    float roughness = sqrtRoughness * sqrtRoughness;
+    if(settings.ClampRoughness)
+        roughness = Max(roughness, inPayload.Roughness);
+
+    Float3 msEnergyCompensation = 1.0f;
+    if(settings.ApplyMultiscatteringEnergyCompensation)
+    {
+        Float2 DFG = GGXEnvironmentBRDFScaleBias(Saturate(Float3::Dot(normalWS, -incomingRayDirWS)), sqrtRoughness);
+
+        // Improve energy preservation by applying a scaled version of the original
+        // single scattering specular lobe. Based on "Practical multiple scattering
+        // compensation for microfacet models" [Turquin19].
+        float Ess = DFG.x;
+        msEnergyCompensation = Float3(1.0f) + specularAlbedo * (1.0f / Ess - 1.0f);
+    }
+
+    sample.Radiance = settings.EnableWhiteFurnaceMode ? Float3(0.0f) : SampleMaterialTexture(material, MaterialTextures::Emissive, hitSurface.UV).To3D();
+    sample.NumShadowRays = 0;
+
+    // Apply sun light
+    if(settings.EnableSun && !settings.EnableWhiteFurnaceMode)
+    {
+        Float3 sunDirection = rtConstants->SunDirectionWS;
+
+        if(settings.SunAreaLightApproximation)
+        {
+            Float3 D = rtConstants->SunDirectionWS;
+            Float3 R = Reflect(incomingRayDirWS, normalWS);
+            float r = rtConstants->SinSunAngularRadius;
+            float d = rtConstants->CosSunAngularRadius;
+            float DDotR = Float3::Dot(D, R);
+            Float3 S = R - DDotR * D;
+            sunDirection = DDotR < d ? Float3::Normalize(d * D + Float3::Normalize(S) * r) : R;
+        }
+
+        // Shoot a shadow ray to see if the sun is occluded
+        ShadowRay& shadowRay = sample.ShadowRays[sample.NumShadowRays++];
+        shadowRay.Ray.Origin = positionWS;
+        shadowRay.Ray.Direction = rtConstants->SunDirectionWS;
+        shadowRay.Ray.TMin = 0.00001f;
+        shadowRay.Ray.TMax = FloatMax;
+        shadowRay.PathLength = inPayload.PathLength;
+        shadowRay.PixelIdx = inPayload.PixelIdx;
+        shadowRay.Radiance = CalcLighting(normalWS, sunDirection, rtConstants->SunIrradiance, diffuseAlbedo, specularAlbedo,
+                                          roughness, positionWS, incomingRayOriginWS, msEnergyCompensation);
+    }
+
+    // Apply spot lights
+    if(settings.RenderLights)
+    {
+        for(uint32 spotLightIdx = 0; spotLightIdx < rtConstants->NumLights; ++spotLightIdx)
+        {
+            const SpotLight& spotLight = rtConstants->SpotLights[spotLightIdx];
+
+            Float3 surfaceToLight = spotLight.Position - positionWS;
+            float distanceToLight = Float3::Length(surfaceToLight);
+            surfaceToLight /= distanceToLight;
+            float angleFactor = Saturate(Float3::Dot(surfaceToLight, spotLight.Direction));
+            float angularAttenuation = Smoothstep(spotLight.AngularAttenuationY, spotLight.AngularAttenuationX, angleFactor);
+
+            float d = distanceToLight / spotLight.Range;
+            float falloff = Saturate(1.0f - (d * d * d * d));
+            falloff = (falloff * falloff) / (distanceToLight * distanceToLight + 1.0f);
+
+            angularAttenuation *= falloff;
+
+            if(angularAttenuation > 0.0f)
+            {
+                Float3 intensity = spotLight.Intensity * angularAttenuation;
+
+                ShadowRay& shadowRay = sample.ShadowRays[sample.NumShadowRays++];
+                shadowRay.Ray.Origin = positionWS + normalWS * 0.01f;
+                shadowRay.Ray.Direction = surfaceToLight;
+                shadowRay.Ray.TMin = AppSettings::SpotShadowNearClip;
+                shadowRay.Ray.TMax = distanceToLight - AppSettings::SpotShadowNearClip;
+                shadowRay.PathLength = inPayload.PathLength;
+                shadowRay.PixelIdx = inPayload.PixelIdx;
+                shadowRay.Radiance = CalcLighting(normalWS, surfaceToLight, intensity, diffuseAlbedo, specularAlbedo,
+                                                  roughness, positionWS, incomingRayOriginWS, msEnergyCompensation);
+            }
+        }
+    }
+
+    // Choose our next path by importance sampling our BRDFs
+    Float2 brdfSample = SamplePoint(payloadCopy.PixelIdx, payloadCopy.SampleSetIdx);
+
+    Float3 throughput = 0.0f;
+    Float3 rayDirTS = 0.0f;
+
+    float selector = brdfSample.x;
+    if(enableSpecular == false)
+        selector = 0.0f;
+    else if(enableDiffuse == false)
+        selector = 1.0f;
+
+    if(selector < 0.5f)
+    {
+        // We're sampling the diffuse BRDF, so sample a cosine-weighted hemisphere
+        if(enableSpecular)
+            brdfSample.x *= 2.0f;
+        rayDirTS = SampleDirectionCosineHemisphere(brdfSample.x, brdfSample.y);
+
+        // The PDF of sampling a cosine hemisphere is NdotL / Pi, which cancels out those terms
+        // from the diffuse BRDF and the irradiance integral
+        throughput = diffuseAlbedo;
+    }
+    else
+    {
+        // We're sampling the GGX specular BRDF by sampling the distribution of visible normals
+        if(enableDiffuse)
+            brdfSample.x = (brdfSample.x - 0.5f) * 2.0f;
+
+        Float3 incomingRayDirTS = Float3::Normalize(Float3::Transform(incomingRayDirWS, Float3x3::Transpose(tangentToWorld)));
+        Float3 microfacetNormalTS = SampleGGXVisibleNormal(-incomingRayDirTS, roughness, roughness, brdfSample.x, brdfSample.y);
+        Float3 sampleDirTS = Reflect(incomingRayDirTS, microfacetNormalTS);
+
+        Float3 normalTS = Float3(0.0f, 0.0f, 1.0f);
+
+        Float3 F = settings.EnableWhiteFurnaceMode ? Float3(1.0f) : Fresnel(specularAlbedo, microfacetNormalTS, sampleDirTS);
+        float G1 = SmithGGXMasking(normalTS, sampleDirTS, -incomingRayDirTS, roughness * roughness);
+        float G2 = SmithGGXMaskingShadowing(normalTS, sampleDirTS, -incomingRayDirTS, roughness * roughness);
+
+        throughput = (F * (G2 / G1));
+        rayDirTS = sampleDirTS;
+
+        if(settings.ApplyMultiscatteringEnergyCompensation)
+        {
+            Float2 DFG = GGXEnvironmentBRDFScaleBias(Saturate(Float3::Dot(normalTS, -incomingRayDirWS)), sqrtRoughness);
+
+            float Ess = DFG.x;
+            throughput *= Float3(1.0f) + specularAlbedo * (1.0f / Ess - 1.0f);
+        }
+    }
+
+    const Float3 rayDirWS = Float3::Normalize(Float3::Transform(rayDirTS, tangentToWorld));
+
+    if(enableDiffuse && enableSpecular)
+        throughput *= 2.0f;
+
+    // Shoot another ray to get the next path
+    BVHRay ray;
+    ray.Origin = positionWS;
+    ray.Direction = rayDirWS;
+    ray.TMin = 0.00001f;
+    ray.TMax = FloatMax;
+
+    // The direct lighting rays aren't needed if their result gets thrown away
+    if(inPayload.PathLength == 1 && !settings.EnableDirect)
+    {
+        sample.Radiance = 0.0f;
+        sample.NumShadowRays = 0;
+    }
+
+    sample.ContinuePath = false;
+    if(settings.EnableIndirect && (inPayload.PathLength + 1 < uint32(settings.MaxPathLength)) && !settings.EnableWhiteFurnaceMode)
+    {
+        sample.ContinuePath = true;
+        sample.NextRay = ray;
+        sample.Throughput = throughput;
+
+        PrimaryPayload& payload = sample.NextPayload;
+        payload.Radiance = 0.0f;
+        payload.PathLength = inPayload.PathLength + 1;
+        payload.PixelIdx = payloadCopy.PixelIdx;
+        payload.SampleSetIdx = payloadCopy.SampleSetIdx;
+        payload.IsDiffuse = (selector < 0.5f);
+        payload.Roughness = roughness;
+    }
+    else if(settings.EnableWhiteFurnaceMode)
+    {
+        // The furnace test doesn't care about visibility, so there's no need for the sky ray
+        sample.Radiance = throughput;
+        sample.NumShadowRays = 0;
+    }
+    else if(settings.EnableSky)
+    {
+        ShadowRay& shadowRay = sample.ShadowRays[sample.NumShadowRays++];
+        shadowRay.Ray = ray;
+        shadowRay.PathLength = inPayload.PathLength + 1;
+        shadowRay.PixelIdx = inPayload.PixelIdx;
+        shadowRay.Radiance = SampleSky(rayDirWS) * throughput;
+    }
+
+    return true;
+}
+
+// Looks up the vertex data for the hit triangle and interpolates its attributes
+MeshVertex CPUPathTracer::GetHitSurface(const BVHHit& hit) const
+{
+    const Float3 barycentrics = Float3(1.0f - hit.U - hit.V, hit.U, hit.V);
+
+    const Mesh& mesh = model->Meshes()[hit.MeshIdx];
+    const MeshVertex* vertices = mesh.Vertices();
+    const MeshVertex& vtx0 = vertices[MeshIndex(mesh, hit.TriangleIdx * 3 + 0)];
+    const MeshVertex& vtx1 = vertices[MeshIndex(mesh, hit.TriangleIdx * 3 + 1)];
+    const MeshVertex& vtx2 = vertices[MeshIndex(mesh, hit.TriangleIdx * 3 + 2)];
+
+    MeshVertex vtx;
+    vtx.Position = BarycentricLerp(vtx0.Position, vtx1.Position, vtx2.Position, barycentrics);
+    vtx.Normal = Float3::Normalize(BarycentricLerp(vtx0.Normal, vtx1.Normal, vtx2.Normal, barycentrics));
+    vtx.UV = BarycentricLerp(vtx0.UV, vtx1.UV, vtx2.UV, barycentrics);
+    vtx.Tangent = Float3::Normalize(BarycentricLerp(vtx0.Tangent, vtx1.Tangent, vtx2.Tangent, barycentrics));
+    vtx.Bitangent = Float3::Normalize(BarycentricLerp(vtx0.Bitangent, vtx1.Bitangent, vtx2.Bitangent, barycentrics));
+
+    return vtx;
+}
+
+const CPUPathTracer::MaterialData& CPUPathTracer::GetHitMaterial(const BVHHit& hit) const
+{
+    return materials[meshMaterials[hit.MeshIdx]];
+}
+
+Float4 CPUPathTracer::SampleMaterialTexture(const MaterialData& material, MaterialTextures texType, Float2 uv) const
+{
+    const TextureData<Half4>* texData = material.Textures[uint64(texType)];
+    if(texData == nullptr)
+        return Float4(0.0f, 0.0f, 0.0f, 1.0f);
+
+    return Float4(SampleTexture2D(uv, *texData));
+}
+
+Float3 CPUPathTracer::SampleSky(const Float3& dir) const
+{
+    if(skyTexture.NumSlices != 6)
+        return 0.0f;
+
+    return Float3(SampleCubemap(dir, skyTexture));
+}
+
+// Standard alpha testing, equivalent to the any-hit shaders in RayTrace.hlsl
+bool CPUPathTracer::AlphaTestFilter(const void* context, const BVHHit& hit)
+{
+    const CPUPathTracer* pathTracer = reinterpret_cast<const CPUPathTracer*>(context);
+    const MaterialData& material = pathTracer->GetHitMaterial(hit);
+    if(material.Opaque)
+        return true;
+
+    const MeshVertex hitSurface = pathTracer->GetHitSurface(hit);
+    return pathTracer->SampleMaterialTexture(material, MaterialTextures::Opacity, hitSurface.UV).x >= AlphaTestThreshold;
+}
\ No newline at end of file
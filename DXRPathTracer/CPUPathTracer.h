@@ -0,0 +1,241 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include <PCH.h>
+
+#include <Graphics/Model.h>
+#include <Graphics/BVH.h>
+#include <Graphics/BVH8.h>
+#include <Graphics/Textures.h>
+#include <Graphics/BlueNoiseTiles.h>
+
+#include "AppSettings.h"
+#include "SharedTypes.h"
+
+using namespace SampleFramework12;
+
+// Same inputs that RayTrace.hlsl gets through RayTraceConstants and LightConstants
+struct CPURayTraceConstants
+{
+    Float4x4 InvViewProjection;
+
+    Float3 SunDirectionWS;
+    float CosSunAngularRadius = 0.0f;
+    Float3 SunIrradiance;
+    float SinSunAngularRadius = 0.0f;
+    Float3 SunRenderColor;
+    Float3 CameraPosWS;
+
+    const SpotLight* SpotLights = nullptr;
+    uint32 NumLights = 0;
+
+    const BlueNoiseTiles* SampleTiles = nullptr;
+};
+
+// CPU implementation of the progressive path tracer in RayTrace.hlsl. It runs the same
+// algorithm against the same Model data, so that it can produce reference images and
+// throughput numbers on machines without a DXR-capable GPU.
+class CPUPathTracer
+{
+
+public:
+
+    void Initialize(const Model* model);
+    void Shutdown();
+
+    // Reads back the pre-computed sky cube map, which needs to be up-to-date before rendering
+    void SetSkyCubeMap(const Texture& cubeMap);
+
+    // Restarts progressive accumulation with the given output size
+    void Reset(uint32 width, uint32 height);
+
+    // Traces one sample per pixel and blends it into the output
+    void RenderSample(const CPURayTraceConstants& constants);
+
+    // Primary rays are traced as packets by default, this switches them to single-ray traversal
+    void SetPrimaryRayPackets(bool enable) { primaryRayPackets = enable; }
+    bool PrimaryRayPackets() const { return primaryRayPackets; }
+
+    // Wavefront mode advances every path by one bounce at a time instead of tracing each pixel's
+    // path recursively. Rays are queued and sorted by direction and origin before they're traced,
+    // and hit points are shaded in groups that share a material.
+    void SetWavefront(bool enable) { wavefront = enable; }
+    bool Wavefront() const { return wavefront; }
+
+    struct WavefrontBounceStats
+    {
+        uint64 NumExtensionRays = 0;
+        uint64 NumShadowRays = 0;
+        double ExtensionSortMs = 0.0;
+        double ExtensionTraceMs = 0.0;
+        double ShadeMs = 0.0;
+        double ShadowSortMs = 0.0;
+        double ShadowTraceMs = 0.0;
+    };
+
+    struct WavefrontStats
+    {
+        static const uint64 MaxBounces = AppSettings::MaxPathLengthSetting;
+
+        WavefrontBounceStats Bounces[MaxBounces];
+        uint32 NumBounces = 0;
+    };
+
+    // Accessors
+    const TextureData<Float4>& Output() const { return output; }
+    const BVH& SceneBVH() const { return bvh; }
+    uint32 CurrSampleIdx() const { return currSampleIdx; }
+    const WavefrontStats& LastWavefrontStats() const { return wavefrontStats; }
+
+    uint64 LastSampleRayCount() const { return lastSampleRayCount; }
+    double LastSampleSeconds() const { return lastSampleSeconds; }
+    double LastSampleMRaysPerSecond() const;
+    double AverageMRaysPerSecond() const;
+
+    static const uint32 TileSize = 16;
+    static const uint32 PacketSize = 8;
+
+protected:
+
+    struct ThreadStats
+    {
+        uint64 NumRays = 0;
+        uint8 Padding[56] = { };
+    };
+
+    struct MaterialData
+    {
+        const TextureData<Half4>* Textures[uint64(MaterialTextures::Count)] = { };
+        bool Opaque = true;
+    };
+
+    struct PrimaryPayload
+    {
+        Float3 Radiance;
+        float Roughness = 0.0f;
+        uint32 PathLength = 0;
+        uint32 PixelIdx = 0;
+        uint32 SampleSetIdx = 0;
+        bool IsDiffuse = false;
+    };
+
+    struct ShadowRay
+    {
+        BVHRay Ray;
+        Float3 Radiance;            // Added to the pixel if the ray isn't occluded
+        uint32 PathLength = 0;
+        uint32 PixelIdx = 0;
+    };
+
+    // Sun, spot lights, and the sky ray at the end of a path
+    static const uint64 MaxShadowRays = AppSettings::MaxSpotLights + 2;
+
+    // Everything produced by shading one path vertex, so that the rays can either be
+    // traced right away or queued up for later
+    struct SurfaceSample
+    {
+        Float3 Radiance;
+        ShadowRay ShadowRays[MaxShadowRays];
+        uint32 NumShadowRays = 0;
+
+        bool ContinuePath = false;
+        BVHRay NextRay;
+        Float3 Throughput;
+        PrimaryPayload NextPayload;
+    };
+
+    struct WavefrontPath
+    {
+        BVHRay Ray;
+        Float3 Throughput;          // Product of the BRDF weights along the path so far
+        PrimaryPayload Payload;
+    };
+
+    // Each thread appends to its own queues while shading, which are then concatenated
+    struct WavefrontThreadQueues
+    {
+        GrowableList<WavefrontPath> Paths;
+        GrowableList<ShadowRay> ShadowRays;
+    };
+
+    void RenderTile(uint32 tileIdx, uint64& numRays) const;
+    void GeneratePrimaryRay(uint32 x, uint32 y, BVHRay& ray, PrimaryPayload& payload) const;
+    void AccumulateSample(uint32 pixelIdx, const Float3& sampleRadiance) const;
+    void RenderWavefront();
+    void GeneratePrimaryPaths();
+    void TraceExtensionRays(uint32 pathLength, WavefrontBounceStats& stats);
+    void ShadePaths(WavefrontBounceStats& stats);
+    void TraceShadowRays(WavefrontBounceStats& stats);
+
+    Float2 SamplePoint(uint32 pixelIdx, uint32& setIdx) const;
+    void TraceRadianceRay(const BVHRay& ray, PrimaryPayload& payload, uint64& numRays) const;
+    void ShadeRadianceRay(const BVHRay& ray, const BVHHit& hit, PrimaryPayload& payload, uint64& numRays) const;
+    Float3 MissRadiance(const BVHRay& ray, uint32 pathLength) const;
+    float TraceShadowRay(const BVHRay& ray, uint32 pathLength, uint64& numRays) const;
+    bool SampleSurface(const MeshVertex& hitSurface, const MaterialData& material, const BVHRay& incomingRay,
+                       const PrimaryPayload& inPayload, SurfaceSample& sample) const;
+    Float3 PathTrace(const MeshVertex& hitSurface, const MaterialData& material, const BVHRay& incomingRay,
+                     const PrimaryPayload& inPayload, uint64& numRays) const;
+
+    MeshVertex GetHitSurface(const BVHHit& hit) const;
+    const MaterialData& GetHitMaterial(const BVHHit& hit) const;
+    Float4 SampleMaterialTexture(const MaterialData& material, MaterialTextures texType, Float2 uv) const;
+    Float3 SampleSky(const Float3& dir) const;
+
+    static bool AlphaTestFilter(const void* context, const BVHHit& hit);
+
+    const Model* model = nullptr;
+    BVH bvh;
+#if EnableCompressedBVH8_
+    CompressedBVH8 bvh8;
+#else
+    BVH8 bvh8;
+#endif
+    bool useBVH8 = false;
+    bool primaryRayPackets = true;
+    bool wavefront = false;
+
+    Array<TextureData<Half4>> textureData;
+    Array<MaterialData> materials;
+    Array<uint32> meshMaterials;
+    TextureData<Half4> skyTexture;
+
+    TextureData<Float4> output;
+    uint32 currSampleIdx = 0;
+
+    // Only valid while RenderSample() is running
+    const CPURayTraceConstants* rtConstants = nullptr;
+    AppSettings::AppSettingsCBuffer settings = { };
+
+    Array<ThreadStats> threadStats;
+
+    // Wavefront queues, which are kept around between samples
+    Array<Float3> pixelRadiance;
+    Array<WavefrontPath> paths;
+    uint64 numPaths = 0;
+    Array<uint64> pathOffsets;
+    Array<BVHHit> pathHits;
+    Array<uint32> shadeOrder;
+    Array<uint32> materialOffsets;
+    Array<ShadowRay> shadowRays;
+    uint64 numShadowRays = 0;
+    Array<uint64> shadowRayOffsets;
+    Array<uint8> shadowRaysOccluded;
+    Array<uint64> sortKeys;
+    Array<uint64> sortScratch;
+    Array<WavefrontThreadQueues> threadQueues;
+    WavefrontStats wavefrontStats;
+    uint64 lastSampleRayCount = 0;
+    double lastSampleSeconds = 0.0;
+    uint64 totalRayCount = 0;
+    double totalSeconds = 0.0;
+};
\ No newline at end of file
@@ -19,6 +19,7 @@
 #include <Graphics/Profiler.h>
 #include <Graphics/Textures.h>
 #include <Graphics/Sampling.h>
+#include <Graphics/BlueNoiseTiles.h>
 #include <Graphics/DX12.h>
 #include <Graphics/DX12_Helpers.h>
 #include <Graphics/DXRHelper.h>
@@ -29,9 +30,13 @@
 
 #include "DXRPathTracer.h"
 #include "SharedTypes.h"
+#include "BVHBenchmark.h"
+#include "SamplerBenchmark.h"
 
 using namespace SampleFramework12;
 
+static const char* SceneNames[] = { "Sponza", "SunTemple", "BoxTest", "WhiteFurnace" };
+
 // Model filenames
 static const wchar* ScenePaths[] =
 {
@@ -47,6 +52,7 @@ static const Float3 SceneCameraPositions[] = { Float3(-11.5f, 1.85f, -0.45f), Fl
 static const Float2 SceneCameraRotations[] = { Float2(0.0f, 1.544f), Float2(0.2f, 3.0f), Float2(0.0f, 0.0f), Float2(0.0f, 0.0f) };
 static const Float3 SceneSunDirections[] = { Float3(0.26f, 0.987f, -0.16f), Float3(-0.133022308f, 0.642787635f, 0.75440651f), Float3(0.26f, 0.987f, -0.16f), Float3(0.0f, 1.0f, 0.0f) };
 
+StaticAssert_(ArraySize_(SceneNames) == uint64(Scenes::NumValues));
 StaticAssert_(ArraySize_(ScenePaths) == uint64(Scenes::NumValues));
 StaticAssert_(ArraySize_(SceneTextureDirs) == uint64(Scenes::NumValues));
 StaticAssert_(ArraySize_(SceneScales) == uint64(Scenes::NumValues));
@@ -54,6 +60,9 @@ StaticAssert_(ArraySize_(SceneCameraPositions) == uint64(Scenes::NumValues));
 StaticAssert_(ArraySize_(SceneCameraRotations) == uint64(Scenes::NumValues));
 StaticAssert_(ArraySize_(SceneSunDirections) == uint64(Scenes::NumValues));
 
+// Scene models and their textures are evicted to stay under this
+static const uint64 SceneStreamingBudget = 3072ull * 1024 * 1024;
+
 static const uint64 NumConeSides = 16;
 
 static const bool Benchmark = false;
@@ -99,7 +108,7 @@ struct RayTraceConstants
     Float3 SunIrradiance;
     float SinSunAngularRadius = 0.0f;
     Float3 SunRenderColor;
-    uint32 Padding = 0;
+    uint32 CompactVertices = 0;
     Float3 CameraPosWS;
     uint32 CurrSampleIdx = 0;
     uint32 TotalNumPixels = 0;
@@ -110,6 +119,10 @@ struct RayTraceConstants
     uint32 MaterialBufferIdx = uint32(-1);
     uint32 SkyTextureIdx = uint32(-1);
     uint32 NumLights = 0;
+
+    Float4Align Float3 PositionScale;
+    Float4Align Float3 PositionOffset;
+    uint32 BlueNoiseBufferIdx = uint32(-1);
 };
 
 enum ClusterRootParams : uint32
@@ -175,6 +188,48 @@ DXRPathTracer::DXRPathTracer(const wchar* cmdLine) : App(L"DXR Path Tracer", cmd
     globalHelpText = "DXR Path Tracer\n\n"
                      "Controls:\n\n"
                      "Use W/S/A/D/Q/E to move the camera, and hold right-click while dragging the mouse to rotate.";
+
+    cxxopts::Options options("DXRPathTracer", "");
+    options.allow_unrecognised_options();
+    options.add_options()
+         ("cpureference", "Render a reference image with the CPU path tracer and exit")
+         ("cpureferenceoutput", "Output path for the CPU reference image", cxxopts::value<std::string>())
+         ("cpuwavefront", "Trace the CPU reference image one bounce at a time with sorted ray queues")
+         ("bvhbenchmark", "Benchmark CPU ray traversal for every scene and exit")
+         ("samplerbenchmark", "Compare the error convergence, discrepancy, and cost of the samplers and exit")
+         ("samplerbenchmarkoutput", "Output path for the sampler benchmark's CSV results", cxxopts::value<std::string>());
+
+    cxxopts::ParseResult parseResult = ParseCommandLineOptions(cmdLine, options);
+
+    if(parseResult.count("cpureference"))
+    {
+        // No need to show a window, we only need a device for decoding textures
+        cpuReferenceMode = true;
+        showWindow = false;
+        cpuReferenceOutputPath = L"CPUReference.exr";
+    }
+
+    if(parseResult.count("bvhbenchmark"))
+    {
+        bvhBenchmarkMode = true;
+        showWindow = false;
+    }
+
+    if(parseResult.count("samplerbenchmark"))
+    {
+        samplerBenchmarkMode = true;
+        showWindow = false;
+        samplerBenchmarkOutputPath = L"SamplerBenchmark.csv";
+    }
+
+    if(parseResult.count("cpureferenceoutput"))
+        cpuReferenceOutputPath = AnsiToWString(parseResult["cpureferenceoutput"].as<std::string>().c_str());
+
+    if(parseResult.count("samplerbenchmarkoutput"))
+        samplerBenchmarkOutputPath = AnsiToWString(parseResult["samplerbenchmarkoutput"].as<std::string>().c_str());
+
+    if(parseResult.count("cpuwavefront"))
+        cpuPathTracer.SetWavefront(true);
 }
 
 void DXRPathTracer::BeforeReset()
@@ -213,6 +268,9 @@ void DXRPathTracer::Initialize()
 
     ShadowHelper::Initialize(ShadowMapMode::DepthMap, ShadowMSAAMode::MSAA1x);
 
+    sceneStreamer.Initialize(sceneModels, ArraySize_(sceneModels), SceneStreamingBudget,
+                             [this](uint64 sceneIdx) { LoadSceneModel(sceneIdx, true); });
+
     InitializeScene();
 
     skybox.Initialize();
@@ -365,12 +423,40 @@ void DXRPathTracer::Initialize()
     }
 
     InitRayTracing();
+
+    if(bvhBenchmarkMode)
+    {
+        for(uint64 sceneIdx = 0; sceneIdx < uint64(Scenes::NumValues); ++sceneIdx)
+        {
+            LoadSceneModel(sceneIdx, false);
+
+            camera.SetPosition(SceneCameraPositions[sceneIdx]);
+            camera.SetXRotation(SceneCameraRotations[sceneIdx].x);
+            camera.SetYRotation(SceneCameraRotations[sceneIdx].y);
+
+            RunBVHBenchmark(sceneModels[sceneIdx], SceneNames[sceneIdx], camera.ViewProjectionMatrix(),
+                            swapChain.Width(), swapChain.Height());
+        }
+        Exit();
+    }
+    else if(samplerBenchmarkMode)
+    {
+        InitBlueNoiseTiles();
+        RunSamplerBenchmark(blueNoiseTiles, samplerBenchmarkOutputPath.c_str());
+        Exit();
+    }
+    else if(cpuReferenceMode)
+    {
+        RenderCPUReference();
+        Exit();
+    }
 }
 
 void DXRPathTracer::Shutdown()
 {
     ShadowHelper::Shutdown();
 
+    sceneStreamer.Shutdown();
     for(uint64 i = 0; i < ArraySize_(sceneModels); ++i)
         sceneModels[i].Shutdown();
 
@@ -404,6 +490,10 @@ void DXRPathTracer::Shutdown()
     rtHitTable.Shutdown();
     rtMissTable.Shutdown();
     rtGeoInfoBuffer.Shutdown();
+    blueNoiseBuffer.Shutdown();
+    blueNoiseTiles.Shutdown();
+
+    cpuPathTracer.Shutdown();
 }
 
 void DXRPathTracer::CreatePSOs()
@@ -594,31 +684,47 @@ void DXRPathTracer::CreateRenderTargets()
     rtShouldRestartPathTrace = true;
 }
 
+// Loads the model for a scene (if necessary). With deferResources it can be called on a task thread,
+// and the model's GPU resources need to be created on the main thread afterwards.
+void DXRPathTracer::LoadSceneModel(uint64 sceneIdx, bool deferResources)
+{
+    if(sceneModels[sceneIdx].NumMeshes() > 0)
+        return;
+
+    if(sceneIdx == uint64(Scenes::BoxTest) || ScenePaths[sceneIdx] == nullptr)
+    {
+        // The box scene is generated on the main thread before it's requested from the streamer
+        Assert_(deferResources == false);
+        sceneModels[sceneIdx].GenerateBoxTestScene();
+    }
+    else
+    {
+        ModelLoadSettings settings;
+        settings.FilePath = ScenePaths[sceneIdx];
+        settings.TextureDir = SceneTextureDirs[sceneIdx];
+        settings.ForceSRGB = true;
+        settings.SceneScale = SceneScales[sceneIdx];
+        settings.MergeMeshes = false;
+        settings.CacheMeshData = true;
+        settings.CompactVertices = EnableCompactVertices_ != 0;
+        settings.OptimizeVertexOrder = true;
+        settings.GenerateMeshlets = true;
+        settings.NumLODs = 4;
+        settings.StreamTextures = cpuReferenceMode == false;
+        settings.DeferResourceCreation = deferResources;
+        sceneModels[sceneIdx].CreateWithAssimp(settings);
+    }
+}
+
 void DXRPathTracer::InitializeScene()
 {
     const uint64 currSceneIdx = uint64(AppSettings::CurrentScene);
     AppSettings::EnableWhiteFurnaceMode.SetValue(currSceneIdx == uint64(Scenes::WhiteFurnace));
 
-    // Load the scene (if necessary)
-    if(sceneModels[currSceneIdx].NumMeshes() == 0)
-    {
-        if(currSceneIdx == uint64(Scenes::BoxTest) || ScenePaths[currSceneIdx] == nullptr)
-        {
-            sceneModels[currSceneIdx].GenerateBoxTestScene();
-        }
-        else
-        {
-            ModelLoadSettings settings;
-            settings.FilePath = ScenePaths[currSceneIdx];
-            settings.TextureDir = SceneTextureDirs[currSceneIdx];
-            settings.ForceSRGB = true;
-            settings.SceneScale = SceneScales[currSceneIdx];
-            settings.MergeMeshes = false;
-            sceneModels[currSceneIdx].CreateWithAssimp(settings);
-        }
-    }
+    LoadSceneModel(currSceneIdx, false);
 
     currentModel = &sceneModels[currSceneIdx];
+    sceneStreamer.SetCurrentModel(currSceneIdx);
     meshRenderer.Shutdown();
     DX12::FlushGPU();
     meshRenderer.Initialize(currentModel);
@@ -721,6 +827,24 @@ void DXRPathTracer::InitRayTracing()
     rtCurrCamera = camera;
 }
 
+// Generates the blue-noise sampler keys the first time that something needs them, since optimizing
+// them takes a few seconds when there's no cache file. There's a tile for each pair of dimensions
+// that gets a sample set.
+void DXRPathTracer::InitBlueNoiseTiles()
+{
+    if(blueNoiseTiles.NumDims() > 0)
+        return;
+
+    blueNoiseTiles.Initialize(AppSettings::SampleTileSize, AppSettings::NumSampleSets);
+
+    StructuredBufferInit sbInit;
+    sbInit.Stride = sizeof(BlueNoiseKeys);
+    sbInit.NumElements = blueNoiseTiles.AllKeys().Size();
+    sbInit.Name = L"Blue Noise Keys";
+    sbInit.InitData = blueNoiseTiles.AllKeys().Data();
+    blueNoiseBuffer.Initialize(sbInit);
+}
+
 void DXRPathTracer::CreateRayTracingPSOs()
 {
     StateObjectBuilder builder;
@@ -928,19 +1052,37 @@ void DXRPathTracer::Update(const Timer& timer)
         CreatePSOs();
     }
 
-    if(AppSettings::CurrentScene.Changed() && currentModel != &sceneModels[uint64(AppSettings::CurrentScene)])
+    // New scenes load in the background, and the current one keeps rendering until it's done
+    const uint64 sceneIdx = uint64(AppSettings::CurrentScene);
+    if(AppSettings::CurrentScene.Changed())
+    {
+        // The box scene is generated rather than loaded, so it's created right away
+        if(sceneIdx == uint64(Scenes::BoxTest) || ScenePaths[sceneIdx] == nullptr)
+            LoadSceneModel(sceneIdx, false);
+        sceneStreamer.RequestModel(sceneIdx);
+    }
+
+    const bool materialsChanged = sceneStreamer.Update(camera);
+    if(currentModel != &sceneModels[sceneIdx] && sceneStreamer.ModelResident(sceneIdx))
     {
-        currentModel = &sceneModels[uint64(AppSettings::CurrentScene)];
+        currentModel = &sceneModels[sceneIdx];
         DestroyPSOs();
         InitializeScene();
         CreatePSOs();
 
         rtShouldRestartPathTrace = true;
     }
+    else if(materialsChanged)
+    {
+        // Textures were streamed in or evicted
+        meshRenderer.UpdateMaterialBuffer();
+        rtShouldRestartPathTrace = true;
+    }
 
     const Setting* settingsToCheck[] =
     {
         &AppSettings::SqrtNumSamples,
+        &AppSettings::SampleMode,
         &AppSettings::MaxPathLength,
         &AppSettings::EnableAlbedoMaps,
         &AppSettings::EnableNormalMaps,
@@ -1020,6 +1162,9 @@ void DXRPathTracer::Render(const Timer& timer)
     {
         RenderClusters();
 
+        // The shadow casters use the LODs that the main camera sees
+        meshRenderer.SelectLODs(camera, float(mainTarget.Height()));
+
         if(AppSettings::EnableSun)
             meshRenderer.RenderSunShadowMap(cmdList, camera);
 
@@ -1316,6 +1461,10 @@ void DXRPathTracer::RenderRayTracing()
     if(rtCurrSampleIdx >= uint32(AppSettings::SqrtNumSamples * AppSettings::SqrtNumSamples))
         return;
 
+    // The shaders only read the blue-noise keys in this mode, so the buffer's SRV is left invalid otherwise
+    if(AppSettings::SampleMode == SampleModes::BlueNoise)
+        InitBlueNoiseTiles();
+
     ID3D12GraphicsCommandList4* cmdList = DX12::CmdList;
     cmdList->SetComputeRootSignature(rtRootSignature);
 
@@ -1336,11 +1485,16 @@ void DXRPathTracer::RenderRayTracing()
     rtConstants.CurrSampleIdx = rtCurrSampleIdx;
     rtConstants.TotalNumPixels = uint32(rtTarget.Width()) * uint32(rtTarget.Height());
 
+    rtConstants.CompactVertices = currentModel->CompactVertices() ? 1 : 0;
+    rtConstants.PositionScale = currentModel->PositionScale();
+    rtConstants.PositionOffset = currentModel->PositionOffset();
+
     rtConstants.VtxBufferIdx = currentModel->VertexBuffer().SRV;
     rtConstants.IdxBufferIdx = currentModel->IndexBuffer().SRV;
     rtConstants.GeometryInfoBufferIdx = rtGeoInfoBuffer.SRV;
     rtConstants.MaterialBufferIdx = meshRenderer.MaterialBuffer().SRV;
     rtConstants.SkyTextureIdx = skyCache.CubeMap.SRV;
+    rtConstants.BlueNoiseBufferIdx = blueNoiseBuffer.SRV;
     rtConstants.NumLights = Min<uint32>(uint32(spotLights.Size()), AppSettings::MaxLightClamp);
 
     DX12::BindTempConstantBuffer(cmdList, rtConstants, RTParams_CBuffer, CmdListMode::Compute);
@@ -1382,6 +1536,17 @@ void DXRPathTracer::RenderHUD(const Timer& timer)
     std::wstring fpsText = MakeString(L"Frame Time: %.2fms (%u FPS)", 1000.0f / fps, fps);
     spriteRenderer.RenderText(cmdList, font, fpsText.c_str(), textPos, Float4(1.0f, 1.0f, 0.0f, 1.0f));
 
+    if(sceneStreamer.LoadingModel() || sceneStreamer.NumPendingTextures() > 0)
+    {
+        textPos.y += font.Size() * 1.5f;
+        std::wstring streamingText = MakeString(L"Streaming: %ls%llu textures pending (%.0f / %.0f MB resident)",
+                                                sceneStreamer.LoadingModel() ? L"loading scene, " : L"",
+                                                sceneStreamer.NumPendingTextures(),
+                                                sceneStreamer.ResidentMemorySize() / (1024.0 * 1024.0),
+                                                sceneStreamer.MemoryBudget() / (1024.0 * 1024.0));
+        spriteRenderer.RenderText(cmdList, font, streamingText.c_str(), textPos, Float4(1.0f, 1.0f, 0.0f, 1.0f));
+    }
+
     spriteRenderer.End();
 
     // Draw the progress bar
@@ -1439,7 +1604,7 @@ void DXRPathTracer::RenderHUD(const Timer& timer)
 
 void DXRPathTracer::BuildRTAccelerationStructure()
 {
-    const FormattedBuffer& idxBuffer = currentModel->IndexBuffer();
+    const RawBuffer& idxBuffer = currentModel->IndexBuffer();
     const StructuredBuffer& vtxBuffer = currentModel->VertexBuffer();
 
     const uint64 numMeshes = currentModel->NumMeshes();
@@ -1459,11 +1624,11 @@ void DXRPathTracer::BuildRTAccelerationStructure()
         D3D12_RAYTRACING_GEOMETRY_DESC& geometryDesc = geometryDescs[meshIdx];
         geometryDesc = { };
         geometryDesc.Type = D3D12_RAYTRACING_GEOMETRY_TYPE_TRIANGLES;
-        geometryDesc.Triangles.IndexBuffer = idxBuffer.GPUAddress + mesh.IndexOffset() * idxBuffer.Stride;
+        geometryDesc.Triangles.IndexBuffer = idxBuffer.GPUAddress + mesh.IndexBufferOffset();
         geometryDesc.Triangles.IndexCount = uint32(mesh.NumIndices());
-        geometryDesc.Triangles.IndexFormat = idxBuffer.Format;
+        geometryDesc.Triangles.IndexFormat = mesh.IndexBufferFormat();
         geometryDesc.Triangles.Transform3x4 = 0;
-        geometryDesc.Triangles.VertexFormat = DXGI_FORMAT_R32G32B32_FLOAT;
+        geometryDesc.Triangles.VertexFormat = currentModel->CompactVertices() ? DXGI_FORMAT_R16G16B16A16_SNORM : DXGI_FORMAT_R32G32B32_FLOAT;
         geometryDesc.Triangles.VertexCount = uint32(mesh.NumVertices());
         geometryDesc.Triangles.VertexBuffer.StartAddress = vtxBuffer.GPUAddress + mesh.VertexOffset() * vtxBuffer.Stride;
         geometryDesc.Triangles.VertexBuffer.StrideInBytes = vtxBuffer.Stride;
@@ -1472,8 +1637,9 @@ void DXRPathTracer::BuildRTAccelerationStructure()
         GeometryInfo& geoInfo = geoInfoBufferData[meshIdx];
         geoInfo = { };
         geoInfo.VtxOffset = uint32(mesh.VertexOffset());
-        geoInfo.IdxOffset = uint32(mesh.IndexOffset());
+        geoInfo.IdxByteOffset = uint32(mesh.IndexBufferOffset());
         geoInfo.MaterialIdx = mesh.MeshParts()[0].MaterialIdx;
+        geoInfo.IndexType = uint32(mesh.IndexBufferType());
 
         Assert_(mesh.NumMeshParts() == 1);
     }
@@ -1540,8 +1706,16 @@ void DXRPathTracer::BuildRTAccelerationStructure()
     }
 
     // Create an instance desc for the bottom-level acceleration structure.
+    // Compact vertex positions are quantized to the model bounds, and the instance transform scales them back
+    const Float3& positionScale = currentModel->PositionScale();
+    const Float3& positionOffset = currentModel->PositionOffset();
     D3D12_RAYTRACING_INSTANCE_DESC instanceDesc = {};
-    instanceDesc.Transform[0][0] = instanceDesc.Transform[1][1] = instanceDesc.Transform[2][2] = 1.0f;
+    instanceDesc.Transform[0][0] = positionScale.x;
+    instanceDesc.Transform[1][1] = positionScale.y;
+    instanceDesc.Transform[2][2] = positionScale.z;
+    instanceDesc.Transform[0][3] = positionOffset.x;
+    instanceDesc.Transform[1][3] = positionOffset.y;
+    instanceDesc.Transform[2][3] = positionOffset.z;
     instanceDesc.InstanceMask = 1;
     instanceDesc.AccelerationStructure = rtBottomLevelAccelStructure.GPUAddress;
 
@@ -1601,3 +1775,55 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
     DXRPathTracer app(lpCmdLine);
     app.Run();
 }
+
+// Renders the current scene and camera with the CPU path tracer until the full sample count is
+// reached, and saves the result to disk. The output is the same un-tonemapped radiance that
+// RenderRayTracing() accumulates into rtTarget.
+void DXRPathTracer::RenderCPUReference()
+{
+    skyCache.Init(AppSettings::SunDirection, AppSettings::SunSize, AppSettings::GroundAlbedo, AppSettings::Turbidity, true);
+
+    cpuPathTracer.Initialize(currentModel);
+    cpuPathTracer.SetSkyCubeMap(skyCache.CubeMap);
+    cpuPathTracer.Reset(swapChain.Width(), swapChain.Height());
+
+    if(AppSettings::SampleMode == SampleModes::BlueNoise)
+        InitBlueNoiseTiles();
+
+    CPURayTraceConstants rtConstants;
+    rtConstants.InvViewProjection = Float4x4::Invert(camera.ViewProjectionMatrix());
+    rtConstants.SunDirectionWS = AppSettings::SunDirection;
+    rtConstants.SunIrradiance = skyCache.SunIrradiance;
+    rtConstants.CosSunAngularRadius = std::cos(DegToRad(AppSettings::SunSize));
+    rtConstants.SinSunAngularRadius = std::sin(DegToRad(AppSettings::SunSize));
+    rtConstants.SunRenderColor = skyCache.SunRenderColor;
+    rtConstants.CameraPosWS = camera.Position();
+    rtConstants.SpotLights = spotLights.Data();
+    rtConstants.NumLights = Min<uint32>(uint32(spotLights.Size()), AppSettings::MaxLightClamp);
+    rtConstants.SampleTiles = &blueNoiseTiles;
+
+    const uint32 numSamples = uint32(AppSettings::SqrtNumSamples * AppSettings::SqrtNumSamples);
+    for(uint32 sampleIdx = 0; sampleIdx < numSamples; ++sampleIdx)
+    {
+        cpuPathTracer.RenderSample(rtConstants);
+        WriteLog("CPU path tracer sample %u/%u: %.2f ms, %.2f MRays/s", sampleIdx + 1, numSamples,
+                 cpuPathTracer.LastSampleSeconds() * 1000.0, cpuPathTracer.LastSampleMRaysPerSecond());
+
+        if(cpuPathTracer.Wavefront())
+        {
+            const CPUPathTracer::WavefrontStats& stats = cpuPathTracer.LastWavefrontStats();
+            for(uint32 bounceIdx = 0; bounceIdx < stats.NumBounces; ++bounceIdx)
+            {
+                const CPUPathTracer::WavefrontBounceStats& bounce = stats.Bounces[bounceIdx];
+                WriteLog("    Bounce %u: %llu extension rays (sort %.2f ms, trace %.2f ms), shade %.2f ms, %llu shadow rays (sort %.2f ms, trace %.2f ms)",
+                         bounceIdx + 1, bounce.NumExtensionRays, bounce.ExtensionSortMs, bounce.ExtensionTraceMs, bounce.ShadeMs,
+                         bounce.NumShadowRays, bounce.ShadowSortMs, bounce.ShadowTraceMs);
+            }
+        }
+    }
+
+    WriteLog("CPU path tracer finished %u samples at %ux%u, average of %.2f MRays/s", numSamples,
+             swapChain.Width(), swapChain.Height(), cpuPathTracer.AverageMRaysPerSecond());
+
+    SaveTextureAsEXR(cpuPathTracer.Output(), cpuReferenceOutputPath.c_str());
+}
\ No newline at end of file
@@ -19,9 +19,12 @@
 #include <Graphics/Model.h>
 #include <Graphics/Skybox.h>
 #include <Graphics/GraphicsTypes.h>
+#include <Graphics/BlueNoiseTiles.h>
 
 #include "PostProcessor.h"
 #include "MeshRenderer.h"
+#include "CPUPathTracer.h"
+#include "SceneStreamer.h"
 
 using namespace SampleFramework12;
 
@@ -40,6 +43,7 @@ protected:
     // Model
     Model sceneModels[uint64(Scenes::NumValues)];
     const Model* currentModel = nullptr;
+    SceneStreamer sceneStreamer;
     MeshRenderer meshRenderer;
 
     RenderTexture mainTarget;
@@ -88,10 +92,20 @@ protected:
     StructuredBuffer rtHitTable;
     StructuredBuffer rtMissTable;
     StructuredBuffer rtGeoInfoBuffer;
+    BlueNoiseTiles blueNoiseTiles;
+    StructuredBuffer blueNoiseBuffer;
     FirstPersonCamera rtCurrCamera;
     bool rtShouldRestartPathTrace = false;
     uint32 rtCurrSampleIdx = 0;
 
+    // CPU reference path tracer
+    CPUPathTracer cpuPathTracer;
+    bool cpuReferenceMode = false;
+    std::wstring cpuReferenceOutputPath;
+    bool bvhBenchmarkMode = false;
+    bool samplerBenchmarkMode = false;
+    std::wstring samplerBenchmarkOutputPath;
+
 
     virtual void Initialize() override;
     virtual void Shutdown() override;
@@ -106,9 +120,11 @@ protected:
     virtual void DestroyPSOs() override;
 
     void CreateRenderTargets();
+    void LoadSceneModel(uint64 sceneIdx, bool deferResources);
     void InitializeScene();
 
     void InitRayTracing();
+    void InitBlueNoiseTiles();
     void CreateRayTracingPSOs();
 
     void UpdateLights();
@@ -121,6 +137,8 @@ protected:
 
     void BuildRTAccelerationStructure();
 
+    void RenderCPUReference();
+
 public:
 
     DXRPathTracer(const wchar* cmdLine);
@@ -14,6 +14,11 @@
 // Includes
 //=================================================================================================
 #include "Shading.hlsl"
+#include <RayTracing.hlsl>
+
+#ifndef CompactVertices_
+    #define CompactVertices_ 0
+#endif
 
 //=================================================================================================
 // Constant buffers
@@ -25,6 +30,8 @@ struct VSConstants
     row_major float4x4 WorldViewProjection;
     float NearClip;
     float FarClip;
+    float3 PositionScale;
+    float3 PositionOffset;
 };
 
 struct MatIndexConstants
@@ -59,11 +66,18 @@ SamplerComparisonState PCFSampler : register(s2);
 //=================================================================================================
 struct VSInput
 {
+#if CompactVertices_
+    float4 PositionOS           : POSITION;     // Within the model bounds, with the bitangent sign in w
+    float2 NormalOS             : NORMAL;       // Octahedral
+    float2 UV                   : UV;
+    float2 TangentOS            : TANGENT;      // Octahedral
+#else
     float3 PositionOS           : POSITION;
     float3 NormalOS             : NORMAL;
     float2 UV                   : UV;
     float3 TangentOS            : TANGENT;
     float3 BitangentOS          : BITANGENT;
+#endif
 };
 
 struct VSOutput
@@ -103,7 +117,17 @@ VSOutput VS(in VSInput input, in uint VertexID : SV_VertexID)
 {
     VSOutput output;
 
-    float3 positionOS = input.PositionOS;
+    #if CompactVertices_
+        float3 positionOS = input.PositionOS.xyz * VSCBuffer.PositionScale + VSCBuffer.PositionOffset;
+        float3 normalOS = DecodeOctahedral(input.NormalOS);
+        float3 tangentOS = DecodeOctahedral(input.TangentOS);
+        float3 bitangentOS = cross(normalOS, tangentOS) * (input.PositionOS.w < 0.0f ? -1.0f : 1.0f);
+    #else
+        float3 positionOS = input.PositionOS;
+        float3 normalOS = input.NormalOS;
+        float3 tangentOS = input.TangentOS;
+        float3 bitangentOS = input.BitangentOS;
+    #endif
 
     // Calc the world-space position
     output.PositionWS = mul(float4(positionOS, 1.0f), VSCBuffer.World).xyz;
@@ -113,11 +137,11 @@ VSOutput VS(in VSInput input, in uint VertexID : SV_VertexID)
     output.DepthVS = output.PositionCS.w;
 
     // Rotate the normal into world space
-    output.NormalWS = normalize(mul(float4(input.NormalOS, 0.0f), VSCBuffer.World)).xyz;
+    output.NormalWS = normalize(mul(float4(normalOS, 0.0f), VSCBuffer.World)).xyz;
 
     // Rotate the rest of the tangent frame into world space
-    output.TangentWS = normalize(mul(float4(input.TangentOS, 0.0f), VSCBuffer.World)).xyz;
-    output.BitangentWS = normalize(mul(float4(input.BitangentOS, 0.0f), VSCBuffer.World)).xyz;
+    output.TangentWS = normalize(mul(float4(tangentOS, 0.0f), VSCBuffer.World)).xyz;
+    output.BitangentWS = normalize(mul(float4(bitangentOS, 0.0f), VSCBuffer.World)).xyz;
 
     // Pass along the texture coordinates
     output.UV = input.UV;
@@ -45,27 +45,20 @@ struct MeshVSConstants
     Float4Align Float4x4 WorldViewProjection;
     float NearClip = 0.0f;
     float FarClip = 0.0f;
+    Float4Align Float3 PositionScale = Float3(1.0f, 1.0f, 1.0f);
+    Float4Align Float3 PositionOffset;
 };
 
-// Frustum culls meshes, and produces a buffer of visible mesh indices
-static uint64 CullMeshes(const Camera& camera, const Array<DirectX::BoundingBox>& boundingBoxes, Array<uint32>& drawIndices)
+// Builds a world-space frustum for culling against a perspective camera
+static DirectX::BoundingFrustum MakeCullingFrustum(const Camera& camera)
 {
     DirectX::BoundingFrustum frustum(camera.ProjectionMatrix().ToSIMD());
     frustum.Transform(frustum, 1.0f, camera.Orientation().ToSIMD(), camera.Position().ToSIMD());
-
-    uint64 numVisible = 0;
-    const uint64 numMeshes = boundingBoxes.Size();
-    for(uint64 i = 0; i < numMeshes; ++i)
-    {
-        if(frustum.Intersects(boundingBoxes[i]))
-            drawIndices[numVisible++] = uint32(i);
-    }
-
-    return numVisible;
+    return frustum;
 }
 
-// Frustum culls meshes for an orthographic projection, and produces a buffer of visible mesh indices
-static uint64 CullMeshesOrthographic(const OrthographicCamera& camera, bool ignoreNearZ, const Array<DirectX::BoundingBox>& boundingBoxes, Array<uint32>& drawIndices)
+// Builds a world-space box for culling against an orthographic camera
+static DirectX::BoundingOrientedBox MakeCullingOBB(const OrthographicCamera& camera, bool ignoreNearZ)
 {
     Float3 mins = Float3(camera.MinX(), camera.MinY(), camera.NearClip());
     Float3 maxes = Float3(camera.MaxX(), camera.MaxY(), camera.FarClip());
@@ -81,18 +74,125 @@ static uint64 CullMeshesOrthographic(const OrthographicCamera& camera, bool igno
     obb.Extents = extents.ToXMFLOAT3();
     obb.Center = center.ToXMFLOAT3();
     obb.Orientation = camera.Orientation().ToXMFLOAT4();
+    return obb;
+}
 
+// Tests mesh bounding boxes against a culling volume, and produces a buffer of visible mesh indices
+template<typename TVolume> static uint64 CullMeshBoxes(const TVolume& volume, const Array<DirectX::BoundingBox>& boundingBoxes, Array<uint32>& drawIndices)
+{
     uint64 numVisible = 0;
     const uint64 numMeshes = boundingBoxes.Size();
     for(uint64 i = 0; i < numMeshes; ++i)
     {
-        if(obb.Intersects(boundingBoxes[i]))
+        if(volume.Intersects(boundingBoxes[i]))
             drawIndices[numVisible++] = uint32(i);
     }
 
     return numVisible;
 }
 
+// Returns true if every triangle in the meshlet faces away from the camera
+static bool MeshletIsBackFacing(const Meshlet& meshlet, const Camera& camera)
+{
+    if(meshlet.ConeCutoff >= 1.0f)
+        return false;
+
+    Float3 viewDir = camera.Forward();
+    if(camera.IsOrthographic() == false)
+        viewDir = Float3::Normalize(meshlet.ConeApex - camera.Position());
+
+    return Float3::Dot(viewDir, meshlet.ConeAxis) >= meshlet.ConeCutoff;
+}
+
+// Culls the meshlets of the visible meshes that are drawn at full detail against the volume and the
+// camera, and produces a list of index ranges to draw. Meshes without meshlets or with a simplified
+// LOD get a range for each of their parts. Adjacent visible meshlets are merged into a single range,
+// which can cross mesh parts when mergeParts is true.
+template<typename TVolume> static void CullMeshlets(const TVolume& volume, const Camera& camera, const uint32* lodLevels,
+                                                    const Model& model, const Array<DirectX::BoundingSphere>& boundingSpheres,
+                                                    const uint32* meshIndices, uint64 numMeshes, bool mergeParts,
+                                                    GrowableList<MeshDrawRange>& drawRanges)
+{
+    drawRanges.RemoveAll();
+
+    for(uint64 i = 0; i < numMeshes; ++i)
+    {
+        const uint32 meshIdx = meshIndices[i];
+        const Mesh& mesh = model.Meshes()[meshIdx];
+
+        const uint64 lodLevel = lodLevels[meshIdx];
+        if(mesh.NumMeshlets() == 0 || lodLevel > 0)
+        {
+            const MeshPart* parts = model.LODParts(mesh, lodLevel);
+            for(uint64 partIdx = 0; partIdx < mesh.NumMeshParts(); ++partIdx)
+            {
+                const MeshPart& part = parts[partIdx];
+                if(part.IndexCount == 0)
+                    continue;
+
+                MeshDrawRange range;
+                range.MeshIdx = meshIdx;
+                range.PartIdx = uint32(partIdx);
+                range.IndexStart = part.IndexStart;
+                range.IndexCount = part.IndexCount;
+                drawRanges.Add(range);
+            }
+
+            continue;
+        }
+
+        bool appendToLast = false;
+        for(uint32 meshletIdx = mesh.FirstMeshlet(); meshletIdx < mesh.FirstMeshlet() + mesh.NumMeshlets(); ++meshletIdx)
+        {
+            const Meshlet& meshlet = model.Meshlets()[meshletIdx];
+            if(volume.Intersects(boundingSpheres[meshletIdx]) == false || MeshletIsBackFacing(meshlet, camera))
+            {
+                appendToLast = false;
+                continue;
+            }
+
+            if(appendToLast && (mergeParts || drawRanges[drawRanges.Count() - 1].PartIdx == meshlet.MeshPartIdx))
+            {
+                drawRanges[drawRanges.Count() - 1].IndexCount += meshlet.IndexCount;
+            }
+            else
+            {
+                MeshDrawRange range;
+                range.MeshIdx = meshIdx;
+                range.PartIdx = meshlet.MeshPartIdx;
+                range.IndexStart = meshlet.IndexStart;
+                range.IndexCount = meshlet.IndexCount;
+                drawRanges.Add(range);
+            }
+
+            appendToLast = true;
+        }
+    }
+}
+
+// Gets the descriptor indices of each material's textures, for the material buffer
+static void GetMaterialBufferData(const Model& model, Array<Material>& matBufferData)
+{
+    const Array<MeshMaterial>& materials = model.Materials();
+    const uint64 numMaterials = materials.Size();
+    matBufferData.Init(numMaterials);
+    for(uint64 i = 0; i < numMaterials; ++i)
+    {
+        Material& matIndices = matBufferData[i];
+        const MeshMaterial& material = materials[i];
+
+        matIndices.Albedo = material.Textures[uint64(MaterialTextures::Albedo)]->SRV;
+        matIndices.Normal = material.Textures[uint64(MaterialTextures::Normal)]->SRV;
+        matIndices.Roughness = material.Textures[uint64(MaterialTextures::Roughness)]->SRV;
+        matIndices.Metallic = material.Textures[uint64(MaterialTextures::Metallic)]->SRV;
+        matIndices.Emissive = material.Textures[uint64(MaterialTextures::Emissive)]->SRV;
+
+        // Opacity is optional
+        const Texture* opacity = material.Textures[uint64(MaterialTextures::Opacity)];
+        matIndices.Opacity = opacity ? opacity->SRV : uint32(-1);
+    }
+}
+
 MeshRenderer::MeshRenderer()
 {
 }
@@ -106,6 +206,10 @@ void MeshRenderer::LoadShaders()
     meshVS = CompileFromFile(L"Mesh.hlsl", "VS", ShaderType::Vertex, opts);
     meshPS = CompileFromFile(L"Mesh.hlsl", "PSForward", ShaderType::Pixel, opts);
 
+    opts.Add("CompactVertices_", 1);
+    meshCompactVS = CompileFromFile(L"Mesh.hlsl", "VS", ShaderType::Vertex, opts);
+
+    opts.Reset();
     opts.Add("AlphaTest_", 1);
     meshAlphaTestPS = CompileFromFile(L"Mesh.hlsl", "PSForward", ShaderType::Pixel, opts);
 }
@@ -117,6 +221,7 @@ void MeshRenderer::Initialize(const Model* model_)
 
     const uint64 numMeshes = model->Meshes().Size();
     meshBoundingBoxes.Init(numMeshes);
+    meshLODLevels.Init(numMeshes, 0);
     frustumCulledIndices.Init(numMeshes, uint32(-1));
     meshZDepths.Init(numMeshes, FloatMax);
     for(uint64 i = 0; i < numMeshes; ++i)
@@ -129,6 +234,15 @@ void MeshRenderer::Initialize(const Model* model_)
         boundingBox.Extents = extents.ToXMFLOAT3();
     }
 
+    const uint64 numMeshlets = model->Meshlets().Size();
+    meshletBoundingSpheres.Init(numMeshlets);
+    for(uint64 i = 0; i < numMeshlets; ++i)
+    {
+        const Meshlet& meshlet = model->Meshlets()[i];
+        meshletBoundingSpheres[i].Center = meshlet.BoundsCenter.ToXMFLOAT3();
+        meshletBoundingSpheres[i].Radius = meshlet.BoundsRadius;
+    }
+
     LoadShaders();
 
     {
@@ -156,30 +270,16 @@ void MeshRenderer::Initialize(const Model* model_)
     }
 
     {
-        // Create a structured buffer containing texture indices per-material
-        const Array<MeshMaterial>& materials = model->Materials();
-        const uint64 numMaterials = materials.Size();
-        Array<Material> matBufferData(numMaterials);
-        for(uint64 i = 0; i < numMaterials; ++i)
-        {
-            Material& matIndices = matBufferData[i];
-            const MeshMaterial& material = materials[i];
-
-            matIndices.Albedo = material.Textures[uint64(MaterialTextures::Albedo)]->SRV;
-            matIndices.Normal = material.Textures[uint64(MaterialTextures::Normal)]->SRV;
-            matIndices.Roughness = material.Textures[uint64(MaterialTextures::Roughness)]->SRV;
-            matIndices.Metallic = material.Textures[uint64(MaterialTextures::Metallic)]->SRV;
-            matIndices.Emissive = material.Textures[uint64(MaterialTextures::Emissive)]->SRV;
-
-            // Opacity is optional
-            const Texture* opacity = material.Textures[uint64(MaterialTextures::Opacity)];
-            matIndices.Opacity = opacity ? opacity->SRV : uint32(-1);
-        }
+        // Create a structured buffer containing texture indices per-material. It's dynamic so that
+        // the indices can change as textures are streamed in.
+        Array<Material> matBufferData;
+        GetMaterialBufferData(*model, matBufferData);
 
         StructuredBufferInit sbInit;
         sbInit.Stride = sizeof(Material);
-        sbInit.NumElements = numMaterials;
-        sbInit.Dynamic = false;
+        sbInit.NumElements = matBufferData.Size();
+        sbInit.Dynamic = true;
+        sbInit.CPUAccessible = true;
         sbInit.InitData = matBufferData.Data();
         materialBuffer.Initialize(sbInit);
         materialBuffer.Resource()->SetName(L"Material Texture Indices");
@@ -280,6 +380,15 @@ void MeshRenderer::Initialize(const Model* model_)
     }
 }
 
+// Updates the texture indices in the material buffer, which needs to happen whenever the model's
+// materials switch textures. This can only be done once per frame.
+void MeshRenderer::UpdateMaterialBuffer()
+{
+    Array<Material> matBufferData;
+    GetMaterialBufferData(*model, matBufferData);
+    materialBuffer.MapAndSetData(matBufferData.Data(), matBufferData.Size());
+}
+
 void MeshRenderer::Shutdown()
 {
     DestroyPSOs();
@@ -298,11 +407,17 @@ void MeshRenderer::CreatePSOs(DXGI_FORMAT mainRTFormat, DXGI_FORMAT depthFormat,
 
     ID3D12Device* device = DX12::Device;
 
+    // Models with compact vertices need a different input layout, and a vertex shader that decodes them
+    const CompiledShaderPtr& vertexShader = model->CompactVertices() ? meshCompactVS : meshVS;
+    D3D12_INPUT_LAYOUT_DESC inputLayout = { };
+    inputLayout.NumElements = uint32(model->CompactVertices() ? Model::NumCompactInputElements() : Model::NumInputElements());
+    inputLayout.pInputElementDescs = model->CompactVertices() ? Model::CompactInputElements() : Model::InputElements();
+
     {
         // Main pass PSO
         D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
         psoDesc.pRootSignature = mainPassRootSignature;
-        psoDesc.VS = meshVS.ByteCode();
+        psoDesc.VS = vertexShader.ByteCode();
         psoDesc.PS = meshPS.ByteCode();
         psoDesc.RasterizerState = DX12::GetRasterizerState(RasterizerState::BackFaceCull);
         psoDesc.BlendState = DX12::GetBlendState(BlendState::Disabled);
@@ -314,8 +429,7 @@ void MeshRenderer::CreatePSOs(DXGI_FORMAT mainRTFormat, DXGI_FORMAT depthFormat,
         psoDesc.DSVFormat = depthFormat;
         psoDesc.SampleDesc.Count = numMSAASamples;
         psoDesc.SampleDesc.Quality = numMSAASamples > 1 ? DX12::StandardMSAAPattern : 0;
-        psoDesc.InputLayout.NumElements = uint32(Model::NumInputElements());
-        psoDesc.InputLayout.pInputElementDescs = Model::InputElements();
+        psoDesc.InputLayout = inputLayout;
         DXCall(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&mainPassPSO)));
 
         psoDesc.PS = meshAlphaTestPS.ByteCode();
@@ -326,7 +440,7 @@ void MeshRenderer::CreatePSOs(DXGI_FORMAT mainRTFormat, DXGI_FORMAT depthFormat,
         // Depth-only PSO
         D3D12_GRAPHICS_PIPELINE_STATE_DESC psoDesc = {};
         psoDesc.pRootSignature = depthRootSignature;
-        psoDesc.VS = meshVS.ByteCode();
+        psoDesc.VS = vertexShader.ByteCode();
         psoDesc.RasterizerState = DX12::GetRasterizerState(RasterizerState::BackFaceCull);
         psoDesc.BlendState = DX12::GetBlendState(BlendState::Disabled);
         psoDesc.DepthStencilState = DX12::GetDepthState(DepthState::WritesEnabled);
@@ -336,8 +450,7 @@ void MeshRenderer::CreatePSOs(DXGI_FORMAT mainRTFormat, DXGI_FORMAT depthFormat,
         psoDesc.DSVFormat = depthFormat;
         psoDesc.SampleDesc.Count = numMSAASamples;
         psoDesc.SampleDesc.Quality = numMSAASamples > 1 ? DX12::StandardMSAAPattern : 0;
-        psoDesc.InputLayout.NumElements = uint32(Model::NumInputElements());
-        psoDesc.InputLayout.pInputElementDescs = Model::InputElements();
+        psoDesc.InputLayout = inputLayout;
         DXCall(device->CreateGraphicsPipelineState(&psoDesc, IID_PPV_ARGS(&depthPSO)));
 
         // Spotlight shadow depth PSO
@@ -365,13 +478,23 @@ void MeshRenderer::DestroyPSOs()
     DX12::DeferredRelease(sunShadowPSO);
 }
 
+// Picks the LOD of every mesh for the frame. The shadow passes use the same LODs as the main pass,
+// since a caster drawn with a different LOD than the receiving surface would shadow itself.
+void MeshRenderer::SelectLODs(const Camera& camera, float viewportHeight)
+{
+    const Array<Mesh>& meshes = model->Meshes();
+    for(uint64 i = 0; i < meshes.Size(); ++i)
+        meshLODLevels[i] = uint32(model->SelectLOD(meshes[i], camera, viewportHeight));
+}
+
 // Renders all meshes in the model, with shadows
 void MeshRenderer::RenderMainPass(ID3D12GraphicsCommandList* cmdList, const Camera& camera, const MainPassData& mainPassData)
 {
     PIXMarker marker(cmdList, "Mesh Rendering");
 
-    const uint64 numVisible = CullMeshes(camera, meshBoundingBoxes, frustumCulledIndices);
-    const uint32* meshDrawIndices = frustumCulledIndices.Data();
+    const DirectX::BoundingFrustum frustum = MakeCullingFrustum(camera);
+    const uint64 numVisible = CullMeshBoxes(frustum, meshBoundingBoxes, frustumCulledIndices);
+    CullMeshlets(frustum, camera, meshLODLevels.Data(), *model, meshletBoundingSpheres, frustumCulledIndices.Data(), numVisible, false, drawRanges);
 
     cmdList->SetGraphicsRootSignature(mainPassRootSignature);
     cmdList->SetPipelineState(mainPassPSO);
@@ -388,6 +511,8 @@ void MeshRenderer::RenderMainPass(ID3D12GraphicsCommandList* cmdList, const Came
     vsConstants.World = world;
     vsConstants.View = camera.ViewMatrix();
     vsConstants.WorldViewProjection = world * camera.ViewProjectionMatrix();
+    vsConstants.PositionScale = model->PositionScale();
+    vsConstants.PositionOffset = model->PositionOffset();
     DX12::BindTempConstantBuffer(cmdList, vsConstants, MainPass_VSCBuffer, CmdListMode::Graphics);
 
     ShadingConstants psConstants;
@@ -421,47 +546,48 @@ void MeshRenderer::RenderMainPass(ID3D12GraphicsCommandList* cmdList, const Came
 
     DX12::BindTempConstantBuffer(cmdList, psSRVs, MainPass_SRVIndices, CmdListMode::Graphics);
 
-    // Bind vertices and indices
+    // Bind vertices. Each mesh has its own index buffer view, since the index size can differ per mesh
     D3D12_VERTEX_BUFFER_VIEW vbView = model->VertexBuffer().VBView();
-    D3D12_INDEX_BUFFER_VIEW ibView = model->IndexBuffer().IBView();
     cmdList->IASetVertexBuffers(0, 1, &vbView);
-    cmdList->IASetIndexBuffer(&ibView);
 
     // Draw all visible meshes
     uint32 currMaterial = uint32(-1);
-    for(uint64 i = 0; i < numVisible; ++i)
+    uint32 currMesh = uint32(-1);
+    const uint64 numRanges = drawRanges.Count();
+    for(uint64 i = 0; i < numRanges; ++i)
     {
-        uint64 meshIdx = meshDrawIndices[i];
-        const Mesh& mesh = model->Meshes()[meshIdx];
-
-        // Draw all parts
-        for(uint64 partIdx = 0; partIdx < mesh.NumMeshParts(); ++partIdx)
+        const MeshDrawRange& range = drawRanges[i];
+        const Mesh& mesh = model->Meshes()[range.MeshIdx];
+        const MeshPart& part = mesh.MeshParts()[range.PartIdx];
+        if(range.MeshIdx != currMesh)
         {
-            const MeshPart& part = mesh.MeshParts()[partIdx];
-            if(part.MaterialIdx != currMaterial)
-            {
-                cmdList->SetGraphicsRoot32BitConstant(MainPass_MatIndexCBuffer, part.MaterialIdx, 0);
-                currMaterial = part.MaterialIdx;
-            }
+            cmdList->IASetIndexBuffer(mesh.IBView());
+            currMesh = range.MeshIdx;
+        }
 
-            ID3D12PipelineState* newPSO = mainPassPSO;
-            const MeshMaterial& material = model->Materials()[part.MaterialIdx];
-            if(material.Textures[uint64(MaterialTextures::Opacity)] != nullptr)
-                newPSO = mainPassAlphaTestPSO;
+        if(part.MaterialIdx != currMaterial)
+        {
+            cmdList->SetGraphicsRoot32BitConstant(MainPass_MatIndexCBuffer, part.MaterialIdx, 0);
+            currMaterial = part.MaterialIdx;
+        }
 
-            if(currPSO != newPSO)
-            {
-                cmdList->SetPipelineState(newPSO);
-                currPSO = newPSO;
-            }
+        ID3D12PipelineState* newPSO = mainPassPSO;
+        const MeshMaterial& material = model->Materials()[part.MaterialIdx];
+        if(material.Textures[uint64(MaterialTextures::Opacity)] != nullptr)
+            newPSO = mainPassAlphaTestPSO;
 
-            cmdList->DrawIndexedInstanced(part.IndexCount, 1, mesh.IndexOffset() + part.IndexStart, mesh.VertexOffset(), 0);
+        if(currPSO != newPSO)
+        {
+            cmdList->SetPipelineState(newPSO);
+            currPSO = newPSO;
         }
+
+        cmdList->DrawIndexedInstanced(range.IndexCount, 1, range.IndexStart, mesh.VertexOffset(), 0);
     }
 }
 
 // Renders all meshes using depth-only rendering
-void MeshRenderer::RenderDepth(ID3D12GraphicsCommandList* cmdList, const Camera& camera, ID3D12PipelineState* pso, uint64 numVisible, const uint32* meshDrawIndices)
+void MeshRenderer::RenderDepth(ID3D12GraphicsCommandList* cmdList, const Camera& camera, ID3D12PipelineState* pso)
 {
     cmdList->SetGraphicsRootSignature(depthRootSignature);
     cmdList->SetPipelineState(pso);
@@ -474,36 +600,46 @@ void MeshRenderer::RenderDepth(ID3D12GraphicsCommandList* cmdList, const Camera&
     vsConstants.World = world;
     vsConstants.View = camera.ViewMatrix();
     vsConstants.WorldViewProjection = world * camera.ViewProjectionMatrix();
+    vsConstants.PositionScale = model->PositionScale();
+    vsConstants.PositionOffset = model->PositionOffset();
     DX12::BindTempConstantBuffer(cmdList, vsConstants, 0, CmdListMode::Graphics);
 
-    // Bind vertices and indices
+    // Bind vertices. Each mesh has its own index buffer view, since the index size can differ per mesh
     D3D12_VERTEX_BUFFER_VIEW vbView = model->VertexBuffer().VBView();
-    D3D12_INDEX_BUFFER_VIEW ibView = model->IndexBuffer().IBView();
     cmdList->IASetVertexBuffers(0, 1, &vbView);
-    cmdList->IASetIndexBuffer(&ibView);
 
-    // Draw all meshes
-    for(uint64 i = 0; i < numVisible; ++i)
+    // Draw all visible ranges
+    uint32 currMesh = uint32(-1);
+    const uint64 numRanges = drawRanges.Count();
+    for(uint64 i = 0; i < numRanges; ++i)
     {
-        uint64 meshIdx = meshDrawIndices[i];
-        const Mesh& mesh = model->Meshes()[meshIdx];
+        const MeshDrawRange& range = drawRanges[i];
+        const Mesh& mesh = model->Meshes()[range.MeshIdx];
+        if(range.MeshIdx != currMesh)
+        {
+            cmdList->IASetIndexBuffer(mesh.IBView());
+            currMesh = range.MeshIdx;
+        }
 
-        // Draw the whole mesh
-        cmdList->DrawIndexedInstanced(mesh.NumIndices(), 1, mesh.IndexOffset(), mesh.VertexOffset(), 0);
+        cmdList->DrawIndexedInstanced(range.IndexCount, 1, range.IndexStart, mesh.VertexOffset(), 0);
     }
 }
 
 // Renders all meshes using depth-only rendering for a sun shadow map
 void MeshRenderer::RenderSunShadowDepth(ID3D12GraphicsCommandList* cmdList, const OrthographicCamera& camera)
 {
-    const uint64 numVisible = CullMeshesOrthographic(camera, true, meshBoundingBoxes, frustumCulledIndices);
-    RenderDepth(cmdList, camera, sunShadowPSO, numVisible, frustumCulledIndices.Data());
+    const DirectX::BoundingOrientedBox obb = MakeCullingOBB(camera, true);
+    const uint64 numVisible = CullMeshBoxes(obb, meshBoundingBoxes, frustumCulledIndices);
+    CullMeshlets(obb, camera, meshLODLevels.Data(), *model, meshletBoundingSpheres, frustumCulledIndices.Data(), numVisible, true, drawRanges);
+    RenderDepth(cmdList, camera, sunShadowPSO);
 }
 
 void MeshRenderer::RenderSpotLightShadowDepth(ID3D12GraphicsCommandList* cmdList, const Camera& camera)
 {
-    const uint64 numVisible = CullMeshes(camera, meshBoundingBoxes, frustumCulledIndices);
-    RenderDepth(cmdList, camera, spotLightShadowPSO, numVisible, frustumCulledIndices.Data());
+    const DirectX::BoundingFrustum frustum = MakeCullingFrustum(camera);
+    const uint64 numVisible = CullMeshBoxes(frustum, meshBoundingBoxes, frustumCulledIndices);
+    CullMeshlets(frustum, camera, meshLODLevels.Data(), *model, meshletBoundingSpheres, frustumCulledIndices.Data(), numVisible, true, drawRanges);
+    RenderDepth(cmdList, camera, spotLightShadowPSO);
 }
 
 // Renders meshes using cascaded shadow mapping
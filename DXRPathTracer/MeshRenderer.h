@@ -53,6 +53,16 @@ struct ShadingConstants
     Float4Align ShaderSH9Color SkySH;
 };
 
+// Range of a mesh's indices that passed culling, which is either a whole mesh part, a part of a
+// simplified LOD, or a run of visible meshlets
+struct MeshDrawRange
+{
+    uint32 MeshIdx = 0;
+    uint32 PartIdx = 0;
+    uint32 IndexStart = 0;      // Relative to the mesh
+    uint32 IndexCount = 0;
+};
+
 class MeshRenderer
 {
 
@@ -64,9 +74,13 @@ public:
     void Initialize(const Model* sceneModel);
     void Shutdown();
 
+    void UpdateMaterialBuffer();
+
     void CreatePSOs(DXGI_FORMAT mainRTFormat, DXGI_FORMAT depthFormat, uint32 numMSAASamples);
     void DestroyPSOs();
 
+    void SelectLODs(const Camera& camera, float viewportHeight);
+
     void RenderMainPass(ID3D12GraphicsCommandList* cmdList, const Camera& camera, const MainPassData& mainPassData);
 
     void RenderSunShadowDepth(ID3D12GraphicsCommandList* cmdList, const OrthographicCamera& camera);
@@ -81,7 +95,7 @@ public:
 protected:
 
     void LoadShaders();
-    void RenderDepth(ID3D12GraphicsCommandList* cmdList, const Camera& camera, ID3D12PipelineState* pso, uint64 numVisible, const uint32* meshDrawIndices);
+    void RenderDepth(ID3D12GraphicsCommandList* cmdList, const Camera& camera, ID3D12PipelineState* pso);
 
     const Model* model = nullptr;
 
@@ -92,6 +106,7 @@ protected:
     StructuredBuffer materialBuffer;
 
     CompiledShaderPtr meshVS;
+    CompiledShaderPtr meshCompactVS;
     CompiledShaderPtr meshPS;
     CompiledShaderPtr meshAlphaTestPS;
     ID3D12PipelineState* mainPassPSO = nullptr;
@@ -106,6 +121,9 @@ protected:
 
     Array<DirectX::BoundingBox> meshBoundingBoxes;
     Array<uint32> frustumCulledIndices;
+    Array<uint32> meshLODLevels;
+    Array<DirectX::BoundingSphere> meshletBoundingSpheres;
+    GrowableList<MeshDrawRange> drawRanges;
     Array<float> meshZDepths;
 
     SunShadowConstantsDepthMap sunShadowConstants;
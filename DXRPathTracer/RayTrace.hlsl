@@ -30,7 +30,7 @@ struct RayTraceConstants
     float3 SunIrradiance;
     float SinSunAngularRadius;
     float3 SunRenderColor;
-    uint Padding;
+    uint CompactVertices;
     float3 CameraPosWS;
     uint CurrSampleIdx;
     uint TotalNumPixels;
@@ -41,6 +41,10 @@ struct RayTraceConstants
     uint MaterialBufferIdx;
     uint SkyTextureIdx;
     uint NumLights;
+
+    float3 PositionScale;
+    float3 PositionOffset;
+    uint BlueNoiseBufferIdx;
 };
 
 struct LightConstants
@@ -84,8 +88,25 @@ enum RayTypes {
 
 static float2 SamplePoint(in uint pixelIdx, inout uint setIdx)
 {
-    const uint permutation = setIdx * RayTraceCB.TotalNumPixels + pixelIdx;
+    const uint dimIdx = setIdx;
     setIdx += 1;
+    if(AppSettings.SampleMode == SampleModes_Sobol)
+        return SampleSobol2D(RayTraceCB.CurrSampleIdx, dimIdx, pixelIdx);
+
+    if(AppSettings.SampleMode == SampleModes_BlueNoise)
+    {
+        // The tiles only cover the first NumSampleSets pairs of dimensions
+        if(dimIdx >= NumSampleSets)
+            return SampleSobol2D(RayTraceCB.CurrSampleIdx, dimIdx, pixelIdx);
+
+        // Scramble seed in x, rank key in y (see BlueNoiseTiles.h)
+        StructuredBuffer<uint2> blueNoiseKeys = ResourceDescriptorHeap[RayTraceCB.BlueNoiseBufferIdx];
+        const uint2 tilePos = DispatchRaysIndex().xy % SampleTileSize;
+        const uint2 keys = blueNoiseKeys[(dimIdx * SampleTileSize + tilePos.y) * SampleTileSize + tilePos.x];
+        return SampleSobol2DFromSeed(RayTraceCB.CurrSampleIdx ^ keys.y, keys.x);
+    }
+
+    const uint permutation = dimIdx * RayTraceCB.TotalNumPixels + pixelIdx;
     return SampleCMJ2D(RayTraceCB.CurrSampleIdx, AppSettings.SqrtNumSamples, AppSettings.SqrtNumSamples, permutation);
 }
 
@@ -440,6 +461,24 @@ static float3 PathTrace(in MeshVertex hitSurface, in Material material, in Prima
     return radiance;
 }
 
+// Loads the 3 indices of a triangle from the raw index buffer, which can hold 16-bit or 32-bit
+// indices depending on the mesh. 16-bit triangles are only 2-byte aligned, so they're loaded from
+// the enclosing pair of 32-bit words and unpacked.
+uint3 LoadTriangleIndices(in GeometryInfo geoInfo, in uint primIdx)
+{
+    ByteAddressBuffer idxBuffer = ResourceDescriptorHeap[RayTraceCB.IdxBufferIdx];
+
+    if(geoInfo.IndexType != 0)
+        return idxBuffer.Load3(geoInfo.IdxByteOffset + primIdx * 12);
+
+    const uint byteOffset = geoInfo.IdxByteOffset + primIdx * 6;
+    const uint2 words = idxBuffer.Load2(byteOffset & ~3);
+    if((byteOffset & 2) == 0)
+        return uint3(words.x & 0xFFFF, words.x >> 16, words.y & 0xFFFF);
+    else
+        return uint3(words.x >> 16, words.y & 0xFFFF, words.y >> 16);
+}
+
 // Loops up the vertex data for the hit triangle and interpolates its attributes
 MeshVertex GetHitSurface(in HitAttributes attr, in uint geometryIdx)
 {
@@ -448,17 +487,26 @@ MeshVertex GetHitSurface(in HitAttributes attr, in uint geometryIdx)
     StructuredBuffer<GeometryInfo> geoInfoBuffer = ResourceDescriptorHeap[RayTraceCB.GeometryInfoBufferIdx];
     const GeometryInfo geoInfo = geoInfoBuffer[geometryIdx];
 
-    StructuredBuffer<MeshVertex> vtxBuffer = ResourceDescriptorHeap[RayTraceCB.VtxBufferIdx];
-    Buffer<uint> idxBuffer = ResourceDescriptorHeap[RayTraceCB.IdxBufferIdx];
+    const uint3 triIndices = LoadTriangleIndices(geoInfo, PrimitiveIndex());
+    const uint idx0 = triIndices.x;
+    const uint idx1 = triIndices.y;
+    const uint idx2 = triIndices.z;
 
-    const uint primIdx = PrimitiveIndex();
-    const uint idx0 = idxBuffer[primIdx * 3 + geoInfo.IdxOffset + 0];
-    const uint idx1 = idxBuffer[primIdx * 3 + geoInfo.IdxOffset + 1];
-    const uint idx2 = idxBuffer[primIdx * 3 + geoInfo.IdxOffset + 2];
-
-    const MeshVertex vtx0 = vtxBuffer[idx0 + geoInfo.VtxOffset];
-    const MeshVertex vtx1 = vtxBuffer[idx1 + geoInfo.VtxOffset];
-    const MeshVertex vtx2 = vtxBuffer[idx2 + geoInfo.VtxOffset];
+    MeshVertex vtx0, vtx1, vtx2;
+    if(RayTraceCB.CompactVertices)
+    {
+        StructuredBuffer<CompactMeshVertex> vtxBuffer = ResourceDescriptorHeap[RayTraceCB.VtxBufferIdx];
+        vtx0 = DecodeCompactVertex(vtxBuffer[idx0 + geoInfo.VtxOffset], RayTraceCB.PositionScale, RayTraceCB.PositionOffset);
+        vtx1 = DecodeCompactVertex(vtxBuffer[idx1 + geoInfo.VtxOffset], RayTraceCB.PositionScale, RayTraceCB.PositionOffset);
+        vtx2 = DecodeCompactVertex(vtxBuffer[idx2 + geoInfo.VtxOffset], RayTraceCB.PositionScale, RayTraceCB.PositionOffset);
+    }
+    else
+    {
+        StructuredBuffer<MeshVertex> vtxBuffer = ResourceDescriptorHeap[RayTraceCB.VtxBufferIdx];
+        vtx0 = vtxBuffer[idx0 + geoInfo.VtxOffset];
+        vtx1 = vtxBuffer[idx1 + geoInfo.VtxOffset];
+        vtx2 = vtxBuffer[idx2 + geoInfo.VtxOffset];
+    }
 
     return BarycentricLerp(vtx0, vtx1, vtx2, barycentrics);
 }
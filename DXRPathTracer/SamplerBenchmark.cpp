@@ -0,0 +1,433 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#include <PCH.h>
+
+#include <Utility.h>
+#include <Timer.h>
+#include <FileIO.h>
+#include <Containers.h>
+#include <Graphics/Sampling.h>
+
+#include "SamplerBenchmark.h"
+#include "AppSettings.h"
+
+using namespace SampleFramework12;
+
+static const uint32 NumTrials = 256;
+static const uint32 MaxDims = 4;
+static const uint32 NumSampleCounts = 5;
+static const uint32 SqrtSampleCounts[NumSampleCounts] = { 4, 8, 16, 32, 64 };
+static const uint32 NumTimingRuns = 16;
+
+// Computing the exact star discrepancy is O(N^2), so it uses fewer trials than the error measurements
+static const uint32 NumDiscrepancyTrials = 16;
+
+static const double GaussianSigma = 0.15;
+static const float GGXRoughness = 0.5f;
+static const float GGXConeCosTheta = 0.8f;
+
+enum class BenchmarkSamplers
+{
+    Random = 0,
+    Stratified,
+    Grid,
+    Hammersley,
+    LatinHypercube,
+    CMJ,
+    Sobol,
+    BlueNoise,
+
+    NumValues
+};
+
+static const char* SamplerNames[] = { "Random", "Stratified", "Grid", "Hammersley", "Latin Hypercube", "CMJ", "Sobol", "Blue-Noise Sobol" };
+StaticAssert_(ArraySize_(SamplerNames) == uint64(BenchmarkSamplers::NumValues));
+
+typedef double (*IntegrandFunction)(const float* u);
+
+struct Integrand
+{
+    const char* Name;
+    uint32 NumDims;
+    IntegrandFunction Function;
+    double Reference;
+};
+
+static double QuarterDisc(const float* u)
+{
+    return u[0] * u[0] + u[1] * u[1] < 1.0f ? 1.0 : 0.0;
+}
+
+static double Gaussian(const float* u)
+{
+    const double dx = u[0] - 0.5;
+    const double dy = u[1] - 0.5;
+    return std::exp(-(dx * dx + dy * dy) / (2.0 * GaussianSigma * GaussianSigma));
+}
+
+static double Bilinear(const float* u)
+{
+    return double(u[0]) * double(u[1]);
+}
+
+// Step along a line that isn't aligned with either axis, which has an area of 0.5 underneath it
+static double SlantedStep(const float* u)
+{
+    return u[1] < 0.3f + 0.4f * u[0] ? 1.0 : 0.0;
+}
+
+static double DiscTimesGaussian(const float* u)
+{
+    return QuarterDisc(u) * Gaussian(u + 2);
+}
+
+// Estimates the integral of a clamped cosine lobe (which is 1) by importance sampling a GGX
+// lobe with SampleDirectionGGX(), the same way that the path tracer samples specular bounces
+static double GGXCosine(const float* u)
+{
+    const Float3 n = Float3(0.0f, 0.0f, 1.0f);
+    const Float3 v = Float3::Normalize(Float3(1.0f, 0.0f, 1.0f));
+    const Float3 l = SampleDirectionGGX(v, n, GGXRoughness, Float3x3(), u[0], u[1]);
+    if(l.z <= 0.0f)
+        return 0.0;
+
+    const Float3 h = Float3::Normalize(v + l);
+    const float pdf = SampleDirectionGGX_PDF(n, h, v, GGXRoughness);
+    return pdf > 0.0f ? (l.z / Pi) / pdf : 0.0;
+}
+
+// Same as above, but for the solid angle of a cone around the normal. Looking straight down the
+// normal centers the GGX lobe on the cone, which leaves a discontinuity inside of the lobe.
+static double GGXCone(const float* u)
+{
+    const Float3 n = Float3(0.0f, 0.0f, 1.0f);
+    const Float3 l = SampleDirectionGGX(n, n, GGXRoughness, Float3x3(), u[0], u[1]);
+    if(l.z < GGXConeCosTheta)
+        return 0.0;
+
+    const Float3 h = Float3::Normalize(n + l);
+    const float pdf = SampleDirectionGGX_PDF(n, h, n, GGXRoughness);
+    return pdf > 0.0f ? 1.0 / pdf : 0.0;
+}
+
+static double GaussianReference()
+{
+    const double integral1D = GaussianSigma * std::sqrt(2.0 * Pi) * std::erf(0.5 / (GaussianSigma * std::sqrt(2.0)));
+    return integral1D * integral1D;
+}
+
+// Generates all of the samples for one pair of dimensions of pixel "trialIdx". CMJ, Sobol, and blue-noise
+// Sobol return the same 2D points that RayTrace.hlsl would get from SamplePoint(). Grid and Hammersley
+// always produce the same points, so they get a random toroidal shift [Cranley and Patterson 1976] for
+// each trial to keep the RMS error from measuring a single point set.
+static void GenerateSamples(BenchmarkSamplers sampler, uint32 sqrtNumSamples, uint32 trialIdx, uint32 pairIdx,
+                            const BlueNoiseTiles& blueNoiseTiles, Random& rng, Float2* samples)
+{
+    const uint32 numSamples = sqrtNumSamples * sqrtNumSamples;
+    if(sampler == BenchmarkSamplers::Random)
+        GenerateRandomSamples2D(samples, numSamples, rng);
+    else if(sampler == BenchmarkSamplers::Stratified)
+        GenerateStratifiedSamples2D(samples, sqrtNumSamples, sqrtNumSamples, rng);
+    else if(sampler == BenchmarkSamplers::Grid)
+        GenerateGridSamples2D(samples, sqrtNumSamples, sqrtNumSamples);
+    else if(sampler == BenchmarkSamplers::Hammersley)
+        GenerateHammersleySamples2D(samples, numSamples, pairIdx);
+    else if(sampler == BenchmarkSamplers::LatinHypercube)
+        GenerateLatinHypercubeSamples2D(samples, numSamples, rng);
+    else if(sampler == BenchmarkSamplers::CMJ)
+        GenerateCMJSamples2D(samples, sqrtNumSamples, sqrtNumSamples, pairIdx * NumTrials + trialIdx);
+    else if(sampler == BenchmarkSamplers::Sobol || pairIdx >= blueNoiseTiles.NumDims())
+        GenerateSobolSamples2D(samples, numSamples, pairIdx, trialIdx);
+    else
+    {
+        const uint32 pixelX = trialIdx % blueNoiseTiles.TileSize();
+        const uint32 pixelY = trialIdx / blueNoiseTiles.TileSize();
+        for(uint32 sampleIdx = 0; sampleIdx < numSamples; ++sampleIdx)
+            samples[sampleIdx] = blueNoiseTiles.Sample(sampleIdx, pixelX, pixelY, pairIdx);
+    }
+
+    if(sampler == BenchmarkSamplers::Grid || sampler == BenchmarkSamplers::Hammersley)
+    {
+        const Float2 shift = rng.RandomFloat2();
+        for(uint32 sampleIdx = 0; sampleIdx < numSamples; ++sampleIdx)
+        {
+            Float2& sample = samples[sampleIdx];
+            sample += shift;
+            sample.x = sample.x >= 1.0f ? sample.x - 1.0f : sample.x;
+            sample.y = sample.y >= 1.0f ? sample.y - 1.0f : sample.y;
+        }
+    }
+}
+
+static double IntegrationRMSE(const Integrand& integrand, BenchmarkSamplers sampler, uint32 sqrtNumSamples,
+                              const BlueNoiseTiles& blueNoiseTiles)
+{
+    const uint32 numSamples = sqrtNumSamples * sqrtNumSamples;
+    const uint32 numPairs = integrand.NumDims / 2;
+    Array<Float2> pairSamples[MaxDims / 2];
+    for(uint32 pairIdx = 0; pairIdx < numPairs; ++pairIdx)
+        pairSamples[pairIdx].Init(numSamples);
+
+    Random rng;
+    double sumSquaredError = 0.0;
+    for(uint32 trialIdx = 0; trialIdx < NumTrials; ++trialIdx)
+    {
+        for(uint32 pairIdx = 0; pairIdx < numPairs; ++pairIdx)
+            GenerateSamples(sampler, sqrtNumSamples, trialIdx, pairIdx, blueNoiseTiles, rng, pairSamples[pairIdx].Data());
+
+        double sum = 0.0;
+        for(uint32 sampleIdx = 0; sampleIdx < numSamples; ++sampleIdx)
+        {
+            float u[MaxDims] = { };
+            for(uint32 pairIdx = 0; pairIdx < numPairs; ++pairIdx)
+            {
+                u[pairIdx * 2 + 0] = pairSamples[pairIdx][sampleIdx].x;
+                u[pairIdx * 2 + 1] = pairSamples[pairIdx][sampleIdx].y;
+            }
+            sum += integrand.Function(u);
+        }
+
+        const double error = sum / numSamples - integrand.Reference;
+        sumSquaredError += error * error;
+    }
+
+    return std::sqrt(sumSquaredError / NumTrials);
+}
+
+static void InsertSorted(Array<float>& values, uint32& count, float value)
+{
+    const float* position = std::upper_bound(values.Data(), values.Data() + count, value);
+    const uint64 insertIdx = position - values.Data();
+    for(uint64 i = count; i > insertIdx; --i)
+        values[i] = values[i - 1];
+    values[insertIdx] = value;
+    ++count;
+}
+
+// Computes the exact star discrepancy of a 2D point set, which is the largest difference between the
+// area of a box anchored at the origin and the fraction of the points inside of it. It only needs to
+// check boxes whose corners line up with the points' coordinates, once counting the points on the
+// box's edges and once without them [Clerc 2013].
+static double StarDiscrepancy(const Float2* samples, uint32 numSamples)
+{
+    // The points sorted by x, and every y coordinate (plus the top of the square) sorted as box heights
+    Array<Float2> sortedSamples(numSamples);
+    Array<float> boxHeights(numSamples + 1);
+    for(uint32 i = 0; i < numSamples; ++i)
+    {
+        sortedSamples[i] = samples[i];
+        boxHeights[i] = samples[i].y;
+    }
+    boxHeights[numSamples] = 1.0f;
+    std::sort(sortedSamples.Data(), sortedSamples.Data() + numSamples, [](const Float2& a, const Float2& b) { return a.x < b.x; });
+    std::sort(boxHeights.Data(), boxHeights.Data() + numSamples + 1);
+
+    // Sorted y coordinates of the points that are strictly left of the box's right edge, and of
+    // the points that are on or left of it
+    Array<float> openHeights(numSamples);
+    Array<float> closedHeights(numSamples);
+    uint32 numOpen = 0;
+    uint32 numClosed = 0;
+
+    double discrepancy = 0.0;
+    uint32 sampleIdx = 0;
+    while(true)
+    {
+        const bool lastEdge = sampleIdx == numSamples;
+        const float boxWidth = lastEdge ? 1.0f : sortedSamples[sampleIdx].x;
+
+        uint32 groupEnd = sampleIdx;
+        while(groupEnd < numSamples && sortedSamples[groupEnd].x == boxWidth)
+            InsertSorted(closedHeights, numClosed, sortedSamples[groupEnd++].y);
+
+        uint32 openCount = 0;
+        uint32 closedCount = 0;
+        for(uint32 heightIdx = 0; heightIdx <= numSamples; ++heightIdx)
+        {
+            const float boxHeight = boxHeights[heightIdx];
+            while(openCount < numOpen && openHeights[openCount] < boxHeight)
+                ++openCount;
+            while(closedCount < numClosed && closedHeights[closedCount] <= boxHeight)
+                ++closedCount;
+
+            const double area = double(boxWidth) * double(boxHeight);
+            discrepancy = Max(discrepancy, area - double(openCount) / numSamples);
+            discrepancy = Max(discrepancy, double(closedCount) / numSamples - area);
+        }
+
+        if(lastEdge)
+            break;
+
+        for(; sampleIdx < groupEnd; ++sampleIdx)
+            InsertSorted(openHeights, numOpen, sortedSamples[sampleIdx].y);
+    }
+
+    return discrepancy;
+}
+
+static double AverageStarDiscrepancy(BenchmarkSamplers sampler, uint32 sqrtNumSamples, const BlueNoiseTiles& blueNoiseTiles)
+{
+    const uint32 numSamples = sqrtNumSamples * sqrtNumSamples;
+    Array<Float2> samples(numSamples);
+    Random rng;
+    double sum = 0.0;
+    for(uint32 trialIdx = 0; trialIdx < NumDiscrepancyTrials; ++trialIdx)
+    {
+        GenerateSamples(sampler, sqrtNumSamples, trialIdx, 0, blueNoiseTiles, rng, samples.Data());
+        sum += StarDiscrepancy(samples.Data(), numSamples);
+    }
+
+    return sum / NumDiscrepancyTrials;
+}
+
+// Times how long it takes to fill the sample sets for a batch of pixels, which is how sample tables get
+// filled and how the CPU path tracer consumes them
+static double NanosecondsPerSample(BenchmarkSamplers sampler, const BlueNoiseTiles& blueNoiseTiles, Array<Float2>& samples)
+{
+    const uint32 sqrtNumSamples = SqrtSampleCounts[NumSampleCounts - 1];
+    const uint32 numSamples = sqrtNumSamples * sqrtNumSamples;
+    samples.Init(numSamples);
+
+    // Reading the results keeps the optimizer from throwing away the work
+    Random rng;
+    float checksum = 0.0f;
+    Timer timer;
+    for(uint32 runIdx = 0; runIdx < NumTimingRuns; ++runIdx)
+    {
+        for(uint32 trialIdx = 0; trialIdx < NumTrials; ++trialIdx)
+        {
+            GenerateSamples(sampler, sqrtNumSamples, trialIdx, 0, blueNoiseTiles, rng, samples.Data());
+            checksum += samples[trialIdx % numSamples].x;
+        }
+    }
+    timer.Update();
+
+    if(checksum < 0.0f)
+        WriteLog("Sampler benchmark: negative checksum");
+
+    const double totalSamples = double(NumTimingRuns) * NumTrials * numSamples;
+    return timer.ElapsedMicrosecondsD() * 1000.0 / totalSamples;
+}
+
+// Fills a CMJ pattern for every pixel of every sample set tile, once one sample at a time and once with
+// the batched function, and returns the milliseconds taken by each
+static void TableGenerationMilliseconds(uint32 sqrtNumSamples, double& scalarMS, double& batchedMS)
+{
+    const uint32 numSamples = sqrtNumSamples * sqrtNumSamples;
+    const uint32 numPatterns = uint32(AppSettings::NumSampleSets * AppSettings::NumPixelsPerTile);
+    Array<float> samplesX(numSamples);
+    Array<float> samplesY(numSamples);
+
+    float checksum = 0.0f;
+    Timer timer;
+    for(uint32 patternIdx = 0; patternIdx < numPatterns; ++patternIdx)
+    {
+        for(uint32 sampleIdx = 0; sampleIdx < numSamples; ++sampleIdx)
+        {
+            const Float2 sample = SampleCMJ2D(sampleIdx, sqrtNumSamples, sqrtNumSamples, patternIdx);
+            samplesX[sampleIdx] = sample.x;
+            samplesY[sampleIdx] = sample.y;
+        }
+        checksum += samplesX[patternIdx % numSamples];
+    }
+    timer.Update();
+    scalarMS = timer.DeltaMillisecondsD();
+
+    for(uint32 patternIdx = 0; patternIdx < numPatterns; ++patternIdx)
+    {
+        GenerateCMJSamples2D(samplesX.Data(), samplesY.Data(), sqrtNumSamples, sqrtNumSamples, patternIdx);
+        checksum += samplesX[patternIdx % numSamples];
+    }
+    timer.Update();
+    batchedMS = timer.DeltaMillisecondsD();
+
+    if(checksum < 0.0f)
+        WriteLog("Sampler benchmark: negative checksum");
+}
+
+void RunSamplerBenchmark(const BlueNoiseTiles& blueNoiseTiles, const wchar* csvPath)
+{
+    Assert_(blueNoiseTiles.TileSize() * blueNoiseTiles.TileSize() >= NumTrials);
+
+    const Integrand integrands[] =
+    {
+        { "Quarter Disc", 2, QuarterDisc, Pi / 4.0 },
+        { "Gaussian", 2, Gaussian, GaussianReference() },
+        { "Bilinear", 2, Bilinear, 0.25 },
+        { "Slanted Step", 2, SlantedStep, 0.5 },
+        { "GGX Cosine", 2, GGXCosine, 1.0 },
+        { "GGX Cone", 2, GGXCone, Pi2 * (1.0 - GGXConeCosTheta) },
+        { "Disc x Gaussian (4D)", 4, DiscTimesGaussian, (Pi / 4.0) * GaussianReference() },
+    };
+
+    // One row per measurement, so that everything can go in one table
+    std::string csv = "Metric,Sampler,Integrand,SamplesPerPixel,Value\n";
+
+    const uint64 numSamplers = uint64(BenchmarkSamplers::NumValues);
+    for(uint64 integrandIdx = 0; integrandIdx < ArraySize_(integrands); ++integrandIdx)
+    {
+        const Integrand& integrand = integrands[integrandIdx];
+
+        for(uint64 samplerIdx = 0; samplerIdx < numSamplers; ++samplerIdx)
+        {
+            double rmse[NumSampleCounts] = { };
+            for(uint32 countIdx = 0; countIdx < NumSampleCounts; ++countIdx)
+            {
+                const uint32 numSamples = SqrtSampleCounts[countIdx] * SqrtSampleCounts[countIdx];
+                rmse[countIdx] = IntegrationRMSE(integrand, BenchmarkSamplers(samplerIdx), SqrtSampleCounts[countIdx], blueNoiseTiles);
+                csv += MakeString("RMSE,%s,%s,%u,%.6e\n", SamplerNames[samplerIdx], integrand.Name, numSamples, rmse[countIdx]);
+            }
+
+            // The slope of log(error) over log(sample count), where -0.5 is what plain random sampling gets
+            const double logCountRange = std::log(double(SqrtSampleCounts[NumSampleCounts - 1]) / SqrtSampleCounts[0]) * 2.0;
+            const double convergence = std::log(rmse[NumSampleCounts - 1] / rmse[0]) / logCountRange;
+            csv += MakeString("ConvergenceRate,%s,%s,,%.4f\n", SamplerNames[samplerIdx], integrand.Name, convergence);
+
+            WriteLog("Sampler benchmark [%s]: %s RMSE %.3e at %u spp, %.3e at %u spp, converges at N^%.2f",
+                     integrand.Name, SamplerNames[samplerIdx], rmse[0], SqrtSampleCounts[0] * SqrtSampleCounts[0],
+                     rmse[NumSampleCounts - 1], SqrtSampleCounts[NumSampleCounts - 1] * SqrtSampleCounts[NumSampleCounts - 1],
+                     convergence);
+        }
+    }
+
+    for(uint64 samplerIdx = 0; samplerIdx < numSamplers; ++samplerIdx)
+    {
+        for(uint32 countIdx = 0; countIdx < NumSampleCounts; ++countIdx)
+        {
+            const uint32 numSamples = SqrtSampleCounts[countIdx] * SqrtSampleCounts[countIdx];
+            const double discrepancy = AverageStarDiscrepancy(BenchmarkSamplers(samplerIdx), SqrtSampleCounts[countIdx], blueNoiseTiles);
+            csv += MakeString("StarDiscrepancy,%s,,%u,%.6e\n", SamplerNames[samplerIdx], numSamples, discrepancy);
+            WriteLog("Sampler benchmark: %s star discrepancy at %u spp is %.3e", SamplerNames[samplerIdx], numSamples, discrepancy);
+        }
+    }
+
+    Array<Float2> samples;
+    for(uint64 samplerIdx = 0; samplerIdx < numSamplers; ++samplerIdx)
+    {
+        const double nsPerSample = NanosecondsPerSample(BenchmarkSamplers(samplerIdx), blueNoiseTiles, samples);
+        csv += MakeString("MSamplesPerSecond,%s,,%u,%.3f\n", SamplerNames[samplerIdx], uint32(samples.Size()), 1000.0 / nsPerSample);
+        WriteLog("Sampler benchmark: %s takes %.2f ns per 2D sample (%.2f MSamples/s)",
+                 SamplerNames[samplerIdx], nsPerSample, 1000.0 / nsPerSample);
+    }
+
+    for(uint32 countIdx = 0; countIdx < NumSampleCounts; ++countIdx)
+    {
+        double scalarMS = 0.0;
+        double batchedMS = 0.0;
+        TableGenerationMilliseconds(SqrtSampleCounts[countIdx], scalarMS, batchedMS);
+        WriteLog("Sampler benchmark: %u spp CMJ tables for %llu sample sets take %.2f ms one sample at a time, %.2f ms batched%s",
+                 SqrtSampleCounts[countIdx] * SqrtSampleCounts[countIdx], AppSettings::NumSampleSets * AppSettings::NumPixelsPerTile,
+                 scalarMS, batchedMS, CPUSupportsAVX2() ? "" : " (no AVX2)");
+    }
+
+    WriteStringAsFile(csvPath, csv);
+    WriteLog(L"Sampler benchmark: wrote results to %ls", csvPath);
+}
\ No newline at end of file
@@ -0,0 +1,25 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include <PCH.h>
+
+#include <Graphics/BlueNoiseTiles.h>
+
+using namespace SampleFramework12;
+
+// Integrates a suite of analytic functions (discs, Gaussians, step functions, and GGX lobes sampled
+// with SampleDirectionGGX()) with every sampler in Sampling.h as well as the ones the path tracer
+// uses, and logs the RMS error over many differently-scrambled runs for a range of sample counts.
+// One of the functions uses two pairs of dimensions, to check that the pairs aren't correlated with
+// each other. The star discrepancy and generation cost of each sampler are also measured, and all of
+// the results are written to a CSV file.
+void RunSamplerBenchmark(const BlueNoiseTiles& blueNoiseTiles, const wchar* csvPath);
\ No newline at end of file
@@ -0,0 +1,439 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#include <PCH.h>
+
+#include <Utility.h>
+#include <Exceptions.h>
+#include <Graphics/DX12.h>
+
+#include "SceneStreamer.h"
+
+using namespace SampleFramework12;
+
+// Textures are loaded in small batches, so that a batch that's in flight doesn't hold up textures
+// that become more important while it loads
+static const uint64 MaxTextureLoadsPerBatch = 8;
+
+static uint64 TextureMemorySize(const Texture& texture)
+{
+    const D3D12_RESOURCE_DESC desc = texture.Resource->GetDesc();
+    return DX12::Device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+}
+
+// DDS files are about the same size as their texture. Other formats get decoded and have mips
+// generated, so this underestimates them until they've actually been loaded.
+static uint64 EstimateTextureSize(const std::wstring& filePath)
+{
+    WIN32_FILE_ATTRIBUTE_DATA attributes = { };
+    if(GetFileAttributesExW(filePath.c_str(), GetFileExInfoStandard, &attributes) == false)
+        return 0;
+    return (uint64(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+}
+
+void SceneStreamer::Initialize(Model* models_, uint64 numModels_, uint64 memoryBudget_, const LoadModelFunction& loadModel_)
+{
+    Assert_(models_ != nullptr);
+    Assert_(numModels_ > 0);
+
+    models = models_;
+    numModels = numModels_;
+    memoryBudget = memoryBudget_;
+    loadModel = loadModel_;
+
+    modelResident.Init(numModels, false);
+    modelLastUsedFrames.Init(numModels, 0);
+
+    modelLoadTask.m_Function = [this](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        try
+        {
+            loadModel(loadingModelIdx);
+        }
+        catch(Exception& exception)
+        {
+            // Exceptions can't leave a task, so they get re-thrown on the main thread
+            modelLoadError = exception.GetMessage();
+        }
+    };
+
+    textureLoadTask.m_Function = [this](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 i = range.start; i < range.end; ++i)
+        {
+            try
+            {
+                models[currentModelIdx].LoadTexture(loadingTextures[i]);
+            }
+            catch(Exception& exception)
+            {
+                textureLoadErrors[i] = exception.GetMessage();
+            }
+        }
+    };
+}
+
+void SceneStreamer::Shutdown()
+{
+    // Anything that's pending gets cleaned up when the models are shut down
+    Tasks::Scheduler().WaitforTaskSet(&modelLoadTask);
+    Tasks::Scheduler().WaitforTaskSet(&textureLoadTask);
+
+    loadingModelIdx = uint64(-1);
+    requestedModelIdx = uint64(-1);
+    currentModelIdx = uint64(-1);
+    loadingTextures.Shutdown();
+    pendingUnloads.Shutdown();
+    modelResident.Shutdown();
+    modelLastUsedFrames.Shutdown();
+    texturePriorities.Shutdown();
+    textureSizes.Shutdown();
+    textureLastUsedFrames.Shutdown();
+    textureOrder.Shutdown();
+    textureLoadErrors.Shutdown();
+    residentMemory = 0;
+    numPendingTextures = 0;
+    models = nullptr;
+    numModels = 0;
+}
+
+void SceneStreamer::RequestModel(uint64 modelIdx)
+{
+    Assert_(modelIdx < numModels);
+    requestedModelIdx = uint64(-1);
+    if(modelResident[modelIdx] || loadingModelIdx == modelIdx)
+        return;
+
+    if(loadingModelIdx != uint64(-1))
+    {
+        // It gets started once the current load finishes
+        requestedModelIdx = modelIdx;
+        return;
+    }
+
+    loadingModelIdx = modelIdx;
+    modelLoadError = L"";
+    modelLoadTask.m_SetSize = 1;
+    Tasks::Scheduler().AddTaskSetToPipe(&modelLoadTask);
+}
+
+void SceneStreamer::SetCurrentModel(uint64 modelIdx)
+{
+    Assert_(modelIdx < numModels);
+    if(modelIdx == currentModelIdx)
+        return;
+
+    // The texture loads are always for the current model, so the batch in flight needs to finish first
+    if(loadingTextures.Count() > 0)
+    {
+        Tasks::Scheduler().WaitforTaskSet(&textureLoadTask);
+        FinishTextureLoads();
+    }
+
+    // Models can also be loaded without going through the streamer, like the first scene
+    if(modelResident[modelIdx] == false)
+    {
+        Assert_(models[modelIdx].NumMeshes() > 0);
+        Assert_(loadingModelIdx != modelIdx);
+        modelResident[modelIdx] = true;
+        residentMemory += ModelMemorySize(modelIdx);
+    }
+
+    currentModelIdx = modelIdx;
+    modelLastUsedFrames[modelIdx] = DX12::CurrentCPUFrame;
+
+    const GrowableList<MaterialTexture*>& matTextures = models[modelIdx].MaterialTextures();
+    const uint64 numTextures = matTextures.Count();
+    texturePriorities.Init(numTextures, 0.0f);
+    textureSizes.Init(numTextures, 0);
+    textureLastUsedFrames.Init(numTextures, 0);
+    textureOrder.Init(numTextures, 0);
+    for(uint64 i = 0; i < numTextures; ++i)
+    {
+        const MaterialTexture& matTexture = *matTextures[i];
+        textureSizes[i] = matTexture.Texture != nullptr ? TextureMemorySize(*matTexture.Texture) : EstimateTextureSize(matTexture.Name);
+    }
+
+    EvictModels(0);
+}
+
+bool SceneStreamer::Update(const Camera& camera)
+{
+    if(loadingModelIdx != uint64(-1) && modelLoadTask.GetIsComplete())
+    {
+        FinishModelLoad();
+        if(requestedModelIdx != uint64(-1))
+            RequestModel(requestedModelIdx);
+    }
+
+    ProcessTextureUnloads(uint64(-1), false);
+
+    if(currentModelIdx == uint64(-1))
+        return false;
+
+    modelLastUsedFrames[currentModelIdx] = DX12::CurrentCPUFrame;
+
+    bool materialsChanged = false;
+    if(loadingTextures.Count() > 0 && textureLoadTask.GetIsComplete())
+        materialsChanged = FinishTextureLoads();
+
+    if(loadingTextures.Count() == 0)
+        materialsChanged = StartTextureLoads(camera) || materialsChanged;
+
+    return materialsChanged;
+}
+
+void SceneStreamer::FinishModelLoad()
+{
+    const uint64 modelIdx = loadingModelIdx;
+    loadingModelIdx = uint64(-1);
+    if(modelLoadError.length() > 0)
+        throw Exception(modelLoadError);
+
+    // The task only did the CPU side of loading, and the buffers and textures are created here
+    Model& model = models[modelIdx];
+    if(model.ResourcesPending())
+        model.CreateResources();
+
+    modelResident[modelIdx] = true;
+    modelLastUsedFrames[modelIdx] = DX12::CurrentCPUFrame;
+    residentMemory += ModelMemorySize(modelIdx);
+
+    EvictModels(0);
+}
+
+bool SceneStreamer::FinishTextureLoads()
+{
+    Model& model = models[currentModelIdx];
+    const GrowableList<MaterialTexture*>& matTextures = model.MaterialTextures();
+
+    const uint64 numLoaded = loadingTextures.Count();
+    for(uint64 i = 0; i < numLoaded; ++i)
+    {
+        if(textureLoadErrors[i].length() > 0)
+            throw Exception(textureLoadErrors[i]);
+
+        const uint32 texIdx = loadingTextures[i];
+        model.FinishTextureLoad(texIdx);
+        textureSizes[texIdx] = TextureMemorySize(*matTextures[texIdx]->Texture);
+        residentMemory += textureSizes[texIdx];
+        model.SetTextureResident(texIdx, true);
+    }
+
+    loadingTextures.RemoveAll();
+    model.UpdateMaterialTextures();
+
+    return numLoaded > 0;
+}
+
+// Decides which textures of the current model should be resident, and starts loading the most
+// important ones that aren't. Returns true if any materials switched textures.
+bool SceneStreamer::StartTextureLoads(const Camera& camera)
+{
+    Model& model = models[currentModelIdx];
+    const GrowableList<MaterialTexture*>& matTextures = model.MaterialTextures();
+    const Array<MeshMaterial>& materials = model.Materials();
+    const uint64 numTextures = matTextures.Count();
+    const uint64 frame = DX12::CurrentCPUFrame;
+
+    // Paths bounce off of surfaces in every direction, so a mesh's priority only depends on how big
+    // it is relative to its distance from the camera, and not on whether it's in view. When it is in
+    // view this is proportional to its size on screen.
+    texturePriorities.Fill(0.0f);
+    const uint64 numMeshes = model.NumMeshes();
+    for(uint64 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+    {
+        const Mesh& mesh = model.Meshes()[meshIdx];
+        const Float3 center = (mesh.AABBMin() + mesh.AABBMax()) * 0.5f;
+        const float radius = Float3::Length(mesh.AABBMax() - mesh.AABBMin()) * 0.5f;
+        const float distance = Max(Float3::Distance(center, camera.Position()) - radius, camera.NearClip());
+        const float priority = radius / distance;
+
+        for(uint64 partIdx = 0; partIdx < mesh.NumMeshParts(); ++partIdx)
+        {
+            const MeshMaterial& material = materials[mesh.MeshParts()[partIdx].MaterialIdx];
+            for(uint64 texType = 0; texType < uint64(MaterialTextures::Count); ++texType)
+            {
+                const uint32 texIdx = material.TextureIndices[texType];
+                if(texIdx != uint32(-1))
+                    texturePriorities[texIdx] = Max(texturePriorities[texIdx], priority);
+            }
+        }
+    }
+
+    // Geometry and non-streamed textures always stay resident
+    uint64 numStreamed = 0;
+    uint64 wantedMemory = model.GeometryMemorySize();
+    for(uint64 i = 0; i < numTextures; ++i)
+    {
+        if(matTextures[i]->Streamed)
+            textureOrder[numStreamed++] = uint32(i);
+        else
+            wantedMemory += textureSizes[i];
+    }
+
+    std::sort(textureOrder.Data(), textureOrder.Data() + numStreamed, [&](uint32 a, uint32 b)
+    {
+        return texturePriorities[a] > texturePriorities[b];
+    });
+
+    // The most important textures that fit in the budget should be resident
+    bool materialsChanged = false;
+    uint64 batchMemory = 0;
+    numPendingTextures = 0;
+    for(uint64 i = 0; i < numStreamed; ++i)
+    {
+        const uint32 texIdx = textureOrder[i];
+        wantedMemory += textureSizes[texIdx];
+        if(wantedMemory > memoryBudget)
+            break;
+
+        textureLastUsedFrames[texIdx] = frame;
+
+        const MaterialTexture& matTexture = *matTextures[texIdx];
+        if(matTexture.Resident)
+            continue;
+
+        if(matTexture.Texture != nullptr)
+        {
+            // It was evicted but hasn't been unloaded yet, so it can be used again right away
+            for(uint64 unloadIdx = 0; unloadIdx < pendingUnloads.Count(); ++unloadIdx)
+            {
+                if(pendingUnloads[unloadIdx].ModelIdx == currentModelIdx && pendingUnloads[unloadIdx].TextureIdx == texIdx)
+                {
+                    pendingUnloads.Remove(unloadIdx);
+                    break;
+                }
+            }
+
+            residentMemory += textureSizes[texIdx];
+            model.SetTextureResident(texIdx, true);
+            materialsChanged = true;
+            continue;
+        }
+
+        numPendingTextures += 1;
+        if(loadingTextures.Count() < MaxTextureLoadsPerBatch)
+        {
+            loadingTextures.Add(texIdx);
+            batchMemory += textureSizes[texIdx];
+        }
+    }
+
+    // Make room for the new batch, first with other scenes and then with the textures that have gone
+    // the longest without being wanted
+    EvictModels(batchMemory);
+    while(residentMemory + batchMemory > memoryBudget)
+    {
+        uint64 evictIdx = uint64(-1);
+        for(uint64 i = 0; i < numStreamed; ++i)
+        {
+            const uint32 texIdx = textureOrder[i];
+            if(matTextures[texIdx]->Resident && textureLastUsedFrames[texIdx] < frame &&
+               (evictIdx == uint64(-1) || textureLastUsedFrames[texIdx] < textureLastUsedFrames[evictIdx]))
+                evictIdx = texIdx;
+        }
+
+        if(evictIdx == uint64(-1))
+            break;
+
+        EvictTexture(evictIdx);
+        materialsChanged = true;
+    }
+
+    if(materialsChanged)
+        model.UpdateMaterialTextures();
+
+    if(loadingTextures.Count() > 0)
+    {
+        textureLoadErrors.Init(loadingTextures.Count());
+        textureLoadTask.m_SetSize = uint32(loadingTextures.Count());
+        Tasks::Scheduler().AddTaskSetToPipe(&textureLoadTask);
+    }
+
+    return materialsChanged;
+}
+
+void SceneStreamer::EvictTexture(uint64 textureIdx)
+{
+    models[currentModelIdx].SetTextureResident(textureIdx, false);
+    residentMemory -= textureSizes[textureIdx];
+
+    TextureUnload unload;
+    unload.ModelIdx = currentModelIdx;
+    unload.TextureIdx = uint32(textureIdx);
+    unload.Frame = DX12::CurrentCPUFrame;
+    pendingUnloads.Add(unload);
+}
+
+// Unloads evicted textures once the GPU is done with them, or right away if force is set. A model
+// index of -1 processes the textures of all models.
+void SceneStreamer::ProcessTextureUnloads(uint64 modelIdx, bool force)
+{
+    for(uint64 i = 0; i < pendingUnloads.Count();)
+    {
+        const TextureUnload& unload = pendingUnloads[i];
+        const bool gpuDone = DX12::CurrentCPUFrame >= unload.Frame + DX12::RenderLatency;
+        if((modelIdx == uint64(-1) || unload.ModelIdx == modelIdx) && (force || gpuDone))
+        {
+            models[unload.ModelIdx].UnloadTexture(unload.TextureIdx);
+            pendingUnloads.Remove(i);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+// Evicts the least-recently used models until there's room for requiredMemory, without touching the
+// current model or any model that could still be used by a frame that the GPU hasn't finished. Like
+// evicted textures, a model that was just switched away from stays resident for RenderLatency frames.
+void SceneStreamer::EvictModels(uint64 requiredMemory)
+{
+    const uint64 frame = DX12::CurrentCPUFrame;
+    while(residentMemory + requiredMemory > memoryBudget)
+    {
+        uint64 evictIdx = uint64(-1);
+        for(uint64 i = 0; i < numModels; ++i)
+        {
+            if(modelResident[i] && i != currentModelIdx && modelLastUsedFrames[i] + DX12::RenderLatency <= frame &&
+               (evictIdx == uint64(-1) || modelLastUsedFrames[i] < modelLastUsedFrames[evictIdx]))
+                evictIdx = i;
+        }
+
+        if(evictIdx == uint64(-1))
+            break;
+
+        // The GPU is done with every frame that used the model, so its evicted textures can go right away too
+        ProcessTextureUnloads(evictIdx, true);
+        residentMemory -= ModelMemorySize(evictIdx);
+        models[evictIdx].Shutdown();
+        modelResident[evictIdx] = false;
+
+        WriteLog("Evicted scene model %llu to stay within the streaming budget, %.2f MB is still resident",
+                 evictIdx, residentMemory / (1024.0 * 1024.0));
+    }
+}
+
+uint64 SceneStreamer::ModelMemorySize(uint64 modelIdx) const
+{
+    const Model& model = models[modelIdx];
+    uint64 size = model.GeometryMemorySize();
+
+    const GrowableList<MaterialTexture*>& matTextures = model.MaterialTextures();
+    for(uint64 i = 0; i < matTextures.Count(); ++i)
+    {
+        if(matTextures[i]->Texture != nullptr)
+            size += TextureMemorySize(*matTextures[i]->Texture);
+    }
+
+    return size;
+}
\ No newline at end of file
@@ -0,0 +1,105 @@
+//=================================================================================================
+//
+//  DXR Path Tracer
+//  by MJP
+//  http://mynameismjp.wordpress.com/
+//
+//  All code and content licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include <PCH.h>
+
+#include <Tasks.h>
+#include <Graphics/Model.h>
+#include <Graphics/Camera.h>
+
+using namespace SampleFramework12;
+
+// Loads scene models on a task thread so that switching scenes doesn't block rendering, and streams
+// in the textures of the current scene in order of how large their meshes are from the camera's
+// point of view. Models need to be loaded with ModelLoadSettings::StreamTextures so that their
+// materials start out with the default textures. Everything that's resident is kept within a memory
+// budget by evicting the least-recently used textures of the current scene, and then the least-
+// recently used scenes.
+class SceneStreamer
+{
+
+public:
+
+    typedef std::function<void(uint64 modelIdx)> LoadModelFunction;
+
+    // loadModel is called on a task thread to load models[modelIdx], and needs to use
+    // ModelLoadSettings::DeferResourceCreation so that its GPU resources get created on the main thread.
+    // Textures are also decoded on a task thread, and created on the main thread by Update().
+    void Initialize(Model* models, uint64 numModels, uint64 memoryBudget, const LoadModelFunction& loadModel);
+    void Shutdown();
+
+    // Starts loading the model in the background, unless it's already resident. Only one model is
+    // loaded at a time, and requesting another one replaces a request that hasn't started yet.
+    void RequestModel(uint64 modelIdx);
+    bool ModelResident(uint64 modelIdx) const { return modelResident[modelIdx]; }
+    bool LoadingModel() const { return loadingModelIdx != uint64(-1); }
+
+    // Switches texture streaming over to a resident model, which also keeps it from being evicted
+    void SetCurrentModel(uint64 modelIdx);
+
+    // Needs to be called once per frame on the main thread. Returns true if the current model's
+    // materials switched textures, in which case anything that holds onto their texture indices
+    // needs to be updated.
+    bool Update(const Camera& camera);
+
+    uint64 ResidentMemorySize() const { return residentMemory; }
+    uint64 MemoryBudget() const { return memoryBudget; }
+    uint64 NumPendingTextures() const { return numPendingTextures; }
+
+protected:
+
+    void FinishModelLoad();
+    bool FinishTextureLoads();
+    bool StartTextureLoads(const Camera& camera);
+    void EvictTexture(uint64 textureIdx);
+    void ProcessTextureUnloads(uint64 modelIdx, bool force);
+    void EvictModels(uint64 requiredMemory);
+    uint64 ModelMemorySize(uint64 modelIdx) const;
+
+    Model* models = nullptr;
+    uint64 numModels = 0;
+    uint64 memoryBudget = 0;
+    uint64 residentMemory = 0;
+    LoadModelFunction loadModel;
+
+    Array<bool> modelResident;
+    Array<uint64> modelLastUsedFrames;
+    uint64 currentModelIdx = uint64(-1);
+
+    // Background model loading
+    enki::TaskSet modelLoadTask;
+    uint64 loadingModelIdx = uint64(-1);
+    uint64 requestedModelIdx = uint64(-1);
+    std::wstring modelLoadError;
+
+    // Streaming state for the textures of the current model
+    Array<float> texturePriorities;
+    Array<uint64> textureSizes;
+    Array<uint64> textureLastUsedFrames;
+    Array<uint32> textureOrder;
+    uint64 numPendingTextures = 0;
+
+    // Background texture loading, which is always for the current model
+    enki::TaskSet textureLoadTask;
+    GrowableList<uint32> loadingTextures;
+    Array<std::wstring> textureLoadErrors;
+
+    // Evicted textures are kept alive until the GPU is done with the frames that could use them
+    struct TextureUnload
+    {
+        uint64 ModelIdx = 0;
+        uint32 TextureIdx = 0;
+        uint64 Frame = 0;
+    };
+
+    GrowableList<TextureUnload> pendingUnloads;
+};
\ No newline at end of file
@@ -58,7 +58,7 @@ struct ClusterBounds
 struct GeometryInfo
 {
     uint VtxOffset;
-    uint IdxOffset;
+    uint IdxByteOffset;     // Mesh indices start here in the raw index buffer
     uint MaterialIdx;
-    uint PadTo16Bytes;
+    uint IndexType;         // 0 for 16-bit indices, 1 for 32-bit
 };
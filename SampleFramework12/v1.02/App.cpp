@@ -16,6 +16,7 @@
 #include "SF12_Math.h"
 #include "FileIO.h"
 #include "Settings.h"
+#include "Tasks.h"
 #include "ImGuiHelper.h"
 #include "ImGui/imgui.h"
 
@@ -138,13 +139,24 @@ void App::ParseCommandLine(const wchar* cmdLine)
     if(cmdLine == nullptr)
         return;
 
-    std::string cmdLineA = WStringToAnsi(cmdLine);
+    cxxopts::Options options("App", "");
+    options.allow_unrecognised_options();
+    options.add_options()
+         ("a,adapter", "GPU adapter index", cxxopts::value<int32>());
+
+    cxxopts::ParseResult parseResult = ParseCommandLineOptions(cmdLine, options);
+
+    if(parseResult.count("adapter"))
+        adapterIdx = parseResult["adapter"].as<int32>();
+}
+
+cxxopts::ParseResult App::ParseCommandLineOptions(const wchar* cmdLine, cxxopts::Options& options)
+{
+    std::string cmdLineA = cmdLine != nullptr ? WStringToAnsi(cmdLine) : std::string();
     GrowableList<std::string> parts;
     Split(cmdLineA, parts, " ");
 
     uint64 numParts = parts.Count();
-    if(numParts == 0)
-        return;
 
     char appString[4] = "App";
 
@@ -156,15 +168,7 @@ void App::ParseCommandLine(const wchar* cmdLine)
     int32 argc = int32(numParts + 1);
     char** argv = partStrings.Data();
 
-    cxxopts::Options options("App", "");
-    options.allow_unrecognised_options();
-    options.add_options()
-         ("a,adapter", "GPU adapter index", cxxopts::value<int32>());
-
-    cxxopts::ParseResult parseResult = options.parse(argc, argv);
-
-    if(parseResult.count("adapter"))
-        adapterIdx = parseResult["adapter"].as<int32>();
+    return options.parse(argc, argv);
 }
 
 void App::Initialize_Internal()
@@ -183,6 +187,8 @@ void App::Initialize_Internal()
 
     Profiler::GlobalProfiler.Initialize();
 
+    Tasks::Initialize();
+
     window.RegisterMessageCallback(OnWindowResized, this);
 
     // Initialize ImGui
@@ -208,6 +214,8 @@ void App::Shutdown_Internal()
 
     Shutdown();
 
+    Tasks::Shutdown();
+
     DX12::Shutdown();
 }
 
@@ -52,6 +52,9 @@ protected:
 
     static void OnWindowResized(void* context, HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
+    // Parses the command line using app-specific options, unrecognized options are ignored
+    static cxxopts::ParseResult ParseCommandLineOptions(const wchar* cmdLine, cxxopts::Options& options);
+
     Window window;
     SwapChain swapChain;
     Timer appTimer;
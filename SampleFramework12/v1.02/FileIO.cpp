@@ -240,4 +240,76 @@ uint64 File::Size() const
     return fileSize.QuadPart;
 }
 
+// == MemoryMappedFile ============================================================================
+
+MemoryMappedFile::MemoryMappedFile() : fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL), data(nullptr), size(0)
+{
+}
+
+MemoryMappedFile::MemoryMappedFile(const wchar* filePath) : fileHandle(INVALID_HANDLE_VALUE), mappingHandle(NULL),
+                                                            data(nullptr), size(0)
+{
+    Open(filePath);
+}
+
+MemoryMappedFile::~MemoryMappedFile()
+{
+    Close();
+    Assert_(fileHandle == INVALID_HANDLE_VALUE);
+}
+
+void MemoryMappedFile::Open(const wchar* filePath)
+{
+    Assert_(fileHandle == INVALID_HANDLE_VALUE);
+
+    const std::wstring errPrefix = std::wstring(L"Failed to map file ") + filePath + L":\n";
+
+    fileHandle = CreateFile(filePath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(fileHandle == INVALID_HANDLE_VALUE)
+        throw Win32Exception(GetLastError(), errPrefix.c_str());
+
+    LARGE_INTEGER fileSize;
+    Win32Call(GetFileSizeEx(fileHandle, &fileSize));
+    size = fileSize.QuadPart;
+
+    // Empty files can't be mapped
+    if(size == 0)
+    {
+        Close();
+        throw Exception(errPrefix + L"The file is empty");
+    }
+
+    mappingHandle = CreateFileMapping(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(mappingHandle == NULL)
+    {
+        const DWORD errorCode = GetLastError();
+        Close();
+        throw Win32Exception(errorCode, errPrefix.c_str());
+    }
+
+    data = reinterpret_cast<const uint8*>(MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0));
+    if(data == nullptr)
+    {
+        const DWORD errorCode = GetLastError();
+        Close();
+        throw Win32Exception(errorCode, errPrefix.c_str());
+    }
+}
+
+void MemoryMappedFile::Close()
+{
+    if(data != nullptr)
+        Win32Call(UnmapViewOfFile(data));
+    data = nullptr;
+    size = 0;
+
+    if(mappingHandle != NULL)
+        Win32Call(CloseHandle(mappingHandle));
+    mappingHandle = NULL;
+
+    if(fileHandle != INVALID_HANDLE_VALUE)
+        Win32Call(CloseHandle(fileHandle));
+    fileHandle = INVALID_HANDLE_VALUE;
+}
+
 }
\ No newline at end of file
@@ -70,6 +70,34 @@ public:
     uint64 Size() const;
 };
 
+// Read-only view of a whole file, which is paged in by the OS as it's accessed
+class MemoryMappedFile
+{
+
+private:
+
+    HANDLE fileHandle;
+    HANDLE mappingHandle;
+    const uint8* data;
+    uint64 size;
+
+public:
+
+    // Lifetime
+    MemoryMappedFile();
+    explicit MemoryMappedFile(const wchar* filePath);
+    ~MemoryMappedFile();
+
+    // Explicit Open and close
+    void Open(const wchar* filePath);
+    void Close();
+
+    // Accessors
+    const uint8* Data() const { return data; }
+    uint64 Size() const { return size; }
+    bool IsOpen() const { return data != nullptr; }
+};
+
 // == File ========================================================================================
 
 template<typename T> void File::Read(T& data) const
@@ -74,6 +74,47 @@ inline float GGX_Specular(float m, const Float3& n, const Float3& h, const Float
 
     return d * vis;
 }
+
+// Smith G1 masking term for GGX, where a2 is the squared GGX alpha
+inline float SmithGGXMasking(const Float3& n, const Float3& l, const Float3& v, float a2)
+{
+    float nDotV = Saturate(Float3::Dot(n, v));
+    float denomC = std::sqrt(a2 + (1.0f - a2) * nDotV * nDotV) + nDotV;
+
+    return 2.0f * nDotV / denomC;
+}
+
+// Height-correlated Smith G2 masking-shadowing term for GGX, where a2 is the squared GGX alpha
+inline float SmithGGXMaskingShadowing(const Float3& n, const Float3& l, const Float3& v, float a2)
+{
+    float nDotL = Saturate(Float3::Dot(n, l));
+    float nDotV = Saturate(Float3::Dot(n, v));
+
+    float denomA = nDotV * std::sqrt(a2 + (1.0f - a2) * nDotL * nDotL);
+    float denomB = nDotL * std::sqrt(a2 + (1.0f - a2) * nDotV * nDotV);
+
+    return 2.0f * nDotL * nDotV / (denomA + denomB);
+}
+
+// Returns the scale and bias that need to be applied to the specular albedo to compute the
+// pre-integrated environment BRDF for GGX. Matches GGXEnvironmentBRDFScaleBias() in BRDF.hlsl.
+inline Float2 GGXEnvironmentBRDFScaleBias(float nDotV, float sqrtRoughness)
+{
+    const float nDotV2 = nDotV * nDotV;
+    const float sqrtRoughness2 = sqrtRoughness * sqrtRoughness;
+    const float sqrtRoughness3 = sqrtRoughness2 * sqrtRoughness;
+
+    const float delta = 0.991086418474895f + (0.412367709802119f * sqrtRoughness * nDotV2) -
+                        (0.363848256078895f * sqrtRoughness2) -
+                        (0.758634385642633f * nDotV * sqrtRoughness2);
+    const float bias = Saturate((0.0306613448029984f * sqrtRoughness) + 0.0238299731830387f /
+                                (0.0272458171384516f + sqrtRoughness3 + nDotV2) -
+                                0.0454747751719356f);
+
+    const float scale = Saturate(delta - bias);
+    return Float2(scale, bias);
+}
+
 // Computes the radiance reflected off a surface towards the eye given
 // the differential irradiance from a given direction
 inline Float3 CalcLighting(const Float3& normal, const Float3& lightIrradiance,
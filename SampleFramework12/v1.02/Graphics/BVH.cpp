@@ -0,0 +1,1479 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "BVH.h"
+#include "Model.h"
+#include "..\\Utility.h"
+#include "..\\Timer.h"
+#include "..\\Tasks.h"
+#include "..\\FileIO.h"
+#include "..\\Exceptions.h"
+
+namespace SampleFramework12
+{
+
+struct BuildPrimitive
+{
+    Float3 BoundsMin;
+    Float3 BoundsMax;
+    Float3 Centroid;
+    uint32 PrimIdx = 0;
+};
+
+struct BuildTask
+{
+    uint32 NodeIdx = 0;
+    uint32 Start = 0;
+    uint32 Count = 0;
+    uint32 Depth = 0;
+    Float3 CentroidMin;
+    Float3 CentroidMax;
+};
+
+// Bounds of the primitives and primitive centroids that fall into an SAH bin
+struct BuildBin
+{
+    Float3 BoundsMin = FloatMax;
+    Float3 BoundsMax = -FloatMax;
+    Float3 CentroidMin = FloatMax;
+    Float3 CentroidMax = -FloatMax;
+    uint32 Count = 0;
+};
+
+struct BuildContext
+{
+    BuildPrimitive* Prims = nullptr;
+    BVHNode* Nodes = nullptr;
+    volatile int64 NumNodes = 0;
+};
+
+static const uint32 NumBins = uint32(BVH::NumSAHBins);
+static const float SAHTraversalCost = 1.0f;
+static const float SAHIntersectCost = 1.0f;
+
+// Nodes with at least this many primitives are binned across all task threads
+static const uint32 ParallelBinningThreshold = 64 * 1024;
+static const uint32 BinningChunkSize = 16 * 1024;
+
+// Subtrees smaller than this are always built on a single thread
+static const uint32 MinSubtreeSize = 1024;
+
+// Needs to be incremented whenever the node/primitive layout or the build algorithm changes
+static const uint32 CacheFileVersion = 2;
+static const uint32 CacheFileMagic = 0x43485642;    // 'BVHC'
+
+static Float3 Min3(const Float3& a, const Float3& b)
+{
+    return Float3(Min(a.x, b.x), Min(a.y, b.y), Min(a.z, b.z));
+}
+
+static Float3 Max3(const Float3& a, const Float3& b)
+{
+    return Float3(Max(a.x, b.x), Max(a.y, b.y), Max(a.z, b.z));
+}
+
+static uint32 MeshIndex(const Mesh& mesh, uint32 idx)
+{
+    if(mesh.IndexBufferType() == IndexType::Index32Bit)
+        return mesh.Indices32()[idx];
+    else
+        return mesh.Indices()[idx];
+}
+
+// Bounds of the origins and inverse directions of a ray packet
+struct PacketFrustum
+{
+    float OriginMin[3];
+    float OriginMax[3];
+    float InvDirMin[3];
+    float InvDirMax[3];
+    bool Positive[3];
+    float TMin = FloatMax;
+    float TMax = -FloatMax;
+};
+
+// Conservative interval arithmetic test: returns true only if every ray in the packet misses the box
+static bool FrustumMissesBounds(const PacketFrustum& frustum, const Float3& boundsMin, const Float3& boundsMax)
+{
+    float tEnter = frustum.TMin;
+    float tExit = frustum.TMax;
+    for(uint32 axis = 0; axis < 3; ++axis)
+    {
+        const float nearPlane = frustum.Positive[axis] ? boundsMin[axis] : boundsMax[axis];
+        const float farPlane = frustum.Positive[axis] ? boundsMax[axis] : boundsMin[axis];
+        const float invDirMin = frustum.InvDirMin[axis];
+        const float invDirMax = frustum.InvDirMax[axis];
+
+        const float nearLo = nearPlane - frustum.OriginMax[axis];
+        const float nearHi = nearPlane - frustum.OriginMin[axis];
+        const float farLo = farPlane - frustum.OriginMax[axis];
+        const float farHi = farPlane - frustum.OriginMin[axis];
+
+        const float enterLowerBound = Min(Min(nearLo * invDirMin, nearLo * invDirMax), Min(nearHi * invDirMin, nearHi * invDirMax));
+        const float exitUpperBound = Max(Max(farLo * invDirMin, farLo * invDirMax), Max(farHi * invDirMin, farHi * invDirMax));
+
+        tEnter = Max(tEnter, enterLowerBound);
+        tExit = Min(tExit, exitUpperBound);
+    }
+
+    return tEnter > tExit;
+}
+
+static float HalfArea(const Float3& boundsMin, const Float3& boundsMax)
+{
+    Float3 extents = boundsMax - boundsMin;
+    if(extents.x < 0.0f || extents.y < 0.0f || extents.z < 0.0f)
+        return 0.0f;
+    return extents.x * extents.y + extents.y * extents.z + extents.z * extents.x;
+}
+
+static void GrowBin(BuildBin& bin, const BuildPrimitive& prim)
+{
+    bin.BoundsMin = Min3(bin.BoundsMin, prim.BoundsMin);
+    bin.BoundsMax = Max3(bin.BoundsMax, prim.BoundsMax);
+    bin.CentroidMin = Min3(bin.CentroidMin, prim.Centroid);
+    bin.CentroidMax = Max3(bin.CentroidMax, prim.Centroid);
+    bin.Count += 1;
+}
+
+static void MergeBin(BuildBin& bin, const BuildBin& other)
+{
+    bin.BoundsMin = Min3(bin.BoundsMin, other.BoundsMin);
+    bin.BoundsMax = Max3(bin.BoundsMax, other.BoundsMax);
+    bin.CentroidMin = Min3(bin.CentroidMin, other.CentroidMin);
+    bin.CentroidMax = Max3(bin.CentroidMax, other.CentroidMax);
+    bin.Count += other.Count;
+}
+
+static uint32 BinIndex(float centroid, float centroidMin, float binScale)
+{
+    return Min(uint32((centroid - centroidMin) * binScale), NumBins - 1);
+}
+
+// Computes the combined bounds of a range of primitives, optionally split across the task threads
+static void BinRange(const BuildPrimitive* prims, uint32 count, bool parallel, BuildBin& result)
+{
+    result = BuildBin();
+    if(parallel == false)
+    {
+        for(uint32 i = 0; i < count; ++i)
+            GrowBin(result, prims[i]);
+        return;
+    }
+
+    const uint32 numChunks = (count + BinningChunkSize - 1) / BinningChunkSize;
+    Array<BuildBin> chunkBins(numChunks);
+    Tasks::ParallelFor(numChunks, [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 chunkIdx = range.start; chunkIdx < range.end; ++chunkIdx)
+        {
+            const uint32 chunkEnd = Min((chunkIdx + 1) * BinningChunkSize, count);
+            for(uint32 i = chunkIdx * BinningChunkSize; i < chunkEnd; ++i)
+                GrowBin(chunkBins[chunkIdx], prims[i]);
+        }
+    });
+
+    for(uint32 chunkIdx = 0; chunkIdx < numChunks; ++chunkIdx)
+        MergeBin(result, chunkBins[chunkIdx]);
+}
+
+// Sorts a range of primitives into SAH bins along all 3 axes
+static void BinPrimitives(const BuildPrimitive* prims, uint32 count, const float centroidMin[3],
+                          const float binScale[3], BuildBin* bins)
+{
+    for(uint32 i = 0; i < count; ++i)
+    {
+        const BuildPrimitive& prim = prims[i];
+        for(uint32 axis = 0; axis < 3; ++axis)
+            GrowBin(bins[axis * NumBins + BinIndex(prim.Centroid[axis], centroidMin[axis], binScale[axis])], prim);
+    }
+}
+
+// Turns the node for a build task into either a leaf or an interior node, using binned SAH to
+// pick the split. Returns true and fills out the tasks for the two children if the node was split.
+static bool SplitTask(BuildContext& context, const BuildTask& task, bool parallelBinning, BuildTask& leftTask, BuildTask& rightTask)
+{
+    BVHNode& node = context.Nodes[task.NodeIdx];
+    BuildPrimitive* prims = context.Prims + task.Start;
+
+    const bool forceLeaf = task.Count <= 1 || task.Depth + 1 >= BVH::MaxDepth;
+
+    float centroidMin[3] = { };
+    float binScale[3] = { };
+    bool canBin = false;
+    for(uint32 axis = 0; axis < 3; ++axis)
+    {
+        const float extent = task.CentroidMax[axis] - task.CentroidMin[axis];
+        centroidMin[axis] = task.CentroidMin[axis];
+        binScale[axis] = extent > 0.0f ? (NumBins * 0.99999f) / extent : 0.0f;
+        canBin = canBin || extent > 0.0f;
+    }
+
+    uint32 splitAxis = 0;
+    uint32 splitBin = 0;
+    float splitCost = FloatMax;
+    BuildBin leftBin;
+    BuildBin rightBin;
+
+    if(canBin && forceLeaf == false)
+    {
+        BuildBin bins[3 * NumBins];
+
+        if(parallelBinning)
+        {
+            const uint32 numChunks = (task.Count + BinningChunkSize - 1) / BinningChunkSize;
+            Array<BuildBin> chunkBins(numChunks * 3 * NumBins);
+            Tasks::ParallelFor(numChunks, [&](enki::TaskSetPartition range, uint32 threadNum)
+            {
+                for(uint32 chunkIdx = range.start; chunkIdx < range.end; ++chunkIdx)
+                {
+                    const uint32 chunkStart = chunkIdx * BinningChunkSize;
+                    const uint32 chunkCount = Min(BinningChunkSize, task.Count - chunkStart);
+                    BinPrimitives(prims + chunkStart, chunkCount, centroidMin, binScale, &chunkBins[chunkIdx * 3 * NumBins]);
+                }
+            });
+
+            for(uint32 chunkIdx = 0; chunkIdx < numChunks; ++chunkIdx)
+                for(uint32 binIdx = 0; binIdx < 3 * NumBins; ++binIdx)
+                    MergeBin(bins[binIdx], chunkBins[chunkIdx * 3 * NumBins + binIdx]);
+        }
+        else
+        {
+            BinPrimitives(prims, task.Count, centroidMin, binScale, bins);
+        }
+
+        const float invNodeArea = 1.0f / Max(HalfArea(node.BoundsMin, node.BoundsMax), 1e-20f);
+        for(uint32 axis = 0; axis < 3; ++axis)
+        {
+            if(binScale[axis] == 0.0f)
+                continue;
+
+            const BuildBin* axisBins = &bins[axis * NumBins];
+
+            // Sweep from the right to get the bounds for every possible right side
+            BuildBin rightBins[NumBins];
+            rightBins[NumBins - 1] = axisBins[NumBins - 1];
+            for(int32 binIdx = NumBins - 2; binIdx >= 0; --binIdx)
+            {
+                rightBins[binIdx] = rightBins[binIdx + 1];
+                MergeBin(rightBins[binIdx], axisBins[binIdx]);
+            }
+
+            // Then sweep from the left and evaluate the cost of splitting after each bin
+            BuildBin leftAccum;
+            for(uint32 binIdx = 0; binIdx < NumBins - 1; ++binIdx)
+            {
+                MergeBin(leftAccum, axisBins[binIdx]);
+                const BuildBin& rightAccum = rightBins[binIdx + 1];
+                if(leftAccum.Count == 0 || rightAccum.Count == 0)
+                    continue;
+
+                const float cost = SAHTraversalCost + SAHIntersectCost * invNodeArea *
+                                   (HalfArea(leftAccum.BoundsMin, leftAccum.BoundsMax) * leftAccum.Count +
+                                    HalfArea(rightAccum.BoundsMin, rightAccum.BoundsMax) * rightAccum.Count);
+                if(cost < splitCost)
+                {
+                    splitCost = cost;
+                    splitAxis = axis;
+                    splitBin = binIdx;
+                    leftBin = leftAccum;
+                    rightBin = rightAccum;
+                }
+            }
+        }
+    }
+
+    const float leafCost = task.Count * SAHIntersectCost;
+    const bool makeLeaf = forceLeaf || (task.Count <= BVH::MaxLeafSize && leafCost <= splitCost);
+    if(makeLeaf)
+    {
+        node.Offset = task.Start;
+        node.NumPrimitives = task.Count;
+        return false;
+    }
+
+    uint32 numLeft = 0;
+    if(splitCost == FloatMax)
+    {
+        // All of the centroids are in the same spot, so just split the range in half
+        numLeft = task.Count / 2;
+        BinRange(prims, numLeft, false, leftBin);
+        BinRange(prims + numLeft, task.Count - numLeft, false, rightBin);
+    }
+    else
+    {
+        const float axisMin = centroidMin[splitAxis];
+        const float axisScale = binScale[splitAxis];
+        BuildPrimitive* mid = std::partition(prims, prims + task.Count, [=](const BuildPrimitive& prim)
+        {
+            return BinIndex(prim.Centroid[splitAxis], axisMin, axisScale) <= splitBin;
+        });
+
+        numLeft = uint32(mid - prims);
+        Assert_(numLeft == leftBin.Count);
+    }
+
+    const uint32 childIdx = uint32(InterlockedAdd64(&context.NumNodes, 2) - 2);
+    node.Offset = childIdx;
+    node.NumPrimitives = 0;
+
+    BVHNode& leftNode = context.Nodes[childIdx];
+    leftNode.BoundsMin = leftBin.BoundsMin;
+    leftNode.BoundsMax = leftBin.BoundsMax;
+
+    BVHNode& rightNode = context.Nodes[childIdx + 1];
+    rightNode.BoundsMin = rightBin.BoundsMin;
+    rightNode.BoundsMax = rightBin.BoundsMax;
+
+    leftTask.NodeIdx = childIdx;
+    leftTask.Start = task.Start;
+    leftTask.Count = numLeft;
+    leftTask.Depth = task.Depth + 1;
+    leftTask.CentroidMin = leftBin.CentroidMin;
+    leftTask.CentroidMax = leftBin.CentroidMax;
+
+    rightTask.NodeIdx = childIdx + 1;
+    rightTask.Start = task.Start + numLeft;
+    rightTask.Count = task.Count - numLeft;
+    rightTask.Depth = task.Depth + 1;
+    rightTask.CentroidMin = rightBin.CentroidMin;
+    rightTask.CentroidMax = rightBin.CentroidMax;
+
+    return true;
+}
+
+// Builds the tree below a root task whose node has already been set up. The top of the tree is split
+// on this thread (with parallel binning for the big nodes) until there are enough independent
+// subtrees to keep all of the task threads busy, and then the subtrees are built in parallel.
+static void BuildNodes(BuildContext& context, const BuildTask& rootTask)
+{
+    const uint32 subtreeThreshold = Max(uint32(rootTask.Count / (Tasks::NumThreads() * 8)), MinSubtreeSize);
+
+    GrowableList<BuildTask> taskStack;
+    GrowableList<BuildTask> subtreeTasks;
+    taskStack.Add(rootTask);
+    while(taskStack.Count() > 0)
+    {
+        BuildTask task = taskStack[taskStack.Count() - 1];
+        taskStack.Remove(taskStack.Count() - 1);
+
+        if(task.Count <= subtreeThreshold)
+        {
+            subtreeTasks.Add(task);
+            continue;
+        }
+
+        BuildTask leftTask;
+        BuildTask rightTask;
+        if(SplitTask(context, task, task.Count >= ParallelBinningThreshold, leftTask, rightTask))
+        {
+            taskStack.Add(rightTask);
+            taskStack.Add(leftTask);
+        }
+    }
+
+    // Largest subtrees first, so that they don't end up as the tail of the parallel loop
+    std::sort(subtreeTasks.Data(), subtreeTasks.Data() + subtreeTasks.Count(), [](const BuildTask& a, const BuildTask& b)
+    {
+        return a.Count > b.Count;
+    });
+
+    Tasks::ParallelFor(uint32(subtreeTasks.Count()), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 subtreeIdx = range.start; subtreeIdx < range.end; ++subtreeIdx)
+        {
+            // Depth-first, so the stack never holds more than one pending task per level
+            BuildTask stack[BVH::MaxDepth + 1];
+            uint32 stackSize = 0;
+            stack[stackSize++] = subtreeTasks[subtreeIdx];
+            while(stackSize > 0)
+            {
+                BuildTask task = stack[--stackSize];
+
+                BuildTask leftTask;
+                BuildTask rightTask;
+                if(SplitTask(context, task, false, leftTask, rightTask))
+                {
+                    Assert_(stackSize + 2 <= ArraySize_(stack));
+                    stack[stackSize++] = rightTask;
+                    stack[stackSize++] = leftTask;
+                }
+            }
+        }
+    });
+}
+
+// Reads the triangles of a range of meshes into pre-transformed primitives
+static void ReadMeshPrimitives(const Model& model, uint32 firstMesh, uint32 numMeshes, Array<BVHPrimitive>& primitives)
+{
+    Array<uint32> meshPrimOffsets(numMeshes);
+    uint64 numTriangles = 0;
+    for(uint32 i = 0; i < numMeshes; ++i)
+    {
+        meshPrimOffsets[i] = uint32(numTriangles);
+        numTriangles += model.Meshes()[firstMesh + i].NumIndices() / 3;
+    }
+
+    Assert_(numTriangles < UINT32_MAX / 2);
+    primitives.Init(numTriangles);
+
+    Tasks::ParallelFor(numMeshes, [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 i = range.start; i < range.end; ++i)
+        {
+            const uint32 meshIdx = firstMesh + i;
+            const Mesh& mesh = model.Meshes()[meshIdx];
+            const MeshVertex* vertices = mesh.Vertices();
+            const uint32 numMeshTriangles = mesh.NumIndices() / 3;
+            for(uint32 triIdx = 0; triIdx < numMeshTriangles; ++triIdx)
+            {
+                const Float3& p0 = vertices[MeshIndex(mesh, triIdx * 3 + 0)].Position;
+                const Float3& p1 = vertices[MeshIndex(mesh, triIdx * 3 + 1)].Position;
+                const Float3& p2 = vertices[MeshIndex(mesh, triIdx * 3 + 2)].Position;
+
+                BVHPrimitive& prim = primitives[meshPrimOffsets[i] + triIdx];
+                prim.V0 = p0;
+                prim.E1 = p1 - p0;
+                prim.E2 = p2 - p0;
+                prim.MeshIdx = meshIdx;
+                prim.TriangleIdx = triIdx;
+            }
+        }
+    });
+}
+
+// Builds the nodes for a set of build primitives, which are left in leaf order. Returns the number of nodes.
+static uint64 BuildTree(BuildPrimitive* buildPrims, uint32 numPrims, Array<BVHNode>& nodes)
+{
+    // A binary tree with N leaves has at most 2N - 1 nodes
+    nodes.Init(uint64(numPrims) * 2);
+
+    BuildContext context;
+    context.Prims = buildPrims;
+    context.Nodes = nodes.Data();
+    context.NumNodes = 1;
+
+    BuildBin rootBin;
+    BinRange(context.Prims, numPrims, true, rootBin);
+
+    BuildTask rootTask;
+    rootTask.NodeIdx = 0;
+    rootTask.Start = 0;
+    rootTask.Count = numPrims;
+    rootTask.Depth = 0;
+    rootTask.CentroidMin = rootBin.CentroidMin;
+    rootTask.CentroidMax = rootBin.CentroidMax;
+    nodes[0].BoundsMin = rootBin.BoundsMin;
+    nodes[0].BoundsMax = rootBin.BoundsMax;
+
+    BuildNodes(context, rootTask);
+
+    const uint64 numNodes = uint64(context.NumNodes);
+    Assert_(numNodes <= nodes.Size());
+    return numNodes;
+}
+
+uint64 BuildBoundsTree(const Float3* boundsMin, const Float3* boundsMax, uint64 numBounds,
+                       Array<BVHNode>& nodes, Array<uint32>& leafOrder)
+{
+    Assert_(numBounds > 0);
+    Assert_(numBounds < UINT32_MAX / 2);
+
+    Array<BuildPrimitive> buildPrims(numBounds);
+    for(uint64 i = 0; i < numBounds; ++i)
+    {
+        BuildPrimitive& buildPrim = buildPrims[i];
+        buildPrim.BoundsMin = boundsMin[i];
+        buildPrim.BoundsMax = boundsMax[i];
+        buildPrim.Centroid = (boundsMin[i] + boundsMax[i]) * 0.5f;
+        buildPrim.PrimIdx = uint32(i);
+    }
+
+    const uint64 numNodes = BuildTree(buildPrims.Data(), uint32(numBounds), nodes);
+
+    leafOrder.Init(numBounds);
+    for(uint64 i = 0; i < numBounds; ++i)
+        leafOrder[i] = buildPrims[i].PrimIdx;
+
+    return numNodes;
+}
+
+void BVH::Build(const Model& model)
+{
+    Timer timer;
+
+    Array<BVHPrimitive> srcPrimitives;
+    ReadMeshPrimitives(model, 0, uint32(model.NumMeshes()), srcPrimitives);
+    Build(srcPrimitives.Data(), srcPrimitives.Size());
+
+    timer.Update();
+    buildStats.BuildTimeMs = timer.ElapsedMillisecondsD();
+
+    WriteLog("Built BVH for %llu triangles in %.2f ms: %llu nodes, %llu leaves (%.2f avg / %llu max triangles), max depth %llu, SAH cost %.2f",
+             buildStats.NumTriangles, buildStats.BuildTimeMs, buildStats.NumNodes, buildStats.NumLeaves,
+             buildStats.AvgLeafPrimitives, buildStats.MaxLeafPrimitives, buildStats.MaxDepth, buildStats.SAHCost);
+}
+
+void BVH::Build(const Model& model, uint32 meshIdx)
+{
+    Assert_(meshIdx < model.NumMeshes());
+
+    Timer timer;
+
+    Array<BVHPrimitive> srcPrimitives;
+    ReadMeshPrimitives(model, meshIdx, 1, srcPrimitives);
+    Build(srcPrimitives.Data(), srcPrimitives.Size());
+
+    timer.Update();
+    buildStats.BuildTimeMs = timer.ElapsedMillisecondsD();
+}
+
+void BVH::Build(const BVHPrimitive* srcPrimitives, uint64 numSrcPrimitives)
+{
+    Shutdown();
+
+    Timer timer;
+
+    Assert_(numSrcPrimitives > 0);
+    Assert_(numSrcPrimitives < UINT32_MAX / 2);
+
+    Array<BuildPrimitive> buildPrims(numSrcPrimitives);
+    Tasks::ParallelFor(uint32(numSrcPrimitives), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 primIdx = range.start; primIdx < range.end; ++primIdx)
+        {
+            const BVHPrimitive& prim = srcPrimitives[primIdx];
+            const Float3 p1 = prim.V0 + prim.E1;
+            const Float3 p2 = prim.V0 + prim.E2;
+
+            BuildPrimitive& buildPrim = buildPrims[primIdx];
+            buildPrim.BoundsMin = Min3(Min3(prim.V0, p1), p2);
+            buildPrim.BoundsMax = Max3(Max3(prim.V0, p1), p2);
+            buildPrim.Centroid = (buildPrim.BoundsMin + buildPrim.BoundsMax) * 0.5f;
+            buildPrim.PrimIdx = primIdx;
+        }
+    });
+
+    numNodes = BuildTree(buildPrims.Data(), uint32(numSrcPrimitives), nodes);
+
+    // Store the triangles in leaf order so that leaves can reference a contiguous range
+    primitives.Init(numSrcPrimitives);
+    Tasks::ParallelFor(uint32(numSrcPrimitives), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 i = range.start; i < range.end; ++i)
+            primitives[i] = srcPrimitives[buildPrims[i].PrimIdx];
+    });
+
+    timer.Update();
+
+    ComputeStats();
+    buildStats.BuildTimeMs = timer.ElapsedMillisecondsD();
+}
+
+// SAH cost of the subtree below a node, given the costs of its children
+static float SubtreeCost(const BVHNode& node, const float* costs)
+{
+    const float area = HalfArea(node.BoundsMin, node.BoundsMax);
+    if(node.IsLeaf())
+        return area * node.NumPrimitives * SAHIntersectCost;
+    else
+        return area * SAHTraversalCost + costs[node.Offset] + costs[node.Offset + 1];
+}
+
+void BVH::Refit(const Model& model, const uint32* changedMeshes, uint64 numChangedMeshes,
+                const Float4x4* meshTransforms, float rebuildThreshold)
+{
+    Assert_(numNodes > 0);
+
+    Timer timer;
+
+    refitStats = BVHRefitStats();
+    if(refitCosts.Size() != numNodes)
+        PrepareRefit();
+
+    Array<uint8> meshChanged(model.NumMeshes(), 0);
+    for(uint64 i = 0; i < numChangedMeshes; ++i)
+    {
+        Assert_(changedMeshes[i] < model.NumMeshes());
+        meshChanged[changedMeshes[i]] = 1;
+    }
+
+    // Re-read the triangles for the meshes that changed
+    volatile int64 numChangedPrimitives = 0;
+    Tasks::ParallelFor(uint32(primitives.Size()), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        int64 numChanged = 0;
+        for(uint32 primIdx = range.start; primIdx < range.end; ++primIdx)
+        {
+            BVHPrimitive& prim = primitives[primIdx];
+            if(meshChanged[prim.MeshIdx] == 0)
+                continue;
+
+            const Mesh& mesh = model.Meshes()[prim.MeshIdx];
+            const MeshVertex* vertices = mesh.Vertices();
+            Float3 p0 = vertices[MeshIndex(mesh, prim.TriangleIdx * 3 + 0)].Position;
+            Float3 p1 = vertices[MeshIndex(mesh, prim.TriangleIdx * 3 + 1)].Position;
+            Float3 p2 = vertices[MeshIndex(mesh, prim.TriangleIdx * 3 + 2)].Position;
+            if(meshTransforms != nullptr)
+            {
+                const Float4x4& transform = meshTransforms[prim.MeshIdx];
+                p0 = Float3::Transform(p0, transform);
+                p1 = Float3::Transform(p1, transform);
+                p2 = Float3::Transform(p2, transform);
+            }
+
+            prim.V0 = p0;
+            prim.E1 = p1 - p0;
+            prim.E2 = p2 - p0;
+            ++numChanged;
+        }
+
+        InterlockedAdd64(&numChangedPrimitives, numChanged);
+    });
+
+    // Refit the leaves that contain a changed triangle
+    volatile int64 numRefitNodes = 0;
+    Tasks::ParallelFor(uint32(refitLeaves.Size()), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        int64 numRefit = 0;
+        for(uint32 i = range.start; i < range.end; ++i)
+        {
+            const uint32 nodeIdx = refitLeaves[i];
+            BVHNode& node = nodes[nodeIdx];
+
+            bool dirty = false;
+            for(uint32 primIdx = node.Offset; primIdx < node.Offset + node.NumPrimitives; ++primIdx)
+                dirty = dirty || meshChanged[primitives[primIdx].MeshIdx] != 0;
+
+            refitDirty[nodeIdx] = uint8(dirty);
+            if(dirty == false)
+                continue;
+
+            Float3 boundsMin = FloatMax;
+            Float3 boundsMax = -FloatMax;
+            for(uint32 primIdx = node.Offset; primIdx < node.Offset + node.NumPrimitives; ++primIdx)
+            {
+                const BVHPrimitive& prim = primitives[primIdx];
+                const Float3 p1 = prim.V0 + prim.E1;
+                const Float3 p2 = prim.V0 + prim.E2;
+                boundsMin = Min3(boundsMin, Min3(Min3(prim.V0, p1), p2));
+                boundsMax = Max3(boundsMax, Max3(Max3(prim.V0, p1), p2));
+            }
+
+            node.BoundsMin = boundsMin;
+            node.BoundsMax = boundsMax;
+            refitCosts[nodeIdx] = SubtreeCost(node, refitCosts.Data());
+            ++numRefit;
+        }
+
+        InterlockedAdd64(&numRefitNodes, numRefit);
+    });
+
+    // Then work up towards the root one level at a time, so that both children of a node are
+    // always finished before the node itself
+    for(int64 depth = int64(MaxDepth); depth >= 0; --depth)
+    {
+        const uint32 levelStart = refitLevelOffsets[depth];
+        const uint32 levelCount = refitLevelOffsets[depth + 1] - levelStart;
+        if(levelCount == 0)
+            continue;
+
+        Tasks::ParallelFor(levelCount, [&](enki::TaskSetPartition range, uint32 threadNum)
+        {
+            int64 numRefit = 0;
+            for(uint32 i = range.start; i < range.end; ++i)
+            {
+                const uint32 nodeIdx = refitLevelNodes[levelStart + i];
+                BVHNode& node = nodes[nodeIdx];
+                const BVHNode& left = nodes[node.Offset];
+                const BVHNode& right = nodes[node.Offset + 1];
+
+                const bool dirty = refitDirty[node.Offset] != 0 || refitDirty[node.Offset + 1] != 0;
+                refitDirty[nodeIdx] = uint8(dirty);
+                if(dirty == false)
+                    continue;
+
+                node.BoundsMin = Min3(left.BoundsMin, right.BoundsMin);
+                node.BoundsMax = Max3(left.BoundsMax, right.BoundsMax);
+                refitCosts[nodeIdx] = SubtreeCost(node, refitCosts.Data());
+                ++numRefit;
+            }
+
+            InterlockedAdd64(&numRefitNodes, numRefit);
+        });
+    }
+
+    timer.Update();
+
+    const float invRootArea = 1.0f / Max(HalfArea(nodes[0].BoundsMin, nodes[0].BoundsMax), 1e-20f);
+    refitStats.RefitTimeMs = timer.ElapsedMillisecondsD();
+    refitStats.NumChangedPrimitives = uint64(numChangedPrimitives);
+    refitStats.NumRefitNodes = uint64(numRefitNodes);
+    refitStats.RefitSAHCost = refitCosts[0] * invRootArea;
+    refitStats.SAHCost = refitStats.RefitSAHCost;
+
+    // Look for the topmost subtrees that have degraded too much since they were built. Only the
+    // nodes above a changed triangle need to be checked, since nothing else has moved.
+    GrowableList<uint32> subtreeRoots;
+    GrowableList<uint32> subtreeDepths;
+
+    struct StackEntry
+    {
+        uint32 NodeIdx;
+        uint32 Depth;
+    };
+
+    StackEntry stack[MaxDepth + 1];
+    uint32 stackSize = 0;
+    stack[stackSize++] = { 0, 0 };
+    while(stackSize > 0)
+    {
+        const StackEntry entry = stack[--stackSize];
+        const BVHNode& node = nodes[entry.NodeIdx];
+        if(refitDirty[entry.NodeIdx] == 0 || node.IsLeaf())
+            continue;
+
+        if(refitCosts[entry.NodeIdx] > refitBuiltCosts[entry.NodeIdx] * rebuildThreshold)
+        {
+            subtreeRoots.Add(entry.NodeIdx);
+            subtreeDepths.Add(entry.Depth);
+            continue;
+        }
+
+        Assert_(stackSize + 2 <= ArraySize_(stack));
+        stack[stackSize++] = { node.Offset + 1, entry.Depth + 1 };
+        stack[stackSize++] = { node.Offset, entry.Depth + 1 };
+    }
+
+    if(subtreeRoots.Count() == 0)
+    {
+        buildStats.SAHCost = refitStats.SAHCost;
+        return;
+    }
+
+    Timer rebuildTimer;
+
+    RebuildSubtrees(subtreeRoots, subtreeDepths);
+    PrepareRefit();
+
+    const double buildTimeMs = buildStats.BuildTimeMs;
+    ComputeStats();
+    buildStats.BuildTimeMs = buildTimeMs;
+
+    rebuildTimer.Update();
+    refitStats.RebuildTimeMs = rebuildTimer.ElapsedMillisecondsD();
+    refitStats.NumRebuiltSubtrees = subtreeRoots.Count();
+    refitStats.SAHCost = buildStats.SAHCost;
+}
+
+// Gathers the leaves and sorts the interior nodes by depth so that they can be refit in parallel,
+// and computes the SAH cost of every subtree
+void BVH::PrepareRefit()
+{
+    // Children always come after their parent in the node array, so a forward sweep
+    // sees every parent before its children
+    Array<uint32> depths(numNodes);
+    depths[0] = 0;
+    uint64 numLeaves = 0;
+    uint32 levelCounts[MaxDepth + 1] = { };
+    for(uint64 nodeIdx = 0; nodeIdx < numNodes; ++nodeIdx)
+    {
+        const BVHNode& node = nodes[nodeIdx];
+        if(node.IsLeaf())
+        {
+            numLeaves += 1;
+            continue;
+        }
+
+        Assert_(node.Offset > nodeIdx);
+        levelCounts[depths[nodeIdx]] += 1;
+        depths[node.Offset] = depths[nodeIdx] + 1;
+        depths[node.Offset + 1] = depths[nodeIdx] + 1;
+    }
+
+    refitLevelOffsets.Init(MaxDepth + 2, 0);
+    for(uint64 depth = 0; depth <= MaxDepth; ++depth)
+        refitLevelOffsets[depth + 1] = refitLevelOffsets[depth] + levelCounts[depth];
+
+    uint32 levelCursors[MaxDepth + 1] = { };
+    for(uint64 depth = 0; depth <= MaxDepth; ++depth)
+        levelCursors[depth] = refitLevelOffsets[depth];
+
+    refitLeaves.Init(numLeaves);
+    refitLevelNodes.Init(numNodes - numLeaves);
+    numLeaves = 0;
+    for(uint64 nodeIdx = 0; nodeIdx < numNodes; ++nodeIdx)
+    {
+        if(nodes[nodeIdx].IsLeaf())
+            refitLeaves[numLeaves++] = uint32(nodeIdx);
+        else
+            refitLevelNodes[levelCursors[depths[nodeIdx]]++] = uint32(nodeIdx);
+    }
+
+    // And a reverse sweep sees both children before their parent
+    refitCosts.Init(numNodes);
+    for(int64 nodeIdx = int64(numNodes) - 1; nodeIdx >= 0; --nodeIdx)
+        refitCosts[nodeIdx] = SubtreeCost(nodes[nodeIdx], refitCosts.Data());
+
+    refitBuiltCosts.Init(numNodes);
+    memcpy(refitBuiltCosts.Data(), refitCosts.Data(), refitCosts.MemorySize());
+
+    refitDirty.Init(numNodes, 0);
+}
+
+// Rebuilds the subtrees below a set of nodes from their current triangles, and then copies the
+// whole tree into a new node array so that the rebuilt subtrees can have a different node count
+void BVH::RebuildSubtrees(const GrowableList<uint32>& subtreeRoots, const GrowableList<uint32>& subtreeDepths)
+{
+    const uint64 numSubtrees = subtreeRoots.Count();
+    Array<Array<BVHNode>> subtreeNodes(numSubtrees);
+    Array<uint32> subtreeIndices(numNodes, uint32(-1));
+
+    for(uint64 subtreeIdx = 0; subtreeIdx < numSubtrees; ++subtreeIdx)
+    {
+        const uint32 rootIdx = subtreeRoots[subtreeIdx];
+        subtreeIndices[rootIdx] = uint32(subtreeIdx);
+
+        // The leaves below a node always cover a contiguous range of primitives
+        uint32 primStart = UINT32_MAX;
+        uint32 primCount = 0;
+        GrowableList<uint32> nodeStack;
+        nodeStack.Add(rootIdx);
+        while(nodeStack.Count() > 0)
+        {
+            const BVHNode& node = nodes[nodeStack[nodeStack.Count() - 1]];
+            nodeStack.Remove(nodeStack.Count() - 1);
+            if(node.IsLeaf())
+            {
+                primStart = Min(primStart, node.Offset);
+                primCount += node.NumPrimitives;
+            }
+            else
+            {
+                nodeStack.Add(node.Offset);
+                nodeStack.Add(node.Offset + 1);
+            }
+        }
+
+        Array<BuildPrimitive> buildPrims(primCount);
+        for(uint32 i = 0; i < primCount; ++i)
+        {
+            const BVHPrimitive& prim = primitives[primStart + i];
+            const Float3 p1 = prim.V0 + prim.E1;
+            const Float3 p2 = prim.V0 + prim.E2;
+
+            BuildPrimitive& buildPrim = buildPrims[i];
+            buildPrim.BoundsMin = Min3(Min3(prim.V0, p1), p2);
+            buildPrim.BoundsMax = Max3(Max3(prim.V0, p1), p2);
+            buildPrim.Centroid = (buildPrim.BoundsMin + buildPrim.BoundsMax) * 0.5f;
+            buildPrim.PrimIdx = i;
+        }
+
+        Array<BVHNode>& dstNodes = subtreeNodes[subtreeIdx];
+        dstNodes.Init(primCount * 2);
+
+        BuildContext context;
+        context.Prims = buildPrims.Data();
+        context.Nodes = dstNodes.Data();
+        context.NumNodes = 1;
+
+        BuildBin rootBin;
+        BinRange(context.Prims, primCount, primCount >= ParallelBinningThreshold, rootBin);
+
+        // Start at the original depth so that the subtree still respects MaxDepth
+        BuildTask rootTask;
+        rootTask.NodeIdx = 0;
+        rootTask.Start = 0;
+        rootTask.Count = primCount;
+        rootTask.Depth = subtreeDepths[subtreeIdx];
+        rootTask.CentroidMin = rootBin.CentroidMin;
+        rootTask.CentroidMax = rootBin.CentroidMax;
+        dstNodes[0].BoundsMin = rootBin.BoundsMin;
+        dstNodes[0].BoundsMax = rootBin.BoundsMax;
+
+        BuildNodes(context, rootTask);
+
+        // Put the primitives in the new leaf order, and point the leaves at the subtree's range
+        Array<BVHPrimitive> subtreePrims(primCount);
+        for(uint32 i = 0; i < primCount; ++i)
+            subtreePrims[i] = primitives[primStart + buildPrims[i].PrimIdx];
+        for(uint32 i = 0; i < primCount; ++i)
+            primitives[primStart + i] = subtreePrims[i];
+
+        for(int64 nodeIdx = 0; nodeIdx < context.NumNodes; ++nodeIdx)
+        {
+            if(dstNodes[nodeIdx].IsLeaf())
+                dstNodes[nodeIdx].Offset += primStart;
+        }
+
+        refitStats.NumRebuiltPrimitives += primCount;
+    }
+
+    // Copy the tree depth-first, switching over to the new nodes at the root of each rebuilt subtree
+    struct CopyEntry
+    {
+        uint32 SrcIdx;
+        uint32 DstIdx;
+        uint32 Subtree;
+    };
+
+    Array<BVHNode> newNodes(nodes.Size());
+    uint32 newNumNodes = 1;
+
+    GrowableList<CopyEntry> copyStack;
+    copyStack.Add({ 0, 0, uint32(-1) });
+    while(copyStack.Count() > 0)
+    {
+        CopyEntry entry = copyStack[copyStack.Count() - 1];
+        copyStack.Remove(copyStack.Count() - 1);
+
+        if(entry.Subtree == uint32(-1) && subtreeIndices[entry.SrcIdx] != uint32(-1))
+        {
+            entry.Subtree = subtreeIndices[entry.SrcIdx];
+            entry.SrcIdx = 0;
+        }
+
+        BVHNode node = entry.Subtree == uint32(-1) ? nodes[entry.SrcIdx] : subtreeNodes[entry.Subtree][entry.SrcIdx];
+        if(node.IsLeaf() == false)
+        {
+            const uint32 childIdx = newNumNodes;
+            newNumNodes += 2;
+            copyStack.Add({ node.Offset + 1, childIdx + 1, entry.Subtree });
+            copyStack.Add({ node.Offset, childIdx, entry.Subtree });
+            node.Offset = childIdx;
+        }
+
+        newNodes[entry.DstIdx] = node;
+    }
+
+    Assert_(newNumNodes <= nodes.Size());
+    numNodes = newNumNodes;
+    memcpy(nodes.Data(), newNodes.Data(), numNodes * sizeof(BVHNode));
+}
+
+void BVH::LoadOrBuild(const Model& model)
+{
+    Shutdown();
+
+    // Generated models don't have a directory to put the cache in
+    if(model.FileDirectory().length() == 0)
+    {
+        Build(model);
+        return;
+    }
+
+    Timer timer;
+
+    const Hash geometryHash = GeometryHash(model);
+    const std::wstring cachePath = CacheFilePath(model, geometryHash);
+    if(LoadFromCache(model, cachePath.c_str(), geometryHash))
+    {
+        timer.Update();
+        WriteLog(L"Loaded BVH for %llu triangles from '%ls' in %.2f ms (the original build took %.2f ms)",
+                 buildStats.NumTriangles, cachePath.c_str(), timer.ElapsedMillisecondsD(), buildStats.BuildTimeMs);
+        return;
+    }
+
+    Build(model);
+    SaveToCache(cachePath.c_str(), geometryHash);
+}
+
+Hash BVH::GeometryHash(const Model& model)
+{
+    // Mesh boundaries matter too, since the primitives store mesh indices
+    const uint64 numMeshes = model.NumMeshes();
+    Hash hash = GenerateHash(&numMeshes, sizeof(numMeshes), CacheFileVersion);
+
+    // The mesh data file already has a hash of the geometry, and using it saves touching every page of
+    // the mapped vertex and index data
+    if(!(model.MeshDataHash() == Hash()))
+        return CombineHashes(hash, model.MeshDataHash());
+
+    Array<Hash> meshHashes(numMeshes);
+    Tasks::ParallelFor(uint32(numMeshes), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 meshIdx = range.start; meshIdx < range.end; ++meshIdx)
+        {
+            const Mesh& mesh = model.Meshes()[meshIdx];
+            const uint64 vertexDataSize = uint64(mesh.NumVertices()) * sizeof(MeshVertex);
+            const uint64 indexDataSize = uint64(mesh.NumIndices()) * (mesh.IndexBufferType() == IndexType::Index32Bit ? 4 : 2);
+            Assert_(vertexDataSize <= INT32_MAX && indexDataSize <= INT32_MAX);
+
+            const void* indices = mesh.IndexBufferType() == IndexType::Index32Bit ? (const void*)mesh.Indices32() : (const void*)mesh.Indices();
+            meshHashes[meshIdx] = CombineHashes(GenerateHash(mesh.Vertices(), int32(vertexDataSize)),
+                                                GenerateHash(indices, int32(indexDataSize)));
+        }
+    });
+
+    for(uint64 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+        hash = CombineHashes(hash, meshHashes[meshIdx]);
+
+    return hash;
+}
+
+std::wstring BVH::CacheFilePath(const Model& model, Hash geometryHash)
+{
+    return model.FileDirectory() + L"BVH_" + geometryHash.ToString() + L".bvhcache";
+}
+
+// The geometry hash only tells us which model a cache file was built for, so a corrupted file could
+// still have nodes and primitives that would send traversal outside of the arrays
+static bool ValidateCachedBVH(const Model& model, const Array<BVHNode>& nodes, uint64 numNodes, const Array<BVHPrimitive>& primitives)
+{
+    const uint64 numPrimitives = primitives.Size();
+    for(uint64 nodeIdx = 0; nodeIdx < numNodes; ++nodeIdx)
+    {
+        // Children always come after their parent, which also rules out cycles
+        const BVHNode& node = nodes[nodeIdx];
+        if(node.IsLeaf() && uint64(node.Offset) + node.NumPrimitives > numPrimitives)
+            return false;
+        if(node.IsLeaf() == false && (node.Offset <= nodeIdx || uint64(node.Offset) + 1 >= numNodes))
+            return false;
+    }
+
+    const uint64 numMeshes = model.NumMeshes();
+    for(uint64 primIdx = 0; primIdx < numPrimitives; ++primIdx)
+    {
+        const BVHPrimitive& prim = primitives[primIdx];
+        if(prim.MeshIdx >= numMeshes || prim.TriangleIdx >= model.Meshes()[prim.MeshIdx].NumIndices() / 3)
+            return false;
+    }
+
+    return true;
+}
+
+bool BVH::LoadFromCache(const Model& model, const wchar* filePath, Hash geometryHash)
+{
+    Shutdown();
+
+    if(FileExists(filePath) == false)
+        return false;
+
+    try
+    {
+        FileReadSerializer serializer(filePath);
+
+        uint32 magic = 0;
+        uint32 version = 0;
+        Hash fileHash;
+        SerializeItem(serializer, magic);
+        SerializeItem(serializer, version);
+        SerializeItem(serializer, fileHash.A);
+        SerializeItem(serializer, fileHash.B);
+        if(magic != CacheFileMagic || version != CacheFileVersion || !(fileHash == geometryHash))
+            return false;
+
+        uint64 fileNumNodes = 0;
+        uint64 numPrimitives = 0;
+        SerializeItem(serializer, fileNumNodes);
+        SerializeItem(serializer, numPrimitives);
+
+        // Check the counts against each other and against the file size before allocating anything, so that
+        // a corrupted file can't request an allocation that would fail (or succeed and then read garbage)
+        const uint64 headerSize = sizeof(magic) + sizeof(version) + sizeof(fileHash.A) + sizeof(fileHash.B) +
+                                  sizeof(fileNumNodes) + sizeof(numPrimitives);
+        const uint64 fileSize = serializer.FileSize();
+        const uint64 dataSize = fileSize > headerSize ? fileSize - headerSize : 0;
+        if(numPrimitives == 0 || numPrimitives > dataSize / sizeof(BVHPrimitive) ||
+           fileNumNodes == 0 || fileNumNodes > numPrimitives * 2)
+            return false;
+
+        // Neither product can overflow once the counts are bounded by the file size above
+        const uint64 expectedDataSize = fileNumNodes * sizeof(BVHNode) + numPrimitives * sizeof(BVHPrimitive) +
+                                        sizeof(BVHBuildStats) + sizeof(uint32);
+        if(expectedDataSize != dataSize)
+            return false;
+
+        numNodes = fileNumNodes;
+        nodes.Init(numNodes);
+        primitives.Init(numPrimitives);
+        SerializeContents(serializer);
+
+        uint32 footer = 0;
+        SerializeItem(serializer, footer);
+        if(footer != CacheFileMagic || ValidateCachedBVH(model, nodes, numNodes, primitives) == false)
+        {
+            Shutdown();
+            return false;
+        }
+    }
+    catch(Exception& exception)
+    {
+        WriteLog(L"Failed to load BVH cache file '%ls': %ls", filePath, exception.GetMessage().c_str());
+        Shutdown();
+        return false;
+    }
+
+    return true;
+}
+
+void BVH::SaveToCache(const wchar* filePath, Hash geometryHash) const
+{
+    Assert_(numNodes > 0);
+
+    // Write to a temporary file first, so that an interrupted write doesn't leave a partial cache file
+    const std::wstring tempPath = std::wstring(filePath) + L".tmp";
+
+    try
+    {
+        {
+            FileWriteSerializer serializer(tempPath.c_str());
+
+            uint32 magic = CacheFileMagic;
+            uint32 version = CacheFileVersion;
+            SerializeItem(serializer, magic);
+            SerializeItem(serializer, version);
+            SerializeItem(serializer, geometryHash.A);
+            SerializeItem(serializer, geometryHash.B);
+
+            uint64 fileNumNodes = numNodes;
+            uint64 numPrimitives = primitives.Size();
+            SerializeItem(serializer, fileNumNodes);
+            SerializeItem(serializer, numPrimitives);
+
+            const_cast<BVH*>(this)->SerializeContents(serializer);
+
+            SerializeItem(serializer, magic);
+        }
+
+        Win32Call(MoveFileEx(tempPath.c_str(), filePath, MOVEFILE_REPLACE_EXISTING));
+    }
+    catch(Exception& exception)
+    {
+        // The cache is optional, so failing to write it (for instance to a read-only directory) isn't fatal
+        WriteLog(L"Failed to write BVH cache file '%ls': %ls", filePath, exception.GetMessage().c_str());
+    }
+}
+
+void BVH::ComputeStats()
+{
+    buildStats = BVHBuildStats();
+    buildStats.NumTriangles = primitives.Size();
+    buildStats.NumNodes = numNodes;
+    if(numNodes == 0)
+        return;
+
+    const float invRootArea = 1.0f / Max(HalfArea(nodes[0].BoundsMin, nodes[0].BoundsMax), 1e-20f);
+
+    struct StackEntry
+    {
+        uint32 NodeIdx;
+        uint32 Depth;
+    };
+
+    StackEntry stack[MaxDepth + 1];
+    uint32 stackSize = 0;
+    stack[stackSize++] = { 0, 0 };
+
+    float sahCost = 0.0f;
+    while(stackSize > 0)
+    {
+        const StackEntry entry = stack[--stackSize];
+        const BVHNode& node = nodes[entry.NodeIdx];
+        const float relativeArea = HalfArea(node.BoundsMin, node.BoundsMax) * invRootArea;
+
+        buildStats.MaxDepth = Max<uint64>(buildStats.MaxDepth, entry.Depth);
+
+        if(node.IsLeaf())
+        {
+            buildStats.NumLeaves += 1;
+            buildStats.MaxLeafPrimitives = Max<uint64>(buildStats.MaxLeafPrimitives, node.NumPrimitives);
+            sahCost += relativeArea * node.NumPrimitives * SAHIntersectCost;
+        }
+        else
+        {
+            buildStats.NumInteriorNodes += 1;
+            sahCost += relativeArea * SAHTraversalCost;
+
+            Assert_(stackSize + 2 <= ArraySize_(stack));
+            stack[stackSize++] = { node.Offset + 1, entry.Depth + 1 };
+            stack[stackSize++] = { node.Offset, entry.Depth + 1 };
+        }
+    }
+
+    buildStats.AvgLeafPrimitives = float(buildStats.NumTriangles) / float(buildStats.NumLeaves);
+    buildStats.SAHCost = sahCost;
+}
+
+void BVH::Shutdown()
+{
+    nodes.Shutdown();
+    primitives.Shutdown();
+    numNodes = 0;
+
+    refitLeaves.Shutdown();
+    refitLevelNodes.Shutdown();
+    refitLevelOffsets.Shutdown();
+    refitDirty.Shutdown();
+    refitCosts.Shutdown();
+    refitBuiltCosts.Shutdown();
+}
+
+template<bool AnyHit> bool BVH::Traverse(const BVHRay& ray, BVHHit& hit, BVHHitFilter filter, const void* filterContext) const
+{
+    if(numNodes == 0)
+        return false;
+
+    const Float3 origin = ray.Origin;
+    const Float3 dir = ray.Direction;
+    const Float3 invDir = SafeInverseDirection(dir);
+    float tMax = ray.TMax;
+    bool foundHit = false;
+
+    uint32 stack[MaxDepth];
+    uint32 stackSize = 0;
+
+    const BVHNode* nodeData = nodes.Data();
+    if(IntersectRayBounds(nodeData[0].BoundsMin, nodeData[0].BoundsMax, origin, invDir, ray.TMin, tMax) == FloatMax)
+        return false;
+
+    uint32 nodeIdx = 0;
+    while(true)
+    {
+        const BVHNode& node = nodeData[nodeIdx];
+        if(node.IsLeaf())
+        {
+            for(uint32 i = 0; i < node.NumPrimitives; ++i)
+            {
+                const BVHPrimitive& prim = primitives[node.Offset + i];
+                float t, u, v;
+                if(IntersectRayTriangle(prim, origin, dir, ray.TMin, tMax, t, u, v) == false)
+                    continue;
+
+                BVHHit candidate;
+                candidate.T = t;
+                candidate.U = u;
+                candidate.V = v;
+                candidate.MeshIdx = prim.MeshIdx;
+                candidate.TriangleIdx = prim.TriangleIdx;
+                if(filter != nullptr && filter(filterContext, candidate) == false)
+                    continue;
+
+                hit = candidate;
+                tMax = t;
+                foundHit = true;
+
+                if(AnyHit)
+                    return true;
+            }
+        }
+        else
+        {
+            // Visit the closer child first, and push the other one
+            const uint32 leftIdx = node.Offset;
+            const uint32 rightIdx = node.Offset + 1;
+            const float tLeft = IntersectRayBounds(nodeData[leftIdx].BoundsMin, nodeData[leftIdx].BoundsMax, origin, invDir, ray.TMin, tMax);
+            const float tRight = IntersectRayBounds(nodeData[rightIdx].BoundsMin, nodeData[rightIdx].BoundsMax, origin, invDir, ray.TMin, tMax);
+
+            if(tLeft != FloatMax && tRight != FloatMax)
+            {
+                Assert_(stackSize < MaxDepth);
+                if(tLeft <= tRight)
+                {
+                    stack[stackSize++] = rightIdx;
+                    nodeIdx = leftIdx;
+                }
+                else
+                {
+                    stack[stackSize++] = leftIdx;
+                    nodeIdx = rightIdx;
+                }
+                continue;
+            }
+            else if(tLeft != FloatMax)
+            {
+                nodeIdx = leftIdx;
+                continue;
+            }
+            else if(tRight != FloatMax)
+            {
+                nodeIdx = rightIdx;
+                continue;
+            }
+        }
+
+        if(stackSize == 0)
+            break;
+        nodeIdx = stack[--stackSize];
+    }
+
+    return foundHit;
+}
+
+bool BVH::Intersect(const BVHRay& ray, BVHHit& hit, BVHHitFilter filter, const void* filterContext) const
+{
+    hit = BVHHit();
+    return Traverse<false>(ray, hit, filter, filterContext);
+}
+
+bool BVH::Occluded(const BVHRay& ray, BVHHitFilter filter, const void* filterContext) const
+{
+    BVHHit hit;
+    return Traverse<true>(ray, hit, filter, filterContext);
+}
+
+template<bool AnyHit> void BVH::TraversePacket(const BVHRay* rays, uint32 numRays, BVHHit* hits, bool* occluded,
+                                               BVHHitFilter filter, const void* filterContext) const
+{
+    Assert_(numRays <= MaxPacketSize);
+    if(numNodes == 0 || numRays == 0)
+        return;
+
+    Float3 invDirs[MaxPacketSize];
+    float tMax[MaxPacketSize];
+    bool done[MaxPacketSize] = { };
+
+    PacketFrustum frustum;
+    bool useFrustum = true;
+    for(uint32 axis = 0; axis < 3; ++axis)
+    {
+        frustum.OriginMin[axis] = frustum.InvDirMin[axis] = FloatMax;
+        frustum.OriginMax[axis] = frustum.InvDirMax[axis] = -FloatMax;
+        frustum.Positive[axis] = rays[0].Direction[axis] >= 0.0f;
+    }
+
+    for(uint32 rayIdx = 0; rayIdx < numRays; ++rayIdx)
+    {
+        const BVHRay& ray = rays[rayIdx];
+        invDirs[rayIdx] = SafeInverseDirection(ray.Direction);
+        tMax[rayIdx] = ray.TMax;
+
+        for(uint32 axis = 0; axis < 3; ++axis)
+        {
+            frustum.OriginMin[axis] = Min(frustum.OriginMin[axis], ray.Origin[axis]);
+            frustum.OriginMax[axis] = Max(frustum.OriginMax[axis], ray.Origin[axis]);
+            frustum.InvDirMin[axis] = Min(frustum.InvDirMin[axis], invDirs[rayIdx][axis]);
+            frustum.InvDirMax[axis] = Max(frustum.InvDirMax[axis], invDirs[rayIdx][axis]);
+            useFrustum = useFrustum && ((ray.Direction[axis] >= 0.0f) == frustum.Positive[axis]);
+        }
+
+        frustum.TMin = Min(frustum.TMin, ray.TMin);
+        frustum.TMax = Max(frustum.TMax, ray.TMax);
+    }
+
+    // Each stack entry remembers the first ray that was still active when it was pushed,
+    // since rays that missed the parent can't hit the child
+    struct StackEntry
+    {
+        uint32 NodeIdx;
+        uint32 FirstActive;
+    };
+
+    StackEntry stack[MaxDepth + 1];
+    uint32 stackSize = 0;
+    stack[stackSize++] = { 0, 0 };
+
+    const BVHNode* nodeData = nodes.Data();
+    while(stackSize > 0)
+    {
+        const StackEntry entry = stack[--stackSize];
+        const BVHNode& node = nodeData[entry.NodeIdx];
+
+        if(useFrustum && FrustumMissesBounds(frustum, node.BoundsMin, node.BoundsMax))
+            continue;
+
+        // Find the first ray that hits the node
+        uint32 firstActive = entry.FirstActive;
+        float firstActiveT = FloatMax;
+        for(; firstActive < numRays; ++firstActive)
+        {
+            if(done[firstActive])
+                continue;
+
+            const BVHRay& ray = rays[firstActive];
+            firstActiveT = IntersectRayBounds(node.BoundsMin, node.BoundsMax, ray.Origin, invDirs[firstActive], ray.TMin, tMax[firstActive]);
+            if(firstActiveT != FloatMax)
+                break;
+        }
+
+        if(firstActive == numRays)
+            continue;
+
+        if(node.IsLeaf())
+        {
+            for(uint32 rayIdx = firstActive; rayIdx < numRays; ++rayIdx)
+            {
+                if(done[rayIdx])
+                    continue;
+
+                const BVHRay& ray = rays[rayIdx];
+                for(uint32 i = 0; i < node.NumPrimitives; ++i)
+                {
+                    const BVHPrimitive& prim = primitives[node.Offset + i];
+                    float t, u, v;
+                    if(IntersectRayTriangle(prim, ray.Origin, ray.Direction, ray.TMin, tMax[rayIdx], t, u, v) == false)
+                        continue;
+
+                    BVHHit candidate;
+                    candidate.T = t;
+                    candidate.U = u;
+                    candidate.V = v;
+                    candidate.MeshIdx = prim.MeshIdx;
+                    candidate.TriangleIdx = prim.TriangleIdx;
+                    if(filter != nullptr && filter(filterContext, candidate) == false)
+                        continue;
+
+                    tMax[rayIdx] = t;
+
+                    if(AnyHit)
+                    {
+                        occluded[rayIdx] = true;
+                        done[rayIdx] = true;
+                        break;
+                    }
+                    else
+                    {
+                        hits[rayIdx] = candidate;
+                    }
+                }
+            }
+
+            continue;
+        }
+
+        // Order the children using the first active ray
+        const BVHRay& firstRay = rays[firstActive];
+        const uint32 leftIdx = node.Offset;
+        const uint32 rightIdx = node.Offset + 1;
+        const float tLeft = IntersectRayBounds(nodeData[leftIdx].BoundsMin, nodeData[leftIdx].BoundsMax, firstRay.Origin,
+                                               invDirs[firstActive], firstRay.TMin, tMax[firstActive]);
+        const float tRight = IntersectRayBounds(nodeData[rightIdx].BoundsMin, nodeData[rightIdx].BoundsMax, firstRay.Origin,
+                                                invDirs[firstActive], firstRay.TMin, tMax[firstActive]);
+
+        Assert_(stackSize + 2 <= ArraySize_(stack));
+        if(tLeft <= tRight)
+        {
+            stack[stackSize++] = { rightIdx, firstActive };
+            stack[stackSize++] = { leftIdx, firstActive };
+        }
+        else
+        {
+            stack[stackSize++] = { leftIdx, firstActive };
+            stack[stackSize++] = { rightIdx, firstActive };
+        }
+    }
+}
+
+void BVH::IntersectPacket(const BVHRay* rays, uint32 numRays, BVHHit* hits, BVHHitFilter filter, const void* filterContext) const
+{
+    for(uint32 rayIdx = 0; rayIdx < numRays; ++rayIdx)
+        hits[rayIdx] = BVHHit();
+    TraversePacket<false>(rays, numRays, hits, nullptr, filter, filterContext);
+}
+
+void BVH::OccludedPacket(const BVHRay* rays, uint32 numRays, bool* occluded, BVHHitFilter filter, const void* filterContext) const
+{
+    for(uint32 rayIdx = 0; rayIdx < numRays; ++rayIdx)
+        occluded[rayIdx] = false;
+    TraversePacket<true>(rays, numRays, nullptr, occluded, filter, filterContext);
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,269 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "..\\PCH.h"
+#include "..\\SF12_Math.h"
+#include "..\\Containers.h"
+#include "..\\MurmurHash.h"
+#include "..\\Serialization.h"
+
+namespace SampleFramework12
+{
+
+class Model;
+
+struct BVHRay
+{
+    Float3 Origin;
+    Float3 Direction;
+    float TMin = 0.0f;
+    float TMax = FloatMax;
+};
+
+struct BVHHit
+{
+    float T = FloatMax;
+
+    // Barycentrics of vertex 1 and 2, same convention as BuiltInTriangleIntersectionAttributes
+    float U = 0.0f;
+    float V = 0.0f;
+
+    uint32 MeshIdx = uint32(-1);
+    uint32 TriangleIdx = uint32(-1);
+    uint32 InstanceIdx = uint32(-1);    // Only set by TwoLevelBVH
+
+    bool Valid() const { return MeshIdx != uint32(-1); }
+};
+
+// Called for every candidate hit that's closer than the current hit. Returning false ignores
+// the hit, which can be used to implement alpha testing the same way as an any-hit shader
+typedef bool (*BVHHitFilter)(const void* context, const BVHHit& hit);
+
+struct BVHNode
+{
+    Float3 BoundsMin;
+    uint32 Offset = 0;          // Index of the first child for interior nodes, or the first primitive for leaves
+    Float3 BoundsMax;
+    uint32 NumPrimitives = 0;   // 0 for interior nodes
+
+    bool IsLeaf() const { return NumPrimitives > 0; }
+};
+
+StaticAssert_(sizeof(BVHNode) == 32);
+
+// Pre-transformed triangle, stored in an edge-based form for ray intersection
+struct BVHPrimitive
+{
+    Float3 V0;
+    Float3 E1;
+    Float3 E2;
+    uint32 MeshIdx = 0;
+    uint32 TriangleIdx = 0;
+};
+
+// Moller-Trumbore ray/triangle test with no backface culling, to match DXR's default behavior
+inline bool IntersectRayTriangle(const BVHPrimitive& prim, const Float3& origin, const Float3& dir,
+                                 float tMin, float tMax, float& t, float& u, float& v)
+{
+    const Float3 p = Float3(dir.y * prim.E2.z - dir.z * prim.E2.y, dir.z * prim.E2.x - dir.x * prim.E2.z, dir.x * prim.E2.y - dir.y * prim.E2.x);
+    const float det = prim.E1.x * p.x + prim.E1.y * p.y + prim.E1.z * p.z;
+    if(std::abs(det) < 1e-12f)
+        return false;
+
+    const float invDet = 1.0f / det;
+    const Float3 toOrigin = origin - prim.V0;
+    u = (toOrigin.x * p.x + toOrigin.y * p.y + toOrigin.z * p.z) * invDet;
+    if(u < 0.0f || u > 1.0f)
+        return false;
+
+    const Float3 q = Float3(toOrigin.y * prim.E1.z - toOrigin.z * prim.E1.y, toOrigin.z * prim.E1.x - toOrigin.x * prim.E1.z, toOrigin.x * prim.E1.y - toOrigin.y * prim.E1.x);
+    v = (dir.x * q.x + dir.y * q.y + dir.z * q.z) * invDet;
+    if(v < 0.0f || u + v > 1.0f)
+        return false;
+
+    t = (prim.E2.x * q.x + prim.E2.y * q.y + prim.E2.z * q.z) * invDet;
+    return t >= tMin && t <= tMax;
+}
+
+// Reciprocal of a ray direction, with zero components nudged so that slab tests don't produce NaNs
+inline Float3 SafeInverseDirection(const Float3& dir)
+{
+    const float eps = 1e-20f;
+    return Float3(1.0f / (std::abs(dir.x) > eps ? dir.x : (dir.x < 0.0f ? -eps : eps)),
+                  1.0f / (std::abs(dir.y) > eps ? dir.y : (dir.y < 0.0f ? -eps : eps)),
+                  1.0f / (std::abs(dir.z) > eps ? dir.z : (dir.z < 0.0f ? -eps : eps)));
+}
+
+// Slab test, returns the entry distance or FloatMax if the box is missed
+inline float IntersectRayBounds(const Float3& boundsMin, const Float3& boundsMax, const Float3& origin,
+                                const Float3& invDir, float tMin, float tMax)
+{
+    float tx0 = (boundsMin.x - origin.x) * invDir.x;
+    float tx1 = (boundsMax.x - origin.x) * invDir.x;
+    float ty0 = (boundsMin.y - origin.y) * invDir.y;
+    float ty1 = (boundsMax.y - origin.y) * invDir.y;
+    float tz0 = (boundsMin.z - origin.z) * invDir.z;
+    float tz1 = (boundsMax.z - origin.z) * invDir.z;
+
+    float tEnter = Max(Max(Min(tx0, tx1), Min(ty0, ty1)), Max(Min(tz0, tz1), tMin));
+    float tExit = Min(Min(Max(tx0, tx1), Max(ty0, ty1)), Min(Max(tz0, tz1), tMax));
+
+    return tEnter <= tExit ? tEnter : FloatMax;
+}
+
+// Builds a binary tree over a set of boxes with the same binned SAH builder that BVH uses, for trees whose
+// leaves reference something other than triangles (such as the instances in a TwoLevelBVH). Each leaf
+// references a range of leafOrder, which holds indices into the boxes. Returns the number of nodes.
+uint64 BuildBoundsTree(const Float3* boundsMin, const Float3* boundsMax, uint64 numBounds,
+                       Array<BVHNode>& nodes, Array<uint32>& leafOrder);
+
+struct BVHBuildStats
+{
+    double BuildTimeMs = 0.0;
+    uint64 NumTriangles = 0;
+    uint64 NumNodes = 0;
+    uint64 NumInteriorNodes = 0;
+    uint64 NumLeaves = 0;
+    uint64 MaxLeafPrimitives = 0;
+    float AvgLeafPrimitives = 0.0f;
+    uint64 MaxDepth = 0;
+    float SAHCost = 0.0f;       // Expected cost of a random ray, relative to a single triangle test
+};
+
+// Subtrees are rebuilt by BVH::Refit() once their SAH cost is this many times higher than when they were built
+static const float BVHDefaultRebuildThreshold = 1.5f;
+
+struct BVHRefitStats
+{
+    double RefitTimeMs = 0.0;
+    double RebuildTimeMs = 0.0;
+    uint64 NumChangedPrimitives = 0;
+    uint64 NumRefitNodes = 0;
+    uint64 NumRebuiltSubtrees = 0;
+    uint64 NumRebuiltPrimitives = 0;
+    float RefitSAHCost = 0.0f;  // After refitting, but before any subtrees were rebuilt
+    float SAHCost = 0.0f;
+};
+
+// Binary BVH over all of the triangles in a Model, in the same world space that the GPU
+// acceleration structure is built in. The two children of an interior node are always stored
+// next to each other in the node array. Built top-down with binned SAH, using the task scheduler
+// to bin large nodes and to build independent subtrees in parallel
+class BVH
+{
+
+public:
+
+    ~BVH()
+    {
+        Assert_(nodes.Size() == 0);
+    }
+
+    void Build(const Model& model);
+    void Shutdown();
+
+    // Builds a BVH over the triangles of a single mesh, in the mesh's own space. This is what the
+    // bottom-level BVHs in a TwoLevelBVH use.
+    void Build(const Model& model, uint32 meshIdx);
+
+    // Builds a BVH over an arbitrary set of triangles
+    void Build(const BVHPrimitive* srcPrimitives, uint64 numSrcPrimitives);
+
+    // Updates the tree after the vertices of some meshes have changed, either in the model itself or
+    // through the optional per-mesh transforms (which are applied to the model's vertex positions).
+    // The triangles of the changed meshes are re-read, and the bounds of every node above them are
+    // refit bottom-up. The topology is left alone unless a subtree's SAH cost has grown by more than
+    // rebuildThreshold since it was built, in which case the largest such subtrees are rebuilt.
+    void Refit(const Model& model, const uint32* changedMeshes, uint64 numChangedMeshes,
+               const Float4x4* meshTransforms = nullptr, float rebuildThreshold = BVHDefaultRebuildThreshold);
+
+    // Loads the BVH from a cache file next to the model's mesh data if one exists for the
+    // same geometry, otherwise builds it and writes the cache file
+    void LoadOrBuild(const Model& model);
+
+    // Hash of all vertex and index data in the model, which is what the cache is keyed on. Models
+    // with a mesh data file use the hash that's stored in it instead of hashing their data again.
+    static Hash GeometryHash(const Model& model);
+    static std::wstring CacheFilePath(const Model& model, Hash geometryHash);
+
+    // Returns false and leaves the BVH empty if the file is missing, truncated, from an older
+    // version, was built from different geometry, or has nodes or primitives that point outside of
+    // the BVH or the model
+    bool LoadFromCache(const Model& model, const wchar* filePath, Hash geometryHash);
+    void SaveToCache(const wchar* filePath, Hash geometryHash) const;
+
+    // Returns the closest hit within [TMin, TMax]
+    bool Intersect(const BVHRay& ray, BVHHit& hit, BVHHitFilter filter = nullptr, const void* filterContext = nullptr) const;
+
+    // Returns true if anything is hit within [TMin, TMax], without finding the closest hit
+    bool Occluded(const BVHRay& ray, BVHHitFilter filter = nullptr, const void* filterContext = nullptr) const;
+
+    // Packet versions of the above for up to MaxPacketSize coherent rays (such as a block of camera rays),
+    // which traverse the tree together and share the node visits. Nodes are culled against the bounding
+    // frustum of the packet when all rays have the same direction signs. Results match the single-ray queries.
+    void IntersectPacket(const BVHRay* rays, uint32 numRays, BVHHit* hits, BVHHitFilter filter = nullptr, const void* filterContext = nullptr) const;
+    void OccludedPacket(const BVHRay* rays, uint32 numRays, bool* occluded, BVHHitFilter filter = nullptr, const void* filterContext = nullptr) const;
+
+    // Accessors
+    const BVHNode* Nodes() const { return nodes.Data(); }
+    uint64 NumNodes() const { return numNodes; }
+    const Array<BVHPrimitive>& Primitives() const { return primitives; }
+    uint64 NumPrimitives() const { return primitives.Size(); }
+
+    const Float3& BoundsMin() const { return nodes[0].BoundsMin; }
+    const Float3& BoundsMax() const { return nodes[0].BoundsMax; }
+
+    uint64 MemorySize() const { return nodes.MemorySize() + primitives.MemorySize(); }
+
+    const BVHBuildStats& BuildStats() const { return buildStats; }
+    const BVHRefitStats& RefitStats() const { return refitStats; }
+
+    static const uint64 MaxLeafSize = 4;
+    static const uint64 MaxDepth = 64;
+    static const uint64 NumSAHBins = 16;
+    static const uint64 MaxPacketSize = 64;
+
+protected:
+
+    template<bool AnyHit> bool Traverse(const BVHRay& ray, BVHHit& hit, BVHHitFilter filter, const void* filterContext) const;
+    template<bool AnyHit> void TraversePacket(const BVHRay* rays, uint32 numRays, BVHHit* hits, bool* occluded,
+                                              BVHHitFilter filter, const void* filterContext) const;
+
+    void ComputeStats();
+
+    void PrepareRefit();
+    void RebuildSubtrees(const GrowableList<uint32>& subtreeRoots, const GrowableList<uint32>& subtreeDepths);
+
+    // The node and primitive counts are serialized separately by LoadFromCache()/SaveToCache(), so that they
+    // can be validated before the arrays are allocated
+    template<typename TSerializer> void SerializeContents(TSerializer& serializer)
+    {
+        BulkSerializeArray(serializer, nodes.Data(), numNodes);
+        BulkSerializeArray(serializer, primitives.Data(), primitives.Size());
+        SerializeData(serializer, buildStats);
+    }
+
+    Array<BVHNode> nodes;
+    uint64 numNodes = 0;
+    Array<BVHPrimitive> primitives;
+    BVHBuildStats buildStats;
+
+    // Data for refitting, which is only created once Refit() is called
+    Array<uint32> refitLeaves;
+    Array<uint32> refitLevelNodes;      // Interior nodes sorted by depth
+    Array<uint32> refitLevelOffsets;    // Start of each depth in refitLevelNodes
+    Array<uint8> refitDirty;
+    Array<float> refitCosts;            // Un-normalized SAH cost of the subtree below each node
+    Array<float> refitBuiltCosts;       // Same, but from when the subtree was last built
+    BVHRefitStats refitStats;
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,706 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include <immintrin.h>
+
+#include "BVH8.h"
+#include "..\\Utility.h"
+#include "..\\Timer.h"
+
+namespace SampleFramework12
+{
+
+struct CollapseTask
+{
+    uint32 SrcNodeIdx = 0;
+    uint32 DstNodeIdx = 0;
+};
+
+// No default initializers, since the traversal stack is a big local array
+struct TraversalEntry
+{
+    uint32 Index;
+    uint32 NumPrimitives;   // Non-zero for leaves
+    float TNear;
+};
+
+static float HalfArea(const BVHNode& node)
+{
+    Float3 extents = node.BoundsMax - node.BoundsMin;
+    return extents.x * extents.y + extents.y * extents.z + extents.z * extents.x;
+}
+
+// Float with the given exponent and a mantissa of 1, for exponents in [-126, 127]
+static float ExponentToScale(int32 exponent)
+{
+    const uint32 bits = uint32(exponent + 127) << 23;
+    float scale = 0.0f;
+    memcpy(&scale, &bits, sizeof(float));
+    return scale;
+}
+
+// Picks the smallest power-of-two step that lets 255 steps cover the node's extent on an axis
+static int32 QuantizationExponent(float boundsMin, float boundsMax)
+{
+    const float extent = boundsMax - boundsMin;
+    int32 exponent = -126;
+    if(extent > 0.0f)
+        exponent = Clamp(int32(std::ceil(std::log2(extent / 255.0f))), -126, 127);
+
+    // The addition can round down, in which case the far end would fall short of the max bounds
+    while(exponent < 127 && boundsMin + 255.0f * ExponentToScale(exponent) < boundsMax)
+        ++exponent;
+
+    return exponent;
+}
+
+// Rounds a child's bounds outwards to the quantization grid: the min bound rounds toward -inf and the
+// max bound toward +inf. The bound is padded by an ulp first, so that the dequantized box still contains
+// the child after the small rounding error of the slab test in traversal. The loops fix up the cases
+// where the division rounded to the wrong side of a grid point.
+static uint8 QuantizeMin(float value, float origin, float scale)
+{
+    const float padded = std::nextafter(value, -FloatMax);
+    int32 q = Clamp(int32(std::floor((padded - origin) / scale)), 0, 255);
+    while(q > 0 && origin + float(q) * scale > padded)
+        --q;
+    return uint8(q);
+}
+
+static uint8 QuantizeMax(float value, float origin, float scale)
+{
+    const float padded = std::nextafter(value, FloatMax);
+    int32 q = Clamp(int32(std::ceil((padded - origin) / scale)), 0, 255);
+    while(q < 255 && origin + float(q) * scale < padded)
+        ++q;
+    return uint8(q);
+}
+
+// Compressed nodes count the primitives of each leaf with 8 bits, but leaves that the binary builder
+// had to force (like the ones at BVH::MaxDepth) can be bigger than that. Those are split into a small
+// subtree of nodes with up to 8 children each, in primitive order.
+static const uint32 MaxCompressedLeafPrimitives = 255;
+
+static uint64 NumLeafSplitNodes(uint64 numPrimitives)
+{
+    if(numPrimitives <= MaxCompressedLeafPrimitives)
+        return 0;
+
+    const uint64 chunkSize = (numPrimitives + 7) / 8;
+    uint64 numNodes = 1;
+    for(uint64 start = 0; start < numPrimitives; start += chunkSize)
+        numNodes += NumLeafSplitNodes(Min(chunkSize, numPrimitives - start));
+    return numNodes;
+}
+
+// Returns the index of the subtree's root, where split node i is node numSrcNodes + i
+static uint32 SplitLeaf(const Array<BVHPrimitive>& primitives, uint32 firstPrimitive, uint32 numPrimitives,
+                        uint64 numSrcNodes, GrowableList<BVH8Node>& splitNodes)
+{
+    Assert_(numPrimitives > MaxCompressedLeafPrimitives);
+
+    BVH8Node node;
+    const uint32 chunkSize = (numPrimitives + 7) / 8;
+    for(uint32 i = 0; i < 8; ++i)
+    {
+        const uint32 chunkStart = i * chunkSize;
+        if(chunkStart >= numPrimitives)
+        {
+            node.BoundsMinX[i] = node.BoundsMinY[i] = node.BoundsMinZ[i] = FloatMax;
+            node.BoundsMaxX[i] = node.BoundsMaxY[i] = node.BoundsMaxZ[i] = -FloatMax;
+            node.Children[i] = BVH8Node::InvalidChild;
+            node.NumPrimitives[i] = 0;
+            continue;
+        }
+
+        const uint32 chunkCount = Min(chunkSize, numPrimitives - chunkStart);
+        Float3 boundsMin = FloatMax;
+        Float3 boundsMax = -FloatMax;
+        for(uint32 primIdx = firstPrimitive + chunkStart; primIdx < firstPrimitive + chunkStart + chunkCount; ++primIdx)
+        {
+            const BVHPrimitive& prim = primitives[primIdx];
+            const Float3 v1 = prim.V0 + prim.E1;
+            const Float3 v2 = prim.V0 + prim.E2;
+            boundsMin = Float3(Min(Min(boundsMin.x, prim.V0.x), Min(v1.x, v2.x)), Min(Min(boundsMin.y, prim.V0.y), Min(v1.y, v2.y)),
+                               Min(Min(boundsMin.z, prim.V0.z), Min(v1.z, v2.z)));
+            boundsMax = Float3(Max(Max(boundsMax.x, prim.V0.x), Max(v1.x, v2.x)), Max(Max(boundsMax.y, prim.V0.y), Max(v1.y, v2.y)),
+                               Max(Max(boundsMax.z, prim.V0.z), Max(v1.z, v2.z)));
+        }
+
+        node.BoundsMinX[i] = boundsMin.x;
+        node.BoundsMinY[i] = boundsMin.y;
+        node.BoundsMinZ[i] = boundsMin.z;
+        node.BoundsMaxX[i] = boundsMax.x;
+        node.BoundsMaxY[i] = boundsMax.y;
+        node.BoundsMaxZ[i] = boundsMax.z;
+
+        if(chunkCount <= MaxCompressedLeafPrimitives)
+        {
+            node.Children[i] = firstPrimitive + chunkStart;
+            node.NumPrimitives[i] = chunkCount;
+        }
+        else
+        {
+            node.Children[i] = SplitLeaf(primitives, firstPrimitive + chunkStart, chunkCount, numSrcNodes, splitNodes);
+            node.NumPrimitives[i] = 0;
+        }
+    }
+
+    return uint32(numSrcNodes + splitNodes.Add(node));
+}
+
+// Widens 8 quantized bounds to floats
+static __m256 LoadQuantized(const uint8* quantized)
+{
+    return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(quantized))));
+}
+
+bool BVH8::Supported()
+{
+    return CPUSupportsAVX2();
+}
+
+void BVH8::Build(const BVH& bvh)
+{
+    Shutdown();
+
+    Timer timer;
+
+    const BVHNode* srcNodes = bvh.Nodes();
+    const uint64 numSrcNodes = bvh.NumNodes();
+    Assert_(numSrcNodes > 0);
+
+    // Every wide node is created from a distinct interior node of the binary tree
+    nodes.Init(Max<uint64>(numSrcNodes / 2, 1));
+    numNodes = 1;
+
+    GrowableList<CollapseTask> taskStack;
+    taskStack.Add(CollapseTask());
+
+    while(taskStack.Count() > 0)
+    {
+        const CollapseTask task = taskStack[taskStack.Count() - 1];
+        taskStack.Remove(taskStack.Count() - 1);
+
+        uint32 children[8] = { };
+        uint32 numChildren = 0;
+
+        const BVHNode& srcNode = srcNodes[task.SrcNodeIdx];
+        if(srcNode.IsLeaf())
+        {
+            // Only happens when the whole tree is a single leaf
+            children[numChildren++] = task.SrcNodeIdx;
+        }
+        else
+        {
+            children[numChildren++] = srcNode.Offset;
+            children[numChildren++] = srcNode.Offset + 1;
+        }
+
+        // Keep replacing the interior child with the largest surface area with its two children,
+        // which pulls in the nodes that are most likely to be visited
+        while(numChildren < 8)
+        {
+            int32 openIdx = -1;
+            float openArea = -1.0f;
+            for(uint32 i = 0; i < numChildren; ++i)
+            {
+                const BVHNode& child = srcNodes[children[i]];
+                if(child.IsLeaf())
+                    continue;
+
+                const float area = HalfArea(child);
+                if(area > openArea)
+                {
+                    openIdx = int32(i);
+                    openArea = area;
+                }
+            }
+
+            if(openIdx < 0)
+                break;
+
+            const BVHNode& openNode = srcNodes[children[openIdx]];
+            children[openIdx] = openNode.Offset;
+            children[numChildren++] = openNode.Offset + 1;
+        }
+
+        BVH8Node& dstNode = nodes[task.DstNodeIdx];
+        for(uint32 i = 0; i < 8; ++i)
+        {
+            if(i >= numChildren)
+            {
+                dstNode.BoundsMinX[i] = dstNode.BoundsMinY[i] = dstNode.BoundsMinZ[i] = FloatMax;
+                dstNode.BoundsMaxX[i] = dstNode.BoundsMaxY[i] = dstNode.BoundsMaxZ[i] = -FloatMax;
+                dstNode.Children[i] = BVH8Node::InvalidChild;
+                dstNode.NumPrimitives[i] = 0;
+                continue;
+            }
+
+            const BVHNode& child = srcNodes[children[i]];
+            dstNode.BoundsMinX[i] = child.BoundsMin.x;
+            dstNode.BoundsMinY[i] = child.BoundsMin.y;
+            dstNode.BoundsMinZ[i] = child.BoundsMin.z;
+            dstNode.BoundsMaxX[i] = child.BoundsMax.x;
+            dstNode.BoundsMaxY[i] = child.BoundsMax.y;
+            dstNode.BoundsMaxZ[i] = child.BoundsMax.z;
+
+            if(child.IsLeaf())
+            {
+                dstNode.Children[i] = child.Offset;
+                dstNode.NumPrimitives[i] = child.NumPrimitives;
+            }
+            else
+            {
+                Assert_(numNodes < nodes.Size());
+                CollapseTask childTask;
+                childTask.SrcNodeIdx = children[i];
+                childTask.DstNodeIdx = uint32(numNodes++);
+                taskStack.Add(childTask);
+
+                dstNode.Children[i] = childTask.DstNodeIdx;
+                dstNode.NumPrimitives[i] = 0;
+            }
+        }
+    }
+
+    primitives.Init(bvh.NumPrimitives());
+    memcpy(primitives.Data(), bvh.Primitives().Data(), primitives.MemorySize());
+
+    timer.Update();
+    WriteLog("Collapsed BVH with %llu nodes into BVH8 with %llu nodes in %.2f ms", numSrcNodes, numNodes, timer.ElapsedMillisecondsD());
+}
+
+void BVH8::Shutdown()
+{
+    nodes.Shutdown();
+    primitives.Shutdown();
+    numNodes = 0;
+}
+
+template<bool AnyHit> bool BVH8::Traverse(const BVHRay& ray, BVHHit& hit, BVHHitFilter filter, const void* filterContext) const
+{
+    if(numNodes == 0)
+        return false;
+
+    const Float3 origin = ray.Origin;
+    const Float3 dir = ray.Direction;
+    const Float3 invDir = SafeInverseDirection(dir);
+    float tMax = ray.TMax;
+    bool foundHit = false;
+
+    // (bounds - origin) * invDir is computed as bounds * invDir - origin * invDir so that it maps to an FMA
+    const __m256 invDirX = _mm256_set1_ps(invDir.x);
+    const __m256 invDirY = _mm256_set1_ps(invDir.y);
+    const __m256 invDirZ = _mm256_set1_ps(invDir.z);
+    const __m256 scaledOriginX = _mm256_set1_ps(origin.x * invDir.x);
+    const __m256 scaledOriginY = _mm256_set1_ps(origin.y * invDir.y);
+    const __m256 scaledOriginZ = _mm256_set1_ps(origin.z * invDir.z);
+    const __m256 rayTMin = _mm256_set1_ps(ray.TMin);
+    const __m256i invalidChild = _mm256_set1_epi32(int32(BVH8Node::InvalidChild));
+
+    // Pick the near and far planes up-front based on the direction signs, which avoids a min/max per axis
+    const uint64 nearX = invDir.x >= 0.0f ? offsetof(BVH8Node, BoundsMinX) : offsetof(BVH8Node, BoundsMaxX);
+    const uint64 nearY = invDir.y >= 0.0f ? offsetof(BVH8Node, BoundsMinY) : offsetof(BVH8Node, BoundsMaxY);
+    const uint64 nearZ = invDir.z >= 0.0f ? offsetof(BVH8Node, BoundsMinZ) : offsetof(BVH8Node, BoundsMaxZ);
+    const uint64 farX = invDir.x >= 0.0f ? offsetof(BVH8Node, BoundsMaxX) : offsetof(BVH8Node, BoundsMinX);
+    const uint64 farY = invDir.y >= 0.0f ? offsetof(BVH8Node, BoundsMaxY) : offsetof(BVH8Node, BoundsMinY);
+    const uint64 farZ = invDir.z >= 0.0f ? offsetof(BVH8Node, BoundsMaxZ) : offsetof(BVH8Node, BoundsMinZ);
+
+    TraversalEntry stack[MaxStackSize];
+    uint32 stackSize = 0;
+    stack[stackSize++] = { 0, 0, ray.TMin };
+
+    const BVH8Node* nodeData = nodes.Data();
+    while(stackSize > 0)
+    {
+        const TraversalEntry entry = stack[--stackSize];
+        if(entry.TNear > tMax)
+            continue;
+
+        if(entry.NumPrimitives > 0)
+        {
+            for(uint32 i = 0; i < entry.NumPrimitives; ++i)
+            {
+                const BVHPrimitive& prim = primitives[entry.Index + i];
+                float t, u, v;
+                if(IntersectRayTriangle(prim, origin, dir, ray.TMin, tMax, t, u, v) == false)
+                    continue;
+
+                BVHHit candidate;
+                candidate.T = t;
+                candidate.U = u;
+                candidate.V = v;
+                candidate.MeshIdx = prim.MeshIdx;
+                candidate.TriangleIdx = prim.TriangleIdx;
+                if(filter != nullptr && filter(filterContext, candidate) == false)
+                    continue;
+
+                hit = candidate;
+                tMax = t;
+                foundHit = true;
+
+                if(AnyHit)
+                    return true;
+            }
+
+            continue;
+        }
+
+        // Test all 8 child boxes at once
+        const BVH8Node& node = nodeData[entry.Index];
+        const uint8* nodeBytes = reinterpret_cast<const uint8*>(&node);
+        const __m256 tNearX = _mm256_fmsub_ps(_mm256_load_ps(reinterpret_cast<const float*>(nodeBytes + nearX)), invDirX, scaledOriginX);
+        const __m256 tNearY = _mm256_fmsub_ps(_mm256_load_ps(reinterpret_cast<const float*>(nodeBytes + nearY)), invDirY, scaledOriginY);
+        const __m256 tNearZ = _mm256_fmsub_ps(_mm256_load_ps(reinterpret_cast<const float*>(nodeBytes + nearZ)), invDirZ, scaledOriginZ);
+        const __m256 tFarX = _mm256_fmsub_ps(_mm256_load_ps(reinterpret_cast<const float*>(nodeBytes + farX)), invDirX, scaledOriginX);
+        const __m256 tFarY = _mm256_fmsub_ps(_mm256_load_ps(reinterpret_cast<const float*>(nodeBytes + farY)), invDirY, scaledOriginY);
+        const __m256 tFarZ = _mm256_fmsub_ps(_mm256_load_ps(reinterpret_cast<const float*>(nodeBytes + farZ)), invDirZ, scaledOriginZ);
+
+        const __m256 tNear = _mm256_max_ps(_mm256_max_ps(tNearX, tNearY), _mm256_max_ps(tNearZ, rayTMin));
+        const __m256 tFar = _mm256_min_ps(_mm256_min_ps(tFarX, tFarY), _mm256_min_ps(tFarZ, _mm256_set1_ps(tMax)));
+
+        const __m256i children = _mm256_load_si256(reinterpret_cast<const __m256i*>(node.Children));
+        const __m256 invalidMask = _mm256_castsi256_ps(_mm256_cmpeq_epi32(children, invalidChild));
+        const __m256 hitMask = _mm256_andnot_ps(invalidMask, _mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ));
+
+        uint32 hitBits = uint32(_mm256_movemask_ps(hitMask));
+        if(hitBits == 0)
+            continue;
+
+        alignas(32) float childTNear[8];
+        _mm256_store_ps(childTNear, tNear);
+
+        // Push the children sorted by descending distance, so that the closest one gets popped first
+        Assert_(stackSize + 8 <= MaxStackSize);
+        const uint32 stackBase = stackSize;
+        while(hitBits != 0)
+        {
+            unsigned long childIdx = 0;
+            _BitScanForward(&childIdx, hitBits);
+            hitBits &= hitBits - 1;
+
+            TraversalEntry childEntry;
+            childEntry.Index = node.Children[childIdx];
+            childEntry.NumPrimitives = node.NumPrimitives[childIdx];
+            childEntry.TNear = childTNear[childIdx];
+
+            uint32 insertIdx = stackSize;
+            while(insertIdx > stackBase && stack[insertIdx - 1].TNear < childEntry.TNear)
+            {
+                stack[insertIdx] = stack[insertIdx - 1];
+                --insertIdx;
+            }
+
+            stack[insertIdx] = childEntry;
+            ++stackSize;
+        }
+    }
+
+    return foundHit;
+}
+
+bool BVH8::Intersect(const BVHRay& ray, BVHHit& hit, BVHHitFilter filter, const void* filterContext) const
+{
+    hit = BVHHit();
+    return Traverse<false>(ray, hit, filter, filterContext);
+}
+
+bool BVH8::Occluded(const BVHRay& ray, BVHHitFilter filter, const void* filterContext) const
+{
+    BVHHit hit;
+    return Traverse<true>(ray, hit, filter, filterContext);
+}
+
+void CompressedBVH8::Build(const BVH& bvh)
+{
+    BVH8 bvh8;
+    bvh8.Build(bvh);
+    Build(bvh8);
+    bvh8.Shutdown();
+}
+
+void CompressedBVH8::Build(const BVH8& bvh8)
+{
+    Shutdown();
+
+    Timer timer;
+
+    const BVH8Node* srcNodes = bvh8.Nodes();
+    const uint64 numSrcNodes = bvh8.NumNodes();
+    const Array<BVHPrimitive>& srcPrimitives = bvh8.Primitives();
+    Assert_(numSrcNodes > 0);
+
+    uint64 numSplitNodes = 0;
+    for(uint64 nodeIdx = 0; nodeIdx < numSrcNodes; ++nodeIdx)
+    {
+        for(uint32 i = 0; i < 8; ++i)
+            numSplitNodes += NumLeafSplitNodes(srcNodes[nodeIdx].NumPrimitives[i]);
+    }
+
+    nodes.Init(numSrcNodes + numSplitNodes);
+    numNodes = 1;
+
+    GrowableList<BVH8Node> splitNodes;
+
+    // The primitives are re-ordered so that the leaves of each node are contiguous
+    primitives.Init(srcPrimitives.Size());
+    uint64 numPrimitives = 0;
+
+    GrowableList<CollapseTask> taskStack;
+    taskStack.Add(CollapseTask());
+
+    while(taskStack.Count() > 0)
+    {
+        const CollapseTask task = taskStack[taskStack.Count() - 1];
+        taskStack.Remove(taskStack.Count() - 1);
+
+        // Copied, since splitting a leaf adds to splitNodes
+        BVH8Node srcNode = task.SrcNodeIdx < numSrcNodes ? srcNodes[task.SrcNodeIdx] : splitNodes[task.SrcNodeIdx - numSrcNodes];
+        CompressedBVH8Node& dstNode = nodes[task.DstNodeIdx];
+
+        Float3 boundsMin = FloatMax;
+        Float3 boundsMax = -FloatMax;
+        uint32 numInteriorChildren = 0;
+        for(uint32 i = 0; i < 8; ++i)
+        {
+            if(srcNode.Children[i] == BVH8Node::InvalidChild)
+                continue;
+
+            if(srcNode.NumPrimitives[i] > MaxCompressedLeafPrimitives)
+            {
+                srcNode.Children[i] = SplitLeaf(srcPrimitives, srcNode.Children[i], srcNode.NumPrimitives[i], numSrcNodes, splitNodes);
+                srcNode.NumPrimitives[i] = 0;
+            }
+
+            boundsMin = Float3(Min(boundsMin.x, srcNode.BoundsMinX[i]), Min(boundsMin.y, srcNode.BoundsMinY[i]), Min(boundsMin.z, srcNode.BoundsMinZ[i]));
+            boundsMax = Float3(Max(boundsMax.x, srcNode.BoundsMaxX[i]), Max(boundsMax.y, srcNode.BoundsMaxY[i]), Max(boundsMax.z, srcNode.BoundsMaxZ[i]));
+            if(srcNode.NumPrimitives[i] == 0)
+                ++numInteriorChildren;
+        }
+
+        float scale[3] = { };
+        for(uint32 axis = 0; axis < 3; ++axis)
+        {
+            const int32 exponent = QuantizationExponent(boundsMin[axis], boundsMax[axis]);
+            dstNode.Exponents[axis] = int8(exponent);
+            scale[axis] = ExponentToScale(exponent);
+        }
+
+        dstNode.Origin = boundsMin;
+        dstNode.ChildBase = uint32(numNodes);
+        dstNode.PrimitiveBase = uint32(numPrimitives);
+
+        numNodes += numInteriorChildren;
+        Assert_(numNodes <= nodes.Size());
+
+        uint32 numAddedChildren = 0;
+        for(uint32 i = 0; i < 8; ++i)
+        {
+            if(srcNode.Children[i] == BVH8Node::InvalidChild)
+            {
+                // Inverted bounds, which can't be hit
+                dstNode.QuantMinX[i] = dstNode.QuantMinY[i] = dstNode.QuantMinZ[i] = 255;
+                dstNode.QuantMaxX[i] = dstNode.QuantMaxY[i] = dstNode.QuantMaxZ[i] = 0;
+                continue;
+            }
+
+            dstNode.QuantMinX[i] = QuantizeMin(srcNode.BoundsMinX[i], boundsMin.x, scale[0]);
+            dstNode.QuantMinY[i] = QuantizeMin(srcNode.BoundsMinY[i], boundsMin.y, scale[1]);
+            dstNode.QuantMinZ[i] = QuantizeMin(srcNode.BoundsMinZ[i], boundsMin.z, scale[2]);
+            dstNode.QuantMaxX[i] = QuantizeMax(srcNode.BoundsMaxX[i], boundsMin.x, scale[0]);
+            dstNode.QuantMaxY[i] = QuantizeMax(srcNode.BoundsMaxY[i], boundsMin.y, scale[1]);
+            dstNode.QuantMaxZ[i] = QuantizeMax(srcNode.BoundsMaxZ[i], boundsMin.z, scale[2]);
+
+            const uint32 numChildPrimitives = srcNode.NumPrimitives[i];
+            if(numChildPrimitives == 0)
+            {
+                dstNode.InteriorMask |= uint8(1 << i);
+
+                CollapseTask childTask;
+                childTask.SrcNodeIdx = srcNode.Children[i];
+                childTask.DstNodeIdx = dstNode.ChildBase + numAddedChildren++;
+                taskStack.Add(childTask);
+            }
+            else
+            {
+                Assert_(numChildPrimitives <= MaxCompressedLeafPrimitives);
+                dstNode.NumPrimitives[i] = uint8(numChildPrimitives);
+
+                memcpy(&primitives[numPrimitives], &srcPrimitives[srcNode.Children[i]], numChildPrimitives * sizeof(BVHPrimitive));
+                numPrimitives += numChildPrimitives;
+            }
+        }
+    }
+
+    Assert_(numPrimitives == primitives.Size());
+
+    timer.Update();
+    WriteLog("Compressed BVH8 with %llu nodes (%.2f MB) into %.2f MB in %.2f ms", numNodes,
+             bvh8.NodeMemorySize() / (1024.0 * 1024.0), NodeMemorySize() / (1024.0 * 1024.0), timer.ElapsedMillisecondsD());
+}
+
+void CompressedBVH8::Shutdown()
+{
+    nodes.Shutdown();
+    primitives.Shutdown();
+    numNodes = 0;
+}
+
+template<bool AnyHit> bool CompressedBVH8::Traverse(const BVHRay& ray, BVHHit& hit, BVHHitFilter filter, const void* filterContext) const
+{
+    if(numNodes == 0)
+        return false;
+
+    const Float3 origin = ray.Origin;
+    const Float3 dir = ray.Direction;
+    const Float3 invDir = SafeInverseDirection(dir);
+    float tMax = ray.TMax;
+    bool foundHit = false;
+
+    const __m256 rayTMin = _mm256_set1_ps(ray.TMin);
+    const __m128i zero = _mm_setzero_si128();
+
+    const uint64 nearX = invDir.x >= 0.0f ? offsetof(CompressedBVH8Node, QuantMinX) : offsetof(CompressedBVH8Node, QuantMaxX);
+    const uint64 nearY = invDir.y >= 0.0f ? offsetof(CompressedBVH8Node, QuantMinY) : offsetof(CompressedBVH8Node, QuantMaxY);
+    const uint64 nearZ = invDir.z >= 0.0f ? offsetof(CompressedBVH8Node, QuantMinZ) : offsetof(CompressedBVH8Node, QuantMaxZ);
+    const uint64 farX = invDir.x >= 0.0f ? offsetof(CompressedBVH8Node, QuantMaxX) : offsetof(CompressedBVH8Node, QuantMinX);
+    const uint64 farY = invDir.y >= 0.0f ? offsetof(CompressedBVH8Node, QuantMaxY) : offsetof(CompressedBVH8Node, QuantMinY);
+    const uint64 farZ = invDir.z >= 0.0f ? offsetof(CompressedBVH8Node, QuantMaxZ) : offsetof(CompressedBVH8Node, QuantMinZ);
+
+    TraversalEntry stack[MaxStackSize];
+    uint32 stackSize = 0;
+    stack[stackSize++] = { 0, 0, ray.TMin };
+
+    const CompressedBVH8Node* nodeData = nodes.Data();
+    while(stackSize > 0)
+    {
+        const TraversalEntry entry = stack[--stackSize];
+        if(entry.TNear > tMax)
+            continue;
+
+        if(entry.NumPrimitives > 0)
+        {
+            for(uint32 i = 0; i < entry.NumPrimitives; ++i)
+            {
+                const BVHPrimitive& prim = primitives[entry.Index + i];
+                float t, u, v;
+                if(IntersectRayTriangle(prim, origin, dir, ray.TMin, tMax, t, u, v) == false)
+                    continue;
+
+                BVHHit candidate;
+                candidate.T = t;
+                candidate.U = u;
+                candidate.V = v;
+                candidate.MeshIdx = prim.MeshIdx;
+                candidate.TriangleIdx = prim.TriangleIdx;
+                if(filter != nullptr && filter(filterContext, candidate) == false)
+                    continue;
+
+                hit = candidate;
+                tMax = t;
+                foundHit = true;
+
+                if(AnyHit)
+                    return true;
+            }
+
+            continue;
+        }
+
+        // The distance to a dequantized plane is (origin + q * scale - rayOrigin) * invDir, which is
+        // q * (scale * invDir) + (origin - rayOrigin) * invDir so that each plane is a single FMA
+        const CompressedBVH8Node& node = nodeData[entry.Index];
+        const uint8* nodeBytes = reinterpret_cast<const uint8*>(&node);
+        const __m256 stepX = _mm256_set1_ps(ExponentToScale(node.Exponents[0]) * invDir.x);
+        const __m256 stepY = _mm256_set1_ps(ExponentToScale(node.Exponents[1]) * invDir.y);
+        const __m256 stepZ = _mm256_set1_ps(ExponentToScale(node.Exponents[2]) * invDir.z);
+        const __m256 offsetX = _mm256_set1_ps((node.Origin.x - origin.x) * invDir.x);
+        const __m256 offsetY = _mm256_set1_ps((node.Origin.y - origin.y) * invDir.y);
+        const __m256 offsetZ = _mm256_set1_ps((node.Origin.z - origin.z) * invDir.z);
+
+        const __m256 tNearX = _mm256_fmadd_ps(LoadQuantized(nodeBytes + nearX), stepX, offsetX);
+        const __m256 tNearY = _mm256_fmadd_ps(LoadQuantized(nodeBytes + nearY), stepY, offsetY);
+        const __m256 tNearZ = _mm256_fmadd_ps(LoadQuantized(nodeBytes + nearZ), stepZ, offsetZ);
+        const __m256 tFarX = _mm256_fmadd_ps(LoadQuantized(nodeBytes + farX), stepX, offsetX);
+        const __m256 tFarY = _mm256_fmadd_ps(LoadQuantized(nodeBytes + farY), stepY, offsetY);
+        const __m256 tFarZ = _mm256_fmadd_ps(LoadQuantized(nodeBytes + farZ), stepZ, offsetZ);
+
+        const __m256 tNear = _mm256_max_ps(_mm256_max_ps(tNearX, tNearY), _mm256_max_ps(tNearZ, rayTMin));
+        const __m256 tFar = _mm256_min_ps(_mm256_min_ps(tFarX, tFarY), _mm256_min_ps(tFarZ, _mm256_set1_ps(tMax)));
+
+        // Empty children have inverted bounds, but they're also masked out explicitly
+        const __m128i childPrimCounts = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(node.NumPrimitives));
+        const uint32 leafBits = ~uint32(_mm_movemask_epi8(_mm_cmpeq_epi8(childPrimCounts, zero))) & 0xFF;
+        const uint32 validBits = leafBits | node.InteriorMask;
+
+        uint32 hitBits = uint32(_mm256_movemask_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ))) & validBits;
+        if(hitBits == 0)
+            continue;
+
+        alignas(32) float childTNear[8];
+        _mm256_store_ps(childTNear, tNear);
+
+        // Push the children sorted by descending distance, so that the closest one gets popped first
+        Assert_(stackSize + 8 <= MaxStackSize);
+        const uint32 stackBase = stackSize;
+        while(hitBits != 0)
+        {
+            unsigned long childIdx = 0;
+            _BitScanForward(&childIdx, hitBits);
+            hitBits &= hitBits - 1;
+
+            const uint32 lowerChildren = (1u << childIdx) - 1;
+
+            TraversalEntry childEntry;
+            childEntry.TNear = childTNear[childIdx];
+            if(node.InteriorMask & (1u << childIdx))
+            {
+                childEntry.Index = node.ChildBase + uint32(_mm_popcnt_u32(node.InteriorMask & lowerChildren));
+                childEntry.NumPrimitives = 0;
+            }
+            else
+            {
+                // Leaf primitives are stored in child order, so the offset is the sum of the counts for the lower children
+                const uint64 lowerCountMask = (uint64(1) << (childIdx * 8)) - 1;
+                const __m128i lowerCounts = _mm_and_si128(childPrimCounts, _mm_cvtsi64_si128(int64(lowerCountMask)));
+                childEntry.Index = node.PrimitiveBase + uint32(_mm_cvtsi128_si32(_mm_sad_epu8(lowerCounts, zero)));
+                childEntry.NumPrimitives = node.NumPrimitives[childIdx];
+            }
+
+            uint32 insertIdx = stackSize;
+            while(insertIdx > stackBase && stack[insertIdx - 1].TNear < childEntry.TNear)
+            {
+                stack[insertIdx] = stack[insertIdx - 1];
+                --insertIdx;
+            }
+
+            stack[insertIdx] = childEntry;
+            ++stackSize;
+        }
+    }
+
+    return foundHit;
+}
+
+bool CompressedBVH8::Intersect(const BVHRay& ray, BVHHit& hit, BVHHitFilter filter, const void* filterContext) const
+{
+    hit = BVHHit();
+    return Traverse<false>(ray, hit, filter, filterContext);
+}
+
+bool CompressedBVH8::Occluded(const BVHRay& ray, BVHHitFilter filter, const void* filterContext) const
+{
+    BVHHit hit;
+    return Traverse<true>(ray, hit, filter, filterContext);
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,139 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "..\\PCH.h"
+#include "..\\SF12_Math.h"
+#include "..\\Containers.h"
+#include "BVH.h"
+
+namespace SampleFramework12
+{
+
+// 8-wide node with the child bounds stored as SoA, so that all 8 boxes can be tested at once
+struct alignas(32) BVH8Node
+{
+    float BoundsMinX[8];
+    float BoundsMinY[8];
+    float BoundsMinZ[8];
+    float BoundsMaxX[8];
+    float BoundsMaxY[8];
+    float BoundsMaxZ[8];
+    uint32 Children[8];         // Node index for interior children, first primitive for leaves, or InvalidChild
+    uint32 NumPrimitives[8];    // 0 for interior children
+
+    static const uint32 InvalidChild = uint32(-1);
+};
+
+StaticAssert_(sizeof(BVH8Node) == 256);
+
+// Wide BVH made by collapsing a binary BVH, with an AVX2 traversal kernel. The primitives are
+// copied from the source BVH, so it doesn't need to stay alive after Build() returns.
+class BVH8
+{
+
+public:
+
+    ~BVH8()
+    {
+        Assert_(nodes.Size() == 0);
+    }
+
+    void Build(const BVH& bvh);
+    void Shutdown();
+
+    bool Intersect(const BVHRay& ray, BVHHit& hit, BVHHitFilter filter = nullptr, const void* filterContext = nullptr) const;
+    bool Occluded(const BVHRay& ray, BVHHitFilter filter = nullptr, const void* filterContext = nullptr) const;
+
+    // Returns true if the CPU and OS support AVX2 and FMA, which the traversal kernel requires
+    static bool Supported();
+
+    // Accessors
+    const BVH8Node* Nodes() const { return nodes.Data(); }
+    uint64 NumNodes() const { return numNodes; }
+    uint64 NumPrimitives() const { return primitives.Size(); }
+    const Array<BVHPrimitive>& Primitives() const { return primitives; }
+
+    uint64 NodeMemorySize() const { return numNodes * sizeof(BVH8Node); }
+
+    static const uint64 MaxStackSize = 512;
+
+protected:
+
+    template<bool AnyHit> bool Traverse(const BVHRay& ray, BVHHit& hit, BVHHitFilter filter, const void* filterContext) const;
+
+    Array<BVH8Node> nodes;
+    uint64 numNodes = 0;
+    Array<BVHPrimitive> primitives;
+};
+
+// 8-wide node with the child bounds quantized to 8 bits, relative to the bounds of the node itself. The
+// quantization step on each axis is a power of two, and the children's bounds are rounded outwards to it
+// with an ulp of padding, so the dequantized boxes contain the children. Interior children are stored
+// next to each other starting at ChildBase, and the primitives of leaf children are stored next to each
+// other starting at PrimitiveBase.
+struct alignas(16) CompressedBVH8Node
+{
+    Float3 Origin;                  // Minimum corner of the node bounds
+    int8 Exponents[3] = { };        // Quantization step for each axis is 2^Exponent
+    uint8 InteriorMask = 0;         // Bit per child that's an interior node
+    uint32 ChildBase = 0;
+    uint32 PrimitiveBase = 0;
+    uint8 NumPrimitives[8] = { };   // 0 for interior and empty children
+    uint8 QuantMinX[8] = { };
+    uint8 QuantMinY[8] = { };
+    uint8 QuantMinZ[8] = { };
+    uint8 QuantMaxX[8] = { };
+    uint8 QuantMaxY[8] = { };
+    uint8 QuantMaxZ[8] = { };
+};
+
+StaticAssert_(sizeof(CompressedBVH8Node) == 80);
+
+// BVH8 with compressed nodes, which cuts the memory traffic for node fetches to less than a third
+// at the cost of dequantizing the child bounds during traversal. Uses the same AVX2 kernel as BVH8.
+class CompressedBVH8
+{
+
+public:
+
+    ~CompressedBVH8()
+    {
+        Assert_(nodes.Size() == 0);
+    }
+
+    void Build(const BVH& bvh);
+    void Build(const BVH8& bvh8);
+    void Shutdown();
+
+    bool Intersect(const BVHRay& ray, BVHHit& hit, BVHHitFilter filter = nullptr, const void* filterContext = nullptr) const;
+    bool Occluded(const BVHRay& ray, BVHHitFilter filter = nullptr, const void* filterContext = nullptr) const;
+
+    static bool Supported() { return BVH8::Supported(); }
+
+    // Accessors
+    const CompressedBVH8Node* Nodes() const { return nodes.Data(); }
+    uint64 NumNodes() const { return numNodes; }
+    uint64 NumPrimitives() const { return primitives.Size(); }
+
+    uint64 NodeMemorySize() const { return numNodes * sizeof(CompressedBVH8Node); }
+
+    static const uint64 MaxStackSize = BVH8::MaxStackSize;
+
+protected:
+
+    template<bool AnyHit> bool Traverse(const BVHRay& ray, BVHHit& hit, BVHHitFilter filter, const void* filterContext) const;
+
+    Array<CompressedBVH8Node> nodes;
+    uint64 numNodes = 0;
+    Array<BVHPrimitive> primitives;
+};
+
+}
\ No newline at end of file
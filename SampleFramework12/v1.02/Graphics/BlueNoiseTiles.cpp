@@ -0,0 +1,471 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "BlueNoiseTiles.h"
+#include "Sampling.h"
+#include "..\\Utility.h"
+#include "..\\Timer.h"
+#include "..\\Tasks.h"
+#include "..\\FileIO.h"
+#include "..\\Serialization.h"
+#include "..\\MurmurHash.h"
+#include "..\\Exceptions.h"
+
+namespace SampleFramework12
+{
+
+// The errors of each key are measured at 1, 2, 4, ... MaxRankedSamples samples, for a set of random
+// step functions
+static const uint32 NumLevels = 9;
+static const uint32 NumTestFunctions = 16;
+static const uint32 NumErrors = NumLevels * NumTestFunctions;
+StaticAssert_((1u << (NumLevels - 1)) == BlueNoiseTiles::MaxRankedSamples);
+
+// The optimizer can swap a pixel's keys with another pixel in the tile or with one of the spare keys,
+// which is how it tries out new keys without changing the overall distribution of them
+static const uint32 SparesPerPixel = 3;
+static const uint32 NumOptimizerPasses = 64;
+
+// Energy function from "Blue-noise Dithered Sampling" [Georgiev and Fajardo 2016], with the distance
+// between error vectors normalized so that the same sigma works at every sample count
+static const int32 KernelRadius = 5;
+static const float SigmaImage = 2.1f;
+static const float SigmaError = 0.5f;
+
+static const std::wstring CacheDir = L"BlueNoiseCache\\";
+static const uint32 CacheFileVersion = 0;
+static const uint32 CacheFileMagic = 0x53544E42;    // 'BNTS'
+
+// PCG generator with its own state for each dimension, so that the optimized keys don't depend on
+// the order that the dimensions get processed in
+struct OptimizerRandom
+{
+    uint64 State = 0;
+
+    explicit OptimizerRandom(uint64 seed) : State(seed * 6364136223846793005ull + 1442695040888963407ull)
+    {
+    }
+
+    uint32 Next()
+    {
+        const uint64 oldState = State;
+        State = oldState * 6364136223846793005ull + 1442695040888963407ull;
+        const uint32 xorShifted = uint32(((oldState >> 18) ^ oldState) >> 27);
+        const uint32 rotation = uint32(oldState >> 59);
+        return (xorShifted >> rotation) | (xorShifted << ((32 - rotation) & 31));
+    }
+
+    float NextFloat()
+    {
+        return float(Next() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    uint32 NextBelow(uint32 count)
+    {
+        return uint32((uint64(Next()) * count) >> 32);
+    }
+};
+
+// Function that's 1 on one side of a line through the unit square and 0 on the other, which are the
+// test integrands from [Heitz et al. 2019]
+struct HeavisideFunction
+{
+    Float2 Point;
+    Float2 Normal;
+    float Integral = 0.0f;
+
+    float Evaluate(Float2 u) const
+    {
+        return (u.x - Point.x) * Normal.x + (u.y - Point.y) * Normal.y >= 0.0f ? 1.0f : 0.0f;
+    }
+};
+
+// Clips the unit square against the line and computes the area of what's left
+static float HeavisideIntegral(const HeavisideFunction& function)
+{
+    const Float2 corners[4] = { Float2(0.0f, 0.0f), Float2(1.0f, 0.0f), Float2(1.0f, 1.0f), Float2(0.0f, 1.0f) };
+    Float2 clipped[8];
+    uint32 numClipped = 0;
+    for(uint32 i = 0; i < 4; ++i)
+    {
+        const Float2 a = corners[i];
+        const Float2 b = corners[(i + 1) % 4];
+        const float distA = (a.x - function.Point.x) * function.Normal.x + (a.y - function.Point.y) * function.Normal.y;
+        const float distB = (b.x - function.Point.x) * function.Normal.x + (b.y - function.Point.y) * function.Normal.y;
+        if(distA >= 0.0f)
+            clipped[numClipped++] = a;
+        if((distA >= 0.0f) != (distB >= 0.0f))
+            clipped[numClipped++] = a + (b - a) * (distA / (distA - distB));
+    }
+
+    float area = 0.0f;
+    for(uint32 i = 0; i < numClipped; ++i)
+    {
+        const Float2 a = clipped[i];
+        const Float2 b = clipped[(i + 1) % numClipped];
+        area += a.x * b.y - b.x * a.y;
+    }
+
+    return area * 0.5f;
+}
+
+// Integrates each test function with the first 1, 2, 4, ... samples of the keys' sequence
+static void ComputeErrors(const BlueNoiseKeys& keys, const HeavisideFunction* functions, float* errors)
+{
+    float sums[NumTestFunctions] = { };
+    uint32 levelIdx = 0;
+    for(uint32 sampleIdx = 0; sampleIdx < BlueNoiseTiles::MaxRankedSamples; ++sampleIdx)
+    {
+        const Float2 sample = SampleSobol2DFromSeed(sampleIdx ^ keys.RankKey, keys.ScrambleSeed);
+        for(uint32 funcIdx = 0; funcIdx < NumTestFunctions; ++funcIdx)
+            sums[funcIdx] += functions[funcIdx].Evaluate(sample);
+
+        const uint32 numSamples = sampleIdx + 1;
+        if((numSamples & sampleIdx) == 0)
+        {
+            for(uint32 funcIdx = 0; funcIdx < NumTestFunctions; ++funcIdx)
+                errors[levelIdx * NumTestFunctions + funcIdx] = sums[funcIdx] / numSamples - functions[funcIdx].Integral;
+            ++levelIdx;
+        }
+    }
+
+    Assert_(levelIdx == NumLevels);
+}
+
+struct KernelOffset
+{
+    int32 X = 0;
+    int32 Y = 0;
+    float Weight = 0.0f;
+};
+
+// Optimizes the keys for one pair of dimensions by swapping them around whenever that lowers the energy
+class TileOptimizer
+{
+
+public:
+
+    TileOptimizer(uint32 tileSize_, const float* poolErrors_, uint32 poolSize, const Array<KernelOffset>* offsets_) :
+        tileSize(tileSize_), numPixels(tileSize_ * tileSize_), poolErrors(poolErrors_), offsets(offsets_)
+    {
+        // The first numPixels entries are the keys used by each pixel, the rest are spares
+        assignment.Init(poolSize);
+        for(uint32 i = 0; i < poolSize; ++i)
+            assignment[i] = i;
+    }
+
+    void Optimize(OptimizerRandom& rng)
+    {
+        const uint32 poolSize = uint32(assignment.Size());
+        for(uint32 passIdx = 0; passIdx < NumOptimizerPasses; ++passIdx)
+        {
+            for(uint32 pixelIdx = 0; pixelIdx < numPixels; ++pixelIdx)
+            {
+                uint32 otherIdx = rng.NextBelow(poolSize - 1);
+                if(otherIdx >= pixelIdx)
+                    ++otherIdx;
+
+                // The energy between the two pixels doesn't change when they trade keys
+                const bool otherInTile = otherIdx < numPixels;
+                const uint32 skipPixel = otherInTile ? otherIdx : uint32(-1);
+                const float* errors = Errors(pixelIdx);
+                const float* otherErrors = Errors(otherIdx);
+
+                float delta = PixelEnergy(pixelIdx, otherErrors, skipPixel) - PixelEnergy(pixelIdx, errors, skipPixel);
+                if(otherInTile)
+                    delta += PixelEnergy(otherIdx, errors, pixelIdx) - PixelEnergy(otherIdx, otherErrors, pixelIdx);
+
+                if(delta < 0.0f)
+                    Swap(assignment[pixelIdx], assignment[otherIdx]);
+            }
+        }
+    }
+
+    float TotalEnergy() const
+    {
+        float energy = 0.0f;
+        for(uint32 pixelIdx = 0; pixelIdx < numPixels; ++pixelIdx)
+            energy += PixelEnergy(pixelIdx, Errors(pixelIdx), uint32(-1));
+        return energy;
+    }
+
+    uint32 PoolIndex(uint32 pixelIdx) const { return assignment[pixelIdx]; }
+
+private:
+
+    const float* Errors(uint32 idx) const
+    {
+        return poolErrors + uint64(assignment[idx]) * NumErrors;
+    }
+
+    // Energy between a pixel with the given errors and its neighbors, wrapping around the tile
+    float PixelEnergy(uint32 pixelIdx, const float* errors, uint32 skipPixel) const
+    {
+        const int32 size = int32(tileSize);
+        const int32 pixelX = int32(pixelIdx % tileSize);
+        const int32 pixelY = int32(pixelIdx / tileSize);
+
+        float energy = 0.0f;
+        for(uint64 offsetIdx = 0; offsetIdx < offsets->Size(); ++offsetIdx)
+        {
+            const KernelOffset& offset = (*offsets)[offsetIdx];
+            const uint32 neighborX = uint32((pixelX + offset.X + size) % size);
+            const uint32 neighborY = uint32((pixelY + offset.Y + size) % size);
+            const uint32 neighborIdx = neighborY * tileSize + neighborX;
+            if(neighborIdx == skipPixel)
+                continue;
+
+            const float* neighborErrors = Errors(neighborIdx);
+            float similarity = 0.0f;
+            for(uint32 levelIdx = 0; levelIdx < NumLevels; ++levelIdx)
+            {
+                float distanceSq = 0.0f;
+                for(uint32 funcIdx = 0; funcIdx < NumTestFunctions; ++funcIdx)
+                {
+                    const float diff = errors[levelIdx * NumTestFunctions + funcIdx] - neighborErrors[levelIdx * NumTestFunctions + funcIdx];
+                    distanceSq += diff * diff;
+                }
+                similarity += std::exp(-std::sqrt(distanceSq) / SigmaError);
+            }
+
+            energy += offset.Weight * similarity;
+        }
+
+        return energy;
+    }
+
+    uint32 tileSize = 0;
+    uint32 numPixels = 0;
+    const float* poolErrors = nullptr;
+    const Array<KernelOffset>* offsets = nullptr;
+    Array<uint32> assignment;
+};
+
+void BlueNoiseTiles::Initialize(uint32 tileSize_, uint32 numDims_)
+{
+    Shutdown();
+
+    tileSize = tileSize_;
+    numDims = numDims_;
+    Assert_(tileSize > uint32(KernelRadius) * 2);
+    Assert_(numDims > 0);
+
+    // Everything that changes the optimized keys goes into the file name
+    const uint32 cacheParams[] = { tileSize, numDims, MaxRankedSamples, NumTestFunctions, SparesPerPixel, NumOptimizerPasses, uint32(KernelRadius) };
+    const Hash hash = GenerateHash(cacheParams, sizeof(cacheParams), CacheFileVersion);
+    const std::wstring cachePath = CacheDir + L"BlueNoiseTiles_" + hash.ToString() + L".bin";
+
+    if(LoadFromCache(cachePath.c_str()))
+        return;
+
+    Optimize();
+    SaveToCache(cachePath.c_str());
+}
+
+void BlueNoiseTiles::Shutdown()
+{
+    keys.Shutdown();
+    tileSize = 0;
+    numDims = 0;
+}
+
+Float2 BlueNoiseTiles::Sample(uint32 sampleIdx, uint32 pixelX, uint32 pixelY, uint32 dimIdx) const
+{
+    const BlueNoiseKeys& pixelKeys = Keys(pixelX, pixelY, dimIdx);
+    return SampleSobol2DFromSeed(sampleIdx ^ pixelKeys.RankKey, pixelKeys.ScrambleSeed);
+}
+
+const BlueNoiseKeys& BlueNoiseTiles::Keys(uint32 pixelX, uint32 pixelY, uint32 dimIdx) const
+{
+    Assert_(dimIdx < numDims);
+    return keys[(uint64(dimIdx) * tileSize + pixelY % tileSize) * tileSize + pixelX % tileSize];
+}
+
+void BlueNoiseTiles::Optimize()
+{
+    Timer timer;
+
+    const uint32 numPixels = tileSize * tileSize;
+    const uint32 poolSize = numPixels * (SparesPerPixel + 1);
+
+    OptimizerRandom functionRNG(0);
+    HeavisideFunction functions[NumTestFunctions];
+    for(uint32 funcIdx = 0; funcIdx < NumTestFunctions; ++funcIdx)
+    {
+        HeavisideFunction& function = functions[funcIdx];
+        const float angle = functionRNG.NextFloat() * Pi2;
+        function.Point = Float2(functionRNG.NextFloat(), functionRNG.NextFloat());
+        function.Normal = Float2(std::cos(angle), std::sin(angle));
+        function.Integral = HeavisideIntegral(function);
+    }
+
+    Array<KernelOffset> offsets;
+    {
+        GrowableList<KernelOffset> offsetList;
+        for(int32 y = -KernelRadius; y <= KernelRadius; ++y)
+        {
+            for(int32 x = -KernelRadius; x <= KernelRadius; ++x)
+            {
+                const int32 distanceSq = x * x + y * y;
+                if(distanceSq == 0 || distanceSq > KernelRadius * KernelRadius)
+                    continue;
+
+                KernelOffset& offset = offsetList.Add();
+                offset.X = x;
+                offset.Y = y;
+                offset.Weight = std::exp(-distanceSq / (SigmaImage * SigmaImage));
+            }
+        }
+
+        offsets.Init(offsetList.Count());
+        for(uint64 i = 0; i < offsetList.Count(); ++i)
+            offsets[i] = offsetList[i];
+    }
+
+    // Random starting keys for the tile and the spares, for every pair of dimensions
+    Array<BlueNoiseKeys> poolKeys(uint64(numDims) * poolSize);
+    for(uint32 dimIdx = 0; dimIdx < numDims; ++dimIdx)
+    {
+        OptimizerRandom rng(dimIdx + 1);
+        for(uint32 i = 0; i < poolSize; ++i)
+        {
+            BlueNoiseKeys& poolKey = poolKeys[uint64(dimIdx) * poolSize + i];
+            poolKey.ScrambleSeed = rng.Next();
+            poolKey.RankKey = rng.NextBelow(MaxRankedSamples);
+        }
+    }
+
+    Array<float> poolErrors(poolKeys.Size() * NumErrors);
+    Tasks::ParallelFor(uint32(poolKeys.Size()), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 i = range.start; i < range.end; ++i)
+            ComputeErrors(poolKeys[i], functions, &poolErrors[uint64(i) * NumErrors]);
+    });
+
+    // Errors shrink as the sample count goes up, so each level gets scaled to unit RMS
+    for(uint32 dimIdx = 0; dimIdx < numDims; ++dimIdx)
+    {
+        float* dimErrors = &poolErrors[uint64(dimIdx) * poolSize * NumErrors];
+        for(uint32 levelIdx = 0; levelIdx < NumLevels; ++levelIdx)
+        {
+            double sumSq = 0.0;
+            for(uint32 i = 0; i < poolSize; ++i)
+                for(uint32 funcIdx = 0; funcIdx < NumTestFunctions; ++funcIdx)
+                    sumSq += Square(double(dimErrors[i * NumErrors + levelIdx * NumTestFunctions + funcIdx]));
+
+            const double rms = std::sqrt(sumSq / (double(poolSize) * NumTestFunctions));
+            const float scale = rms > 0.0 ? float(1.0 / (rms * std::sqrt(double(NumTestFunctions)))) : 0.0f;
+            for(uint32 i = 0; i < poolSize; ++i)
+                for(uint32 funcIdx = 0; funcIdx < NumTestFunctions; ++funcIdx)
+                    dimErrors[i * NumErrors + levelIdx * NumTestFunctions + funcIdx] *= scale;
+        }
+    }
+
+    keys.Init(uint64(numDims) * numPixels);
+    Array<float> startEnergies(numDims, 0.0f);
+    Array<float> endEnergies(numDims, 0.0f);
+    Tasks::ParallelFor(numDims, [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 dimIdx = range.start; dimIdx < range.end; ++dimIdx)
+        {
+            TileOptimizer optimizer(tileSize, &poolErrors[uint64(dimIdx) * poolSize * NumErrors], poolSize, &offsets);
+            startEnergies[dimIdx] = optimizer.TotalEnergy();
+
+            OptimizerRandom rng(uint64(dimIdx) + 1 + numDims);
+            optimizer.Optimize(rng);
+            endEnergies[dimIdx] = optimizer.TotalEnergy();
+
+            for(uint32 pixelIdx = 0; pixelIdx < numPixels; ++pixelIdx)
+                keys[uint64(dimIdx) * numPixels + pixelIdx] = poolKeys[uint64(dimIdx) * poolSize + optimizer.PoolIndex(pixelIdx)];
+        }
+    });
+
+    float startEnergy = 0.0f;
+    float endEnergy = 0.0f;
+    for(uint32 dimIdx = 0; dimIdx < numDims; ++dimIdx)
+    {
+        startEnergy += startEnergies[dimIdx];
+        endEnergy += endEnergies[dimIdx];
+    }
+
+    timer.Update();
+    WriteLog("Optimized %ux%u blue-noise sample tiles for %u dimension pairs in %.2f seconds (energy reduced by %.1f%%)",
+             tileSize, tileSize, numDims, timer.ElapsedSecondsD(), (1.0f - endEnergy / startEnergy) * 100.0f);
+}
+
+bool BlueNoiseTiles::LoadFromCache(const wchar* filePath)
+{
+    if(FileExists(filePath) == false)
+        return false;
+
+    try
+    {
+        FileReadSerializer serializer(filePath);
+
+        uint32 magic = 0;
+        uint32 version = 0;
+        SerializeItem(serializer, magic);
+        SerializeItem(serializer, version);
+        if(magic != CacheFileMagic || version != CacheFileVersion)
+            return false;
+
+        BulkSerializeItem(serializer, keys);
+
+        // Reads past the end of a truncated file leave the footer as 0
+        uint32 footer = 0;
+        SerializeItem(serializer, footer);
+        if(footer != CacheFileMagic || keys.Size() != uint64(numDims) * tileSize * tileSize)
+        {
+            keys.Shutdown();
+            return false;
+        }
+    }
+    catch(Exception& exception)
+    {
+        WriteLog(L"Failed to load blue-noise tile cache file '%ls': %ls", filePath, exception.GetMessage().c_str());
+        keys.Shutdown();
+        return false;
+    }
+
+    return true;
+}
+
+void BlueNoiseTiles::SaveToCache(const wchar* filePath) const
+{
+    if(CreateDirectory(CacheDir.c_str(), nullptr) == false && GetLastError() != ERROR_ALREADY_EXISTS)
+        return;
+
+    // Write to a temporary file first, so that an interrupted write doesn't leave a partial cache file
+    const std::wstring tempPath = std::wstring(filePath) + L".tmp";
+
+    try
+    {
+        {
+            FileWriteSerializer serializer(tempPath.c_str());
+
+            uint32 magic = CacheFileMagic;
+            uint32 version = CacheFileVersion;
+            SerializeItem(serializer, magic);
+            SerializeItem(serializer, version);
+            BulkSerializeItem(serializer, const_cast<Array<BlueNoiseKeys>&>(keys));
+            SerializeItem(serializer, magic);
+        }
+
+        Win32Call(MoveFileEx(tempPath.c_str(), filePath, MOVEFILE_REPLACE_EXISTING));
+    }
+    catch(Exception& exception)
+    {
+        // The cache is optional, so failing to write it isn't fatal
+        WriteLog(L"Failed to write blue-noise tile cache file '%ls': %ls", filePath, exception.GetMessage().c_str());
+    }
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "..\\PCH.h"
+#include "..\\SF12_Math.h"
+#include "..\\Containers.h"
+
+namespace SampleFramework12
+{
+
+// Keys for one pixel and pair of dimensions. The scramble seed selects one of the Owen-scrambled
+// Sobol sequences from SampleSobol2DFromSeed(), and the rank key is XOR'ed into the sample index.
+// XOR'ing only changes the order of the samples within aligned power-of-two blocks, so every
+// power-of-two prefix of a pixel's samples is still a stratified subset of its sequence.
+struct BlueNoiseKeys
+{
+    uint32 ScrambleSeed = 0;
+    uint32 RankKey = 0;
+};
+
+// Tileable sets of per-pixel sampler keys that distribute each pixel's integration error as blue
+// noise in screen space, based on "A Low-Discrepancy Sampler that Distributes Monte Carlo Errors
+// as a Blue Noise in Screen Space" [Heitz et al. 2019]. The keys are picked by an optimizer that
+// swaps them between pixels (and a pool of spares) until neighboring pixels have dissimilar errors
+// for a set of test integrands, at 1, 2, 4, ... MaxRankedSamples samples per pixel. Each pair of
+// dimensions is optimized separately, in parallel, and the result is cached on disk since it
+// only depends on the tile size and number of dimensions.
+class BlueNoiseTiles
+{
+
+public:
+
+    static const uint32 MaxRankedSamples = 256;
+
+    // Loads the keys from the cache, or optimizes them and writes them to the cache
+    void Initialize(uint32 tileSize, uint32 numDims);
+    void Shutdown();
+
+    // Returns the same sample as SamplePoint() in RayTrace.hlsl for a pixel and pair of dimensions
+    Float2 Sample(uint32 sampleIdx, uint32 pixelX, uint32 pixelY, uint32 dimIdx) const;
+
+    const BlueNoiseKeys& Keys(uint32 pixelX, uint32 pixelY, uint32 dimIdx) const;
+
+    // Accessors
+    uint32 TileSize() const { return tileSize; }
+    uint32 NumDims() const { return numDims; }
+
+    // All of the keys, with one tile for each pair of dimensions that's stored in row-major order
+    const Array<BlueNoiseKeys>& AllKeys() const { return keys; }
+
+protected:
+
+    void Optimize();
+
+    bool LoadFromCache(const wchar* filePath);
+    void SaveToCache(const wchar* filePath) const;
+
+    uint32 tileSize = 0;
+    uint32 numDims = 0;
+    Array<BlueNoiseKeys> keys;
+};
+
+}
\ No newline at end of file
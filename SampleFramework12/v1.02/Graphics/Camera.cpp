@@ -121,6 +121,15 @@ void Camera::SetProjection(const Float4x4& newProjection)
     viewProjection = view * projection;
 }
 
+float Camera::ProjectedSize(const Float3& worldPosition, float worldSize, float viewportHeight) const
+{
+    // The Y scale of the projection maps view space to [-1, 1], divided by depth for perspective
+    float scale = projection._22 * 0.5f * viewportHeight;
+    if(IsOrthographic() == false)
+        scale /= Max(Float3::Dot(worldPosition - position, Forward()), nearZ);
+    return worldSize * scale;
+}
+
 //=================================================================================================
 // OrthographicCamera
 //=================================================================================================
@@ -64,6 +64,10 @@ public:
     void SetFarClip(float newFarClip);
     void SetProjection(const Float4x4& newProjection);
 
+    // Returns roughly how many pixels a world-space length at the given position covers, for a
+    // viewport with the given height
+    float ProjectedSize(const Float3& worldPosition, float worldSize, float viewportHeight) const;
+
     virtual bool IsOrthographic() const { return false; }
 };
 
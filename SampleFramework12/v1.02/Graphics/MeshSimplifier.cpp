@@ -0,0 +1,480 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "MeshSimplifier.h"
+#include "..\\Containers.h"
+
+namespace SampleFramework12
+{
+
+// Planes along open edges are weighted more heavily than the surface, which keeps borders and seams
+// in place until there's nothing else left to collapse
+static const float BoundaryWeight = 10.0f;
+
+enum class VertexKind : uint8
+{
+    Manifold = 0,   // Can collapse onto any neighbor
+    Border,         // On one open border, can only collapse along it
+    Seam,           // Shares its position with one other vertex, and can only collapse along the seam
+    Locked,         // Never collapses
+};
+
+// Sum of squared distances to a set of weighted planes, stored as the symmetric matrix A, the
+// vector B, and the constant C from the expansion of (dot(N, P) + D)^2
+struct Quadric
+{
+    float A00 = 0.0f, A11 = 0.0f, A22 = 0.0f;
+    float A10 = 0.0f, A20 = 0.0f, A21 = 0.0f;
+    float B0 = 0.0f, B1 = 0.0f, B2 = 0.0f;
+    float C = 0.0f;
+    float Weight = 0.0f;
+
+    void AddPlane(const Float3& n, float d, float weight)
+    {
+        A00 += weight * n.x * n.x;
+        A11 += weight * n.y * n.y;
+        A22 += weight * n.z * n.z;
+        A10 += weight * n.y * n.x;
+        A20 += weight * n.z * n.x;
+        A21 += weight * n.z * n.y;
+        B0 += weight * n.x * d;
+        B1 += weight * n.y * d;
+        B2 += weight * n.z * d;
+        C += weight * d * d;
+        Weight += weight;
+    }
+
+    void Add(const Quadric& other)
+    {
+        A00 += other.A00;
+        A11 += other.A11;
+        A22 += other.A22;
+        A10 += other.A10;
+        A20 += other.A20;
+        A21 += other.A21;
+        B0 += other.B0;
+        B1 += other.B1;
+        B2 += other.B2;
+        C += other.C;
+        Weight += other.Weight;
+    }
+
+    // Returns the weighted mean of the squared distances to the planes
+    float Error(const Float3& p) const
+    {
+        const float quadratic = A00 * p.x * p.x + A11 * p.y * p.y + A22 * p.z * p.z +
+                                2.0f * (A10 * p.x * p.y + A20 * p.x * p.z + A21 * p.y * p.z);
+        const float linear = 2.0f * (B0 * p.x + B1 * p.y + B2 * p.z);
+        return Weight > 0.0f ? std::abs(quadratic + linear + C) / Weight : 0.0f;
+    }
+};
+
+// Directed edge leaving a vertex, along with the third vertex of its triangle
+struct HalfEdge
+{
+    uint32 Next = 0;
+    uint32 Prev = 0;
+};
+
+// Half-edges grouped by the vertex that they leave, rebuilt after every pass of collapses
+struct EdgeAdjacency
+{
+    Array<uint32> Offsets;
+    Array<uint32> Counts;
+    Array<HalfEdge> Edges;
+
+    void Build(const uint32* indices, uint64 numIndices, uint64 numVertices)
+    {
+        Counts.Init(numVertices, 0);
+        for(uint64 i = 0; i < numIndices; ++i)
+            ++Counts[indices[i]];
+
+        Offsets.Init(numVertices);
+        uint32 offset = 0;
+        for(uint64 i = 0; i < numVertices; ++i)
+        {
+            Offsets[i] = offset;
+            offset += Counts[i];
+            Counts[i] = 0;
+        }
+
+        Edges.Init(numIndices);
+        for(uint64 i = 0; i < numIndices; i += 3)
+        {
+            const uint32 tri[3] = { indices[i + 0], indices[i + 1], indices[i + 2] };
+            for(uint64 corner = 0; corner < 3; ++corner)
+            {
+                const uint32 vtxIdx = tri[corner];
+                HalfEdge& edge = Edges[Offsets[vtxIdx] + Counts[vtxIdx]++];
+                edge.Next = tri[(corner + 1) % 3];
+                edge.Prev = tri[(corner + 2) % 3];
+            }
+        }
+    }
+
+    const HalfEdge* Begin(uint32 vtxIdx) const { return Edges.Data() + Offsets[vtxIdx]; }
+    const HalfEdge* End(uint32 vtxIdx) const { return Edges.Data() + Offsets[vtxIdx] + Counts[vtxIdx]; }
+
+    bool HasEdge(uint32 from, uint32 to) const
+    {
+        for(const HalfEdge* edge = Begin(from); edge != End(from); ++edge)
+            if(edge->Next == to)
+                return true;
+        return false;
+    }
+};
+
+struct Collapse
+{
+    uint32 Source = 0;
+    uint32 Target = 0;
+    uint32 SeamSource = uint32(-1);     // The twins of Source and Target for collapses along a seam
+    uint32 SeamTarget = uint32(-1);
+    float Error = 0.0f;
+};
+
+static const Float3& GetPosition(const Float3* positions, uint64 positionStride, uint32 vtxIdx)
+{
+    return *reinterpret_cast<const Float3*>(reinterpret_cast<const uint8*>(positions) + vtxIdx * positionStride);
+}
+
+// Returns true if moving vtxIdx to the target's position would flip or collapse any of the
+// triangles around it that survive the collapse
+static bool HasTriangleFlips(const EdgeAdjacency& adjacency, const Array<Float3>& vertexPositions, const Array<uint32>& positionRemap,
+                             const Array<uint32>& collapseRemap, uint32 vtxIdx, uint32 targetIdx)
+{
+    const Float3& oldPosition = vertexPositions[vtxIdx];
+    const Float3& newPosition = vertexPositions[targetIdx];
+    for(const HalfEdge* edge = adjacency.Begin(vtxIdx); edge != adjacency.End(vtxIdx); ++edge)
+    {
+        const uint32 next = collapseRemap[edge->Next];
+        const uint32 prev = collapseRemap[edge->Prev];
+        if(positionRemap[next] == positionRemap[targetIdx] || positionRemap[prev] == positionRemap[targetIdx])
+            continue;
+
+        const Float3& p1 = vertexPositions[next];
+        const Float3& p2 = vertexPositions[prev];
+        const Float3 oldNormal = Float3::Cross(p1 - oldPosition, p2 - oldPosition);
+        const Float3 newNormal = Float3::Cross(p1 - newPosition, p2 - newPosition);
+        if(Float3::Dot(oldNormal, newNormal) <= 0.25f * oldNormal.Length() * newNormal.Length())
+            return true;
+    }
+
+    return false;
+}
+
+uint64 SimplifyMesh(uint32* indices, uint64 numIndices, const Float3* positions, uint64 positionStride,
+                    uint64 numVertices, uint64 targetIndexCount, float maxError, float* resultError,
+                    const uint8* lockedVertices)
+{
+    Assert_(numIndices % 3 == 0);
+    Assert_(numVertices < uint32(-1));
+
+    if(resultError != nullptr)
+        *resultError = 0.0f;
+    if(numIndices <= targetIndexCount || numVertices == 0)
+        return numIndices;
+
+    Array<Float3> vertexPositions(numVertices);
+    for(uint64 i = 0; i < numVertices; ++i)
+        vertexPositions[i] = GetPosition(positions, positionStride, uint32(i));
+
+    // Find the vertices that share a position by sorting them, and link them into rings of "twins"
+    Array<uint32> positionRemap(numVertices);
+    Array<uint32> twins(numVertices);
+    {
+        Array<uint32> sorted(numVertices);
+        for(uint64 i = 0; i < numVertices; ++i)
+            sorted[i] = uint32(i);
+
+        std::sort(sorted.Data(), sorted.Data() + numVertices, [&](uint32 a, uint32 b)
+        {
+            const Float3& pa = vertexPositions[a];
+            const Float3& pb = vertexPositions[b];
+            if(pa.x != pb.x)
+                return pa.x < pb.x;
+            if(pa.y != pb.y)
+                return pa.y < pb.y;
+            if(pa.z != pb.z)
+                return pa.z < pb.z;
+            return a < b;
+        });
+
+        for(uint64 groupStart = 0; groupStart < numVertices;)
+        {
+            uint64 groupEnd = groupStart + 1;
+            while(groupEnd < numVertices && vertexPositions[sorted[groupEnd]] == vertexPositions[sorted[groupStart]])
+                ++groupEnd;
+
+            for(uint64 i = groupStart; i < groupEnd; ++i)
+            {
+                positionRemap[sorted[i]] = sorted[groupStart];
+                twins[sorted[i]] = sorted[i + 1 < groupEnd ? i + 1 : groupStart];
+            }
+
+            groupStart = groupEnd;
+        }
+    }
+
+    EdgeAdjacency adjacency;
+    adjacency.Build(indices, numIndices, numVertices);
+
+    // Half-edges are open if there's no half-edge going the other way, either between the exact
+    // vertices or between any vertices at the same positions
+    auto hasPositionEdge = [&](uint32 from, uint32 to)
+    {
+        uint32 fromTwin = from;
+        do
+        {
+            for(const HalfEdge* edge = adjacency.Begin(fromTwin); edge != adjacency.End(fromTwin); ++edge)
+                if(positionRemap[edge->Next] == positionRemap[to])
+                    return true;
+            fromTwin = twins[fromTwin];
+        } while(fromTwin != from);
+
+        return false;
+    };
+
+    auto countOpenEdges = [&](uint32 vtxIdx, bool positionSpace, uint32& numOpenOut, uint32& numOpenIn)
+    {
+        numOpenOut = 0;
+        numOpenIn = 0;
+        for(const HalfEdge* edge = adjacency.Begin(vtxIdx); edge != adjacency.End(vtxIdx); ++edge)
+        {
+            numOpenOut += (positionSpace ? hasPositionEdge(edge->Next, vtxIdx) : adjacency.HasEdge(edge->Next, vtxIdx)) ? 0 : 1;
+            numOpenIn += (positionSpace ? hasPositionEdge(vtxIdx, edge->Prev) : adjacency.HasEdge(vtxIdx, edge->Prev)) ? 0 : 1;
+        }
+    };
+
+    // Returns true if the caller locked any of the vertices at the same position
+    auto isLockedByCaller = [&](uint32 vtxIdx)
+    {
+        if(lockedVertices == nullptr)
+            return false;
+
+        uint32 twinIdx = vtxIdx;
+        do
+        {
+            if(lockedVertices[twinIdx])
+                return true;
+            twinIdx = twins[twinIdx];
+        } while(twinIdx != vtxIdx);
+
+        return false;
+    };
+
+    Array<VertexKind> vertexKinds(numVertices, VertexKind::Locked);
+    for(uint32 vtxIdx = 0; vtxIdx < numVertices; ++vtxIdx)
+    {
+        if(isLockedByCaller(vtxIdx))
+            continue;
+
+        uint32 numOpenOut = 0;
+        uint32 numOpenIn = 0;
+        countOpenEdges(vtxIdx, false, numOpenOut, numOpenIn);
+
+        const uint32 twinIdx = twins[vtxIdx];
+        if(twinIdx == vtxIdx)
+        {
+            if(numOpenOut == 0 && numOpenIn == 0)
+                vertexKinds[vtxIdx] = VertexKind::Manifold;
+            else if(numOpenOut == 1 && numOpenIn == 1)
+                vertexKinds[vtxIdx] = VertexKind::Border;
+        }
+        else if(twins[twinIdx] == vtxIdx && numOpenOut == 1 && numOpenIn == 1)
+        {
+            // A seam only splits the attributes, so the surface still has to be closed around it
+            uint32 numTwinOpenOut = 0;
+            uint32 numTwinOpenIn = 0;
+            countOpenEdges(twinIdx, false, numTwinOpenOut, numTwinOpenIn);
+
+            uint32 numPositionOpenOut = 0;
+            uint32 numPositionOpenIn = 0;
+            countOpenEdges(vtxIdx, true, numPositionOpenOut, numPositionOpenIn);
+
+            if(numTwinOpenOut == 1 && numTwinOpenIn == 1 && numPositionOpenOut == 0 && numPositionOpenIn == 0)
+                vertexKinds[vtxIdx] = VertexKind::Seam;
+        }
+    }
+
+    // Accumulate the planes of the triangles around each position weighted by area, along with
+    // planes that are perpendicular to the open edges
+    Array<Quadric> quadrics(numVertices);
+    for(uint64 i = 0; i < numIndices; i += 3)
+    {
+        const uint32 tri[3] = { indices[i + 0], indices[i + 1], indices[i + 2] };
+        const Float3& p0 = vertexPositions[tri[0]];
+        Float3 normal = Float3::Cross(vertexPositions[tri[1]] - p0, vertexPositions[tri[2]] - p0);
+        const float normalLength = normal.Length();
+        if(normalLength == 0.0f)
+            continue;
+
+        normal /= normalLength;
+        for(uint64 corner = 0; corner < 3; ++corner)
+            quadrics[positionRemap[tri[corner]]].AddPlane(normal, -Float3::Dot(normal, p0), normalLength * 0.5f);
+
+        for(uint64 corner = 0; corner < 3; ++corner)
+        {
+            const uint32 from = tri[corner];
+            const uint32 to = tri[(corner + 1) % 3];
+            if(adjacency.HasEdge(to, from))
+                continue;
+
+            const Float3 edgeDir = vertexPositions[to] - vertexPositions[from];
+            const float edgeLength = edgeDir.Length();
+            if(edgeLength == 0.0f)
+                continue;
+
+            const Float3 edgeNormal = Float3::Normalize(Float3::Cross(edgeDir, normal));
+            const float edgeD = -Float3::Dot(edgeNormal, vertexPositions[from]);
+            quadrics[positionRemap[from]].AddPlane(edgeNormal, edgeD, edgeLength * edgeLength * BoundaryWeight);
+            quadrics[positionRemap[to]].AddPlane(edgeNormal, edgeD, edgeLength * edgeLength * BoundaryWeight);
+        }
+    }
+
+    // Returns false if the collapse isn't allowed, and finds the twin collapse for seams
+    auto makeCollapse = [&](uint32 source, uint32 target, Collapse& collapse)
+    {
+        if(positionRemap[source] == positionRemap[target])
+            return false;
+
+        const VertexKind sourceKind = vertexKinds[source];
+        const bool isOpen = adjacency.HasEdge(target, source) == false || adjacency.HasEdge(source, target) == false;
+        if(sourceKind == VertexKind::Locked)
+            return false;
+        if(sourceKind == VertexKind::Border && (vertexKinds[target] != VertexKind::Border || isOpen == false))
+            return false;
+
+        collapse.Source = source;
+        collapse.Target = target;
+        collapse.SeamSource = uint32(-1);
+        collapse.SeamTarget = uint32(-1);
+        collapse.Error = quadrics[positionRemap[source]].Error(vertexPositions[target]);
+
+        if(sourceKind == VertexKind::Seam)
+        {
+            if(vertexKinds[target] != VertexKind::Seam || isOpen == false)
+                return false;
+
+            // The twin has to collapse onto the target's twin along the other side of the seam
+            const uint32 seamSource = twins[source];
+            const uint32 seamTarget = twins[target];
+            if(adjacency.HasEdge(seamSource, seamTarget) == false && adjacency.HasEdge(seamTarget, seamSource) == false)
+                return false;
+
+            collapse.SeamSource = seamSource;
+            collapse.SeamTarget = seamTarget;
+        }
+
+        return true;
+    };
+
+    Array<uint32> collapseRemap(numVertices);
+    Array<uint8> collapseLocked(numVertices);
+    GrowableList<Collapse> collapses(numIndices / 3);
+    float maxCollapseError = 0.0f;
+    const float maxQuadricError = maxError * maxError;
+
+    while(numIndices > targetIndexCount)
+    {
+        // Gather every allowed collapse, only looking at each interior edge once
+        collapses.RemoveAll();
+        for(uint64 i = 0; i < numIndices; i += 3)
+        {
+            for(uint64 corner = 0; corner < 3; ++corner)
+            {
+                const uint32 v0 = indices[i + corner];
+                const uint32 v1 = indices[i + (corner + 1) % 3];
+                if(v0 > v1 && adjacency.HasEdge(v1, v0))
+                    continue;
+
+                Collapse collapse;
+                if(makeCollapse(v0, v1, collapse) && collapse.Error <= maxQuadricError)
+                    collapses.Add(collapse);
+                if(makeCollapse(v1, v0, collapse) && collapse.Error <= maxQuadricError)
+                    collapses.Add(collapse);
+            }
+        }
+
+        if(collapses.Count() == 0)
+            break;
+
+        std::sort(&collapses[0], &collapses[0] + collapses.Count(), [](const Collapse& a, const Collapse& b)
+        {
+            return a.Error < b.Error;
+        });
+
+        for(uint64 i = 0; i < numVertices; ++i)
+            collapseRemap[i] = uint32(i);
+        collapseLocked.Fill(0);
+
+        // Apply the cheapest collapses first, and leave anything touching an earlier collapse for the
+        // next pass so that the quadrics and adjacency can catch up
+        const uint64 numTrianglesToRemove = (numIndices - targetIndexCount) / 3;
+        uint64 numTrianglesRemoved = 0;
+        uint64 numCollapses = 0;
+        for(uint64 i = 0; i < collapses.Count() && numTrianglesRemoved < numTrianglesToRemove; ++i)
+        {
+            const Collapse& collapse = collapses[i];
+            const uint32 sourcePosition = positionRemap[collapse.Source];
+            const uint32 targetPosition = positionRemap[collapse.Target];
+            if(collapseLocked[sourcePosition] || collapseLocked[targetPosition])
+                continue;
+
+            if(HasTriangleFlips(adjacency, vertexPositions, positionRemap, collapseRemap, collapse.Source, collapse.Target))
+                continue;
+
+            const bool isSeam = collapse.SeamSource != uint32(-1);
+            if(isSeam && HasTriangleFlips(adjacency, vertexPositions, positionRemap, collapseRemap, collapse.SeamSource, collapse.SeamTarget))
+                continue;
+
+            collapseRemap[collapse.Source] = collapse.Target;
+            if(isSeam)
+                collapseRemap[collapse.SeamSource] = collapse.SeamTarget;
+
+            collapseLocked[sourcePosition] = 1;
+            collapseLocked[targetPosition] = 1;
+            quadrics[targetPosition].Add(quadrics[sourcePosition]);
+
+            maxCollapseError = Max(maxCollapseError, collapse.Error);
+            numTrianglesRemoved += vertexKinds[collapse.Source] == VertexKind::Border ? 1 : 2;
+            ++numCollapses;
+        }
+
+        if(numCollapses == 0)
+            break;
+
+        // Remap the indices and drop the triangles that became degenerate
+        uint64 numNewIndices = 0;
+        for(uint64 i = 0; i < numIndices; i += 3)
+        {
+            const uint32 v0 = collapseRemap[indices[i + 0]];
+            const uint32 v1 = collapseRemap[indices[i + 1]];
+            const uint32 v2 = collapseRemap[indices[i + 2]];
+            if(positionRemap[v0] == positionRemap[v1] || positionRemap[v1] == positionRemap[v2] || positionRemap[v2] == positionRemap[v0])
+                continue;
+
+            indices[numNewIndices++] = v0;
+            indices[numNewIndices++] = v1;
+            indices[numNewIndices++] = v2;
+        }
+
+        numIndices = numNewIndices;
+        adjacency.Build(indices, numIndices, numVertices);
+    }
+
+    if(resultError != nullptr)
+        *resultError = std::sqrt(maxCollapseError);
+
+    return numIndices;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "..\\PCH.h"
+#include "..\\SF12_Math.h"
+
+namespace SampleFramework12
+{
+
+// Simplifies a triangle list in place using quadric error metrics (Garland and Heckbert, "Surface
+// Simplification Using Quadric Error Metrics"). Edges are collapsed onto one of their existing
+// vertices, so the vertex data doesn't change and the result can share it with the original.
+// Vertices on open borders only slide along the border, and vertices on UV or normal seams (where
+// two vertices share a position) only slide along the seam together with their twin, so that the
+// simplified mesh doesn't tear or smear its attributes. Anything more complicated is left alone.
+//
+// Collapses stop once the index count reaches targetIndexCount, or when the next one would move the
+// surface further than maxError. Returns the new index count, and the largest error of any collapse
+// that was made (in the same units as the positions) through resultError.
+//
+// If lockedVertices is given, a non-zero entry keeps that vertex and every other vertex at the same
+// position from collapsing. This is how a caller keeps the edges it shares with other geometry fixed.
+uint64 SimplifyMesh(uint32* indices, uint64 numIndices, const Float3* positions, uint64 positionStride,
+                    uint64 numVertices, uint64 targetIndexCount, float maxError, float* resultError = nullptr,
+                    const uint8* lockedVertices = nullptr);
+
+}
\ No newline at end of file
@@ -16,7 +16,12 @@
 #include "GraphicsTypes.h"
 #include "..\\Serialization.h"
 #include "..\\FileIO.h"
+#include "..\\Timer.h"
+#include "..\\Tasks.h"
 #include "Textures.h"
+#include "VertexCacheOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Camera.h"
 
 using std::string;
 using std::wstring;
@@ -45,6 +50,14 @@ static const D3D12_INPUT_ELEMENT_DESC StandardInputElements[5] =
     { "BITANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 44, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 };
 
+static const D3D12_INPUT_ELEMENT_DESC CompactVertexInputElements[4] =
+{
+    { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    { "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    { "TANGENT", 0, DXGI_FORMAT_R16G16_SNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+    { "UV", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+};
+
 static const wchar* DefaultTextures[] =
 {
     L"..\\Content\\Textures\\DefaultBaseColor.dds",     // Albedo
@@ -75,9 +88,468 @@ static Float4x4 ConvertMatrix(const aiMatrix4x4& mat)
                     Float4(mat.d1, mat.d2, mat.d3, mat.d4));
 }
 
-void LoadMaterialResources(Array<MeshMaterial>& materials, const wstring& directory, bool32 forceSRGB,
-                           GrowableList<MaterialTexture*>& materialTextures)
+// Runs func(idx, vector) for every vector in a tightly-packed array of Assimp vectors. Four vectors
+// are loaded at a time with three unaligned loads and then shuffled apart, with the scale applied
+// to the loaded registers before the shuffle.
+template<typename TFunc> static void ConvertVectors(const aiVector3D* src, uint64 count, float scale, TFunc func)
+{
+    using namespace DirectX;
+
+    StaticAssert_(sizeof(aiVector3D) == sizeof(XMFLOAT3));
+    const float* srcFloats = &src[0].x;
+    const XMVECTOR scaleVec = XMVectorReplicate(scale);
+
+    uint64 i = 0;
+    for(; i + 4 <= count; i += 4)
+    {
+        // x0 y0 z0 x1 | y1 z1 x2 y2 | z2 x3 y3 z3
+        const float* batch = srcFloats + i * 3;
+        const XMVECTOR a = XMVectorMultiply(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(batch + 0)), scaleVec);
+        const XMVECTOR b = XMVectorMultiply(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(batch + 4)), scaleVec);
+        const XMVECTOR c = XMVectorMultiply(XMLoadFloat4(reinterpret_cast<const XMFLOAT4*>(batch + 8)), scaleVec);
+
+        func(i + 0, a);
+        func(i + 1, XMVectorPermute<XM_PERMUTE_0W, XM_PERMUTE_1X, XM_PERMUTE_1Y, XM_PERMUTE_1Z>(a, b));
+        func(i + 2, XMVectorPermute<XM_PERMUTE_0Z, XM_PERMUTE_0W, XM_PERMUTE_1X, XM_PERMUTE_1Y>(b, c));
+        func(i + 3, XMVectorSwizzle<XM_SWIZZLE_Y, XM_SWIZZLE_Z, XM_SWIZZLE_W, XM_SWIZZLE_X>(c));
+    }
+
+    for(; i < count; ++i)
+        func(i, XMVectorScale(XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(&src[i])), scale));
+}
+
+// Mesh data files start with a header that has the offset and size of every section, with each
+// section aligned so that the vertex and index data can be used straight out of a mapped file.
+// All offsets are relative to the start of the file.
+static const uint32 MeshDataMagic = 0x4C444F4D;     // 'MODL'
+static const uint32 MeshDataVersion = 4;
+static const uint64 MeshDataAlignment = 64;
+static const uint64 MeshDataChunkSize = 1024 * 1024 * 1024;
+
+enum class MeshDataSection : uint32
+{
+    Meshes = 0,
+    MeshParts,
+    Materials,
+    Strings,
+    SpotLights,
+    PointLights,
+    Meshlets,
+    MeshLODs,
+    LODMeshParts,
+
+    // Only the sections above are checked against the header's metadata hash on every load
+    Vertices,
+    Indices,
+
+    NumSections
+};
+
+struct MeshDataSectionDesc
+{
+    uint64 Offset;
+    uint64 Size;
+};
+
+struct MeshDataHeader
+{
+    uint32 Magic;
+    uint32 Version;
+    uint64 FileSize;
+    Hash SourceHash;            // Identifies the file and settings it was converted from
+    uint32 VertexSize;
+    uint32 IndexAlignment;
+    uint32 ForceSRGB;
+    uint32 NumMeshes;
+    uint32 NumMeshParts;
+    uint32 NumMaterials;
+    uint32 NumSpotLights;
+    uint32 NumPointLights;
+    uint32 NumMeshlets;
+    uint32 NumMeshLODs;
+    uint32 NumLODMeshParts;
+    uint32 Padding;             // Keeps the header free of implicit padding, since it's hashed
+    Float3 AABBMin;
+    Float3 AABBMax;
+    MeshDataSectionDesc Sections[uint64(MeshDataSection::NumSections)];
+    Hash DataHash;              // Vertex and index data
+    Hash MetadataHash;          // Header up to this point, and all sections except for vertices and indices
+};
+
+struct MeshDataMesh
+{
+    uint32 NumVertices;
+    uint32 NumIndices;
+    uint32 VertexOffset;
+    uint32 IndexBufferOffset;   // In bytes
+    uint32 IndexType;
+    uint32 FirstMeshPart;
+    uint32 NumMeshParts;
+    uint32 FirstMeshlet;
+    uint32 NumMeshlets;
+    uint32 FirstLOD;
+    uint32 NumLODs;
+    Float3 AABBMin;
+    Float3 AABBMax;
+};
+
+// Byte offset into the string section, with the length in characters
+struct MeshDataString
+{
+    uint32 Offset;
+    uint32 Length;
+};
+
+struct MeshDataMaterial
+{
+    MeshDataString Name;
+    MeshDataString TextureNames[uint64(MaterialTextures::Count)];
+};
+
+// GenerateHash() takes a 32-bit length, so large sections are hashed in chunks
+static Hash HashMeshDataBytes(const uint8* data, uint64 size)
+{
+    Hash hash = GenerateHash(&size, sizeof(size), MeshDataVersion);
+    for(uint64 offset = 0; offset < size; offset += MeshDataChunkSize)
+        hash = CombineHashes(hash, GenerateHash(data + offset, int32(Min(size - offset, MeshDataChunkSize))));
+    return hash;
+}
+
+static Hash HashMeshDataSections(const uint8* const* sectionData, const MeshDataHeader& header,
+                                 MeshDataSection firstSection, MeshDataSection endSection)
+{
+    Hash hash;
+    for(uint64 i = uint64(firstSection); i < uint64(endSection); ++i)
+        hash = CombineHashes(hash, HashMeshDataBytes(sectionData[i], header.Sections[i].Size));
+    return hash;
+}
+
+static Hash MeshDataMetadataHash(const uint8* const* sectionData, const MeshDataHeader& header)
+{
+    Hash hash = GenerateHash(&header, int32(offsetof(MeshDataHeader, MetadataHash)));
+    return CombineHashes(hash, HashMeshDataSections(sectionData, header, MeshDataSection::Meshes, MeshDataSection::Vertices));
+}
+
+static Hash MeshDataContentsHash(const uint8* const* sectionData, const MeshDataHeader& header)
+{
+    return HashMeshDataSections(sectionData, header, MeshDataSection::Vertices, MeshDataSection::NumSections);
+}
+
+// Returns the header if the file is complete, matches the current format, and everything in it is in range
+static const MeshDataHeader* ValidateMeshData(const MemoryMappedFile& file, const Hash* sourceHash)
+{
+    if(file.Size() < sizeof(MeshDataHeader))
+        return nullptr;
+
+    const MeshDataHeader* header = reinterpret_cast<const MeshDataHeader*>(file.Data());
+    if(header->Magic != MeshDataMagic || header->Version != MeshDataVersion || header->FileSize != file.Size() ||
+       header->VertexSize != sizeof(MeshVertex) || header->IndexAlignment != MeshIndexAlignment)
+        return nullptr;
+
+    if(sourceHash != nullptr && !(header->SourceHash == *sourceHash))
+        return nullptr;
+
+    const uint8* sectionData[uint64(MeshDataSection::NumSections)] = { };
+    for(uint64 i = 0; i < uint64(MeshDataSection::NumSections); ++i)
+    {
+        const MeshDataSectionDesc& section = header->Sections[i];
+        if(section.Offset % MeshDataAlignment != 0 || section.Offset > file.Size() || section.Size > file.Size() - section.Offset)
+            return nullptr;
+        sectionData[i] = file.Data() + section.Offset;
+    }
+
+    if(header->Sections[uint64(MeshDataSection::Meshes)].Size != header->NumMeshes * sizeof(MeshDataMesh) ||
+       header->Sections[uint64(MeshDataSection::MeshParts)].Size != header->NumMeshParts * sizeof(MeshPart) ||
+       header->Sections[uint64(MeshDataSection::Materials)].Size != header->NumMaterials * sizeof(MeshDataMaterial) ||
+       header->Sections[uint64(MeshDataSection::SpotLights)].Size != header->NumSpotLights * sizeof(ModelSpotLight) ||
+       header->Sections[uint64(MeshDataSection::PointLights)].Size != header->NumPointLights * sizeof(PointLight) ||
+       header->Sections[uint64(MeshDataSection::Meshlets)].Size != header->NumMeshlets * sizeof(Meshlet) ||
+       header->Sections[uint64(MeshDataSection::MeshLODs)].Size != header->NumMeshLODs * sizeof(MeshLOD) ||
+       header->Sections[uint64(MeshDataSection::LODMeshParts)].Size != header->NumLODMeshParts * sizeof(MeshPart) ||
+       header->Sections[uint64(MeshDataSection::Vertices)].Size % sizeof(MeshVertex) != 0 ||
+       header->Sections[uint64(MeshDataSection::Indices)].Size % MeshIndexAlignment != 0)
+        return nullptr;
+
+    if(!(MeshDataMetadataHash(sectionData, *header) == header->MetadataHash))
+        return nullptr;
+
+    // Everything that's used as an offset or a count gets checked, so that a corrupted file is rejected
+    // rather than read outside of its sections
+    const uint64 stringsSize = header->Sections[uint64(MeshDataSection::Strings)].Size;
+    auto validString = [&](const MeshDataString& str, uint64 charSize)
+    {
+        return str.Offset <= stringsSize && str.Length * charSize <= stringsSize - str.Offset;
+    };
+
+    const MeshDataMaterial* materials = reinterpret_cast<const MeshDataMaterial*>(sectionData[uint64(MeshDataSection::Materials)]);
+    for(uint64 matIdx = 0; matIdx < header->NumMaterials; ++matIdx)
+    {
+        if(validString(materials[matIdx].Name, sizeof(char)) == false)
+            return nullptr;
+        for(uint64 texType = 0; texType < uint64(MaterialTextures::Count); ++texType)
+        {
+            if(validString(materials[matIdx].TextureNames[texType], sizeof(wchar)) == false)
+                return nullptr;
+        }
+    }
+
+    const uint64 numVertices = header->Sections[uint64(MeshDataSection::Vertices)].Size / sizeof(MeshVertex);
+    const uint64 indexDataSize = header->Sections[uint64(MeshDataSection::Indices)].Size;
+    const MeshDataMesh* meshes = reinterpret_cast<const MeshDataMesh*>(sectionData[uint64(MeshDataSection::Meshes)]);
+    const MeshPart* meshParts = reinterpret_cast<const MeshPart*>(sectionData[uint64(MeshDataSection::MeshParts)]);
+    const Meshlet* meshlets = reinterpret_cast<const Meshlet*>(sectionData[uint64(MeshDataSection::Meshlets)]);
+    const MeshLOD* meshLODs = reinterpret_cast<const MeshLOD*>(sectionData[uint64(MeshDataSection::MeshLODs)]);
+    const MeshPart* lodMeshParts = reinterpret_cast<const MeshPart*>(sectionData[uint64(MeshDataSection::LODMeshParts)]);
+    for(uint64 meshIdx = 0; meshIdx < header->NumMeshes; ++meshIdx)
+    {
+        const MeshDataMesh& mesh = meshes[meshIdx];
+        if(mesh.IndexType > uint32(IndexType::Index32Bit) || mesh.IndexBufferOffset % MeshIndexAlignment != 0 ||
+           uint64(mesh.VertexOffset) + mesh.NumVertices > numVertices ||
+           uint64(mesh.FirstMeshPart) + mesh.NumMeshParts > header->NumMeshParts ||
+           uint64(mesh.FirstMeshlet) + mesh.NumMeshlets > header->NumMeshlets ||
+           uint64(mesh.FirstLOD) + mesh.NumLODs > header->NumMeshLODs)
+            return nullptr;
+
+        // Index starts are relative to the mesh, and LOD indices come after the full-detail indices
+        const uint64 indexSize = mesh.IndexType == uint32(IndexType::Index32Bit) ? 4 : 2;
+        const uint64 maxIndices = (indexDataSize - Min<uint64>(mesh.IndexBufferOffset, indexDataSize)) / indexSize;
+        if(mesh.NumIndices > maxIndices)
+            return nullptr;
+
+        auto validPart = [&](const MeshPart& part)
+        {
+            return uint64(part.IndexStart) + part.IndexCount <= maxIndices && uint64(part.VertexStart) + part.VertexCount <= mesh.NumVertices &&
+                   part.MaterialIdx < header->NumMaterials;
+        };
+
+        for(uint64 partIdx = 0; partIdx < mesh.NumMeshParts; ++partIdx)
+        {
+            const MeshPart& part = meshParts[mesh.FirstMeshPart + partIdx];
+            if(validPart(part) == false || uint64(part.IndexStart) + part.IndexCount > mesh.NumIndices)
+                return nullptr;
+        }
+
+        for(uint64 i = 0; i < mesh.NumMeshlets; ++i)
+        {
+            const Meshlet& meshlet = meshlets[mesh.FirstMeshlet + i];
+            if(uint64(meshlet.IndexStart) + meshlet.IndexCount > mesh.NumIndices || meshlet.MeshPartIdx >= mesh.NumMeshParts)
+                return nullptr;
+        }
+
+        // Each LOD has one part for each of the mesh's parts
+        for(uint64 i = 0; i < mesh.NumLODs; ++i)
+        {
+            const MeshLOD& lod = meshLODs[mesh.FirstLOD + i];
+            if(uint64(lod.FirstPart) + mesh.NumMeshParts > header->NumLODMeshParts)
+                return nullptr;
+            for(uint64 partIdx = 0; partIdx < mesh.NumMeshParts; ++partIdx)
+            {
+                if(validPart(lodMeshParts[lod.FirstPart + partIdx]) == false)
+                    return nullptr;
+            }
+        }
+    }
+
+    // The index values themselves aren't range-checked, so the vertex and index data need to match what
+    // was written. This touches every page of the file, but it's the only way to catch corruption there.
+    if(!(MeshDataContentsHash(sectionData, *header) == header->DataHash))
+        return nullptr;
+
+    return header;
+}
+
+static void WriteMeshDataSection(const File& file, uint64& fileOffset, const MeshDataSectionDesc& section, const void* data)
+{
+    static const uint8 Padding[MeshDataAlignment] = { };
+    Assert_(section.Offset >= fileOffset && section.Offset - fileOffset < MeshDataAlignment);
+    file.Write(section.Offset - fileOffset, Padding);
+
+    // File::Write() takes a 32-bit size
+    const uint8* bytes = reinterpret_cast<const uint8*>(data);
+    for(uint64 offset = 0; offset < section.Size; offset += MeshDataChunkSize)
+        file.Write(Min(section.Size - offset, MeshDataChunkSize), bytes + offset);
+
+    fileOffset = section.Offset + section.Size;
+}
+
+static MeshDataString AddMeshDataString(std::string& strings, const void* str, uint64 length, uint64 charSize)
+{
+    MeshDataString result = { uint32(strings.size()), uint32(length) };
+    strings.append(reinterpret_cast<const char*>(str), length * charSize);
+    return result;
+}
+
+// Material textures are shared by their file's key (see TextureFileKey()), so that materials and scenes
+// that use the same file only create it once. The cache is shared by every model, and a texture is
+// destroyed once the last material texture that uses it is released.
+struct SharedTexture
+{
+    Texture Texture;
+    uint64 NumRefs = 0;
+    uint64 MemorySize = 0;
+};
+
+struct HashHasher
+{
+    size_t operator()(const Hash& hash) const
+    {
+        return size_t(hash.A ^ hash.B);
+    }
+};
+
+static std::unordered_map<Hash, SharedTexture*, HashHasher> SharedTextures;
+static SRWLOCK SharedTexturesLock = SRWLOCK_INIT;
+
+// Adds a reference to an existing texture, or returns null if one with that key hasn't been created
+static const Texture* FindSharedTexture(const Hash& fileKey)
+{
+    AcquireSRWLockExclusive(&SharedTexturesLock);
+
+    const Texture* texture = nullptr;
+    auto existing = SharedTextures.find(fileKey);
+    if(existing != SharedTextures.end())
+    {
+        existing->second->NumRefs += 1;
+        texture = &existing->second->Texture;
+    }
+
+    ReleaseSRWLockExclusive(&SharedTexturesLock);
+
+    return texture;
+}
+
+// Creates the texture from a decoded image. The lock is only held to add it, so that creating and
+// uploading it doesn't hold up other loads, and it's thrown away if another thread added one first.
+static const Texture* AddSharedTexture(const Hash& fileKey, const DirectX::ScratchImage& image, const wchar* name, bool32 srgb)
+{
+    SharedTexture* newTexture = new SharedTexture();
+    CreateTexture(newTexture->Texture, image, name, srgb != 0);
+
+    const D3D12_RESOURCE_DESC desc = newTexture->Texture.Resource->GetDesc();
+    newTexture->MemorySize = DX12::Device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+
+    AcquireSRWLockExclusive(&SharedTexturesLock);
+
+    SharedTexture*& sharedTexture = SharedTextures[fileKey];
+    SharedTexture* duplicate = nullptr;
+    if(sharedTexture == nullptr)
+        sharedTexture = newTexture;
+    else
+        duplicate = newTexture;
+
+    sharedTexture->NumRefs += 1;
+    const Texture* texture = &sharedTexture->Texture;
+
+    ReleaseSRWLockExclusive(&SharedTexturesLock);
+
+    if(duplicate != nullptr)
+    {
+        duplicate->Texture.Shutdown();
+        delete duplicate;
+    }
+
+    return texture;
+}
+
+static void ReleaseSharedTexture(const Hash& fileKey)
+{
+    AcquireSRWLockExclusive(&SharedTexturesLock);
+
+    auto existing = SharedTextures.find(fileKey);
+    Assert_(existing != SharedTextures.end() && existing->second->NumRefs > 0);
+
+    SharedTexture* sharedTexture = existing->second;
+    sharedTexture->NumRefs -= 1;
+    if(sharedTexture->NumRefs == 0)
+    {
+        sharedTexture->Texture.Shutdown();
+        delete sharedTexture;
+        SharedTextures.erase(existing);
+    }
+
+    ReleaseSRWLockExclusive(&SharedTexturesLock);
+}
+
+// Returns how much memory would be used if every reference had its own copy of the texture
+static uint64 SharedTextureMemorySaved(uint64& numSharedTextures)
+{
+    AcquireSRWLockExclusive(&SharedTexturesLock);
+
+    uint64 memorySaved = 0;
+    numSharedTextures = 0;
+    for(const auto& entry : SharedTextures)
+    {
+        if(entry.second->NumRefs > 1)
+        {
+            memorySaved += (entry.second->NumRefs - 1) * entry.second->MemorySize;
+            numSharedTextures += 1;
+        }
+    }
+
+    ReleaseSRWLockExclusive(&SharedTexturesLock);
+
+    return memorySaved;
+}
+
+// Points the materials at their textures, or at the placeholders for streamed textures that aren't resident
+static void BindMaterialTextures(Array<MeshMaterial>& materials, const GrowableList<MaterialTexture*>& materialTextures)
+{
+    const uint64 numMaterials = materials.Size();
+    for(uint64 matIdx = 0; matIdx < numMaterials; ++matIdx)
+    {
+        MeshMaterial& material = materials[matIdx];
+        for(uint64 texType = 0; texType < uint64(MaterialTextures::Count); ++texType)
+        {
+            material.Textures[texType] = nullptr;
+            if(material.TextureIndices[texType] == uint32(-1))
+                continue;
+
+            const MaterialTexture* matTexture = materialTextures[material.TextureIndices[texType]];
+            if(matTexture->Resident == false)
+                matTexture = materialTextures[matTexture->PlaceholderIdx];
+
+            Assert_(matTexture->Resident && matTexture->Texture != nullptr);
+            material.Textures[texType] = matTexture->Texture;
+        }
+    }
+}
+
+// Resolves the materials' textures and decodes the ones that need to be loaded into MaterialTexture::Image.
+// Nothing here touches the device, so it can run on any thread.
+static void DecodeMaterialTextures(Array<MeshMaterial>& materials, const wstring& directory, bool32 forceSRGB,
+                                   bool32 compressTextures, bool32 streamTextures, GrowableList<MaterialTexture*>& materialTextures)
 {
+    Timer timer;
+
+    std::unordered_map<wstring, uint32> textureIndices;
+    for(uint64 i = 0; i < materialTextures.Count(); ++i)
+        textureIndices[materialTextures[i]->Name] = uint32(i);
+
+    auto addTexture = [&](const wstring& path, bool32 srgb, bool32 streamed) -> uint32
+    {
+        auto existing = textureIndices.find(path);
+        if(existing != textureIndices.end())
+        {
+            // A texture that's also used as an opacity map can't wait to be streamed in
+            if(streamed == false)
+                materialTextures[existing->second]->Streamed = false;
+            return existing->second;
+        }
+
+        MaterialTexture* newMatTexture = new MaterialTexture();
+        newMatTexture->Name = path;
+        newMatTexture->SRGB = srgb;
+        newMatTexture->Compressed = compressTextures;
+        newMatTexture->Streamed = streamed;
+        const uint32 idx = uint32(materialTextures.Add(newMatTexture));
+        textureIndices[path] = idx;
+        return idx;
+    };
+
+    // Resolve the paths and assign indices up-front, so that the textures end up in the same order as
+    // they would if they were loaded one at a time. Streamed textures start out using the default
+    // texture of their type, but opacity textures are always loaded since they decide which geometry
+    // is alpha-tested.
     const uint64 numMaterials = materials.Size();
     for(uint64 matIdx = 0; matIdx < numMaterials; ++matIdx)
     {
@@ -96,78 +568,200 @@ void LoadMaterialResources(Array<MeshMaterial>& materials, const wstring& direct
                 continue;
             }
 
-            const uint64 numLoaded = materialTextures.Count();
-            for(uint64 i = 0; i < numLoaded; ++i)
+            const bool32 srgb = forceSRGB && texType == uint64(MaterialTextures::Albedo);
+            const bool32 streamed = streamTextures && texType != uint64(MaterialTextures::Opacity) && path != DefaultTextures[texType];
+            const uint32 idx = addTexture(path, srgb, streamed);
+            if(streamed && materialTextures[idx]->PlaceholderIdx == uint32(-1))
+                materialTextures[idx]->PlaceholderIdx = addTexture(DefaultTextures[texType], false, false);
+
+            material.TextureIndices[texType] = idx;
+        }
+    }
+
+    GrowableList<uint32> texturesToLoad;
+    for(uint64 i = 0; i < materialTextures.Count(); ++i)
+    {
+        if(materialTextures[i]->Streamed == false && materialTextures[i]->Resident == false)
+            texturesToLoad.Add(uint32(i));
+    }
+
+    // Only the files that we haven't seen before get decoded
+    const uint64 numNewTextures = texturesToLoad.Count();
+    GrowableList<uint32> texturesToDecode;
+    std::unordered_map<Hash, uint32, HashHasher> decodeIndices;
+    uint64 numShared = 0;
+    for(uint64 i = 0; i < numNewTextures; ++i)
+    {
+        MaterialTexture& matTexture = *materialTextures[texturesToLoad[i]];
+        matTexture.FileKey = TextureFileKey(matTexture.Name.c_str(), matTexture.SRGB != 0, matTexture.Compressed != 0);
+        matTexture.Texture = FindSharedTexture(matTexture.FileKey);
+        if(matTexture.Texture != nullptr || decodeIndices.find(matTexture.FileKey) != decodeIndices.end())
+            ++numShared;
+        else
+            decodeIndices[matTexture.FileKey] = uint32(texturesToDecode.Add(texturesToLoad[i]));
+    }
+
+    // Decoding and mip generation are the expensive part, and don't need the device
+    const uint64 numDecoded = texturesToDecode.Count();
+    Array<wstring> decodeErrors(numDecoded);
+    Array<double> decodeTimes(numDecoded, 0.0);
+    Array<bool> decodeCacheHits(numDecoded, false);
+    Tasks::ParallelFor(uint32(numDecoded), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 i = range.start; i < range.end; ++i)
+        {
+            MaterialTexture& matTexture = *materialTextures[texturesToDecode[i]];
+            try
             {
-                if(materialTextures[i]->Name == path)
-                {
-                    material.Textures[texType] = &materialTextures[i]->Texture;
-                    material.TextureIndices[texType] = uint32(i);
-                    break;
-                }
+                Timer decodeTimer;
+                decodeCacheHits[i] = DecodeTextureFile(matTexture.Name.c_str(), matTexture.Image, matTexture.SRGB != 0, matTexture.Compressed != 0);
+                decodeTimer.Update();
+                decodeTimes[i] = decodeTimer.ElapsedMillisecondsD();
+            }
+            catch(Exception& exception)
+            {
+                // Exceptions can't leave a task, so they get re-thrown on this thread
+                decodeErrors[i] = exception.GetMessage();
             }
+        }
+    });
+
+    for(uint64 i = 0; i < numDecoded; ++i)
+    {
+        if(decodeErrors[i].length() > 0)
+            throw Exception(decodeErrors[i]);
+    }
 
-            if(material.Textures[texType] == nullptr)
+    if(numNewTextures > 0)
+    {
+        timer.Update();
+        WriteLog(L"Decoded %llu material textures in %.2f ms (%llu decoded, %llu shared)",
+                 numNewTextures, timer.ElapsedMillisecondsD(), numDecoded, numShared);
+
+        // The decode times are summed across threads, so they're a measure of the work rather than the wait
+        uint64 numCacheHits = 0;
+        double cacheHitTime = 0.0;
+        double cacheMissTime = 0.0;
+        for(uint64 i = 0; i < numDecoded; ++i)
+        {
+            if(decodeCacheHits[i])
+            {
+                ++numCacheHits;
+                cacheHitTime += decodeTimes[i];
+            }
+            else
             {
-                MaterialTexture* newMatTexture = new MaterialTexture();
-                newMatTexture->Name = path;
-                bool useSRGB = forceSRGB && texType == uint64(MaterialTextures::Albedo);
-                LoadTexture(newMatTexture->Texture, path.c_str(), useSRGB ? true : false);
-                uint64 idx = materialTextures.Add(newMatTexture);
-
-                material.Textures[texType] = &newMatTexture->Texture;
-                material.TextureIndices[texType] = uint32(idx);
+                cacheMissTime += decodeTimes[i];
             }
         }
+
+        if(numDecoded > numCacheHits)
+            WriteLog(L"Processed %llu textures from their source files in %.2f ms", numDecoded - numCacheHits, cacheMissTime);
+        if(numCacheHits > 0)
+            WriteLog(L"Read %llu processed textures from the texture cache in %.2f ms", numCacheHits, cacheHitTime);
+    }
+}
+
+// Creates and uploads the textures that DecodeMaterialTextures() decoded, which needs the main thread
+static void CreateMaterialTextures(Array<MeshMaterial>& materials, GrowableList<MaterialTexture*>& materialTextures)
+{
+    // Textures are created in the order they were added, and the ones that share a file key with one
+    // of them pick it up afterwards
+    uint64 numCreated = 0;
+    const uint64 numTextures = materialTextures.Count();
+    for(uint64 i = 0; i < numTextures; ++i)
+    {
+        MaterialTexture& matTexture = *materialTextures[i];
+        if(matTexture.Streamed || matTexture.Texture != nullptr || matTexture.Image.GetImageCount() == 0)
+            continue;
+
+        matTexture.Texture = AddSharedTexture(matTexture.FileKey, matTexture.Image, matTexture.Name.c_str(), matTexture.SRGB);
+        matTexture.Image.Release();
+        ++numCreated;
+    }
+
+    for(uint64 i = 0; i < numTextures; ++i)
+    {
+        MaterialTexture& matTexture = *materialTextures[i];
+        if(matTexture.Streamed || matTexture.Resident)
+            continue;
+
+        if(matTexture.Texture == nullptr)
+            matTexture.Texture = FindSharedTexture(matTexture.FileKey);
+
+        Assert_(matTexture.Texture != nullptr);
+        matTexture.Resident = true;
+    }
+
+    BindMaterialTextures(materials, materialTextures);
+
+    if(numCreated > 0)
+    {
+        uint64 numSharedTextures = 0;
+        const uint64 memorySaved = SharedTextureMemorySaved(numSharedTextures);
+        WriteLog(L"%llu textures are shared by more than one material texture, saving %.2f MB",
+                 numSharedTextures, memorySaved / (1024.0 * 1024.0));
     }
 }
 
+void LoadMaterialResources(Array<MeshMaterial>& materials, const wstring& directory, bool32 forceSRGB,
+                           bool32 compressTextures, bool32 streamTextures, GrowableList<MaterialTexture*>& materialTextures)
+{
+    DecodeMaterialTextures(materials, directory, forceSRGB, compressTextures, streamTextures, materialTextures);
+    CreateMaterialTextures(materials, materialTextures);
+}
+
 void Mesh::InitFromAssimpMesh(const aiMesh& assimpMesh, float sceneScale, MeshVertex* dstVertices, uint8* dstIndices, IndexType indexType_)
 {
     numVertices = assimpMesh.mNumVertices;
     numIndices = assimpMesh.mNumFaces * 3;
     indexType = indexType_;
 
+    // Assimp's vectors are converted four at a time, see ConvertVectors()
     if(assimpMesh.HasPositions())
     {
         // Compute the AABB of the mesh, and copy the positions
-        aabbMin = FloatMax;
-        aabbMax = -FloatMax;
-
-        for(uint64 i = 0; i < numVertices; ++i)
+        DirectX::XMVECTOR mins = DirectX::XMVectorReplicate(FloatMax);
+        DirectX::XMVECTOR maxes = DirectX::XMVectorReplicate(-FloatMax);
+        ConvertVectors(assimpMesh.mVertices, numVertices, sceneScale, [&](uint64 i, DirectX::FXMVECTOR position)
         {
-            Float3 position = ConvertVector(assimpMesh.mVertices[i]) * sceneScale;
-            aabbMin.x = Min(aabbMin.x, position.x);
-            aabbMin.y = Min(aabbMin.y, position.y);
-            aabbMin.z = Min(aabbMin.z, position.z);
-
-            aabbMax.x = Max(aabbMax.x, position.x);
-            aabbMax.y = Max(aabbMax.y, position.y);
-            aabbMax.z = Max(aabbMax.z, position.z);
+            mins = DirectX::XMVectorMin(mins, position);
+            maxes = DirectX::XMVectorMax(maxes, position);
+            dstVertices[i].Position = Float3(position);
+        });
 
-            dstVertices[i].Position = position;
-        }
+        aabbMin = Float3(mins);
+        aabbMax = Float3(maxes);
     }
 
     if(assimpMesh.HasNormals())
     {
-        for(uint64 i = 0; i < numVertices; ++i)
-            dstVertices[i].Normal = ConvertVector(assimpMesh.mNormals[i]);
+        ConvertVectors(assimpMesh.mNormals, numVertices, 1.0f, [&](uint64 i, DirectX::FXMVECTOR normal)
+        {
+            dstVertices[i].Normal = Float3(normal);
+        });
     }
 
     if(assimpMesh.HasTextureCoords(0))
     {
-        for(uint64 i = 0; i < numVertices; ++i)
-            dstVertices[i].UV = ConvertVector(assimpMesh.mTextureCoords[0][i]).To2D();
+        ConvertVectors(assimpMesh.mTextureCoords[0], numVertices, 1.0f, [&](uint64 i, DirectX::FXMVECTOR uv)
+        {
+            dstVertices[i].UV = Float2(uv);
+        });
     }
 
     if(assimpMesh.HasTangentsAndBitangents())
     {
-        for(uint64 i = 0; i < numVertices; ++i)
+        ConvertVectors(assimpMesh.mTangents, numVertices, 1.0f, [&](uint64 i, DirectX::FXMVECTOR tangent)
         {
-            dstVertices[i].Tangent = ConvertVector(assimpMesh.mTangents[i]);
-            dstVertices[i].Bitangent = ConvertVector(assimpMesh.mBitangents[i]) * -1.0f;
-        }
+            dstVertices[i].Tangent = Float3(tangent);
+        });
+
+        // The bitangents are flipped by the scale
+        ConvertVectors(assimpMesh.mBitangents, numVertices, -1.0f, [&](uint64 i, DirectX::FXMVECTOR bitangent)
+        {
+            dstVertices[i].Bitangent = Float3(bitangent);
+        });
     }
 
     // Copy the index data
@@ -358,21 +952,21 @@ void Mesh::InitPlane(const Float2& dimensions, const Float3& position, const Qua
     aabbMax = Float3(dimensions.x, 0.0f, dimensions.y) * 0.5f;
 }
 
-void Mesh::InitCommon(const MeshVertex* vertices_, const uint8* indices_, uint64 vbAddress, uint64 ibAddress, uint64 vtxOffset_, uint64 idxOffset_)
+void Mesh::InitCommon(const MeshVertex* vertices_, const uint8* indices_, uint64 vbAddress, uint32 vbStride, uint64 ibAddress, uint64 ibSize)
 {
     Assert_(meshParts.Size() > 0);
+    Assert_(ibSize >= IndexSize() * numIndices);
 
     vertices = vertices_;
     indices = indices_;
-    vtxOffset = uint32(vtxOffset_);
-    idxOffset = uint32(idxOffset_);
 
+    // Compact vertices use a smaller stride in the GPU buffer than MeshVertex
     vbView.BufferLocation = vbAddress;
-    vbView.SizeInBytes = sizeof(MeshVertex) * numVertices;
-    vbView.StrideInBytes = sizeof(MeshVertex);
+    vbView.SizeInBytes = vbStride * numVertices;
+    vbView.StrideInBytes = vbStride;
 
     ibView.Format = IndexBufferFormat();
-    ibView.SizeInBytes = IndexSize() * numIndices;
+    ibView.SizeInBytes = uint32(ibSize);
     ibView.BufferLocation = ibAddress;
 }
 
@@ -382,6 +976,10 @@ void Mesh::Shutdown()
     numVertices = 0;
     numIndices = 0;
     meshParts.Shutdown();
+    firstMeshlet = 0;
+    numMeshlets = 0;
+    firstLOD = 0;
+    numLODs = 0;
     vertices = nullptr;
     indices = nullptr;
 }
@@ -403,47 +1001,162 @@ const char* Mesh::InputElementTypeString(InputElementType elemType)
     return ElemStrings[uint64(elemType)];
 }
 
-// == Model =======================================================================================
+// == Compact vertices ============================================================================
 
-void Model::CreateWithAssimp(const ModelLoadSettings& settings)
+static int16 EncodeSNorm16(float x)
 {
-    const wchar* filePath = settings.FilePath;
-    Assert_(filePath != nullptr);
-    if(FileExists(filePath) == false)
-        throw Exception(MakeString(L"Model file with path '%ls' does not exist", filePath));
+    return int16(std::round(Clamp(x, -1.0f, 1.0f) * 32767.0f));
+}
 
-    WriteLog("Loading scene '%ls' with Assimp...", filePath);
+static float DecodeSNorm16(int16 x)
+{
+    return Max(x / 32767.0f, -1.0f);
+}
 
-    std::string fileNameAnsi = WStringToAnsi(filePath);
+static float SignNotZero(float x)
+{
+    return x >= 0.0f ? 1.0f : -1.0f;
+}
 
-    Assimp::Importer importer;
-    const aiScene* scene = importer.ReadFile(fileNameAnsi, 0);
+// Octahedral mapping of a unit vector to [-1, 1]^2
+static void EncodeOctahedral(const Float3& dir, int16* encoded)
+{
+    const float l1Norm = std::abs(dir.x) + std::abs(dir.y) + std::abs(dir.z);
+    float x = l1Norm > 0.0f ? dir.x / l1Norm : 0.0f;
+    float y = l1Norm > 0.0f ? dir.y / l1Norm : 0.0f;
+    if(dir.z < 0.0f)
+    {
+        const float foldedX = (1.0f - std::abs(y)) * SignNotZero(x);
+        const float foldedY = (1.0f - std::abs(x)) * SignNotZero(y);
+        x = foldedX;
+        y = foldedY;
+    }
 
-    if(scene == nullptr)
-        throw Exception(L"Failed to load scene " + std::wstring(filePath) +
-                        L": " + AnsiToWString(importer.GetErrorString()));
+    encoded[0] = EncodeSNorm16(x);
+    encoded[1] = EncodeSNorm16(y);
+}
 
-    if(scene->mNumMeshes == 0)
-        throw Exception(L"Scene " + std::wstring(filePath) + L" has no meshes");
+static Float3 DecodeOctahedral(const int16* encoded)
+{
+    Float3 dir(DecodeSNorm16(encoded[0]), DecodeSNorm16(encoded[1]), 0.0f);
+    dir.z = 1.0f - std::abs(dir.x) - std::abs(dir.y);
+    if(dir.z < 0.0f)
+    {
+        const float foldedX = (1.0f - std::abs(dir.y)) * SignNotZero(dir.x);
+        const float foldedY = (1.0f - std::abs(dir.x)) * SignNotZero(dir.y);
+        dir.x = foldedX;
+        dir.y = foldedY;
+    }
 
-    if(scene->mNumMaterials == 0)
-        throw Exception(L"Scene " + std::wstring(filePath) + L" has no materials");
+    return Float3::Normalize(dir);
+}
 
-    fileDirectory = GetDirectoryFromFilePath(filePath);
-    forceSRGB = settings.ForceSRGB;
+CompactMeshVertex EncodeCompactVertex(const MeshVertex& vertex, const Float3& positionScale, const Float3& positionOffset)
+{
+    CompactMeshVertex result;
+    result.Position[0] = EncodeSNorm16((vertex.Position.x - positionOffset.x) / positionScale.x);
+    result.Position[1] = EncodeSNorm16((vertex.Position.y - positionOffset.y) / positionScale.y);
+    result.Position[2] = EncodeSNorm16((vertex.Position.z - positionOffset.z) / positionScale.z);
 
-    // Grab the lights before we process the scene
-    spotLights.Init(scene->mNumLights);
-    pointLights.Init(scene->mNumLights);
+    // Only the handedness of the bitangent is kept, the rest is rebuilt from the normal and tangent
+    const float bitangentSign = SignNotZero(Float3::Dot(Float3::Cross(vertex.Normal, vertex.Tangent), vertex.Bitangent));
+    result.Position[3] = EncodeSNorm16(bitangentSign);
 
-    uint64 numSpotLights = 0;
-    uint64 numPointLights = 0;
-    for(uint64 i = 0; i < scene->mNumLights; ++i)
-    {
-        const aiLight& srcLight = *scene->mLights[i];
-        if(srcLight.mType == aiLightSource_SPOT)
-        {
-            // Assimp seems to mess up when importing spot light transforms for FBX
+    EncodeOctahedral(vertex.Normal, result.Normal);
+    EncodeOctahedral(vertex.Tangent, result.Tangent);
+
+    result.UV[0] = DirectX::PackedVector::XMConvertFloatToHalf(vertex.UV.x);
+    result.UV[1] = DirectX::PackedVector::XMConvertFloatToHalf(vertex.UV.y);
+
+    return result;
+}
+
+MeshVertex DecodeCompactVertex(const CompactMeshVertex& vertex, const Float3& positionScale, const Float3& positionOffset)
+{
+    MeshVertex result;
+    result.Position.x = DecodeSNorm16(vertex.Position[0]) * positionScale.x + positionOffset.x;
+    result.Position.y = DecodeSNorm16(vertex.Position[1]) * positionScale.y + positionOffset.y;
+    result.Position.z = DecodeSNorm16(vertex.Position[2]) * positionScale.z + positionOffset.z;
+
+    result.Normal = DecodeOctahedral(vertex.Normal);
+    result.Tangent = DecodeOctahedral(vertex.Tangent);
+    result.Bitangent = Float3::Cross(result.Normal, result.Tangent) * SignNotZero(DecodeSNorm16(vertex.Position[3]));
+
+    result.UV.x = DirectX::PackedVector::XMConvertHalfToFloat(vertex.UV[0]);
+    result.UV.y = DirectX::PackedVector::XMConvertHalfToFloat(vertex.UV[1]);
+
+    return result;
+}
+
+// == Model =======================================================================================
+
+void Model::CreateWithAssimp(const ModelLoadSettings& settings)
+{
+    const wchar* filePath = settings.FilePath;
+    Assert_(filePath != nullptr);
+    if(FileExists(filePath) == false)
+        throw Exception(MakeString(L"Model file with path '%ls' does not exist", filePath));
+
+    fileDirectory = GetDirectoryFromFilePath(filePath);
+    forceSRGB = settings.ForceSRGB;
+    streamTextures = settings.StreamTextures;
+    compressTextures = settings.CompressTextures;
+    compactVertices = settings.CompactVertices;
+    std::wstring textureDir = settings.TextureDir ? fileDirectory + L"\\" + settings.TextureDir + L"\\" : fileDirectory;
+
+    // Converted mesh data is tied to the source file's timestamp and the settings that change its contents
+    Hash sourceHash;
+    std::wstring meshDataPath;
+    if(settings.CacheMeshData)
+    {
+        const uint64 sourceTimestamp = GetFileTimestamp(filePath);
+        const uint32 flags = (settings.ForceSRGB ? 1 : 0) | (settings.MergeMeshes ? 2 : 0) | (settings.OptimizeVertexOrder ? 4 : 0) |
+                             (settings.GenerateMeshlets ? 8 : 0);
+        sourceHash = GenerateHash(&sourceTimestamp, sizeof(sourceTimestamp));
+        sourceHash = CombineHashes(sourceHash, GenerateHash(&settings.SceneScale, sizeof(settings.SceneScale)));
+        sourceHash = CombineHashes(sourceHash, GenerateHash(&flags, sizeof(flags)));
+        sourceHash = CombineHashes(sourceHash, GenerateHash(&settings.NumLODs, sizeof(settings.NumLODs)));
+
+        meshDataPath = GetFilePathWithoutExtension(filePath) + L".meshdata";
+        if(LoadMeshData(meshDataPath.c_str(), textureDir, &sourceHash))
+        {
+            if(settings.DeferResourceCreation == false)
+                CreateResources();
+            return;
+        }
+    }
+
+    WriteLog("Loading scene '%ls' with Assimp...", filePath);
+
+    Timer timer;
+
+    std::string fileNameAnsi = WStringToAnsi(filePath);
+
+    Assimp::Importer importer;
+    const aiScene* scene = importer.ReadFile(fileNameAnsi, 0);
+
+    if(scene == nullptr)
+        throw Exception(L"Failed to load scene " + std::wstring(filePath) +
+                        L": " + AnsiToWString(importer.GetErrorString()));
+
+    if(scene->mNumMeshes == 0)
+        throw Exception(L"Scene " + std::wstring(filePath) + L" has no meshes");
+
+    if(scene->mNumMaterials == 0)
+        throw Exception(L"Scene " + std::wstring(filePath) + L" has no materials");
+
+    // Grab the lights before we process the scene
+    spotLights.Init(scene->mNumLights);
+    pointLights.Init(scene->mNumLights);
+
+    uint64 numSpotLights = 0;
+    uint64 numPointLights = 0;
+    for(uint64 i = 0; i < scene->mNumLights; ++i)
+    {
+        const aiLight& srcLight = *scene->mLights[i];
+        if(srcLight.mType == aiLightSource_SPOT)
+        {
+            // Assimp seems to mess up when importing spot light transforms for FBX
             std::string translationName = MakeString("%s_$AssimpFbx$_Translation", srcLight.mName.C_Str());
             const aiNode* translationNode = scene->mRootNode->FindNode(translationName.c_str());
             if(translationNode == nullptr)
@@ -490,8 +1203,14 @@ void Model::CreateWithAssimp(const ModelLoadSettings& settings)
     if(settings.MergeMeshes)
         flags |= aiProcess_PreTransformVertices | aiProcess_OptimizeMeshes;
 
+    timer.Update();
+    const double readMs = timer.DeltaMillisecondsD();
+
     scene = importer.ApplyPostProcessing(flags);
 
+    timer.Update();
+    const double postProcessMs = timer.DeltaMillisecondsD();
+
     // Load the materials
     const uint64 numMaterials = scene->mNumMaterials;
     meshMaterials.Init(numMaterials);
@@ -530,57 +1249,118 @@ void Model::CreateWithAssimp(const ModelLoadSettings& settings)
             material.TextureNames[uint64(MaterialTextures::Emissive)] = GetFileName(AnsiToWString(emissiveMapPath.C_Str()).c_str());
     }
 
-    std::wstring textureDir = settings.TextureDir ? fileDirectory + L"\\" + settings.TextureDir + L"\\" : fileDirectory;
-    LoadMaterialResources(meshMaterials, textureDir, settings.ForceSRGB, materialTextures);
+    DecodeMaterialTextures(meshMaterials, textureDir, settings.ForceSRGB, compressTextures, streamTextures, materialTextures);
+
+    timer.Update();
+    const double materialMs = timer.DeltaMillisecondsD();
 
     aabbMin = FloatMax;
     aabbMax = -FloatMax;
 
-    indexType = IndexType::Index16Bit;
-
-    // Initialize the meshes
+    // Initialize the meshes. Each mesh gets the smallest index size that can address its vertices, and
+    // starts at an aligned offset so that it can be read as either 16-bit or 32-bit indices.
     const uint64 numMeshes = scene->mNumMeshes;
+    meshes.Init(numMeshes);
+    Array<IndexType> meshIndexTypes(numMeshes);
     uint64 numVertices = 0;
     uint64 numIndices = 0;
+    uint64 indexDataSize = 0;
+    bool anyIndex32Bit = false;
     for(uint64 i = 0; i < numMeshes; ++i)
     {
         const aiMesh& assimpMesh = *scene->mMeshes[i];
 
+        meshIndexTypes[i] = assimpMesh.mNumVertices > 0xFFFF ? IndexType::Index32Bit : IndexType::Index16Bit;
+        anyIndex32Bit = anyIndex32Bit || meshIndexTypes[i] == IndexType::Index32Bit;
+
+        meshes[i].vtxOffset = uint32(numVertices);
+        meshes[i].ibOffset = uint32(indexDataSize);
+
+        const uint64 indexSize = meshIndexTypes[i] == IndexType::Index32Bit ? 4 : 2;
         numVertices += assimpMesh.mNumVertices;
         numIndices += assimpMesh.mNumFaces * 3;
-
-        if(assimpMesh.mNumFaces * 3 > 0xFFFF)
-            indexType = IndexType::Index32Bit;
+        indexDataSize += AlignTo(assimpMesh.mNumFaces * 3 * indexSize, MeshIndexAlignment);
     }
 
-
-    const uint64 indexSize = indexType == IndexType::Index32Bit ? 4 : 2;
+    const uint64 uniformIndexDataSize = numIndices * (anyIndex32Bit ? 4 : 2);
+    WriteLog("Index data is %.2f MB with per-mesh index sizes, compared to %.2f MB with one index size for the whole model",
+             indexDataSize / (1024.0 * 1024.0), uniformIndexDataSize / (1024.0 * 1024.0));
 
     vertices.Init(numVertices);
-    indices.Init(numIndices * indexSize);
+    indices.Init(indexDataSize, uint8(0));
+
+    // The offsets are all known up front, so every mesh can be converted independently
+    Tasks::ParallelFor(uint32(numMeshes), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint64 i = range.start; i < range.end; ++i)
+        {
+            Mesh& mesh = meshes[i];
+            mesh.InitFromAssimpMesh(*scene->mMeshes[i], settings.SceneScale, &vertices[mesh.VertexOffset()],
+                                    &indices[mesh.IndexBufferOffset()], meshIndexTypes[i]);
+        }
+    });
 
-    meshes.Init(numMeshes);
-    uint64 vtxOffset = 0;
-    uint64 idxOffset = 0;
     for(uint64 i = 0; i < numMeshes; ++i)
     {
-        meshes[i].InitFromAssimpMesh(*scene->mMeshes[i], settings.SceneScale, &vertices[vtxOffset], &indices[idxOffset], indexType);
+        const Mesh& mesh = meshes[i];
+        aabbMin.x = Min(aabbMin.x, mesh.AABBMin().x);
+        aabbMin.y = Min(aabbMin.y, mesh.AABBMin().y);
+        aabbMin.z = Min(aabbMin.z, mesh.AABBMin().z);
+
+        aabbMax.x = Max(aabbMax.x, mesh.AABBMax().x);
+        aabbMax.y = Max(aabbMax.y, mesh.AABBMax().y);
+        aabbMax.z = Max(aabbMax.z, mesh.AABBMax().z);
+    }
 
-        aabbMin.x = Min(aabbMin.x, meshes[i].AABBMin().x);
-        aabbMin.y = Min(aabbMin.y, meshes[i].AABBMin().y);
-        aabbMin.z = Min(aabbMin.z, meshes[i].AABBMin().z);
+    timer.Update();
+    const double conversionMs = timer.DeltaMillisecondsD();
 
-        aabbMax.x = Max(aabbMax.x, meshes[i].AABBMax().x);
-        aabbMax.y = Max(aabbMax.y, meshes[i].AABBMax().y);
-        aabbMax.z = Max(aabbMax.z, meshes[i].AABBMax().z);
+    if(settings.OptimizeVertexOrder)
+        OptimizeVertexOrder();
 
-        vtxOffset += meshes[i].NumVertices();
-        idxOffset += meshes[i].NumIndices() * indexSize;
-    }
+    timer.Update();
+    const double vertexOrderMs = timer.DeltaMillisecondsD();
 
-    CreateBuffers();
+    if(settings.GenerateMeshlets)
+        GenerateMeshlets();
+
+    timer.Update();
+    const double meshletMs = timer.DeltaMillisecondsD();
+
+    if(settings.NumLODs > 0)
+        GenerateLODs(settings.NumLODs);
+
+    timer.Update();
+    const double lodMs = timer.DeltaMillisecondsD();
 
-    WriteLog("Finished loading scene '%ls'", filePath);
+    vertexData = vertices.Data();
+    vertexCount = vertices.Size();
+    indexData = indices.Data();
+    indexDataSize = indices.Size();
+
+    resourcesPending = true;
+    if(settings.DeferResourceCreation == false)
+        CreateResources();
+
+    timer.Update();
+    const double resourceMs = timer.DeltaMillisecondsD();
+
+    WriteLog("Finished loading scene '%ls' in %.2f ms", filePath, timer.ElapsedMillisecondsD());
+    WriteLog("    Read: %.2f ms, post-process: %.2f ms, materials: %.2f ms, mesh conversion: %.2f ms", readMs, postProcessMs, materialMs, conversionMs);
+    WriteLog("    Vertex order: %.2f ms, meshlets: %.2f ms, LODs: %.2f ms, GPU resources: %.2f ms", vertexOrderMs, meshletMs, lodMs, resourceMs);
+
+    if(settings.CacheMeshData)
+    {
+        try
+        {
+            meshDataHash = WriteMeshData(meshDataPath.c_str(), sourceHash);
+        }
+        catch(Exception& exception)
+        {
+            // The mesh data is only a cache, so failing to write it (for instance to a read-only directory) isn't fatal
+            WriteLog(L"Failed to write mesh data file '%ls': %ls", meshDataPath.c_str(), exception.GetMessage().c_str());
+        }
+    }
 }
 
 void Model::CreateFromMeshData(const wchar* filePath)
@@ -588,14 +1368,24 @@ void Model::CreateFromMeshData(const wchar* filePath)
     if(FileExists(filePath) == false)
         throw Exception(MakeString(L"Model file with path '%ls' does not exist", filePath));
 
-    fileDirectory = GetDirectoryFromFilePath(filePath);
+    if(LoadMeshData(filePath, GetDirectoryFromFilePath(filePath), nullptr) == false)
+        throw Exception(MakeString(L"'%ls' is not a valid mesh data file, or was written by a different version", filePath));
 
-    FileReadSerializer serializer(filePath);
-    Serialize(serializer);
+    CreateResources();
+}
 
-    CreateBuffers();
+void Model::SaveMeshData(const wchar* filePath) const
+{
+    WriteMeshData(filePath, Hash());
+}
+
+void Model::CreateResources()
+{
+    Assert_(resourcesPending);
 
-    LoadMaterialResources(meshMaterials, fileDirectory, forceSRGB, materialTextures);
+    CreateBuffers();
+    CreateMaterialTextures(meshMaterials, materialTextures);
+    resourcesPending = false;
 }
 
 void Model::GenerateBoxScene(const Float3& dimensions, const Float3& position,
@@ -607,9 +1397,7 @@ void Model::GenerateBoxScene(const Float3& dimensions, const Float3& position,
     material.TextureNames[uint64(MaterialTextures::Albedo)] = colorMap;
     material.TextureNames[uint64(MaterialTextures::Normal)] = normalMap;
     fileDirectory = L"..\\Content\\Textures\\";
-    LoadMaterialResources(meshMaterials, L"..\\Content\\Textures\\", false, materialTextures);
-
-    indexType = IndexType::Index16Bit;
+    LoadMaterialResources(meshMaterials, L"..\\Content\\Textures\\", false, false, false, materialTextures);
 
     vertices.Init(NumBoxVerts);
     indices.Init(NumBoxIndices * sizeof(uint16));
@@ -627,9 +1415,7 @@ void Model::GenerateBoxTestScene()
     material.TextureNames[uint64(MaterialTextures::Albedo)] = L"White.png";
     material.TextureNames[uint64(MaterialTextures::Normal)] = L"Hex.png";
     fileDirectory = L"..\\Content\\Textures\\";
-    LoadMaterialResources(meshMaterials, L"..\\Content\\Textures\\", false, materialTextures);
-
-    indexType = IndexType::Index16Bit;
+    LoadMaterialResources(meshMaterials, L"..\\Content\\Textures\\", false, false, false, materialTextures);
 
     vertices.Init(NumBoxVerts * 2);
     indices.Init(NumBoxIndices * 2 * sizeof(uint16));
@@ -637,6 +1423,8 @@ void Model::GenerateBoxTestScene()
     meshes.Init(2);
     meshes[0].InitBox(Float3(2.0f), Float3(0.0f, 1.5f, 0.0f), Quaternion(), 0, vertices.Data(), (uint16*)indices.Data());
     meshes[1].InitBox(Float3(10.0f, 0.25f, 10.0f), Float3(0.0f), Quaternion(), 0, &vertices[NumBoxVerts], (uint16*)&indices[NumBoxIndices * sizeof(uint16)]);
+    meshes[1].vtxOffset = uint32(NumBoxVerts);
+    meshes[1].ibOffset = uint32(NumBoxIndices * sizeof(uint16));
 
     CreateBuffers();
 }
@@ -650,9 +1438,7 @@ void Model::GeneratePlaneScene(const Float2& dimensions, const Float3& position,
     material.TextureNames[uint64(MaterialTextures::Albedo)] = colorMap;
     material.TextureNames[uint64(MaterialTextures::Normal)] = normalMap;
     fileDirectory = L"..\\Content\\Textures\\";
-    LoadMaterialResources(meshMaterials, L"..\\Content\\Textures\\", false, materialTextures);
-
-    indexType = IndexType::Index16Bit;
+    LoadMaterialResources(meshMaterials, L"..\\Content\\Textures\\", false, false, false, materialTextures);
 
     vertices.Init(NumPlaneVerts);
     indices.Init(NumPlaneIndices * sizeof(uint16));
@@ -669,20 +1455,36 @@ void Model::Shutdown()
         meshes[i].Shutdown();
     meshes.Shutdown();
     meshMaterials.Shutdown();
+    meshlets.Shutdown();
+    meshLODs.Shutdown();
+    lodMeshParts.Shutdown();
     for(uint64 i = 0; i < materialTextures.Count(); ++i)
     {
-        materialTextures[i]->Texture.Shutdown();
+        if(materialTextures[i]->Texture != nullptr)
+            ReleaseSharedTexture(materialTextures[i]->FileKey);
         delete materialTextures[i];
         materialTextures[i] = nullptr;
     }
     materialTextures.Shutdown();
     fileDirectory = L"";
+    meshDataHash = Hash();
     forceSRGB = false;
+    streamTextures = false;
+    compressTextures = false;
+    resourcesPending = false;
 
     vertexBuffer.Shutdown();
     indexBuffer.Shutdown();
     vertices.Shutdown();
     indices.Shutdown();
+    compactVertices = false;
+    positionScale = Float3(1.0f, 1.0f, 1.0f);
+    positionOffset = Float3();
+    meshDataFile.Close();
+    vertexData = nullptr;
+    vertexCount = 0;
+    indexData = nullptr;
+    indexDataSize = 0;
 }
 
 const D3D12_INPUT_ELEMENT_DESC* Model::InputElements()
@@ -700,36 +1502,834 @@ uint64 Model::NumInputElements()
     return ArraySize_(StandardInputElements);
 }
 
+const D3D12_INPUT_ELEMENT_DESC* Model::CompactInputElements()
+{
+    return CompactVertexInputElements;
+}
+
+uint64 Model::NumCompactInputElements()
+{
+    return ArraySize_(CompactVertexInputElements);
+}
+
 void Model::CreateBuffers()
 {
     Assert_(meshes.Size() > 0);
 
+    if(meshDataFile.IsOpen() == false)
+    {
+        vertexData = vertices.Data();
+        vertexCount = vertices.Size();
+        indexData = indices.Data();
+        indexDataSize = indices.Size();
+    }
+
     StructuredBufferInit sbInit;
     sbInit.Stride = sizeof(MeshVertex);
-    sbInit.NumElements = vertices.Size();;
-    sbInit.InitData = vertices.Data();
+    sbInit.NumElements = vertexCount;
+    sbInit.InitData = vertexData;
+
+    Array<CompactMeshVertex> compactVertexData;
+    if(compactVertices)
+    {
+        // Quantize positions to the model's bounds, with a minimum size so that flat models don't divide by 0
+        positionOffset = (aabbMin + aabbMax) * 0.5f;
+        positionScale.x = Max((aabbMax.x - aabbMin.x) * 0.5f, 1e-6f);
+        positionScale.y = Max((aabbMax.y - aabbMin.y) * 0.5f, 1e-6f);
+        positionScale.z = Max((aabbMax.z - aabbMin.z) * 0.5f, 1e-6f);
+
+        compactVertexData.Init(vertexCount);
+        Tasks::ParallelFor(uint32((vertexCount + 1023) / 1024), [&](enki::TaskSetPartition range, uint32 threadNum)
+        {
+            const uint64 end = Min<uint64>(uint64(range.end) * 1024, vertexCount);
+            for(uint64 vtxIdx = uint64(range.start) * 1024; vtxIdx < end; ++vtxIdx)
+                compactVertexData[vtxIdx] = EncodeCompactVertex(vertexData[vtxIdx], positionScale, positionOffset);
+        });
+
+        sbInit.Stride = sizeof(CompactMeshVertex);
+        sbInit.InitData = compactVertexData.Data();
+    }
+
     vertexBuffer.Initialize(sbInit);
 
-    const uint32 indexSize = IndexSize();
+    // Index sizes can vary from mesh to mesh, so the indices go in a raw buffer and each mesh has its
+    // own index buffer view with the right format
+    Assert_(indexDataSize % RawBuffer::Stride == 0);
+    RawBufferInit rbInit;
+    rbInit.NumElements = indexDataSize / RawBuffer::Stride;
+    rbInit.InitData = indexData;
+    indexBuffer.Initialize(rbInit);
+
+    const uint64 numMeshes = meshes.Size();
+    for(uint64 i = 0; i < numMeshes; ++i)
+    {
+        Mesh& mesh = meshes[i];
+        const uint64 vbOffset = mesh.VertexOffset() * sbInit.Stride;
+        const uint64 ibOffset = mesh.IndexBufferOffset();
+
+        // The index buffer view runs to the end of the buffer so that it also covers the mesh's LODs
+        mesh.InitCommon(vertexData + mesh.VertexOffset(), indexData + ibOffset, vertexBuffer.GPUAddress + vbOffset,
+                        uint32(sbInit.Stride), indexBuffer.GPUAddress + ibOffset, indexDataSize - ibOffset);
+    }
+}
+
+void Model::OptimizeVertexOrder()
+{
+    Timer timer;
+
+    const uint64 numMeshes = meshes.Size();
+    Array<VertexCacheStats> statsBefore(numMeshes);
+    Array<VertexCacheStats> statsAfter(numMeshes);
+    Tasks::ParallelFor(uint32(numMeshes), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 meshIdx = range.start; meshIdx < range.end; ++meshIdx)
+        {
+            Mesh& mesh = meshes[meshIdx];
+            const uint64 numMeshVertices = mesh.NumVertices();
+            const uint64 numMeshIndices = mesh.NumIndices();
+            MeshVertex* meshVertices = &vertices[mesh.VertexOffset()];
+            uint8* meshIndices = &indices[mesh.IndexBufferOffset()];
+            const IndexType meshIndexType = mesh.IndexBufferType();
+            if(numMeshIndices == 0)
+                continue;
+
+            Array<uint32> indices32(numMeshIndices);
+            for(uint64 i = 0; i < numMeshIndices; ++i)
+                indices32[i] = meshIndexType == IndexType::Index32Bit ? ((const uint32*)meshIndices)[i] : ((const uint16*)meshIndices)[i];
+
+            statsBefore[meshIdx] = AnalyzeVertexCache(indices32.Data(), numMeshIndices, numMeshVertices);
+
+            // Triangles can only move within their mesh part, since each part is drawn on its own
+            for(uint64 partIdx = 0; partIdx < mesh.meshParts.Size(); ++partIdx)
+            {
+                const MeshPart& part = mesh.meshParts[partIdx];
+                OptimizeVertexCache(&indices32[part.IndexStart], part.IndexCount, numMeshVertices);
+            }
+
+            Array<uint32> remap(numMeshVertices);
+            ComputeVertexFetchRemap(indices32.Data(), numMeshIndices, numMeshVertices, remap.Data());
+
+            Array<MeshVertex> remappedVertices(numMeshVertices);
+            for(uint64 i = 0; i < numMeshVertices; ++i)
+                remappedVertices[remap[i]] = meshVertices[i];
+            memcpy(meshVertices, remappedVertices.Data(), remappedVertices.MemorySize());
+
+            for(uint64 i = 0; i < numMeshIndices; ++i)
+                indices32[i] = remap[indices32[i]];
+
+            // The vertex range of each part is now wherever its vertices were remapped to
+            for(uint64 partIdx = 0; partIdx < mesh.meshParts.Size(); ++partIdx)
+            {
+                MeshPart& part = mesh.meshParts[partIdx];
+                if(part.IndexCount == 0)
+                    continue;
+
+                uint32 minVertex = uint32(-1);
+                uint32 maxVertex = 0;
+                for(uint64 i = part.IndexStart; i < part.IndexStart + part.IndexCount; ++i)
+                {
+                    minVertex = Min(minVertex, indices32[i]);
+                    maxVertex = Max(maxVertex, indices32[i]);
+                }
+
+                part.VertexStart = minVertex;
+                part.VertexCount = maxVertex - minVertex + 1;
+            }
+
+            statsAfter[meshIdx] = AnalyzeVertexCache(indices32.Data(), numMeshIndices, numMeshVertices);
+
+            for(uint64 i = 0; i < numMeshIndices; ++i)
+            {
+                if(meshIndexType == IndexType::Index32Bit)
+                    ((uint32*)meshIndices)[i] = indices32[i];
+                else
+                    ((uint16*)meshIndices)[i] = uint16(indices32[i]);
+            }
+        }
+    });
+
+    timer.Update();
+
+    // Totals are weighted by the number of triangles and vertices in each mesh
+    double totalMissesBefore = 0.0;
+    double totalMissesAfter = 0.0;
+    uint64 totalTriangles = 0;
+    uint64 totalVertices = 0;
+    for(uint64 i = 0; i < numMeshes; ++i)
+    {
+        const uint64 numTriangles = meshes[i].NumIndices() / 3;
+        WriteLog("    Mesh %llu (%llu triangles): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", i, numTriangles,
+                 statsBefore[i].ACMR, statsAfter[i].ACMR, statsBefore[i].ATVR, statsAfter[i].ATVR);
+
+        totalMissesBefore += statsBefore[i].ACMR * double(numTriangles);
+        totalMissesAfter += statsAfter[i].ACMR * double(numTriangles);
+        totalTriangles += numTriangles;
+        totalVertices += meshes[i].NumVertices();
+    }
+
+    if(totalTriangles > 0)
+        WriteLog("Optimized vertex order for %llu meshes in %.2f ms: ACMR %.3f -> %.3f, ATVR %.3f -> %.3f", numMeshes,
+                 timer.ElapsedMillisecondsD(), totalMissesBefore / totalTriangles, totalMissesAfter / totalTriangles,
+                 totalMissesBefore / totalVertices, totalMissesAfter / totalVertices);
+}
+
+// Computes the bounding sphere and normal cone for a meshlet's triangles
+static void ComputeMeshletBounds(Meshlet& meshlet, const MeshVertex* vertices, const Array<uint32>& indices)
+{
+    const uint64 numTriangles = meshlet.IndexCount / 3;
+
+    Float3 boundsMin = FloatMax;
+    Float3 boundsMax = -FloatMax;
+    for(uint64 i = 0; i < meshlet.IndexCount; ++i)
+    {
+        const Float3& p = vertices[indices[meshlet.IndexStart + i]].Position;
+        boundsMin = Float3(Min(boundsMin.x, p.x), Min(boundsMin.y, p.y), Min(boundsMin.z, p.z));
+        boundsMax = Float3(Max(boundsMax.x, p.x), Max(boundsMax.y, p.y), Max(boundsMax.z, p.z));
+    }
+
+    Float3 normalSum;
+    Array<Float3> normals(numTriangles);
+    for(uint64 triIdx = 0; triIdx < numTriangles; ++triIdx)
+    {
+        const Float3& p0 = vertices[indices[meshlet.IndexStart + triIdx * 3 + 0]].Position;
+        const Float3& p1 = vertices[indices[meshlet.IndexStart + triIdx * 3 + 1]].Position;
+        const Float3& p2 = vertices[indices[meshlet.IndexStart + triIdx * 3 + 2]].Position;
+
+        // Front faces are clockwise after importing, which makes this the outward-facing normal
+        const Float3 normal = Float3::Cross(p1 - p0, p2 - p0);
+        const float normalLength = normal.Length();
+        normals[triIdx] = normalLength > 0.0f ? normal / normalLength : Float3();
+        normalSum += normals[triIdx];
+    }
+
+    meshlet.BoundsCenter = (boundsMin + boundsMax) * 0.5f;
+    meshlet.BoundsRadius = 0.0f;
+    for(uint64 i = 0; i < meshlet.IndexCount; ++i)
+    {
+        const Float3& position = vertices[indices[meshlet.IndexStart + i]].Position;
+        meshlet.BoundsRadius = Max(meshlet.BoundsRadius, Float3::Distance(position, meshlet.BoundsCenter));
+    }
+
+    // The cone can only be used if every triangle is within 90 degrees of the average normal, with
+    // some slack for precision
+    meshlet.ConeAxis = Float3(0.0f, 0.0f, 1.0f);
+    meshlet.ConeApex = meshlet.BoundsCenter;
+    meshlet.ConeCutoff = 1.0f;
+
+    const float axisLength = normalSum.Length();
+    if(axisLength <= 0.0f)
+        return;
+
+    const Float3 axis = normalSum / axisLength;
+    float minDot = 1.0f;
+    for(uint64 triIdx = 0; triIdx < numTriangles; ++triIdx)
+        minDot = Min(minDot, Float3::Dot(normals[triIdx], axis));
+
+    if(minDot <= 0.1f)
+        return;
+
+    // Move the apex back along the axis until it's behind every triangle's plane, so that any viewer
+    // that passes the test is on the back side of all of them
+    float maxT = 0.0f;
+    for(uint64 triIdx = 0; triIdx < numTriangles; ++triIdx)
+    {
+        const Float3& p0 = vertices[indices[meshlet.IndexStart + triIdx * 3]].Position;
+        const float denominator = Float3::Dot(axis, normals[triIdx]);
+        if(denominator > 0.0f)
+            maxT = Max(maxT, Float3::Dot(meshlet.BoundsCenter - p0, normals[triIdx]) / denominator);
+    }
+
+    meshlet.ConeAxis = axis;
+    meshlet.ConeApex = meshlet.BoundsCenter - axis * maxT;
+    meshlet.ConeCutoff = std::sqrt(1.0f - minDot * minDot);
+}
+
+void Model::GenerateMeshlets()
+{
+    Timer timer;
+
+    const uint64 numMeshes = meshes.Size();
+
+    // Meshlets are cut greedily from the existing triangle order, which keeps each one a contiguous
+    // range of indices. This works best after OptimizeVertexOrder() has made that order coherent.
+    Array<GrowableList<Meshlet>> meshMeshlets(numMeshes);
+    Tasks::ParallelFor(uint32(numMeshes), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 meshIdx = range.start; meshIdx < range.end; ++meshIdx)
+        {
+            const Mesh& mesh = meshes[meshIdx];
+            const uint64 numMeshIndices = mesh.NumIndices();
+            const MeshVertex* meshVertices = &vertices[mesh.VertexOffset()];
+            const uint8* meshIndices = &indices[mesh.IndexBufferOffset()];
+            const IndexType meshIndexType = mesh.IndexBufferType();
+
+            Array<uint32> indices32(numMeshIndices);
+            for(uint64 i = 0; i < numMeshIndices; ++i)
+                indices32[i] = meshIndexType == IndexType::Index32Bit ? ((const uint32*)meshIndices)[i] : ((const uint16*)meshIndices)[i];
+
+            // Tags each vertex with the last meshlet that used it
+            Array<uint32> vertexTags(mesh.NumVertices(), uint32(-1));
+            GrowableList<Meshlet>& dstMeshlets = meshMeshlets[meshIdx];
+
+            for(uint64 partIdx = 0; partIdx < mesh.NumMeshParts(); ++partIdx)
+            {
+                const MeshPart& part = mesh.MeshParts()[partIdx];
+                Meshlet meshlet;
+                meshlet.IndexStart = part.IndexStart;
+                meshlet.MeshPartIdx = uint32(partIdx);
+                uint32 meshletTag = uint32(dstMeshlets.Count());
+
+                for(uint64 i = part.IndexStart; i < part.IndexStart + part.IndexCount; i += 3)
+                {
+                    uint32 numNewVertices = 0;
+                    for(uint64 corner = 0; corner < 3; ++corner)
+                        numNewVertices += vertexTags[indices32[i + corner]] != meshletTag ? 1 : 0;
+
+                    if(meshlet.VertexCount + numNewVertices > MaxMeshletVertices || meshlet.IndexCount / 3 == MaxMeshletTriangles)
+                    {
+                        ComputeMeshletBounds(meshlet, meshVertices, indices32);
+                        dstMeshlets.Add(meshlet);
+
+                        meshlet.IndexStart = uint32(i);
+                        meshlet.IndexCount = 0;
+                        meshlet.VertexCount = 0;
+                        meshletTag = uint32(dstMeshlets.Count());
+                    }
+
+                    for(uint64 corner = 0; corner < 3; ++corner)
+                    {
+                        const uint32 vtxIdx = indices32[i + corner];
+                        if(vertexTags[vtxIdx] != meshletTag)
+                        {
+                            vertexTags[vtxIdx] = meshletTag;
+                            ++meshlet.VertexCount;
+                        }
+                    }
+
+                    meshlet.IndexCount += 3;
+                }
+
+                if(meshlet.IndexCount > 0)
+                {
+                    ComputeMeshletBounds(meshlet, meshVertices, indices32);
+                    dstMeshlets.Add(meshlet);
+                }
+            }
+        }
+    });
+
+    uint64 numMeshlets = 0;
+    for(uint64 i = 0; i < numMeshes; ++i)
+        numMeshlets += meshMeshlets[i].Count();
+
+    meshlets.Init(numMeshlets);
+    numMeshlets = 0;
+    for(uint64 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+    {
+        Mesh& mesh = meshes[meshIdx];
+        mesh.firstMeshlet = uint32(numMeshlets);
+        mesh.numMeshlets = uint32(meshMeshlets[meshIdx].Count());
+        for(uint64 i = 0; i < mesh.numMeshlets; ++i)
+            meshlets[numMeshlets++] = meshMeshlets[meshIdx][i];
+    }
+
+    timer.Update();
+    WriteLog("Generated %llu meshlets for %llu meshes in %.2f ms", numMeshlets, numMeshes, timer.ElapsedMillisecondsD());
+}
+
+// Largest distance that simplifying a mesh for the next LOD can move its surface, as a fraction of
+// the mesh's bounding radius
+static const float MaxLODError = 0.1f;
+
+void Model::GenerateLODs(uint64 maxLODs)
+{
+    Timer timer;
+
+    const uint64 numMeshes = meshes.Size();
+    // Each LOD is simplified from the one before it, so the errors add up. The part index starts
+    // are relative to the mesh's own LOD indices until they're copied into the index array.
+    Array<GrowableList<MeshLOD>> lodLists(numMeshes);
+    Array<GrowableList<MeshPart>> lodPartLists(numMeshes);
+    Array<GrowableList<uint32>> lodIndexLists(numMeshes);
+    Tasks::ParallelFor(uint32(numMeshes), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 meshIdx = range.start; meshIdx < range.end; ++meshIdx)
+        {
+            const Mesh& mesh = meshes[meshIdx];
+            const uint64 numMeshIndices = mesh.NumIndices();
+            const uint64 numParts = mesh.NumMeshParts();
+            const MeshVertex* meshVertices = &vertices[mesh.VertexOffset()];
+            const uint8* meshIndices = &indices[mesh.IndexBufferOffset()];
+            const IndexType meshIndexType = mesh.IndexBufferType();
+            if(numMeshIndices == 0)
+                continue;
+
+            Array<uint32> indices32(numMeshIndices);
+            for(uint64 i = 0; i < numMeshIndices; ++i)
+                indices32[i] = meshIndexType == IndexType::Index32Bit ? ((const uint32*)meshIndices)[i] : ((const uint16*)meshIndices)[i];
+
+            Array<uint64> partIndexCounts(numParts);
+            for(uint64 partIdx = 0; partIdx < numParts; ++partIdx)
+                partIndexCounts[partIdx] = mesh.MeshParts()[partIdx].IndexCount;
+
+            // Parts are simplified separately, so a vertex on the edge between two parts could collapse
+            // differently on each side and open a crack. To avoid that, each part locks every position
+            // that another part also uses. Separate meshes don't share anything, and can still crack.
+            const uint32 NoPart = uint32(-1);
+            const uint32 MultipleParts = uint32(-2);
+            Array<uint32> vertexParts;
+            Array<uint8> lockedVertices;
+            if(numParts > 1)
+            {
+                vertexParts.Init(mesh.NumVertices(), NoPart);
+                for(uint64 partIdx = 0; partIdx < numParts; ++partIdx)
+                {
+                    const MeshPart& part = mesh.MeshParts()[partIdx];
+                    for(uint64 i = part.IndexStart; i < part.IndexStart + part.IndexCount; ++i)
+                    {
+                        uint32& vertexPart = vertexParts[indices32[i]];
+                        vertexPart = (vertexPart == NoPart || vertexPart == partIdx) ? uint32(partIdx) : MultipleParts;
+                    }
+                }
+
+                lockedVertices.Init(mesh.NumVertices(), 0);
+            }
+
+            const float maxError = Float3::Length(mesh.AABBMax() - mesh.AABBMin()) * 0.5f * MaxLODError;
+            float lodError = 0.0f;
+            uint64 prevNumIndices = numMeshIndices;
+            for(uint64 lodIdx = 0; lodIdx < maxLODs; ++lodIdx)
+            {
+                uint64 numLODIndices = 0;
+                float simplifyError = 0.0f;
+                for(uint64 partIdx = 0; partIdx < numParts; ++partIdx)
+                {
+                    const MeshPart& part = mesh.MeshParts()[partIdx];
+                    const uint64 targetIndexCount = partIndexCounts[partIdx] / 6 * 3;
+
+                    // Vertices that other parts use, which SimplifyMesh extends to any vertex at the same position
+                    if(numParts > 1)
+                    {
+                        for(uint64 i = 0; i < mesh.NumVertices(); ++i)
+                            lockedVertices[i] = (vertexParts[i] != NoPart && vertexParts[i] != partIdx) ? 1 : 0;
+                    }
+
+                    float partError = 0.0f;
+                    partIndexCounts[partIdx] = SimplifyMesh(&indices32[part.IndexStart], partIndexCounts[partIdx], &meshVertices[0].Position,
+                                                            sizeof(MeshVertex), mesh.NumVertices(), targetIndexCount, maxError, &partError,
+                                                            numParts > 1 ? lockedVertices.Data() : nullptr);
+                    simplifyError = Max(simplifyError, partError);
+                    numLODIndices += partIndexCounts[partIdx];
+                }
+
+                // Stop once another level would barely save anything
+                if(numLODIndices * 5 > prevNumIndices * 4)
+                    break;
+
+                lodError += simplifyError;
+                prevNumIndices = numLODIndices;
+
+                MeshLOD lod;
+                lod.FirstPart = uint32(lodPartLists[meshIdx].Count());
+                lod.NumIndices = uint32(numLODIndices);
+                lod.Error = lodError;
+                lodLists[meshIdx].Add(lod);
+
+                for(uint64 partIdx = 0; partIdx < numParts; ++partIdx)
+                {
+                    const MeshPart& part = mesh.MeshParts()[partIdx];
+                    uint32* partIndices = &indices32[part.IndexStart];
+                    OptimizeVertexCache(partIndices, partIndexCounts[partIdx], mesh.NumVertices());
+
+                    MeshPart lodPart = part;
+                    lodPart.IndexStart = uint32(lodIndexLists[meshIdx].Count());
+                    lodPart.IndexCount = uint32(partIndexCounts[partIdx]);
+                    lodPartLists[meshIdx].Add(lodPart);
+
+                    for(uint64 i = 0; i < partIndexCounts[partIdx]; ++i)
+                        lodIndexLists[meshIdx].Add(partIndices[i]);
+                }
+            }
+        }
+    });
+
+    // Each mesh's LOD indices use the same index size as the mesh, and start at the same alignment
+    uint64 numLODs = 0;
+    uint64 numLODParts = 0;
+    uint64 lodIndexDataSize = 0;
+    for(uint64 i = 0; i < numMeshes; ++i)
+    {
+        numLODs += lodLists[i].Count();
+        numLODParts += lodPartLists[i].Count();
+        lodIndexDataSize += AlignTo(lodIndexLists[i].Count() * meshes[i].IndexSize(), MeshIndexAlignment);
+    }
+
+    // The LOD indices go after the full-detail indices of every mesh, so that everything that only
+    // works with the full-detail meshes can ignore them
+    const uint64 fullDetailIndexDataSize = indices.Size();
+    indices.Resize(fullDetailIndexDataSize + lodIndexDataSize);
+    memset(indices.Data() + fullDetailIndexDataSize, 0, lodIndexDataSize);
+    meshLODs.Init(numLODs);
+    lodMeshParts.Init(numLODParts);
+
+    uint64 lodIdx = 0;
+    uint64 lodPartIdx = 0;
+    uint64 lodIndexOffset = fullDetailIndexDataSize;
+    for(uint64 meshIdx = 0; meshIdx < numMeshes; ++meshIdx)
+    {
+        Mesh& mesh = meshes[meshIdx];
+        mesh.firstLOD = uint32(lodIdx);
+        mesh.numLODs = uint32(lodLists[meshIdx].Count());
+
+        for(uint64 i = 0; i < lodLists[meshIdx].Count(); ++i)
+        {
+            meshLODs[lodIdx] = lodLists[meshIdx][i];
+            meshLODs[lodIdx].FirstPart += uint32(lodPartIdx);
+            ++lodIdx;
+        }
+
+        // Part index starts are relative to the mesh, like the mesh's own parts
+        const uint64 indexSize = mesh.IndexSize();
+        Assert_((lodIndexOffset - mesh.IndexBufferOffset()) % indexSize == 0);
+        const uint64 firstLODIndex = (lodIndexOffset - mesh.IndexBufferOffset()) / indexSize;
+        for(uint64 i = 0; i < lodPartLists[meshIdx].Count(); ++i)
+        {
+            lodMeshParts[lodPartIdx] = lodPartLists[meshIdx][i];
+            lodMeshParts[lodPartIdx].IndexStart += uint32(firstLODIndex);
+            ++lodPartIdx;
+        }
+
+        const GrowableList<uint32>& lodIndices = lodIndexLists[meshIdx];
+        uint8* dstIndices = indices.Data() + lodIndexOffset;
+        for(uint64 i = 0; i < lodIndices.Count(); ++i)
+        {
+            if(mesh.IndexBufferType() == IndexType::Index32Bit)
+                ((uint32*)dstIndices)[i] = lodIndices[i];
+            else
+                ((uint16*)dstIndices)[i] = uint16(lodIndices[i]);
+        }
+        lodIndexOffset += AlignTo(lodIndices.Count() * indexSize, MeshIndexAlignment);
+    }
+
+    timer.Update();
+    WriteLog("Generated %llu LODs for %llu meshes in %.2f ms, adding %.2f MB of indices to the %.2f MB of full-detail indices",
+             numLODs, numMeshes, timer.ElapsedMillisecondsD(), lodIndexDataSize / (1024.0 * 1024.0), fullDetailIndexDataSize / (1024.0 * 1024.0));
+}
+
+const MeshPart* Model::LODParts(const Mesh& mesh, uint64 lodLevel) const
+{
+    if(lodLevel == 0)
+        return mesh.MeshParts().Data();
+
+    Assert_(lodLevel <= mesh.NumLODs());
+    return &lodMeshParts[meshLODs[mesh.FirstLOD() + lodLevel - 1].FirstPart];
+}
+
+uint32 Model::LODNumIndices(const Mesh& mesh, uint64 lodLevel) const
+{
+    if(lodLevel == 0)
+        return mesh.NumIndices();
+
+    Assert_(lodLevel <= mesh.NumLODs());
+    return meshLODs[mesh.FirstLOD() + lodLevel - 1].NumIndices;
+}
+
+void Model::LoadTexture(uint64 textureIdx)
+{
+    MaterialTexture& matTexture = *materialTextures[textureIdx];
+    Assert_(matTexture.Streamed && matTexture.Resident == false);
+    if(matTexture.Texture != nullptr)
+        return;
+
+    matTexture.FileKey = TextureFileKey(matTexture.Name.c_str(), matTexture.SRGB != 0, matTexture.Compressed != 0);
+    matTexture.Texture = FindSharedTexture(matTexture.FileKey);
+    if(matTexture.Texture != nullptr)
+        return;
+
+    DecodeTextureFile(matTexture.Name.c_str(), matTexture.Image, matTexture.SRGB != 0, matTexture.Compressed != 0);
+}
+
+void Model::FinishTextureLoad(uint64 textureIdx)
+{
+    MaterialTexture& matTexture = *materialTextures[textureIdx];
+    Assert_(matTexture.Streamed && matTexture.Resident == false);
+    if(matTexture.Texture != nullptr)
+        return;
+
+    // Another texture in the same batch might have created it already
+    Assert_(matTexture.Image.GetImageCount() > 0);
+    matTexture.Texture = FindSharedTexture(matTexture.FileKey);
+    if(matTexture.Texture == nullptr)
+        matTexture.Texture = AddSharedTexture(matTexture.FileKey, matTexture.Image, matTexture.Name.c_str(), matTexture.SRGB);
+    matTexture.Image.Release();
+}
+
+void Model::UnloadTexture(uint64 textureIdx)
+{
+    MaterialTexture& matTexture = *materialTextures[textureIdx];
+    Assert_(matTexture.Streamed && matTexture.Resident == false);
+    ReleaseSharedTexture(matTexture.FileKey);
+    matTexture.Texture = nullptr;
+}
 
-    FormattedBufferInit fbInit;
-    fbInit.Format = IndexBufferFormat();
-    fbInit.NumElements = indices.Size() / indexSize;
-    fbInit.InitData = indices.Data();
-    indexBuffer.Initialize(fbInit);
+void Model::SetTextureResident(uint64 textureIdx, bool resident)
+{
+    MaterialTexture& matTexture = *materialTextures[textureIdx];
+    Assert_(matTexture.Streamed);
+    Assert_(resident == false || matTexture.Texture != nullptr);
+    matTexture.Resident = resident;
+}
+
+void Model::UpdateMaterialTextures()
+{
+    BindMaterialTextures(meshMaterials, materialTextures);
+}
+
+uint64 Model::GeometryMemorySize() const
+{
+    return vertexBuffer.InternalBuffer.Size + indexBuffer.InternalBuffer.Size;
+}
+
+uint64 Model::SelectLOD(const Mesh& mesh, const Camera& camera, float viewportHeight, float maxPixelError) const
+{
+    Assert_(viewportHeight > 0.0f);
+
+    // Measure the error at the point on the mesh's bounding sphere that's closest to the camera, so
+    // that it's within the limit across the whole mesh
+    const Float3 center = (mesh.AABBMin() + mesh.AABBMax()) * 0.5f;
+    const float radius = Float3::Length(mesh.AABBMax() - center);
+    const Float3 closestPoint = center - camera.Forward() * radius;
+
+    uint64 lodLevel = 0;
+    for(uint64 i = 0; i < mesh.NumLODs(); ++i)
+    {
+        if(camera.ProjectedSize(closestPoint, meshLODs[mesh.FirstLOD() + i].Error, viewportHeight) > maxPixelError)
+            break;
+        lodLevel = i + 1;
+    }
+
+    return lodLevel;
+}
+
+bool Model::LoadMeshData(const wchar* filePath, const std::wstring& textureDir, const Hash* sourceHash)
+{
+    if(FileExists(filePath) == false)
+        return false;
+
+    Timer timer;
+
+    const MeshDataHeader* header = nullptr;
+    try
+    {
+        meshDataFile.Open(filePath);
+        header = ValidateMeshData(meshDataFile, sourceHash);
+    }
+    catch(Exception& exception)
+    {
+        WriteLog(L"Failed to map mesh data file '%ls': %ls", filePath, exception.GetMessage().c_str());
+    }
+
+    if(header == nullptr)
+    {
+        meshDataFile.Close();
+        return false;
+    }
+
+    const uint8* fileData = meshDataFile.Data();
+    auto section = [&](MeshDataSection sectionType) { return fileData + header->Sections[uint64(sectionType)].Offset; };
+
+    const MeshDataMesh* srcMeshes = reinterpret_cast<const MeshDataMesh*>(section(MeshDataSection::Meshes));
+    const MeshPart* srcMeshParts = reinterpret_cast<const MeshPart*>(section(MeshDataSection::MeshParts));
+    const MeshDataMaterial* srcMaterials = reinterpret_cast<const MeshDataMaterial*>(section(MeshDataSection::Materials));
+    const uint8* strings = section(MeshDataSection::Strings);
+
+    fileDirectory = GetDirectoryFromFilePath(filePath);
+    meshDataHash = header->MetadataHash;
+    forceSRGB = header->ForceSRGB;
+    aabbMin = header->AABBMin;
+    aabbMax = header->AABBMax;
+
+    spotLights.Init(header->NumSpotLights);
+    memcpy(spotLights.Data(), section(MeshDataSection::SpotLights), spotLights.MemorySize());
+    pointLights.Init(header->NumPointLights);
+    memcpy(pointLights.Data(), section(MeshDataSection::PointLights), pointLights.MemorySize());
+    meshlets.Init(header->NumMeshlets);
+    memcpy(meshlets.Data(), section(MeshDataSection::Meshlets), meshlets.MemorySize());
+    meshLODs.Init(header->NumMeshLODs);
+    memcpy(meshLODs.Data(), section(MeshDataSection::MeshLODs), meshLODs.MemorySize());
+    lodMeshParts.Init(header->NumLODMeshParts);
+    memcpy(lodMeshParts.Data(), section(MeshDataSection::LODMeshParts), lodMeshParts.MemorySize());
+
+    // The strings aren't aligned, so they're copied out rather than read in place
+    meshMaterials.Init(header->NumMaterials);
+    for(uint64 i = 0; i < meshMaterials.Size(); ++i)
+    {
+        const MeshDataMaterial& srcMaterial = srcMaterials[i];
+        MeshMaterial& material = meshMaterials[i];
+        material.Name.assign(reinterpret_cast<const char*>(strings + srcMaterial.Name.Offset), srcMaterial.Name.Length);
+        for(uint64 texType = 0; texType < uint64(MaterialTextures::Count); ++texType)
+        {
+            const MeshDataString& srcName = srcMaterial.TextureNames[texType];
+            material.TextureNames[texType].resize(srcName.Length);
+            if(srcName.Length > 0)
+                memcpy(&material.TextureNames[texType][0], strings + srcName.Offset, srcName.Length * sizeof(wchar));
+        }
+    }
+
+    meshes.Init(header->NumMeshes);
+    for(uint64 i = 0; i < meshes.Size(); ++i)
+    {
+        const MeshDataMesh& srcMesh = srcMeshes[i];
+        Mesh& mesh = meshes[i];
+        mesh.numVertices = srcMesh.NumVertices;
+        mesh.numIndices = srcMesh.NumIndices;
+        mesh.vtxOffset = srcMesh.VertexOffset;
+        mesh.ibOffset = srcMesh.IndexBufferOffset;
+        mesh.indexType = IndexType(srcMesh.IndexType);
+        mesh.aabbMin = srcMesh.AABBMin;
+        mesh.aabbMax = srcMesh.AABBMax;
+        mesh.firstMeshlet = srcMesh.FirstMeshlet;
+        mesh.numMeshlets = srcMesh.NumMeshlets;
+        mesh.firstLOD = srcMesh.FirstLOD;
+        mesh.numLODs = srcMesh.NumLODs;
+
+        mesh.meshParts.Init(srcMesh.NumMeshParts);
+        memcpy(mesh.meshParts.Data(), srcMeshParts + srcMesh.FirstMeshPart, mesh.meshParts.MemorySize());
+    }
+
+    vertexData = reinterpret_cast<const MeshVertex*>(section(MeshDataSection::Vertices));
+    vertexCount = header->Sections[uint64(MeshDataSection::Vertices)].Size / sizeof(MeshVertex);
+    indexData = section(MeshDataSection::Indices);
+    indexDataSize = header->Sections[uint64(MeshDataSection::Indices)].Size;
+
+    timer.Update();
+    WriteLog(L"Loaded %llu meshes and %llu vertices from mesh data file '%ls' in %.2f ms",
+             meshes.Size(), vertexCount, filePath, timer.ElapsedMillisecondsD());
+
+    // The caller creates the GPU resources, since that might need to wait for the main thread
+    DecodeMaterialTextures(meshMaterials, textureDir, forceSRGB, compressTextures, streamTextures, materialTextures);
+    resourcesPending = true;
+
+    return true;
+}
+
+Hash Model::WriteMeshData(const wchar* filePath, Hash sourceHash) const
+{
+    Assert_(meshes.Size() > 0);
 
-    uint64 vtxOffset = 0;
-    uint64 idxOffset = 0;
     const uint64 numMeshes = meshes.Size();
+    Array<MeshDataMesh> dstMeshes(numMeshes);
+    uint64 numMeshParts = 0;
+    for(uint64 i = 0; i < numMeshes; ++i)
+        numMeshParts += meshes[i].NumMeshParts();
+
+    Array<MeshPart> dstMeshParts(numMeshParts);
+    numMeshParts = 0;
     for(uint64 i = 0; i < numMeshes; ++i)
     {
-        uint64 vbOffset = vtxOffset * sizeof(MeshVertex);
-        uint64 ibOffset = idxOffset * indexSize;
-        meshes[i].InitCommon(&vertices[vtxOffset], &indices[ibOffset], vertexBuffer.GPUAddress + vbOffset, indexBuffer.GPUAddress + ibOffset, vtxOffset, idxOffset);
+        const Mesh& mesh = meshes[i];
+        MeshDataMesh& dstMesh = dstMeshes[i];
+        dstMesh.NumVertices = mesh.NumVertices();
+        dstMesh.NumIndices = mesh.NumIndices();
+        dstMesh.VertexOffset = mesh.VertexOffset();
+        dstMesh.IndexBufferOffset = mesh.IndexBufferOffset();
+        dstMesh.IndexType = uint32(mesh.IndexBufferType());
+        dstMesh.FirstMeshPart = uint32(numMeshParts);
+        dstMesh.NumMeshParts = uint32(mesh.NumMeshParts());
+        dstMesh.FirstMeshlet = mesh.FirstMeshlet();
+        dstMesh.NumMeshlets = mesh.NumMeshlets();
+        dstMesh.FirstLOD = mesh.FirstLOD();
+        dstMesh.NumLODs = mesh.NumLODs();
+        dstMesh.AABBMin = mesh.AABBMin();
+        dstMesh.AABBMax = mesh.AABBMax();
+
+        for(uint64 partIdx = 0; partIdx < mesh.NumMeshParts(); ++partIdx)
+            dstMeshParts[numMeshParts++] = mesh.MeshParts()[partIdx];
+    }
 
-        vtxOffset += meshes[i].NumVertices();
-        idxOffset += meshes[i].NumIndices();
+    std::string strings;
+    Array<MeshDataMaterial> dstMaterials(meshMaterials.Size());
+    for(uint64 i = 0; i < meshMaterials.Size(); ++i)
+    {
+        const MeshMaterial& material = meshMaterials[i];
+        dstMaterials[i].Name = AddMeshDataString(strings, material.Name.c_str(), material.Name.length(), sizeof(char));
+        for(uint64 texType = 0; texType < uint64(MaterialTextures::Count); ++texType)
+        {
+            const std::wstring& textureName = material.TextureNames[texType];
+            dstMaterials[i].TextureNames[texType] = AddMeshDataString(strings, textureName.c_str(), textureName.length(), sizeof(wchar));
+        }
     }
+
+    MeshDataHeader header = { };
+    header.Magic = MeshDataMagic;
+    header.Version = MeshDataVersion;
+    header.SourceHash = sourceHash;
+    header.VertexSize = sizeof(MeshVertex);
+    header.IndexAlignment = uint32(MeshIndexAlignment);
+    header.ForceSRGB = forceSRGB ? 1 : 0;
+    header.NumMeshes = uint32(numMeshes);
+    header.NumMeshParts = uint32(numMeshParts);
+    header.NumMaterials = uint32(meshMaterials.Size());
+    header.NumSpotLights = uint32(spotLights.Size());
+    header.NumPointLights = uint32(pointLights.Size());
+    header.NumMeshlets = uint32(meshlets.Size());
+    header.NumMeshLODs = uint32(meshLODs.Size());
+    header.NumLODMeshParts = uint32(lodMeshParts.Size());
+    header.AABBMin = aabbMin;
+    header.AABBMax = aabbMax;
+
+    const uint8* sectionData[uint64(MeshDataSection::NumSections)] = { };
+    sectionData[uint64(MeshDataSection::Meshes)] = reinterpret_cast<const uint8*>(dstMeshes.Data());
+    sectionData[uint64(MeshDataSection::MeshParts)] = reinterpret_cast<const uint8*>(dstMeshParts.Data());
+    sectionData[uint64(MeshDataSection::Materials)] = reinterpret_cast<const uint8*>(dstMaterials.Data());
+    sectionData[uint64(MeshDataSection::Strings)] = reinterpret_cast<const uint8*>(strings.data());
+    sectionData[uint64(MeshDataSection::SpotLights)] = reinterpret_cast<const uint8*>(spotLights.Data());
+    sectionData[uint64(MeshDataSection::PointLights)] = reinterpret_cast<const uint8*>(pointLights.Data());
+    sectionData[uint64(MeshDataSection::Meshlets)] = reinterpret_cast<const uint8*>(meshlets.Data());
+    sectionData[uint64(MeshDataSection::MeshLODs)] = reinterpret_cast<const uint8*>(meshLODs.Data());
+    sectionData[uint64(MeshDataSection::LODMeshParts)] = reinterpret_cast<const uint8*>(lodMeshParts.Data());
+    sectionData[uint64(MeshDataSection::Vertices)] = reinterpret_cast<const uint8*>(vertexData);
+    sectionData[uint64(MeshDataSection::Indices)] = indexData;
+
+    header.Sections[uint64(MeshDataSection::Meshes)].Size = dstMeshes.MemorySize();
+    header.Sections[uint64(MeshDataSection::MeshParts)].Size = dstMeshParts.MemorySize();
+    header.Sections[uint64(MeshDataSection::Materials)].Size = dstMaterials.MemorySize();
+    header.Sections[uint64(MeshDataSection::Strings)].Size = strings.size();
+    header.Sections[uint64(MeshDataSection::SpotLights)].Size = spotLights.MemorySize();
+    header.Sections[uint64(MeshDataSection::PointLights)].Size = pointLights.MemorySize();
+    header.Sections[uint64(MeshDataSection::Meshlets)].Size = meshlets.MemorySize();
+    header.Sections[uint64(MeshDataSection::MeshLODs)].Size = meshLODs.MemorySize();
+    header.Sections[uint64(MeshDataSection::LODMeshParts)].Size = lodMeshParts.MemorySize();
+    header.Sections[uint64(MeshDataSection::Vertices)].Size = vertexCount * sizeof(MeshVertex);
+    header.Sections[uint64(MeshDataSection::Indices)].Size = indexDataSize;
+
+    uint64 fileSize = sizeof(MeshDataHeader);
+    for(uint64 i = 0; i < uint64(MeshDataSection::NumSections); ++i)
+    {
+        header.Sections[i].Offset = AlignTo(fileSize, MeshDataAlignment);
+        fileSize = header.Sections[i].Offset + header.Sections[i].Size;
+    }
+    header.FileSize = fileSize;
+
+    header.DataHash = MeshDataContentsHash(sectionData, header);
+    header.MetadataHash = MeshDataMetadataHash(sectionData, header);
+
+    // Write to a temporary file first, so that an interrupted write doesn't leave a partial file
+    const std::wstring tempPath = std::wstring(filePath) + L".tmp";
+
+    {
+        File file(tempPath.c_str(), FileOpenMode::Write);
+        file.Write(header);
+
+        uint64 fileOffset = sizeof(MeshDataHeader);
+        for(uint64 i = 0; i < uint64(MeshDataSection::NumSections); ++i)
+            WriteMeshDataSection(file, fileOffset, header.Sections[i], sectionData[i]);
+        Assert_(fileOffset == fileSize);
+    }
+
+    Win32Call(MoveFileEx(tempPath.c_str(), filePath, MOVEFILE_REPLACE_EXISTING));
+
+    return header.MetadataHash;
 }
 
 // == Geometry helpers ============================================================================
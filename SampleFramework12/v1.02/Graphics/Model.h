@@ -15,6 +15,8 @@
 #include "..\\SF12_Math.h"
 #include "..\\Serialization.h"
 #include "..\\Containers.h"
+#include "..\\FileIO.h"
+#include "..\\MurmurHash.h"
 #include "GraphicsTypes.h"
 
 struct aiMesh;
@@ -22,6 +24,8 @@ struct aiMesh;
 namespace SampleFramework12
 {
 
+class Camera;
+
 struct MeshVertex
 {
     Float3 Position;
@@ -64,6 +68,23 @@ struct MeshVertex
     }
 };
 
+// Optional 20-byte layout for the GPU vertex buffer. Positions are 16-bit SNORM within the model's
+// bounds with the bitangent's handedness in w, normals and tangents are octahedral-encoded as 16-bit
+// SNORM, and UVs are half-precision.
+struct CompactMeshVertex
+{
+    int16 Position[4];
+    int16 Normal[2];
+    int16 Tangent[2];
+    uint16 UV[2];
+};
+
+StaticAssert_(sizeof(CompactMeshVertex) == 20);
+
+// Positions are decoded as quantized * positionScale + positionOffset
+CompactMeshVertex EncodeCompactVertex(const MeshVertex& vertex, const Float3& positionScale, const Float3& positionOffset);
+MeshVertex DecodeCompactVertex(const CompactMeshVertex& vertex, const Float3& positionScale, const Float3& positionOffset);
+
 enum class MaterialTextures
 {
     Albedo = 0,
@@ -111,12 +132,46 @@ struct MeshPart
     }
 };
 
+// Simplified version of a mesh. It has one part for each of the mesh's parts, which use the mesh's
+// vertices, but its indices come after the full-detail indices of every mesh in the index buffer.
+struct MeshLOD
+{
+    uint32 FirstPart = 0;       // Index into Model::LODMeshParts()
+    uint32 NumIndices = 0;
+    float Error = 0.0f;         // Furthest that the surface moved from the full-detail mesh, in model units
+};
+
+static const uint32 MaxMeshletVertices = 64;
+static const uint32 MaxMeshletTriangles = 124;
+
+// Cluster of up to MaxMeshletTriangles triangles that use up to MaxMeshletVertices vertices. Its
+// triangles are a contiguous range of the mesh's indices, so it can be drawn on its own.
+struct Meshlet
+{
+    Float3 BoundsCenter;
+    float BoundsRadius = 0.0f;
+
+    // Every triangle faces away from a viewer at P if dot(normalize(ConeApex - P), ConeAxis) >= ConeCutoff.
+    // ConeCutoff is 1 when the normals are too spread out for the test to ever pass.
+    Float3 ConeApex;
+    float ConeCutoff = 1.0f;
+    Float3 ConeAxis;
+
+    uint32 IndexStart = 0;      // Relative to the mesh
+    uint32 IndexCount = 0;
+    uint32 VertexCount = 0;
+    uint32 MeshPartIdx = 0;
+};
+
 enum class IndexType
 {
     Index16Bit = 0,
     Index32Bit = 1
 };
 
+// Each mesh's indices start at a multiple of this many bytes in the model's index buffer
+static const uint64 MeshIndexAlignment = 4;
+
 enum class InputElementType : uint64
 {
     Position = 0,
@@ -131,7 +186,14 @@ enum class InputElementType : uint64
 struct MaterialTexture
 {
     std::wstring Name;
-    Texture Texture;
+    const Texture* Texture = nullptr;       // Shared by every material texture with the same FileKey
+    Hash FileKey;                           // From TextureFileKey()
+    bool32 SRGB = false;
+    bool32 Compressed = false;              // Block-compressed when it's processed for the texture cache
+    bool32 Streamed = false;                // Created by Model::LoadTexture() instead of when the model loads
+    bool32 Resident = false;                // Materials use the placeholder instead until this is set
+    uint32 PlaceholderIdx = uint32(-1);     // Default texture that stands in for a streamed texture
+    DirectX::ScratchImage Image;            // Decoded on a task thread, and waiting for the main thread to create it
 };
 
 struct ModelSpotLight
@@ -173,7 +235,7 @@ public:
                    const Quaternion& orientation, uint32 materialIdx,
                    MeshVertex* dstVertices, uint16* dstIndices);
 
-    void InitCommon(const MeshVertex* vertices, const uint8* indices, uint64 vbAddress, uint64 ibAddress, uint64 vtxOffset, uint64 idxOffset);
+    void InitCommon(const MeshVertex* vertices, const uint8* indices, uint64 vbAddress, uint32 vbStride, uint64 ibAddress, uint64 ibSize);
 
     void Shutdown();
 
@@ -184,7 +246,15 @@ public:
     uint32 NumVertices() const { return numVertices; }
     uint32 NumIndices() const { return numIndices; }
     uint32 VertexOffset() const { return vtxOffset; }
-    uint32 IndexOffset() const { return idxOffset; }
+    uint32 IndexBufferOffset() const { return ibOffset; }      // In bytes, since index sizes vary between meshes
+
+    // Range of the model's meshlets, which are empty unless they were generated when loading
+    uint32 FirstMeshlet() const { return firstMeshlet; }
+    uint32 NumMeshlets() const { return numMeshlets; }
+
+    // Range of the model's LODs, from the most to the least detailed, not counting the mesh itself
+    uint32 FirstLOD() const { return firstLOD; }
+    uint32 NumLODs() const { return numLODs; }
 
     IndexType IndexBufferType() const { return indexType; }
     DXGI_FORMAT IndexBufferFormat() const { return indexType == IndexType::Index32Bit ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT; }
@@ -208,7 +278,7 @@ public:
         SerializeItem(serializer, numVertices);
         SerializeItem(serializer, numIndices);
         SerializeItem(serializer, vtxOffset);
-        SerializeItem(serializer, idxOffset);
+        SerializeItem(serializer, ibOffset);
         uint32 idxType = uint32(indexType);
         SerializeItem(serializer, idxType);
         indexType = IndexType(idxType);
@@ -223,7 +293,11 @@ protected:
     uint32 numVertices = 0;
     uint32 numIndices = 0;
     uint32 vtxOffset = 0;
-    uint32 idxOffset = 0;
+    uint32 ibOffset = 0;
+    uint32 firstMeshlet = 0;
+    uint32 numMeshlets = 0;
+    uint32 firstLOD = 0;
+    uint32 numLODs = 0;
 
     IndexType indexType = IndexType::Index16Bit;
 
@@ -244,6 +318,14 @@ struct ModelLoadSettings
     float SceneScale = 1.0f;
     bool ForceSRGB = false;
     bool MergeMeshes = true;
+    bool CacheMeshData = false;         // Converts the scene to a mesh data file next to it, and loads that when it's up-to-date
+    bool CompactVertices = false;       // Uses CompactMeshVertex for the GPU vertex buffer
+    bool OptimizeVertexOrder = false;   // Reorders triangles and vertices for the vertex cache and fetch locality
+    bool GenerateMeshlets = false;      // Splits meshes into meshlets with culling bounds
+    uint32 NumLODs = 0;                 // Maximum number of simplified LODs to generate for each mesh
+    bool StreamTextures = false;        // Only loads default and opacity textures, and leaves the rest for LoadTexture()
+    bool CompressTextures = false;      // Compresses textures that aren't DDS files to BC7 when they're processed
+    bool DeferResourceCreation = false; // Leaves the GPU buffers and textures for CreateResources(), so loading can run on a task thread
 };
 
 class Model
@@ -258,8 +340,16 @@ public:
     // Loading from file formats
     void CreateWithAssimp(const ModelLoadSettings& settings);
 
+    // Maps a file written by SaveMeshData, and uses its vertex and index data in place
     void CreateFromMeshData(const wchar* filePath);
 
+    void SaveMeshData(const wchar* filePath) const;
+
+    // Creates the GPU buffers and material textures of a model that was loaded with
+    // ModelLoadSettings::DeferResourceCreation, which needs to happen on the main thread
+    void CreateResources();
+    bool ResourcesPending() const { return resourcesPending != 0; }
+
     // Procedural generation
     void GenerateBoxScene(const Float3& dimensions = Float3(1.0f, 1.0f, 1.0f),
                           const Float3& position = Float3(),
@@ -285,25 +375,62 @@ public:
     const Array<MeshMaterial>& Materials() const { return meshMaterials; }
     const GrowableList<MaterialTexture*>& MaterialTextures() const { return materialTextures; }
 
+    // Streaming for the textures that ModelLoadSettings::StreamTextures left out. LoadTexture() decodes
+    // a texture that isn't resident and can be called from any thread, while FinishTextureLoad() creates
+    // it and the rest need the main thread. Materials only switch over to (or away from) a texture once
+    // UpdateMaterialTextures() is called, so a texture shouldn't be unloaded until the GPU is done with
+    // the frames that used it.
+    void LoadTexture(uint64 textureIdx);
+    void FinishTextureLoad(uint64 textureIdx);
+    void UnloadTexture(uint64 textureIdx);
+    void SetTextureResident(uint64 textureIdx, bool resident);
+    void UpdateMaterialTextures();
+
+    // Size of the vertex and index buffers
+    uint64 GeometryMemorySize() const;
+
     const Array<ModelSpotLight>& SpotLights() const { return spotLights; }
     const Array<PointLight>& PointLights() const { return pointLights; }
 
+    const Array<Meshlet>& Meshlets() const { return meshlets; }
+
+    const Array<MeshLOD>& MeshLODs() const { return meshLODs; }
+    const Array<MeshPart>& LODMeshParts() const { return lodMeshParts; }
+
+    // Returns the parts to draw for an LOD level of a mesh, where level 0 is the mesh itself and
+    // level N is MeshLODs()[mesh.FirstLOD() + N - 1]
+    const MeshPart* LODParts(const Mesh& mesh, uint64 lodLevel) const;
+    uint32 LODNumIndices(const Mesh& mesh, uint64 lodLevel) const;
+
+    // Picks the least detailed LOD level of a mesh whose error covers no more than maxPixelError
+    // pixels of a viewport with the given height
+    uint64 SelectLOD(const Mesh& mesh, const Camera& camera, float viewportHeight, float maxPixelError = 1.0f) const;
+
+    // Meshes have their own index size, so the index buffer is raw and needs to be used through the
+    // views and offsets of the meshes
     const StructuredBuffer& VertexBuffer() const { return vertexBuffer; }
-    const FormattedBuffer& IndexBuffer() const { return indexBuffer; }
+    const RawBuffer& IndexBuffer() const { return indexBuffer; }
 
-    const MeshVertex* Vertices() const { return vertices.Data(); }
-    const uint16* Indices() const { Assert_(indexType == IndexType::Index16Bit); return (const uint16*)indices.Data(); }
-    const uint32* Indices32() const { Assert_(indexType == IndexType::Index32Bit); return (const uint32*)indices.Data(); }
+    const MeshVertex* Vertices() const { return vertexData; }
 
     const std::wstring& FileDirectory() const { return fileDirectory; }
 
+    // Metadata hash of the mesh data file that the model was loaded from or written to, which covers
+    // the header's hash of the vertex and index data along with the mesh layout. It's 0 for models
+    // that don't have a mesh data file.
+    const Hash& MeshDataHash() const { return meshDataHash; }
+
+    // The CPU-side vertices are always MeshVertex, only the GPU vertex buffer uses CompactMeshVertex
+    bool CompactVertices() const { return compactVertices != 0; }
+    const Float3& PositionScale() const { return positionScale; }
+    const Float3& PositionOffset() const { return positionOffset; }
+
     static const D3D12_INPUT_ELEMENT_DESC* InputElements();
     static const InputElementType* InputElementTypes();
     static uint64 NumInputElements();
 
-    IndexType IndexBufferType() const { return indexType; }
-    DXGI_FORMAT IndexBufferFormat() const { return indexType == IndexType::Index32Bit ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT; }
-    uint32 IndexSize() const { return indexType == IndexType::Index32Bit ? 4 : 2; }
+    static const D3D12_INPUT_ELEMENT_DESC* CompactInputElements();
+    static uint64 NumCompactInputElements();
 
     // Serialization
     template<typename TSerializer>
@@ -318,29 +445,49 @@ public:
         SerializeItem(serializer, aabbMax);
         BulkSerializeItem(serializer, vertices);
         BulkSerializeItem(serializer, indices);
-        uint32 idxType = uint32(indexType);
-        SerializeItem(serializer, idxType);
-        indexType = IndexType(idxType);
     }
 
 protected:
 
         void CreateBuffers();
+    void OptimizeVertexOrder();
+    void GenerateMeshlets();
+    void GenerateLODs(uint64 maxLODs);
+
+    bool LoadMeshData(const wchar* filePath, const std::wstring& textureDir, const Hash* sourceHash);
+    Hash WriteMeshData(const wchar* filePath, Hash sourceHash) const;
 
     Array<Mesh> meshes;
     Array<MeshMaterial> meshMaterials;
     Array<ModelSpotLight> spotLights;
     Array<PointLight> pointLights;
+    Array<Meshlet> meshlets;
+    Array<MeshLOD> meshLODs;
+    Array<MeshPart> lodMeshParts;
     std::wstring fileDirectory;
+    Hash meshDataHash;
     bool32 forceSRGB = false;
+    bool32 streamTextures = false;
+    bool32 compressTextures = false;
+    bool32 resourcesPending = false;
     Float3 aabbMin;
     Float3 aabbMax;
 
     StructuredBuffer vertexBuffer;
-    FormattedBuffer indexBuffer;
+    RawBuffer indexBuffer;
     Array<MeshVertex> vertices;
     Array<uint8> indices;
-    IndexType indexType = IndexType::Index16Bit;
+
+    bool32 compactVertices = false;
+    Float3 positionScale = Float3(1.0f, 1.0f, 1.0f);
+    Float3 positionOffset;
+
+    // Points at either the arrays above, or the vertex and index data in a mapped mesh data file
+    MemoryMappedFile meshDataFile;
+    const MeshVertex* vertexData = nullptr;
+    uint64 vertexCount = 0;
+    const uint8* indexData = nullptr;
+    uint64 indexDataSize = 0;
 
     GrowableList<MaterialTexture*> materialTextures;
 };
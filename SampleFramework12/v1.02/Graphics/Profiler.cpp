@@ -36,6 +36,7 @@ struct ProfileData
     bool CPUProfile = false;
     int64 StartTime = 0;
     int64 EndTime = 0;
+    int64 AccumulatedTime = 0;
 
     static const uint64 FilterSize = 64;
     double TimeSamples[FilterSize] = { };
@@ -59,6 +60,7 @@ void Profiler::Initialize()
 
     profiles.Init(MaxProfiles);
     cpuProfiles.Init(MaxProfiles);
+    counters.Init(MaxProfiles);
 }
 
 void Profiler::Shutdown()
@@ -67,7 +69,10 @@ void Profiler::Shutdown()
     readbackBuffer.Shutdown();
     profiles.Shutdown();
     cpuProfiles.Shutdown();
+    counters.Shutdown();
     numProfiles = 0;
+    numCPUProfiles = 0;
+    numCounters = 0;
 }
 
 uint64 Profiler::StartProfile(ID3D12GraphicsCommandList* cmdList, const char* name)
@@ -153,9 +158,11 @@ uint64 Profiler::StartCPUProfile(const char* name)
         cpuProfiles[profileIdx].Name = name;
     }
 
+    // CPU profiles can run more than once per frame, in which case the times are summed
     ProfileData& profileData = cpuProfiles[profileIdx];
     Assert_(profileData.QueryStarted == false);
-    Assert_(profileData.QueryFinished == false);
+    if(profileData.QueryFinished == false)
+        profileData.AccumulatedTime = 0;
     profileData.CPUProfile = true;
     profileData.Active = true;
 
@@ -173,10 +180,10 @@ void Profiler::EndCPUProfile(uint64 idx)
 
     ProfileData& profileData = cpuProfiles[idx];
     Assert_(profileData.QueryStarted == true);
-    Assert_(profileData.QueryFinished == false);
 
     timer.Update();
     profileData.EndTime = timer.ElapsedMicroseconds();
+    profileData.AccumulatedTime += profileData.EndTime - profileData.StartTime;
 
     profileData.QueryStarted = false;
     profileData.QueryFinished = true;
@@ -189,7 +196,7 @@ static void UpdateProfile(ProfileData& profile, uint64 profileIdx, bool drawText
     double time = 0.0f;
     if(profile.CPUProfile)
     {
-        time = double(profile.EndTime - profile.StartTime) / 1000.0;
+        time = double(profile.AccumulatedTime) / 1000.0;
     }
     else if(frameQueryData)
     {
@@ -291,6 +298,16 @@ void Profiler::EndFrame(uint32 displayWidth, uint32 displayHeight)
     for(uint64 profileIdx = 0; profileIdx < numCPUProfiles; ++profileIdx)
         UpdateProfile(cpuProfiles[profileIdx], profileIdx, drawText, gpuFrequency, frameQueryData);
 
+    if(drawText && numCounters > 0)
+    {
+        ImGui::Text(" ");
+        ImGui::Text("Counters");
+        ImGui::Separator();
+
+        for(uint64 counterIdx = 0; counterIdx < numCounters; ++counterIdx)
+            ImGui::Text("%s: %llu", counters[counterIdx].Name, counters[counterIdx].Value);
+    }
+
     if(showUI)
     {
         if(logToClipboard)
@@ -310,6 +327,30 @@ void Profiler::EndFrame(uint32 displayWidth, uint32 displayHeight)
     enableGPUProfiling = showUI;
 }
 
+void Profiler::SetCounter(const char* name, uint64 value)
+{
+    Assert_(name != nullptr);
+
+    uint64 counterIdx = uint64(-1);
+    for(uint64 i = 0; i < numCounters; ++i)
+    {
+        if(counters[i].Name == name)
+        {
+            counterIdx = i;
+            break;
+        }
+    }
+
+    if(counterIdx == uint64(-1))
+    {
+        Assert_(numCounters < MaxProfiles);
+        counterIdx = numCounters++;
+        counters[counterIdx].Name = name;
+    }
+
+    counters[counterIdx].Value = value;
+}
+
 double Profiler::GPUProfileTiming(const char* name) const
 {
     uint64 profileIdx = uint64(-1);
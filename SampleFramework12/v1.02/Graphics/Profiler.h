@@ -36,16 +36,27 @@ public:
     uint64 StartCPUProfile(const char* name);
     void EndCPUProfile(uint64 idx);
 
+    // Counters show up under the timings, and keep the last value that was set
+    void SetCounter(const char* name, uint64 value);
+
     void EndFrame(uint32 displayWidth, uint32 displayHeight);
 
     double GPUProfileTiming(const char* name) const;
 
 protected:
 
+    struct Counter
+    {
+        const char* Name = nullptr;
+        uint64 Value = 0;
+    };
+
     Array<ProfileData> profiles;
     Array<ProfileData> cpuProfiles;
     uint64 numProfiles = 0;
     uint64 numCPUProfiles = 0;
+    Array<Counter> counters;
+    uint64 numCounters = 0;
     Timer timer;
     ID3D12QueryHeap* queryHeap = nullptr;
     ReadbackBuffer readbackBuffer;
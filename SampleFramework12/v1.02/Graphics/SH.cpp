@@ -8,8 +8,12 @@
 //=================================================================================================
 
 #include "PCH.h"
+
+#include <immintrin.h>
+
 #include "SH.h"
 #include "..\\Utility.h"
+#include "..\\Tasks.h"
 #include "ShaderCompilation.h"
 #include "Textures.h"
 
@@ -114,45 +118,306 @@ H4 ConvertToH4(const SH9& sh)
     return hBasis;
 }
 
-SH9Color ProjectCubemapToSH(const Texture& texture)
+// Scale factors for the SH basis functions, in the same order as ProjectOntoSH9()
+static const float SHBasisScales[MaxSHOrder * MaxSHOrder] =
 {
-    Assert_(texture.Cubemap);
+    0.282095f,
+    0.488603f, 0.488603f, 0.488603f,
+    1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f,
+    0.590044f, 2.890611f, 0.457046f, 0.373176f, 0.457046f, 1.445306f, 0.590044f,
+};
 
-    TextureData<Float4> textureData;
-    GetTextureData(texture, textureData);
-    Assert_(textureData.NumSlices == 6);
-    const uint32 width = textureData.Width;
-    const uint32 height = textureData.Height;
+static void EvalSHBasis(float x, float y, float z, uint32 numCoefficients, float* basis)
+{
+    basis[0] = SHBasisScales[0];
 
-    SH9Color result;
-    float weightSum = 0.0f;
-    for(uint32 face = 0; face < 6; ++face)
+    if(numCoefficients > 1)
+    {
+        basis[1] = SHBasisScales[1] * y;
+        basis[2] = SHBasisScales[2] * z;
+        basis[3] = SHBasisScales[3] * x;
+    }
+
+    if(numCoefficients > 4)
+    {
+        basis[4] = SHBasisScales[4] * x * y;
+        basis[5] = SHBasisScales[5] * y * z;
+        basis[6] = SHBasisScales[6] * (3.0f * z * z - 1.0f);
+        basis[7] = SHBasisScales[7] * x * z;
+        basis[8] = SHBasisScales[8] * (x * x - y * y);
+    }
+
+    if(numCoefficients > 9)
+    {
+        basis[9] = SHBasisScales[9] * y * (3.0f * x * x - y * y);
+        basis[10] = SHBasisScales[10] * x * y * z;
+        basis[11] = SHBasisScales[11] * y * (5.0f * z * z - 1.0f);
+        basis[12] = SHBasisScales[12] * z * (5.0f * z * z - 3.0f);
+        basis[13] = SHBasisScales[13] * x * (5.0f * z * z - 1.0f);
+        basis[14] = SHBasisScales[14] * z * (x * x - y * y);
+        basis[15] = SHBasisScales[15] * x * (x * x - 3.0f * y * y);
+    }
+}
+
+// Same as EvalSHBasis(), for 8 directions at once
+static void EvalSHBasis8(__m256 x, __m256 y, __m256 z, uint32 numCoefficients, __m256* basis)
+{
+    basis[0] = _mm256_set1_ps(SHBasisScales[0]);
+
+    if(numCoefficients > 1)
+    {
+        basis[1] = _mm256_mul_ps(_mm256_set1_ps(SHBasisScales[1]), y);
+        basis[2] = _mm256_mul_ps(_mm256_set1_ps(SHBasisScales[2]), z);
+        basis[3] = _mm256_mul_ps(_mm256_set1_ps(SHBasisScales[3]), x);
+    }
+
+    if(numCoefficients > 4)
     {
-        for(uint32 y = 0; y < height; ++y)
+        const __m256 xx = _mm256_mul_ps(x, x);
+        const __m256 yy = _mm256_mul_ps(y, y);
+        const __m256 zz = _mm256_mul_ps(z, z);
+        basis[4] = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(SHBasisScales[4]), x), y);
+        basis[5] = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(SHBasisScales[5]), y), z);
+        basis[6] = _mm256_mul_ps(_mm256_set1_ps(SHBasisScales[6]), _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(3.0f), zz), _mm256_set1_ps(1.0f)));
+        basis[7] = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(SHBasisScales[7]), x), z);
+        basis[8] = _mm256_mul_ps(_mm256_set1_ps(SHBasisScales[8]), _mm256_sub_ps(xx, yy));
+
+        if(numCoefficients > 9)
         {
-            for(uint32 x = 0; x < width; ++x)
-            {
-                const uint32 idx = face * (width * height) + y * (width) + x;
-                Float3 sample = textureData.Texels[idx].To3D();
+            const __m256 fiveZZ = _mm256_mul_ps(_mm256_set1_ps(5.0f), zz);
+            const __m256 fiveZZMinusOne = _mm256_sub_ps(fiveZZ, _mm256_set1_ps(1.0f));
+            basis[9] = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(SHBasisScales[9]), y), _mm256_sub_ps(_mm256_mul_ps(_mm256_set1_ps(3.0f), xx), yy));
+            basis[10] = _mm256_mul_ps(_mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(SHBasisScales[10]), x), y), z);
+            basis[11] = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(SHBasisScales[11]), y), fiveZZMinusOne);
+            basis[12] = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(SHBasisScales[12]), z), _mm256_sub_ps(fiveZZ, _mm256_set1_ps(3.0f)));
+            basis[13] = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(SHBasisScales[13]), x), fiveZZMinusOne);
+            basis[14] = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(SHBasisScales[14]), z), _mm256_sub_ps(xx, yy));
+            basis[15] = _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(SHBasisScales[15]), x), _mm256_sub_ps(xx, _mm256_mul_ps(_mm256_set1_ps(3.0f), yy)));
+        }
+    }
+}
+
+// Loads 8 consecutive texels and transposes their RGB values into one register per channel
+static void LoadTexels8(const Float4* texels, __m256& r, __m256& g, __m256& b)
+{
+    const float* data = reinterpret_cast<const float*>(texels);
+    const __m256 t01 = _mm256_loadu_ps(data + 0);
+    const __m256 t23 = _mm256_loadu_ps(data + 8);
+    const __m256 t45 = _mm256_loadu_ps(data + 16);
+    const __m256 t67 = _mm256_loadu_ps(data + 24);
 
-                float u = (x + 0.5f) / width;
-                float v = (y + 0.5f) / height;
+    // Unpacking and shuffling within 128-bit lanes leaves the texels in 0, 2, 4, 6, 1, 3, 5, 7 order
+    const __m256 rg0246 = _mm256_unpacklo_ps(t01, t23);
+    const __m256 ba0246 = _mm256_unpackhi_ps(t01, t23);
+    const __m256 rg4567 = _mm256_unpacklo_ps(t45, t67);
+    const __m256 ba4567 = _mm256_unpackhi_ps(t45, t67);
 
-                // Account for cubemap texel distribution
-                u = u * 2.0f - 1.0f;
-                v = v * 2.0f - 1.0f;
-                const float temp = 1.0f + u * u + v * v;
-                const float weight = 4.0f / (sqrt(temp) * temp);
+    const __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    r = _mm256_permutevar8x32_ps(_mm256_shuffle_ps(rg0246, rg4567, _MM_SHUFFLE(1, 0, 1, 0)), order);
+    g = _mm256_permutevar8x32_ps(_mm256_shuffle_ps(rg0246, rg4567, _MM_SHUFFLE(3, 2, 3, 2)), order);
+    b = _mm256_permutevar8x32_ps(_mm256_shuffle_ps(ba0246, ba4567, _MM_SHUFFLE(1, 0, 1, 0)), order);
+}
+
+static float HorizontalSum8(__m256 values)
+{
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(values), _mm256_extractf128_ps(values, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+// The direction of a texel is Normalize(U * u + V * v + Normal), matching MapXYSToDirection()
+struct CubeFaceAxes
+{
+    Float3 U;
+    Float3 V;
+    Float3 Normal;
+};
+
+static const CubeFaceAxes FaceAxes[6] =
+{
+    { Float3(0.0f, 0.0f, -1.0f), Float3(0.0f, 1.0f, 0.0f), Float3(1.0f, 0.0f, 0.0f) },
+    { Float3(0.0f, 0.0f, 1.0f), Float3(0.0f, 1.0f, 0.0f), Float3(-1.0f, 0.0f, 0.0f) },
+    { Float3(1.0f, 0.0f, 0.0f), Float3(0.0f, 0.0f, -1.0f), Float3(0.0f, 1.0f, 0.0f) },
+    { Float3(1.0f, 0.0f, 0.0f), Float3(0.0f, 0.0f, 1.0f), Float3(0.0f, -1.0f, 0.0f) },
+    { Float3(1.0f, 0.0f, 0.0f), Float3(0.0f, 1.0f, 0.0f), Float3(0.0f, 0.0f, 1.0f) },
+    { Float3(-1.0f, 0.0f, 0.0f), Float3(0.0f, 1.0f, 0.0f), Float3(0.0f, 0.0f, -1.0f) },
+};
+
+// Per-texel values that are the same for all 6 faces
+struct CubeMapTexelTables
+{
+    uint32 Width = 0;
+    Array<float> Us;
+    Array<float> Vs;
+    Array<float> InvLengths;
+    Array<float> Weights;
+};
+
+// Adds the weighted SH projection of one row of a face to "sums", which has a value for each color
+// channel of each coefficient
+static void ProjectRowToSH(const Float4* rowTexels, uint32 face, uint32 y, const CubeMapTexelTables& tables,
+                           uint32 numCoefficients, bool useAVX2, float* sums)
+{
+    const CubeFaceAxes& axes = FaceAxes[face];
+    const Float3 rowBase = axes.V * tables.Vs[y] + axes.Normal;
+    const float* invLengths = &tables.InvLengths[uint64(y) * tables.Width];
+    const float* weights = &tables.Weights[uint64(y) * tables.Width];
+
+    uint32 x = 0;
+    if(useAVX2)
+    {
+        __m256 accumulators[MaxSHOrder * MaxSHOrder * 3];
+        for(uint32 i = 0; i < numCoefficients * 3; ++i)
+            accumulators[i] = _mm256_setzero_ps();
+
+        const __m256 uAxisX = _mm256_set1_ps(axes.U.x);
+        const __m256 uAxisY = _mm256_set1_ps(axes.U.y);
+        const __m256 uAxisZ = _mm256_set1_ps(axes.U.z);
+        const __m256 baseX = _mm256_set1_ps(rowBase.x);
+        const __m256 baseY = _mm256_set1_ps(rowBase.y);
+        const __m256 baseZ = _mm256_set1_ps(rowBase.z);
+
+        for(; x + 8 <= tables.Width; x += 8)
+        {
+            const __m256 u = _mm256_loadu_ps(&tables.Us[x]);
+            const __m256 invLength = _mm256_loadu_ps(invLengths + x);
+            const __m256 weight = _mm256_loadu_ps(weights + x);
+            const __m256 dirX = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(uAxisX, u), baseX), invLength);
+            const __m256 dirY = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(uAxisY, u), baseY), invLength);
+            const __m256 dirZ = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(uAxisZ, u), baseZ), invLength);
 
-                Float3 dir = MapXYSToDirection(x, y, face, width, height);
-                result += ProjectOntoSH9Color(dir, sample) * weight;
-                weightSum += weight;
+            __m256 r, g, b;
+            LoadTexels8(rowTexels + x, r, g, b);
+            r = _mm256_mul_ps(r, weight);
+            g = _mm256_mul_ps(g, weight);
+            b = _mm256_mul_ps(b, weight);
+
+            __m256 basis[MaxSHOrder * MaxSHOrder];
+            EvalSHBasis8(dirX, dirY, dirZ, numCoefficients, basis);
+            for(uint32 i = 0; i < numCoefficients; ++i)
+            {
+                accumulators[i * 3 + 0] = _mm256_add_ps(accumulators[i * 3 + 0], _mm256_mul_ps(basis[i], r));
+                accumulators[i * 3 + 1] = _mm256_add_ps(accumulators[i * 3 + 1], _mm256_mul_ps(basis[i], g));
+                accumulators[i * 3 + 2] = _mm256_add_ps(accumulators[i * 3 + 2], _mm256_mul_ps(basis[i], b));
             }
         }
+
+        for(uint32 i = 0; i < numCoefficients * 3; ++i)
+            sums[i] += HorizontalSum8(accumulators[i]);
+    }
+
+    for(; x < tables.Width; ++x)
+    {
+        const Float3 dir = (axes.U * tables.Us[x] + rowBase) * invLengths[x];
+        const Float3 color = rowTexels[x].To3D() * weights[x];
+
+        float basis[MaxSHOrder * MaxSHOrder];
+        EvalSHBasis(dir.x, dir.y, dir.z, numCoefficients, basis);
+        for(uint32 i = 0; i < numCoefficients; ++i)
+        {
+            sums[i * 3 + 0] += basis[i] * color.x;
+            sums[i * 3 + 1] += basis[i] * color.y;
+            sums[i * 3 + 2] += basis[i] * color.z;
+        }
+    }
+}
+
+void ProjectCubemapToSH(const TextureData<Float4>& cubeMap, uint32 order, Float3* coefficients)
+{
+    Assert_(cubeMap.NumSlices == 6);
+    Assert_(order >= 2 && order <= MaxSHOrder);
+    const uint32 width = cubeMap.Width;
+    const uint32 height = cubeMap.Height;
+    const uint32 numCoefficients = order * order;
+    const uint32 numSums = numCoefficients * 3;
+
+    // Pre-compute the texel coordinates, the length of the un-normalized direction through each texel,
+    // and the weights that account for the solid angle of each texel
+    CubeMapTexelTables tables;
+    tables.Width = width;
+    tables.Us.Init(width);
+    tables.Vs.Init(height);
+    tables.InvLengths.Init(uint64(width) * height);
+    tables.Weights.Init(uint64(width) * height);
+    for(uint32 x = 0; x < width; ++x)
+        tables.Us[x] = ((x + 0.5f) / width) * 2.0f - 1.0f;
+    for(uint32 y = 0; y < height; ++y)
+        tables.Vs[y] = -(((y + 0.5f) / height) * 2.0f - 1.0f);
+
+    double weightSum = 0.0;
+    for(uint32 y = 0; y < height; ++y)
+    {
+        for(uint32 x = 0; x < width; ++x)
+        {
+            const float temp = 1.0f + tables.Us[x] * tables.Us[x] + tables.Vs[y] * tables.Vs[y];
+            const uint64 idx = uint64(y) * width + x;
+            tables.InvLengths[idx] = 1.0f / std::sqrt(temp);
+            tables.Weights[idx] = 4.0f / (std::sqrt(temp) * temp);
+            weightSum += tables.Weights[idx] * 6.0;
+        }
+    }
+
+    // Each row is summed in floats, and then added to the thread's sums in doubles
+    const bool useAVX2 = CPUSupportsAVX2();
+    const uint32 numThreads = Tasks::NumThreads();
+    Array<double> threadSums(uint64(numThreads) * numSums, 0.0);
+    Tasks::ParallelFor(6 * height, [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        double* sums = &threadSums[uint64(threadNum) * numSums];
+        for(uint32 rowIdx = range.start; rowIdx < range.end; ++rowIdx)
+        {
+            const uint32 face = rowIdx / height;
+            const uint32 y = rowIdx % height;
+            const Float4* rowTexels = &cubeMap.Texels[uint64(rowIdx) * width];
+
+            float rowSums[MaxSHOrder * MaxSHOrder * 3] = { };
+            ProjectRowToSH(rowTexels, face, y, tables, numCoefficients, useAVX2, rowSums);
+            for(uint32 i = 0; i < numSums; ++i)
+                sums[i] += rowSums[i];
+        }
+    });
+
+    const double scale = (4.0 * Pi) / weightSum;
+    for(uint32 i = 0; i < numCoefficients; ++i)
+    {
+        double sum[3] = { };
+        for(uint32 threadIdx = 0; threadIdx < numThreads; ++threadIdx)
+            for(uint32 channel = 0; channel < 3; ++channel)
+                sum[channel] += threadSums[uint64(threadIdx) * numSums + i * 3 + channel];
+
+        coefficients[i] = Float3(float(sum[0] * scale), float(sum[1] * scale), float(sum[2] * scale));
     }
+}
+
+SH4Color ProjectCubemapToSH4(const TextureData<Float4>& cubeMap)
+{
+    SH4Color result;
+    ProjectCubemapToSH(cubeMap, 2, result.Coefficients);
+    return result;
+}
 
-    result *= (4.0f * 3.14159f) / weightSum;
+SH9Color ProjectCubemapToSH9(const TextureData<Float4>& cubeMap)
+{
+    SH9Color result;
+    ProjectCubemapToSH(cubeMap, 3, result.Coefficients);
     return result;
 }
 
+SH16Color ProjectCubemapToSH16(const TextureData<Float4>& cubeMap)
+{
+    SH16Color result;
+    ProjectCubemapToSH(cubeMap, 4, result.Coefficients);
+    return result;
+}
+
+SH9Color ProjectCubemapToSH(const Texture& texture)
+{
+    Assert_(texture.Cubemap);
+
+    TextureData<Float4> textureData;
+    GetTextureData(texture, textureData);
+    return ProjectCubemapToSH9(textureData);
+}
+
 }
\ No newline at end of file
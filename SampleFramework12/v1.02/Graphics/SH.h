@@ -16,11 +16,16 @@ namespace SampleFramework12
 {
 
 struct Texture;
+template<typename T> struct TextureData;
 
 // Constants
 static const float CosineA0 = 1.0f * Pi;
 static const float CosineA1 = (2.0f  * Pi) / 3.0f;
 static const float CosineA2 = (0.25f * Pi);
+static const float CosineA3 = 0.0f;
+
+// Highest number of bands supported by ProjectCubemapToSH()
+static const uint32 MaxSHOrder = 4;
 
 template<typename T, uint64 N> class SH
 {
@@ -159,6 +164,8 @@ public:
                 Coefficients[i] *= CosineA1;
             else if(i < 9)
                 Coefficients[i] *= CosineA2;
+            else if(i < 16)
+                Coefficients[i] *= CosineA3;
     }
 
     template<typename TSerializer>
@@ -173,6 +180,8 @@ typedef SH<float, 4> SH4;
 typedef SH<Float3, 4> SH4Color;
 typedef SH<float, 9> SH9;
 typedef SH<Float3, 9> SH9Color;
+typedef SH<float, 16> SH16;
+typedef SH<Float3, 16> SH16Color;
 
 // H-basis
 class H4 : public SH<float, 4>
@@ -228,6 +237,14 @@ H4 ConvertToH4(const SH9& sh);
 // Lighting environment generation functions
 SH9Color ProjectCubemapToSH(const Texture& texture);
 
+// Projects the 6 faces of a cube map onto the first "order" bands of SH (2, 3, or 4 bands, which is
+// 4, 9, or 16 coefficients). The rows of texels are split up across the task threads, and processed
+// 8 texels at a time when the CPU supports AVX2.
+void ProjectCubemapToSH(const TextureData<Float4>& cubeMap, uint32 order, Float3* coefficients);
+SH4Color ProjectCubemapToSH4(const TextureData<Float4>& cubeMap);
+SH9Color ProjectCubemapToSH9(const TextureData<Float4>& cubeMap);
+SH16Color ProjectCubemapToSH16(const TextureData<Float4>& cubeMap);
+
 // Constants
 static const H4 H4Identity = H4(std::sqrt(2.0f * 3.14159f), 0.0f, 0.0f, 0.0f);
 
@@ -8,7 +8,11 @@
 //=================================================================================================
 
 #include "PCH.h"
+
+#include <immintrin.h>
+
 #include "Sampling.h"
+#include "..\\Utility.h"
 
 namespace SampleFramework12
 {
@@ -30,6 +34,16 @@ namespace SampleFramework12
 
 static const float OneMinusEpsilon = 0.9999999403953552f;
 
+// The bases used by RadicalInverseFast(), for the batched version that can't switch on a constant
+static const uint32 RadicalInversePrimes[] =
+{
+    2, 3, 5, 7, 11, 13, 17, 19, 23, 29, 31, 37, 41, 43, 47, 53,
+    59, 61, 67, 71, 73, 79, 83, 89, 97, 101, 103, 107, 109, 113, 127, 131,
+    137, 139, 149, 151, 157, 163, 167, 173, 179, 181, 191, 193, 197, 199, 211, 223,
+    227, 229, 233, 239, 241, 251, 257, 263, 269, 271, 277, 281, 283, 293, 307, 311,
+};
+StaticAssert_(ArraySize_(RadicalInversePrimes) == 64);
+
 float RadicalInverseFast(uint64 baseIdx, uint64 sampleIdx)
 {
     Assert_(baseIdx < 64);
@@ -228,6 +242,33 @@ Float3 SampleDirectionGGX(const Float3& v, const Float3& n, float roughness, con
     return Float3::Normalize(sampleDir);
 }
 
+// Samples the distribution of visible GGX normals for a tangent-space view direction,
+// matching SampleGGXVisibleNormal() in Sampling.hlsl. See "Sampling the GGX Distribution
+// of Visible Normals" [Heitz 2018]
+Float3 SampleGGXVisibleNormal(const Float3& wo, float ax, float ay, float u1, float u2)
+{
+    // Stretch the view vector so we are sampling as though roughness==1
+    Float3 v = Float3::Normalize(Float3(wo.x * ax, wo.y * ay, wo.z));
+
+    // Build an orthonormal basis with v, t1, and t2
+    Float3 t1 = (v.z < 0.999f) ? Float3::Normalize(Float3::Cross(v, Float3(0.0f, 0.0f, 1.0f))) : Float3(1.0f, 0.0f, 0.0f);
+    Float3 t2 = Float3::Cross(t1, v);
+
+    // Choose a point on a disk with each half of the disk weighted
+    // proportionally to its projection onto direction v
+    float a = 1.0f / (1.0f + v.z);
+    float r = std::sqrt(u1);
+    float phi = (u2 < a) ? (u2 / a) * Pi : Pi + (u2 - a) / (1.0f - a) * Pi;
+    float p1 = r * std::cos(phi);
+    float p2 = r * std::sin(phi) * ((u2 < a) ? 1.0f : v.z);
+
+    // Calculate the normal in this stretched tangent space
+    Float3 n = p1 * t1 + p2 * t2 + std::sqrt(std::max(0.0f, 1.0f - p1 * p1 - p2 * p2)) * v;
+
+    // Unstretch and normalize the normal
+    return Float3::Normalize(Float3(ax * n.x, ay * n.y, std::max(0.0f, n.z)));
+}
+
 // Returns a point inside of a unit sphere
 Float3 SampleSphere(float x1, float x2, float x3, float u1)
 {
@@ -363,15 +404,21 @@ float SampleDirectionRectangularLight_PDF(const Float2& lightSize, const Float3&
     return (distanceToLight * distanceToLight) / (areaNDotL * lightSize.x * lightSize.y);
 }
 
-// Computes a radical inverse with base 2 using crazy bit-twiddling from "Hacker's Delight"
-float RadicalInverseBase2(uint32 bits)
+// Reverses the bits of an integer using crazy bit-twiddling from "Hacker's Delight"
+static uint32 ReverseBits(uint32 bits)
 {
     bits = (bits << 16u) | (bits >> 16u);
     bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
     bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
     bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
     bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
-    return float(bits) * 2.3283064365386963e-10f; // / 0x100000000
+    return bits;
+}
+
+// Computes a radical inverse with base 2
+float RadicalInverseBase2(uint32 bits)
+{
+    return float(ReverseBits(bits)) * 2.3283064365386963e-10f; // / 0x100000000
 }
 
 // Returns a single 2D point in a Hammersley sequence of length "numSamples", using base 1 and base 2
@@ -431,6 +478,365 @@ Float2 SampleCMJ2D(uint32 sampleIdx, uint32 numSamplesX, uint32 numSamplesY, uin
     return Float2((sx + (sy + jx) / numSamplesY) / numSamplesX, (sampleIdx + jy) / N);
 }
 
+// Integer hash with good avalanche behavior ("lowbias32" by Chris Wellons)
+static uint32 SobolHash(uint32 x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352du;
+    x ^= x >> 15;
+    x *= 0x846ca68bu;
+    x ^= x >> 16;
+    return x;
+}
+
+static uint32 SobolHashCombine(uint32 seed, uint32 value)
+{
+    return seed ^ (SobolHash(value) + 0x9e3779b9u + (seed << 6) + (seed >> 2));
+}
+
+// Permutes the bits of x such that each bit only depends on itself and the bits below it [Laine and
+// Karras 2011], using the constants from [Burley 2020]
+static uint32 LaineKarrasPermutation(uint32 x, uint32 seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+// Hash-based approximation of a base-2 Owen scramble, which randomly permutes the elementary intervals
+// of the sequence without breaking up its stratification [Burley 2020]. The Sobol values below are
+// scrambled by calling LaineKarrasPermutation() on their bit-reversed form, which saves two reversals.
+static uint32 NestedUniformScramble(uint32 x, uint32 seed)
+{
+    return ReverseBits(LaineKarrasPermutation(ReverseBits(x), seed));
+}
+
+// The second dimension of the Sobol sequence in bit-reversed form. Its generator matrix is Pascal's
+// triangle mod 2, so each bit is the XOR of the index bits that are a superset of its position, which
+// takes one step per bit of the position. The first dimension is the van der Corput sequence, whose
+// bit-reversed form is just the index.
+static uint32 SobolDimension1Reversed(uint32 index)
+{
+    index ^= (index >> 1) & 0x55555555u;
+    index ^= (index >> 2) & 0x33333333u;
+    index ^= (index >> 4) & 0x0F0F0F0Fu;
+    index ^= (index >> 8) & 0x00FF00FFu;
+    index ^= (index >> 16) & 0x0000FFFFu;
+    return index;
+}
+
+// Only the top 24 bits make it into the float, and truncating them means that 1.0 is never returned
+static float SobolToFloat(uint32 x)
+{
+    return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+static uint32 SobolDimensionSeed(uint32 dimIdx, uint32 seed)
+{
+    return SobolHashCombine(SobolHash(seed), SobolHash(dimIdx));
+}
+
+// Same as SampleSobol2D() with the scrambling seed for the pair of dimensions already computed, which
+// lets callers pick their own seeds
+Float2 SampleSobol2DFromSeed(uint32 sampleIdx, uint32 dimSeed)
+{
+    // Shuffling the index with a different seed for each pair of dimensions decorrelates them from each
+    // other, which lets the same 2D sequence be padded out to any number of dimensions
+    const uint32 shuffledIdx = NestedUniformScramble(sampleIdx, dimSeed);
+    const uint32 x = ReverseBits(LaineKarrasPermutation(shuffledIdx, SobolHashCombine(dimSeed, 0)));
+    const uint32 y = ReverseBits(LaineKarrasPermutation(SobolDimension1Reversed(shuffledIdx), SobolHashCombine(dimSeed, 1)));
+    return Float2(SobolToFloat(x), SobolToFloat(y));
+}
+
+// Returns a 2D sample from an Owen-scrambled Sobol sequence, where "dimIdx" selects a pair of
+// dimensions and "seed" selects the scrambling (typically per-pixel). Any number of samples can be
+// used, but powers of two are best stratified.
+Float2 SampleSobol2D(uint32 sampleIdx, uint32 dimIdx, uint32 seed)
+{
+    return SampleSobol2DFromSeed(sampleIdx, SobolDimensionSeed(dimIdx, seed));
+}
+
+// The batched sample generation functions below compute 8 samples at a time with AVX2 when the CPU
+// supports it, and produce exactly the same values as their scalar counterparts. Sample indices are
+// divided by converting them to floats, which is only exact for indices below 2^24.
+static const uint64 BatchSize = 8;
+static const uint64 MaxBatchSamples = 1 << 24;
+
+static bool UseBatchKernels(uint64 endIdx)
+{
+    return endIdx >= BatchSize && endIdx <= MaxBatchSamples && CPUSupportsAVX2();
+}
+
+static __m256i BatchIndices(uint64 firstIdx)
+{
+    return _mm256_add_epi32(_mm256_set1_epi32(int32(firstIdx)), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+}
+
+// AVX2 can only convert signed integers, so the upper and lower halves are converted separately.
+// Both halves and the scaling are exact, which leaves the add to do the same rounding as a scalar
+// conversion.
+static __m256 UintToFloat8(__m256i x)
+{
+    const __m256 hi = _mm256_cvtepi32_ps(_mm256_srli_epi32(x, 16));
+    const __m256 lo = _mm256_cvtepi32_ps(_mm256_and_si256(x, _mm256_set1_epi32(0xFFFF)));
+    return _mm256_add_ps(_mm256_mul_ps(hi, _mm256_set1_ps(65536.0f)), lo);
+}
+
+// Divides numerators below 2^24 by a value that's the same for every lane. The float estimate is off
+// by at most one, which gets fixed up by checking the remainder.
+static __m256i DivideUint8(__m256i numerator, uint32 denominator, __m256i& remainder)
+{
+    const __m256i denom = _mm256_set1_epi32(int32(denominator));
+    const __m256 estimate = _mm256_mul_ps(_mm256_cvtepi32_ps(numerator), _mm256_set1_ps(1.0f / float(denominator)));
+    __m256i quotient = _mm256_cvttps_epi32(_mm256_floor_ps(estimate));
+    __m256i rem = _mm256_sub_epi32(numerator, _mm256_mullo_epi32(quotient, denom));
+
+    const __m256i tooLarge = _mm256_cmpgt_epi32(_mm256_setzero_si256(), rem);
+    quotient = _mm256_add_epi32(quotient, tooLarge);
+    rem = _mm256_add_epi32(rem, _mm256_and_si256(tooLarge, denom));
+
+    const __m256i tooSmall = _mm256_cmpgt_epi32(rem, _mm256_sub_epi32(denom, _mm256_set1_epi32(1)));
+    quotient = _mm256_sub_epi32(quotient, tooSmall);
+    rem = _mm256_sub_epi32(rem, _mm256_and_si256(tooSmall, denom));
+
+    remainder = rem;
+    return quotient;
+}
+
+// Same as ReverseBits(), using a table of reversed nibbles for each byte and then swapping the bytes
+static __m256i ReverseBits8(__m256i bits)
+{
+    const __m256i reversedNibbles = _mm256_setr_epi8(0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE, 0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF,
+                                                     0x0, 0x8, 0x4, 0xC, 0x2, 0xA, 0x6, 0xE, 0x1, 0x9, 0x5, 0xD, 0x3, 0xB, 0x7, 0xF);
+    const __m256i swapBytes = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+                                               3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+    const __m256i nibbleMask = _mm256_set1_epi8(0x0F);
+
+    const __m256i lo = _mm256_shuffle_epi8(reversedNibbles, _mm256_and_si256(bits, nibbleMask));
+    const __m256i hi = _mm256_shuffle_epi8(reversedNibbles, _mm256_and_si256(_mm256_srli_epi16(bits, 4), nibbleMask));
+    return _mm256_shuffle_epi8(_mm256_or_si256(_mm256_slli_epi16(lo, 4), hi), swapBytes);
+}
+
+static __m256 RadicalInverseBase2_8(__m256i bits)
+{
+    return _mm256_mul_ps(UintToFloat8(ReverseBits8(bits)), _mm256_set1_ps(2.3283064365386963e-10f));
+}
+
+// Same as RadicalInverseFast() for sample indices below 2^24
+static __m256 RadicalInverse8(uint64 baseIdx, __m256i sampleIdx)
+{
+    const __m256 oneMinusEpsilon = _mm256_set1_ps(OneMinusEpsilon);
+    if(baseIdx == 0)
+        return _mm256_min_ps(RadicalInverseBase2_8(sampleIdx), oneMinusEpsilon);
+
+    const uint32 base = RadicalInversePrimes[baseIdx];
+    const __m256d baseD = _mm256_set1_pd(double(base));
+    const __m256 radical = _mm256_set1_ps(1.0f / float(base));
+
+    // The reversed digits are accumulated in doubles, which keeps them exact for as many digits as the
+    // scalar version's 64-bit integer. Each lane stops once it runs out of digits.
+    __m256d valueLo = _mm256_setzero_pd();
+    __m256d valueHi = _mm256_setzero_pd();
+    __m256 factor = _mm256_set1_ps(1.0f);
+    while(_mm256_testz_si256(sampleIdx, sampleIdx) == 0)
+    {
+        const __m256i active = _mm256_cmpgt_epi32(sampleIdx, _mm256_setzero_si256());
+        __m256i digit;
+        sampleIdx = DivideUint8(sampleIdx, base, digit);
+
+        const __m256d nextLo = _mm256_add_pd(_mm256_mul_pd(valueLo, baseD), _mm256_cvtepi32_pd(_mm256_castsi256_si128(digit)));
+        const __m256d nextHi = _mm256_add_pd(_mm256_mul_pd(valueHi, baseD), _mm256_cvtepi32_pd(_mm256_extracti128_si256(digit, 1)));
+        const __m256 nextFactor = _mm256_mul_ps(factor, radical);
+
+        // The lanes are consecutive indices, so they usually all have the same number of digits
+        if(_mm256_movemask_ps(_mm256_castsi256_ps(active)) == 0xFF)
+        {
+            valueLo = nextLo;
+            valueHi = nextHi;
+            factor = nextFactor;
+        }
+        else
+        {
+            valueLo = _mm256_blendv_pd(valueLo, nextLo, _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_castsi256_si128(active))));
+            valueHi = _mm256_blendv_pd(valueHi, nextHi, _mm256_castsi256_pd(_mm256_cvtepi32_epi64(_mm256_extracti128_si256(active, 1))));
+            factor = _mm256_blendv_ps(factor, nextFactor, _mm256_castsi256_ps(active));
+        }
+    }
+
+    const __m256 value = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(valueLo)), _mm256_cvtpd_ps(valueHi), 1);
+    return _mm256_min_ps(_mm256_mul_ps(value, factor), oneMinusEpsilon);
+}
+
+// Same as CMJPermute(), where each lane keeps re-hashing until it lands inside [0, l)
+static __m256i CMJPermute8(__m256i i, uint32 l, uint32 p)
+{
+    uint32 w = l - 1;
+    w |= w >> 1;
+    w |= w >> 2;
+    w |= w >> 4;
+    w |= w >> 8;
+    w |= w >> 16;
+
+    const __m256i wv = _mm256_set1_epi32(int32(w));
+    const __m256i lv = _mm256_set1_epi32(int32(l));
+    __m256i result = _mm256_setzero_si256();
+    __m256i pending = _mm256_set1_epi32(-1);
+    do
+    {
+        i = _mm256_xor_si256(i, _mm256_set1_epi32(int32(p)));
+        i = _mm256_mullo_epi32(i, _mm256_set1_epi32(int32(0xe170893d)));
+        i = _mm256_xor_si256(i, _mm256_set1_epi32(int32(p >> 16)));
+        i = _mm256_xor_si256(i, _mm256_srli_epi32(_mm256_and_si256(i, wv), 4));
+        i = _mm256_xor_si256(i, _mm256_set1_epi32(int32(p >> 8)));
+        i = _mm256_mullo_epi32(i, _mm256_set1_epi32(int32(0x0929eb3f)));
+        i = _mm256_xor_si256(i, _mm256_set1_epi32(int32(p >> 23)));
+        i = _mm256_xor_si256(i, _mm256_srli_epi32(_mm256_and_si256(i, wv), 1));
+        i = _mm256_mullo_epi32(i, _mm256_set1_epi32(int32(1 | p >> 27)));
+        i = _mm256_mullo_epi32(i, _mm256_set1_epi32(int32(0x6935fa69)));
+        i = _mm256_xor_si256(i, _mm256_srli_epi32(_mm256_and_si256(i, wv), 11));
+        i = _mm256_mullo_epi32(i, _mm256_set1_epi32(int32(0x74dcb303)));
+        i = _mm256_xor_si256(i, _mm256_srli_epi32(_mm256_and_si256(i, wv), 2));
+        i = _mm256_mullo_epi32(i, _mm256_set1_epi32(int32(0x9e501cc3)));
+        i = _mm256_xor_si256(i, _mm256_srli_epi32(_mm256_and_si256(i, wv), 2));
+        i = _mm256_mullo_epi32(i, _mm256_set1_epi32(int32(0xc860a3df)));
+        i = _mm256_and_si256(i, wv);
+        i = _mm256_xor_si256(i, _mm256_srli_epi32(i, 5));
+
+        const __m256i accepted = _mm256_and_si256(pending, _mm256_cmpgt_epi32(lv, i));
+        result = _mm256_blendv_epi8(result, i, accepted);
+        pending = _mm256_andnot_si256(accepted, pending);
+    }
+    while(_mm256_testz_si256(pending, pending) == 0);
+
+    // (i + p) % l, where the addition can wrap around in the scalar version. i and p % l are both less
+    // than l, so a single add or subtract of l brings the sum back into range.
+    const __m256i signBit = _mm256_set1_epi32(int32(0x80000000));
+    const __m256i wraps = _mm256_cmpgt_epi32(_mm256_xor_si256(result, signBit), _mm256_set1_epi32(int32(~p ^ 0x80000000)));
+    result = _mm256_add_epi32(result, _mm256_set1_epi32(int32(p % l)));
+    result = _mm256_sub_epi32(result, _mm256_and_si256(wraps, _mm256_set1_epi32(int32((1ull << 32) % l))));
+    result = _mm256_add_epi32(result, _mm256_and_si256(_mm256_cmpgt_epi32(_mm256_setzero_si256(), result), lv));
+    result = _mm256_sub_epi32(result, _mm256_and_si256(_mm256_cmpgt_epi32(result, _mm256_sub_epi32(lv, _mm256_set1_epi32(1))), lv));
+    return result;
+}
+
+// Same as CMJRandFloat()
+static __m256 CMJRandFloat8(__m256i i, uint32 p)
+{
+    i = _mm256_xor_si256(i, _mm256_set1_epi32(int32(p)));
+    i = _mm256_xor_si256(i, _mm256_srli_epi32(i, 17));
+    i = _mm256_xor_si256(i, _mm256_srli_epi32(i, 10));
+    i = _mm256_mullo_epi32(i, _mm256_set1_epi32(int32(0xb36534e5)));
+    i = _mm256_xor_si256(i, _mm256_srli_epi32(i, 12));
+    i = _mm256_xor_si256(i, _mm256_srli_epi32(i, 21));
+    i = _mm256_mullo_epi32(i, _mm256_set1_epi32(int32(0x93fc4795)));
+    i = _mm256_xor_si256(i, _mm256_set1_epi32(int32(0xdf6e307f)));
+    i = _mm256_xor_si256(i, _mm256_srli_epi32(i, 17));
+    i = _mm256_mullo_epi32(i, _mm256_set1_epi32(int32(1 | p >> 18)));
+    return _mm256_mul_ps(UintToFloat8(i), _mm256_set1_ps(1.0f / 4294967808.0f));
+}
+
+// Same as SampleCMJ2D() for sample counts up to 2^24
+static void SampleCMJ2D8(__m256i sampleIdx, uint32 numSamplesX, uint32 numSamplesY, uint32 pattern, __m256& x, __m256& y)
+{
+    const uint32 N = numSamplesX * numSamplesY;
+    sampleIdx = CMJPermute8(sampleIdx, N, pattern * 0x51633e2d);
+
+    __m256i cellX;
+    const __m256i cellY = DivideUint8(sampleIdx, numSamplesX, cellX);
+    const __m256 sx = _mm256_cvtepi32_ps(CMJPermute8(cellX, numSamplesX, pattern * 0x68bc21eb));
+    const __m256 sy = _mm256_cvtepi32_ps(CMJPermute8(cellY, numSamplesY, pattern * 0x02e5be93));
+    const __m256 jx = CMJRandFloat8(sampleIdx, pattern * 0x967a889b);
+    const __m256 jy = CMJRandFloat8(sampleIdx, pattern * 0x368cc8b7);
+
+    const __m256 numSamplesXF = _mm256_set1_ps(float(numSamplesX));
+    const __m256 numSamplesYF = _mm256_set1_ps(float(numSamplesY));
+    x = _mm256_div_ps(_mm256_add_ps(sx, _mm256_div_ps(_mm256_add_ps(sy, jx), numSamplesYF)), numSamplesXF);
+    y = _mm256_div_ps(_mm256_add_ps(_mm256_cvtepi32_ps(sampleIdx), jy), _mm256_set1_ps(float(N)));
+}
+
+// The generation functions can either write Float2's, or separate arrays of x and y coordinates
+static void StoreSamples8(Float2* samples, float* samplesX, float* samplesY, uint64 firstIdx, __m256 x, __m256 y)
+{
+    if(samples != nullptr)
+    {
+        const __m256 lo = _mm256_unpacklo_ps(x, y);
+        const __m256 hi = _mm256_unpackhi_ps(x, y);
+        float* dst = reinterpret_cast<float*>(samples + firstIdx);
+        _mm256_storeu_ps(dst, _mm256_permute2f128_ps(lo, hi, 0x20));
+        _mm256_storeu_ps(dst + BatchSize, _mm256_permute2f128_ps(lo, hi, 0x31));
+    }
+    else
+    {
+        _mm256_storeu_ps(samplesX + firstIdx, x);
+        _mm256_storeu_ps(samplesY + firstIdx, y);
+    }
+}
+
+static void StoreSample(Float2* samples, float* samplesX, float* samplesY, uint64 idx, Float2 sample)
+{
+    if(samples != nullptr)
+    {
+        samples[idx] = sample;
+    }
+    else
+    {
+        samplesX[idx] = sample.x;
+        samplesY[idx] = sample.y;
+    }
+}
+
+static void GenerateHammersleySamples(Float2* samples, float* samplesX, float* samplesY, uint64 numSamples, uint64 dimIdx)
+{
+    const uint64 baseIdx0 = dimIdx * 2 - 1;
+    const uint64 baseIdx1 = baseIdx0 + 1;
+
+    uint64 sampleIdx = 0;
+    if(UseBatchKernels(numSamples))
+    {
+        const __m256 numSamplesF = _mm256_set1_ps(float(numSamples));
+        for(; sampleIdx + BatchSize <= numSamples; sampleIdx += BatchSize)
+        {
+            const __m256i indices = BatchIndices(sampleIdx);
+            if(dimIdx == 0)
+                StoreSamples8(samples, samplesX, samplesY, sampleIdx, _mm256_div_ps(_mm256_cvtepi32_ps(indices), numSamplesF),
+                              RadicalInverseBase2_8(indices));
+            else
+                StoreSamples8(samples, samplesX, samplesY, sampleIdx, RadicalInverse8(baseIdx0, indices),
+                              RadicalInverse8(baseIdx1, indices));
+        }
+    }
+
+    for(; sampleIdx < numSamples; ++sampleIdx)
+    {
+        if(dimIdx == 0)
+            StoreSample(samples, samplesX, samplesY, sampleIdx, Hammersley2D(sampleIdx, numSamples));
+        else
+            StoreSample(samples, samplesX, samplesY, sampleIdx, Float2(RadicalInverseFast(baseIdx0, sampleIdx),
+                                                                       RadicalInverseFast(baseIdx1, sampleIdx)));
+    }
+}
+
+static void GenerateCMJSamples(Float2* samples, float* samplesX, float* samplesY, uint64 numSamplesX, uint64 numSamplesY, uint32 pattern)
+{
+    const uint64 numSamples = numSamplesX * numSamplesY;
+    uint64 sampleIdx = 0;
+    if(UseBatchKernels(numSamples))
+    {
+        for(; sampleIdx + BatchSize <= numSamples; sampleIdx += BatchSize)
+        {
+            __m256 x, y;
+            SampleCMJ2D8(BatchIndices(sampleIdx), uint32(numSamplesX), uint32(numSamplesY), pattern, x, y);
+            StoreSamples8(samples, samplesX, samplesY, sampleIdx, x, y);
+        }
+    }
+
+    for(; sampleIdx < numSamples; ++sampleIdx)
+        StoreSample(samples, samplesX, samplesY, sampleIdx, SampleCMJ2D(uint32(sampleIdx), uint32(numSamplesX), uint32(numSamplesY), pattern));
+}
+
 void GenerateRandomSamples2D(Float2* samples, uint64 numSamples, Random& randomGenerator)
 {
     for(uint64 i = 0; i < numSamples; ++i)
@@ -475,24 +881,18 @@ void GenerateGridSamples2D(Float2* samples, uint64 numSamplesX, uint64 numSample
 // Generates hammersley using base 1 and 2
 void GenerateHammersleySamples2D(Float2* samples, uint64 numSamples)
 {
-    for(uint64 i = 0; i < numSamples; ++i)
-        samples[i] = Hammersley2D(i, numSamples);
+    GenerateHammersleySamples(samples, nullptr, nullptr, numSamples, 0);
 }
 
 // Generates hammersley using arbitrary bases
 void GenerateHammersleySamples2D(Float2* samples, uint64 numSamples, uint64 dimIdx)
 {
-    if(dimIdx == 0)
-    {
-        GenerateHammersleySamples2D(samples, numSamples);
-    }
-    else
-    {
-        uint64 baseIdx0 = dimIdx * 2 - 1;
-        uint64 baseIdx1 = baseIdx0 + 1;
-        for(uint64 i = 0; i < numSamples; ++i)
-            samples[i] = Float2(RadicalInverseFast(baseIdx0, i), RadicalInverseFast(baseIdx1, i));
-    }
+    GenerateHammersleySamples(samples, nullptr, nullptr, numSamples, dimIdx);
+}
+
+void GenerateHammersleySamples2D(float* samplesX, float* samplesY, uint64 numSamples, uint64 dimIdx)
+{
+    GenerateHammersleySamples(nullptr, samplesX, samplesY, numSamples, dimIdx);
 }
 
 void GenerateLatinHypercubeSamples2D(Float2* samples, uint64 numSamples, Random& rng)
@@ -521,9 +921,71 @@ void GenerateLatinHypercubeSamples2D(Float2* samples, uint64 numSamples, Random&
 
 void GenerateCMJSamples2D(Float2* samples, uint64 numSamplesX, uint64 numSamplesY, uint32 pattern)
 {
-    const uint64 numSamples = numSamplesX * numSamplesY;
+    GenerateCMJSamples(samples, nullptr, nullptr, numSamplesX, numSamplesY, pattern);
+}
+
+void GenerateCMJSamples2D(float* samplesX, float* samplesY, uint64 numSamplesX, uint64 numSamplesY, uint32 pattern)
+{
+    GenerateCMJSamples(nullptr, samplesX, samplesY, numSamplesX, numSamplesY, pattern);
+}
+
+void GenerateSobolSamples2D(Float2* samples, uint64 numSamples, uint32 dimIdx, uint32 seed)
+{
+    Assert_(numSamples <= 0xFFFFFFFFull);
+    const uint32 dimSeed = SobolDimensionSeed(dimIdx, seed);
     for(uint64 i = 0; i < numSamples; ++i)
-        samples[i] = SampleCMJ2D(int32(i), int32(numSamplesX), int32(numSamplesY), int32(pattern));
+        samples[i] = SampleSobol2DFromSeed(uint32(i), dimSeed);
+}
+
+// Generates "numDims" values for each sample, with the values for each sample stored contiguously
+void GenerateSobolSamples(float* samples, uint64 numSamples, uint64 numDims, uint32 seed)
+{
+    Assert_(numSamples <= 0xFFFFFFFFull);
+    for(uint64 dimIdx = 0; dimIdx < numDims; dimIdx += 2)
+    {
+        const uint32 dimSeed = SobolDimensionSeed(uint32(dimIdx / 2), seed);
+        const bool storeY = dimIdx + 1 < numDims;
+        for(uint64 i = 0; i < numSamples; ++i)
+        {
+            const Float2 sample = SampleSobol2DFromSeed(uint32(i), dimSeed);
+            samples[i * numDims + dimIdx] = sample.x;
+            if(storeY)
+                samples[i * numDims + dimIdx + 1] = sample.y;
+        }
+    }
+}
+
+// Computes RadicalInverseBase2() for the indices [firstIdx, firstIdx + numValues)
+void GenerateRadicalInverseBase2(float* values, uint32 firstIdx, uint64 numValues)
+{
+    Assert_(firstIdx + numValues <= 0x100000000ull);
+
+    // Bit reversal doesn't need any division, so it isn't limited to 2^24 indices
+    uint64 i = 0;
+    if(numValues >= BatchSize && CPUSupportsAVX2())
+    {
+        for(; i + BatchSize <= numValues; i += BatchSize)
+            _mm256_storeu_ps(values + i, RadicalInverseBase2_8(BatchIndices(firstIdx + i)));
+    }
+
+    for(; i < numValues; ++i)
+        values[i] = RadicalInverseBase2(uint32(firstIdx + i));
+}
+
+// Computes RadicalInverseFast() for the indices [firstIdx, firstIdx + numValues)
+void GenerateRadicalInverse(float* values, uint64 baseIdx, uint64 firstIdx, uint64 numValues)
+{
+    Assert_(baseIdx < 64);
+
+    uint64 i = 0;
+    if(UseBatchKernels(firstIdx + numValues) && numValues >= BatchSize)
+    {
+        for(; i + BatchSize <= numValues; i += BatchSize)
+            _mm256_storeu_ps(values + i, RadicalInverse8(baseIdx, BatchIndices(firstIdx + i)));
+    }
+
+    for(; i < numValues; ++i)
+        values[i] = RadicalInverseFast(baseIdx, firstIdx + i);
 }
 
 }
\ No newline at end of file
@@ -17,6 +17,7 @@ namespace SampleFramework12
 Float2 SquareToConcentricDiskMapping(float x, float y, float numSides, float polygonAmount);
 Float2 SquareToConcentricDiskMapping(float x, float y);
 Float3 SampleDirectionGGX(const Float3& v, const Float3& n, float roughness, const Float3x3& tangentToWorld, float u1, float u2);
+Float3 SampleGGXVisibleNormal(const Float3& wo, float ax, float ay, float u1, float u2);
 Float3 SampleSphere(float x1, float x2, float x3, float u1);
 Float3 SampleDirectionSphere(float u1, float u2);
 Float3 SampleDirectionHemisphere(float u1, float u2);
@@ -39,6 +40,8 @@ float SampleDirectionRectangularLight_PDF(const Float2& lightSize, const Float3&
 // Random sample generation
 Float2 Hammersley2D(uint64 sampleIdx, uint64 numSamples);
 Float2 SampleCMJ2D(uint32 sampleIdx, uint32 numSamplesX, uint32 numSamplesY, uint32 pattern);
+Float2 SampleSobol2D(uint32 sampleIdx, uint32 dimIdx, uint32 seed);
+Float2 SampleSobol2DFromSeed(uint32 sampleIdx, uint32 dimSeed);
 
 // Full random sample set generation
 void GenerateRandomSamples2D(Float2* samples, uint64 numSamples, Random& randomGenerator);
@@ -48,6 +51,14 @@ void GenerateHammersleySamples2D(Float2* samples, uint64 numSamples);
 void GenerateHammersleySamples2D(Float2* samples, uint64 numSamples, uint64 dimIdx);
 void GenerateLatinHypercubeSamples2D(Float2* samples, uint64 numSamples, Random& rng);
 void GenerateCMJSamples2D(Float2* samples, uint64 numSamplesX, uint64 numSamplesY, uint32 pattern);
+void GenerateSobolSamples2D(Float2* samples, uint64 numSamples, uint32 dimIdx, uint32 seed);
+void GenerateSobolSamples(float* samples, uint64 numSamples, uint64 numDims, uint32 seed);
+
+// Batched versions that write separate arrays of x and y coordinates, and use AVX2 when it's supported
+void GenerateHammersleySamples2D(float* samplesX, float* samplesY, uint64 numSamples, uint64 dimIdx = 0);
+void GenerateCMJSamples2D(float* samplesX, float* samplesY, uint64 numSamplesX, uint64 numSamplesY, uint32 pattern);
+void GenerateRadicalInverseBase2(float* values, uint32 firstIdx, uint64 numValues);
+void GenerateRadicalInverse(float* values, uint64 baseIdx, uint64 firstIdx, uint64 numValues);
 
 // Helpers
 float RadicalInverseBase2(uint32 bits);
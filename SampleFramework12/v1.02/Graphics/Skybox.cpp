@@ -164,8 +164,8 @@ bool SkyCache::Init(const Float3& sunDirection_, float sunSize, const Float3& gr
         Array<Half4> texels(NumTexels);
 
         // We'll also project the sky onto SH coefficients for use during rendering
-        SH = SH9Color();
-        float weightSum = 0.0f;
+        TextureData<Float4> radianceData;
+        radianceData.Init(uint32(CubeMapRes), uint32(CubeMapRes), 6);
 
         for(uint64 s = 0; s < 6; ++s)
         {
@@ -180,23 +180,12 @@ bool SkyCache::Init(const Float3& sunDirection_, float sunSize, const Float3& gr
                     samples[idx] = radiance;
                     texels[idx] = Half4(Float4(radiance, 1.0f));
                     sampleDirs[idx] = dir;
-
-                    float u = (x + 0.5f) / CubeMapRes;
-                    float v = (y + 0.5f) / CubeMapRes;
-
-                    // Account for cubemap texel distribution
-                    u = u * 2.0f - 1.0f;
-                    v = v * 2.0f - 1.0f;
-                    const float temp = 1.0f + u * u + v * v;
-                    const float weight = 4.0f / (std::sqrt(temp) * temp);
-
-                    SH += ProjectOntoSH9Color(dir, radiance) * weight;
-                    weightSum += weight;
+                    radianceData.Texels[idx] = Float4(radiance, 1.0f);
                 }
             }
         }
 
-        SH *= (4.0f * 3.14159f) / weightSum;
+        SH = ProjectCubemapToSH9(radianceData);
 
         Create2DTexture(CubeMap, CubeMapRes, CubeMapRes, 1, 1, DXGI_FORMAT_R16G16B16A16_FLOAT, true, texels.Data());
 
@@ -13,6 +13,7 @@
 #include "..\\Exceptions.h"
 #include "Textures.h"
 #include "..\\FileIO.h"
+#include "..\\MurmurHash.h"
 #include "ShaderCompilation.h"
 #include "GraphicsTypes.h"
 #include "TinyEXR.h"
@@ -35,32 +36,107 @@ static uint64 NumMipLevels(uint64 width, uint64 height, uint64 depth = 1)
     return numMips;
 }
 
+// Processed textures are cached as DDS files, named after the source file's key
+static const std::wstring TextureCacheDir = L"TextureCache\\";
+static const uint32 TextureCacheVersion = 1;
+
+static std::wstring MakeTextureCacheName(const wchar* filePath, bool forceSRGB, bool compress)
+{
+    return TextureCacheDir + TextureFileKey(filePath, forceSRGB, compress).ToString() + L".dds";
+}
+
+// Failing to write the cache only costs us the next load, so it isn't treated as an error. The file is
+// written under a temporary name first so that other threads never see it half-written.
+static void WriteTextureCache(const std::wstring& cachePath, const DirectX::ScratchImage& image)
+{
+    if(CreateDirectory(TextureCacheDir.c_str(), nullptr) == false && GetLastError() != ERROR_ALREADY_EXISTS)
+        return;
+
+    const std::wstring tempPath = cachePath + MakeString(L".%u.tmp", GetCurrentThreadId());
+    HRESULT hr = DirectX::SaveToDDSFile(image.GetImages(), image.GetImageCount(), image.GetMetadata(),
+                                        DirectX::DDS_FLAGS_NONE, tempPath.c_str());
+    if(FAILED(hr) || MoveFileEx(tempPath.c_str(), cachePath.c_str(), MOVEFILE_REPLACE_EXISTING) == false)
+        DeleteFile(tempPath.c_str());
+}
+
+Hash TextureFileKey(const wchar* filePath, bool forceSRGB, bool compress)
+{
+    // The full path makes relative paths to the same file from different directories match
+    wchar fullPath[MAX_PATH] = { };
+    const DWORD fullPathLength = GetFullPathNameW(filePath, MAX_PATH, fullPath, nullptr);
+    if(fullPathLength == 0 || fullPathLength >= MAX_PATH)
+        throw Exception(MakeString(L"Failed to get the full path of texture file '%ls'", filePath));
+
+    WIN32_FILE_ATTRIBUTE_DATA attributes = { };
+    Win32Call(GetFileAttributesEx(fullPath, GetFileExInfoStandard, &attributes));
+    const uint64 fileInfo[2] =
+    {
+        (uint64(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow,
+        (uint64(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime,
+    };
+    const uint32 flags = (forceSRGB ? 1 : 0) | (compress ? 2 : 0);
+
+    Hash hash = GenerateHash(fullPath, int32(fullPathLength * sizeof(wchar)), TextureCacheVersion);
+    hash = CombineHashes(hash, GenerateHash(fileInfo, sizeof(fileInfo)));
+    hash = CombineHashes(hash, GenerateHash(&flags, sizeof(flags)));
+    return hash;
+}
+
 void LoadTexture(Texture& texture, const wchar* filePath, bool forceSRGB)
 {
-    texture.Shutdown();
+    DirectX::ScratchImage image;
+    DecodeTextureFile(filePath, image, forceSRGB);
+    CreateTexture(texture, image, filePath, forceSRGB);
+}
+
+bool DecodeTextureFile(const wchar* filePath, DirectX::ScratchImage& image, bool forceSRGB, bool compress)
+{
     if(FileExists(filePath) == false)
         throw Exception(MakeString(L"Texture file with path '%ls' does not exist", filePath));
 
-    DirectX::ScratchImage image;
-
     const std::wstring extension = GetFileExtension(filePath);
     if(extension == L"DDS" || extension == L"dds")
     {
         DXCall(DirectX::LoadFromDDSFile(filePath, DirectX::DDS_FLAGS_NONE, nullptr, image));
+        return false;
     }
-    else if(extension == L"TGA" || extension == L"tga")
-    {
-        DirectX::ScratchImage tempImage;
+
+    const std::wstring cachePath = MakeTextureCacheName(filePath, forceSRGB, compress);
+    if(FileExists(cachePath.c_str()) && SUCCEEDED(DirectX::LoadFromDDSFile(cachePath.c_str(), DirectX::DDS_FLAGS_NONE, nullptr, image)))
+        return true;
+
+    DirectX::ScratchImage tempImage;
+    if(extension == L"TGA" || extension == L"tga")
         DXCall(DirectX::LoadFromTGAFile(filePath, nullptr, tempImage));
-        DXCall(DirectX::GenerateMipMaps(*tempImage.GetImage(0, 0, 0), DirectX::TEX_FILTER_DEFAULT, 0, image, false));
-    }
     else
-    {
-        DirectX::ScratchImage tempImage;
         DXCall(DirectX::LoadFromWICFile(filePath, DirectX::WIC_FLAGS_NONE, nullptr, tempImage));
-        DXCall(DirectX::GenerateMipMaps(*tempImage.GetImage(0, 0, 0), DirectX::TEX_FILTER_DEFAULT, 0, image, false));
+    DXCall(DirectX::GenerateMipMaps(*tempImage.GetImage(0, 0, 0), DirectX::TEX_FILTER_DEFAULT, 0, image, false));
+
+    // Store the format that the texture will be created with, so that the cached file can be used as-is
+    if(forceSRGB)
+        image.OverrideFormat(DirectX::MakeSRGB(image.GetMetadata().format));
+
+    // BC formats need the top mip to be a multiple of the block size
+    const DirectX::TexMetadata& metaData = image.GetMetadata();
+    if(compress && metaData.width % 4 == 0 && metaData.height % 4 == 0)
+    {
+        const DXGI_FORMAT compressedFormat = DirectX::IsSRGB(metaData.format) ? DXGI_FORMAT_BC7_UNORM_SRGB : DXGI_FORMAT_BC7_UNORM;
+        DirectX::ScratchImage compressedImage;
+        DXCall(DirectX::Compress(image.GetImages(), image.GetImageCount(), metaData, compressedFormat,
+                                 DirectX::TEX_COMPRESS_BC7_QUICK | DirectX::TEX_COMPRESS_PARALLEL,
+                                 DirectX::TEX_THRESHOLD_DEFAULT, compressedImage));
+        image = std::move(compressedImage);
     }
 
+    WriteTextureCache(cachePath, image);
+
+    return false;
+}
+
+void CreateTexture(Texture& texture, const DirectX::ScratchImage& image, const wchar* name, bool forceSRGB)
+{
+    texture.Shutdown();
+
     const DirectX::TexMetadata& metaData = image.GetMetadata();
     DXGI_FORMAT format = metaData.format;
     if(forceSRGB)
@@ -84,7 +160,7 @@ void LoadTexture(Texture& texture, const wchar* filePath, bool forceSRGB)
     ID3D12Device* device = DX12::Device;
     DXCall(device->CreateCommittedResource(DX12::GetDefaultHeapProps(), D3D12_HEAP_FLAG_NONE, &textureDesc,
                                            D3D12_RESOURCE_STATE_COMMON, nullptr, IID_PPV_ARGS(&texture.Resource)));
-    texture.Resource->SetName(filePath);
+    texture.Resource->SetName(name);
 
     PersistentDescriptorAlloc srvAlloc = DX12::SRVDescriptorHeap.AllocatePersistent();
     texture.SRV = srvAlloc.Index;
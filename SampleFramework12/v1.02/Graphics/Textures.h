@@ -13,6 +13,7 @@
 
 #include "..\\InterfacePointers.h"
 #include "..\\Serialization.h"
+#include "..\\MurmurHash.h"
 #include "GraphicsTypes.h"
 
 namespace SampleFramework12
@@ -26,6 +27,18 @@ class File;
 
 // Texture loading and creation
 void LoadTexture(Texture& texture, const wchar* filePath, bool forceSRGB = false);
+
+// The two halves of LoadTexture(). Decoding a file and generating its mips doesn't touch the device,
+// so it can run on any thread, while creating the texture and uploading it needs to happen on the main thread.
+// Files other than DDS need their mips generated (and optionally get compressed to BC7), so the result is
+// stored in the TextureCache directory and read back from there next time. Returns true on a cache hit.
+bool DecodeTextureFile(const wchar* filePath, DirectX::ScratchImage& image, bool forceSRGB = false, bool compress = false);
+void CreateTexture(Texture& texture, const DirectX::ScratchImage& image, const wchar* name, bool forceSRGB = false);
+
+// Identifies a texture file along with the settings that change how DecodeTextureFile() processes it.
+// It's built from the file's full path, size and timestamp, so the file itself doesn't need to be read.
+Hash TextureFileKey(const wchar* filePath, bool forceSRGB = false, bool compress = false);
+
 void Create2DTexture(Texture& texture, uint64 width, uint64 height, uint64 numMips,
                      uint64 arraySize, DXGI_FORMAT format, bool cubeMap, const void* initData);
 void Create3DTexture(Texture& texture, uint64 width, uint64 height, uint64 depth, uint64 numMips,
@@ -0,0 +1,336 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "TwoLevelBVH.h"
+#include "Model.h"
+#include "..\\Utility.h"
+#include "..\\Timer.h"
+#include "..\\Tasks.h"
+
+namespace SampleFramework12
+{
+
+// Passed to the BLASes in place of the app's filter, so that the app sees which instance was hit
+struct InstanceFilterContext
+{
+    BVHHitFilter Filter = nullptr;
+    const void* Context = nullptr;
+    uint32 InstanceIdx = 0;
+};
+
+static bool InstanceHitFilter(const void* context, const BVHHit& hit)
+{
+    const InstanceFilterContext* instanceContext = reinterpret_cast<const InstanceFilterContext*>(context);
+    BVHHit instanceHit = hit;
+    instanceHit.InstanceIdx = instanceContext->InstanceIdx;
+    return instanceContext->Filter(instanceContext->Context, instanceHit);
+}
+
+// Float4x4 transforms row vectors, so the 3x4 form is the transpose of its first 3 columns
+static void To3x4(const Float4x4& m, float dst[3][4])
+{
+    const Float4x4 transposed = Float4x4::Transpose(m);
+    memcpy(dst, &transposed._11, sizeof(float) * 12);
+}
+
+void TwoLevelBVH::BuildBLASes(const Model& model)
+{
+    Shutdown();
+
+    const uint64 numMeshes = model.NumMeshes();
+    blases.Init(numMeshes);
+
+    // Most meshes are too small for the builder to go wide on its own, so build them in parallel
+    Tasks::ParallelFor(uint32(numMeshes), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 meshIdx = range.start; meshIdx < range.end; ++meshIdx)
+        {
+            if(model.Meshes()[meshIdx].NumIndices() >= 3)
+                blases[meshIdx].Build(model, meshIdx);
+        }
+    });
+}
+
+void TwoLevelBVH::Build(const Model& model)
+{
+    Timer timer;
+
+    BuildBLASes(model);
+
+    for(uint32 meshIdx = 0; meshIdx < blases.Size(); ++meshIdx)
+    {
+        if(blases[meshIdx].NumNodes() > 0)
+            AddInstance(meshIdx, Float4x4(), 0xFF, meshIdx);
+    }
+
+    BuildTLAS();
+
+    timer.Update();
+    WriteLog("Built two-level BVH with %llu BLASes and %llu instances in %.2f ms (%.2f MB)",
+             blases.Size(), instances.Count(), timer.ElapsedMillisecondsD(), MemorySize() / (1024.0 * 1024.0));
+}
+
+void TwoLevelBVH::Shutdown()
+{
+    for(uint64 i = 0; i < blases.Size(); ++i)
+        blases[i].Shutdown();
+    blases.Shutdown();
+    instances.Shutdown();
+
+    tlasNodes.Shutdown();
+    tlasInstances.Shutdown();
+    numTLASNodes = 0;
+    tlasBuildTimeMs = 0.0;
+}
+
+uint32 TwoLevelBVH::AddInstance(uint32 blasIdx, const Float4x4& transform, uint32 mask, uint32 instanceID)
+{
+    Assert_(blasIdx < blases.Size());
+    Assert_(blases[blasIdx].NumNodes() > 0);
+
+    BVHInstance instance;
+    instance.BLASIdx = blasIdx;
+    instance.InstanceID = instanceID;
+    instance.Mask = mask;
+    To3x4(transform, instance.Transform);
+    To3x4(Float4x4::Invert(transform), instance.InvTransform);
+
+    return uint32(instances.Add(instance));
+}
+
+void TwoLevelBVH::SetInstanceTransform(uint32 instanceIdx, const Float4x4& transform)
+{
+    BVHInstance& instance = instances[instanceIdx];
+    To3x4(transform, instance.Transform);
+    To3x4(Float4x4::Invert(transform), instance.InvTransform);
+}
+
+void TwoLevelBVH::RemoveAllInstances()
+{
+    instances.RemoveAll();
+
+    tlasNodes.Shutdown();
+    tlasInstances.Shutdown();
+    numTLASNodes = 0;
+}
+
+void TwoLevelBVH::BuildTLAS()
+{
+    tlasNodes.Shutdown();
+    tlasInstances.Shutdown();
+    numTLASNodes = 0;
+
+    const uint64 numInstances = instances.Count();
+    if(numInstances == 0)
+        return;
+
+    Timer timer;
+
+    // World-space bounds of each instance, from the 8 corners of its BLAS bounds
+    Array<Float3> instanceBoundsMin(numInstances);
+    Array<Float3> instanceBoundsMax(numInstances);
+    Tasks::ParallelFor(uint32(numInstances), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 instanceIdx = range.start; instanceIdx < range.end; ++instanceIdx)
+        {
+            const BVHInstance& instance = instances[instanceIdx];
+            const BVH& blas = blases[instance.BLASIdx];
+
+            Float3 boundsMin = FloatMax;
+            Float3 boundsMax = -FloatMax;
+            for(uint32 cornerIdx = 0; cornerIdx < 8; ++cornerIdx)
+            {
+                const Float3 corner = Float3((cornerIdx & 1) ? blas.BoundsMax().x : blas.BoundsMin().x,
+                                             (cornerIdx & 2) ? blas.BoundsMax().y : blas.BoundsMin().y,
+                                             (cornerIdx & 4) ? blas.BoundsMax().z : blas.BoundsMin().z);
+                const Float3 worldCorner = TransformPoint3x4(instance.Transform, corner);
+                boundsMin = Float3(Min(boundsMin.x, worldCorner.x), Min(boundsMin.y, worldCorner.y), Min(boundsMin.z, worldCorner.z));
+                boundsMax = Float3(Max(boundsMax.x, worldCorner.x), Max(boundsMax.y, worldCorner.y), Max(boundsMax.z, worldCorner.z));
+            }
+
+            instanceBoundsMin[instanceIdx] = boundsMin;
+            instanceBoundsMax[instanceIdx] = boundsMax;
+        }
+    });
+
+    numTLASNodes = BuildBoundsTree(instanceBoundsMin.Data(), instanceBoundsMax.Data(), numInstances, tlasNodes, tlasInstances);
+
+    timer.Update();
+    tlasBuildTimeMs = timer.ElapsedMillisecondsD();
+}
+
+void TwoLevelBVH::Flatten(BVH& bvh) const
+{
+    const uint64 numInstances = instances.Count();
+    Array<uint64> instancePrimOffsets(numInstances);
+    uint64 numTriangles = 0;
+    for(uint64 instanceIdx = 0; instanceIdx < numInstances; ++instanceIdx)
+    {
+        instancePrimOffsets[instanceIdx] = numTriangles;
+        numTriangles += blases[instances[instanceIdx].BLASIdx].NumPrimitives();
+    }
+
+    Array<BVHPrimitive> worldPrimitives(numTriangles);
+    Tasks::ParallelFor(uint32(numInstances), [&](enki::TaskSetPartition range, uint32 threadNum)
+    {
+        for(uint32 instanceIdx = range.start; instanceIdx < range.end; ++instanceIdx)
+        {
+            const BVHInstance& instance = instances[instanceIdx];
+            const Array<BVHPrimitive>& blasPrimitives = blases[instance.BLASIdx].Primitives();
+            BVHPrimitive* dstPrimitives = &worldPrimitives[instancePrimOffsets[instanceIdx]];
+            for(uint64 primIdx = 0; primIdx < blasPrimitives.Size(); ++primIdx)
+            {
+                const BVHPrimitive& src = blasPrimitives[primIdx];
+                BVHPrimitive& dst = dstPrimitives[primIdx];
+                dst.V0 = TransformPoint3x4(instance.Transform, src.V0);
+                dst.E1 = TransformDirection3x4(instance.Transform, src.E1);
+                dst.E2 = TransformDirection3x4(instance.Transform, src.E2);
+                dst.MeshIdx = src.MeshIdx;
+                dst.TriangleIdx = src.TriangleIdx;
+            }
+        }
+    });
+
+    bvh.Build(worldPrimitives.Data(), numTriangles);
+}
+
+uint64 TwoLevelBVH::NumInstancedTriangles() const
+{
+    uint64 numTriangles = 0;
+    for(uint64 instanceIdx = 0; instanceIdx < instances.Count(); ++instanceIdx)
+        numTriangles += blases[instances[instanceIdx].BLASIdx].NumPrimitives();
+    return numTriangles;
+}
+
+uint64 TwoLevelBVH::MemorySize() const
+{
+    uint64 size = instances.CurrentMaxCount() * sizeof(BVHInstance) + tlasNodes.MemorySize() + tlasInstances.MemorySize();
+    for(uint64 blasIdx = 0; blasIdx < blases.Size(); ++blasIdx)
+        size += blases[blasIdx].MemorySize();
+    return size;
+}
+
+template<bool AnyHit> bool TwoLevelBVH::Traverse(const BVHRay& ray, BVHHit& hit, uint32 instanceMask,
+                                                 BVHHitFilter filter, const void* filterContext) const
+{
+    if(numTLASNodes == 0)
+        return false;
+
+    const Float3 invDir = SafeInverseDirection(ray.Direction);
+    float tMax = ray.TMax;
+    bool foundHit = false;
+
+    uint32 stack[BVH::MaxDepth];
+    uint32 stackSize = 0;
+
+    const BVHNode* nodeData = tlasNodes.Data();
+    if(IntersectRayBounds(nodeData[0].BoundsMin, nodeData[0].BoundsMax, ray.Origin, invDir, ray.TMin, tMax) == FloatMax)
+        return false;
+
+    InstanceFilterContext instanceContext;
+    instanceContext.Filter = filter;
+    instanceContext.Context = filterContext;
+    const BVHHitFilter instanceFilter = filter != nullptr ? InstanceHitFilter : nullptr;
+
+    uint32 nodeIdx = 0;
+    while(true)
+    {
+        const BVHNode& node = nodeData[nodeIdx];
+        if(node.IsLeaf())
+        {
+            for(uint32 i = 0; i < node.NumPrimitives; ++i)
+            {
+                const uint32 instanceIdx = tlasInstances[node.Offset + i];
+                const BVHInstance& instance = instances[instanceIdx];
+                if((instance.Mask & instanceMask) == 0)
+                    continue;
+
+                // The direction isn't re-normalized, so T means the same thing in both spaces
+                BVHRay objectRay;
+                objectRay.Origin = TransformPoint3x4(instance.InvTransform, ray.Origin);
+                objectRay.Direction = TransformDirection3x4(instance.InvTransform, ray.Direction);
+                objectRay.TMin = ray.TMin;
+                objectRay.TMax = tMax;
+
+                instanceContext.InstanceIdx = instanceIdx;
+
+                const BVH& blas = blases[instance.BLASIdx];
+                BVHHit candidate;
+                const bool instanceHit = AnyHit ? blas.Occluded(objectRay, instanceFilter, &instanceContext)
+                                                : blas.Intersect(objectRay, candidate, instanceFilter, &instanceContext);
+                if(instanceHit == false)
+                    continue;
+
+                hit = candidate;
+                hit.InstanceIdx = instanceIdx;
+                tMax = candidate.T;
+                foundHit = true;
+
+                if(AnyHit)
+                    return true;
+            }
+        }
+        else
+        {
+            // Visit the closer child first, and push the other one
+            const uint32 leftIdx = node.Offset;
+            const uint32 rightIdx = node.Offset + 1;
+            const float tLeft = IntersectRayBounds(nodeData[leftIdx].BoundsMin, nodeData[leftIdx].BoundsMax, ray.Origin, invDir, ray.TMin, tMax);
+            const float tRight = IntersectRayBounds(nodeData[rightIdx].BoundsMin, nodeData[rightIdx].BoundsMax, ray.Origin, invDir, ray.TMin, tMax);
+
+            if(tLeft != FloatMax && tRight != FloatMax)
+            {
+                Assert_(stackSize < BVH::MaxDepth);
+                if(tLeft <= tRight)
+                {
+                    stack[stackSize++] = rightIdx;
+                    nodeIdx = leftIdx;
+                }
+                else
+                {
+                    stack[stackSize++] = leftIdx;
+                    nodeIdx = rightIdx;
+                }
+                continue;
+            }
+            else if(tLeft != FloatMax)
+            {
+                nodeIdx = leftIdx;
+                continue;
+            }
+            else if(tRight != FloatMax)
+            {
+                nodeIdx = rightIdx;
+                continue;
+            }
+        }
+
+        if(stackSize == 0)
+            break;
+        nodeIdx = stack[--stackSize];
+    }
+
+    return foundHit;
+}
+
+bool TwoLevelBVH::Intersect(const BVHRay& ray, BVHHit& hit, uint32 instanceMask, BVHHitFilter filter, const void* filterContext) const
+{
+    hit = BVHHit();
+    return Traverse<false>(ray, hit, instanceMask, filter, filterContext);
+}
+
+bool TwoLevelBVH::Occluded(const BVHRay& ray, uint32 instanceMask, BVHHitFilter filter, const void* filterContext) const
+{
+    BVHHit hit;
+    return Traverse<true>(ray, hit, instanceMask, filter, filterContext);
+}
+
+}
\ No newline at end of file
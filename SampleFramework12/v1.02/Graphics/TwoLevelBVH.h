@@ -0,0 +1,124 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "..\\PCH.h"
+#include "..\\SF12_Math.h"
+#include "..\\Containers.h"
+#include "BVH.h"
+
+namespace SampleFramework12
+{
+
+class Model;
+
+// Instance of a bottom-level BVH, laid out the same way as D3D12_RAYTRACING_INSTANCE_DESC
+struct BVHInstance
+{
+    float Transform[3][4] = { };        // Object-to-world, row-major and applied to column vectors
+    float InvTransform[3][4] = { };     // World-to-object
+    uint32 BLASIdx = 0;
+    uint32 InstanceID = 0;              // Free for the app to use, like InstanceID() in HLSL
+    uint32 Mask = 0xFF;                 // Rays skip the instance if this doesn't overlap their instance mask
+};
+
+inline Float3 TransformPoint3x4(const float m[3][4], const Float3& p)
+{
+    return Float3(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                  m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                  m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+}
+
+inline Float3 TransformDirection3x4(const float m[3][4], const Float3& d)
+{
+    return Float3(m[0][0] * d.x + m[0][1] * d.y + m[0][2] * d.z,
+                  m[1][0] * d.x + m[1][1] * d.y + m[1][2] * d.z,
+                  m[2][0] * d.x + m[2][1] * d.y + m[2][2] * d.z);
+}
+
+// Two-level scene with the same structure as a DXR acceleration structure: a bottom-level BVH
+// (BLAS) per mesh, built in the mesh's own space, and a top-level BVH (TLAS) over the world-space
+// bounds of a list of instances. Instances of the same BLAS share its nodes and triangles, so
+// repeated meshes only cost an instance and a few TLAS nodes each. Rays are transformed into the
+// space of each instance they reach, so hits report the same object-space T as a flattened BVH.
+class TwoLevelBVH
+{
+
+public:
+
+    ~TwoLevelBVH()
+    {
+        Assert_(blases.Size() == 0);
+    }
+
+    // Builds a BLAS for every mesh in the model along with one identity instance per mesh, which
+    // gives the same scene as BVH::Build(). More instances can be added afterwards.
+    void Build(const Model& model);
+
+    // Builds a BLAS for every mesh in the model without adding any instances
+    void BuildBLASes(const Model& model);
+
+    void Shutdown();
+
+    // Returns the index of the new instance. The TLAS needs to be rebuilt after adding or moving
+    // instances, but the BLASes are left alone.
+    uint32 AddInstance(uint32 blasIdx, const Float4x4& transform, uint32 mask = 0xFF, uint32 instanceID = 0);
+    void SetInstanceTransform(uint32 instanceIdx, const Float4x4& transform);
+    void RemoveAllInstances();
+
+    void BuildTLAS();
+
+    // Builds a single-level BVH containing world-space copies of every instance's triangles
+    void Flatten(BVH& bvh) const;
+
+    // Returns the closest hit within [TMin, TMax] against instances whose mask overlaps instanceMask
+    bool Intersect(const BVHRay& ray, BVHHit& hit, uint32 instanceMask = 0xFF,
+                   BVHHitFilter filter = nullptr, const void* filterContext = nullptr) const;
+
+    // Returns true if anything is hit within [TMin, TMax], without finding the closest hit
+    bool Occluded(const BVHRay& ray, uint32 instanceMask = 0xFF,
+                  BVHHitFilter filter = nullptr, const void* filterContext = nullptr) const;
+
+    // Accessors
+    uint64 NumBLASes() const { return blases.Size(); }
+    const BVH& BLAS(uint64 blasIdx) const { return blases[blasIdx]; }
+
+    uint64 NumInstances() const { return instances.Count(); }
+    const BVHInstance& Instance(uint64 instanceIdx) const { return instances[instanceIdx]; }
+
+    const BVHNode* TLASNodes() const { return tlasNodes.Data(); }
+    uint64 NumTLASNodes() const { return numTLASNodes; }
+
+    const Float3& BoundsMin() const { return tlasNodes[0].BoundsMin; }
+    const Float3& BoundsMax() const { return tlasNodes[0].BoundsMax; }
+
+    // Number of triangles that the instances add up to, which is what a flattened BVH would contain
+    uint64 NumInstancedTriangles() const;
+
+    // Size of the BLASes, instances, and TLAS
+    uint64 MemorySize() const;
+
+    double TLASBuildTimeMs() const { return tlasBuildTimeMs; }
+
+protected:
+
+    template<bool AnyHit> bool Traverse(const BVHRay& ray, BVHHit& hit, uint32 instanceMask,
+                                        BVHHitFilter filter, const void* filterContext) const;
+
+    Array<BVH> blases;
+    GrowableList<BVHInstance> instances;
+
+    Array<BVHNode> tlasNodes;
+    uint64 numTLASNodes = 0;
+    Array<uint32> tlasInstances;        // Instance indices in leaf order
+    double tlasBuildTimeMs = 0.0;
+};
+
+}
\ No newline at end of file
@@ -0,0 +1,190 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "VertexCacheOptimizer.h"
+#include "..\\Containers.h"
+
+namespace SampleFramework12
+{
+
+VertexCacheStats AnalyzeVertexCache(const uint32* indices, uint64 numIndices, uint64 numVertices, uint32 cacheSize)
+{
+    Assert_(numIndices % 3 == 0);
+    Assert_(cacheSize > 0);
+
+    VertexCacheStats stats;
+    if(numIndices == 0 || numVertices == 0)
+        return stats;
+
+    // A vertex is still in the FIFO if fewer than cacheSize misses happened since it was loaded
+    Array<uint64> loadTimes(numVertices, uint64(0));
+    uint64 numMisses = 0;
+    for(uint64 i = 0; i < numIndices; ++i)
+    {
+        const uint32 vtxIdx = indices[i];
+        Assert_(vtxIdx < numVertices);
+        if(loadTimes[vtxIdx] == 0 || numMisses - loadTimes[vtxIdx] >= cacheSize)
+            loadTimes[vtxIdx] = ++numMisses;
+    }
+
+    // ATVR is relative to the vertices that are actually used
+    uint64 numUsedVertices = 0;
+    for(uint64 i = 0; i < numVertices; ++i)
+        numUsedVertices += loadTimes[i] != 0 ? 1 : 0;
+
+    stats.ACMR = float(numMisses) / float(numIndices / 3);
+    stats.ATVR = float(numMisses) / float(numUsedVertices);
+    return stats;
+}
+
+void OptimizeVertexCache(uint32* indices, uint64 numIndices, uint64 numVertices, uint32 cacheSize)
+{
+    Assert_(numIndices % 3 == 0);
+    Assert_(cacheSize > 0);
+
+    const uint64 numTriangles = numIndices / 3;
+    if(numTriangles <= 1)
+        return;
+
+    // Build the vertex -> triangle adjacency, with the live count of each vertex being the number of
+    // triangles that still need to be emitted
+    Array<uint32> liveCounts(numVertices, 0u);
+    for(uint64 i = 0; i < numIndices; ++i)
+    {
+        Assert_(indices[i] < numVertices);
+        ++liveCounts[indices[i]];
+    }
+
+    Array<uint32> adjacencyOffsets(numVertices + 1);
+    adjacencyOffsets[0] = 0;
+    for(uint64 i = 0; i < numVertices; ++i)
+        adjacencyOffsets[i + 1] = adjacencyOffsets[i] + liveCounts[i];
+
+    Array<uint32> adjacency(numIndices);
+    Array<uint32> adjacencyCounts(numVertices, 0u);
+    for(uint64 triIdx = 0; triIdx < numTriangles; ++triIdx)
+    {
+        for(uint64 corner = 0; corner < 3; ++corner)
+        {
+            const uint32 vtxIdx = indices[triIdx * 3 + corner];
+            adjacency[adjacencyOffsets[vtxIdx] + adjacencyCounts[vtxIdx]++] = uint32(triIdx);
+        }
+    }
+
+    // Cache "time stamps" start far enough in the past that nothing is considered to be cached
+    Array<uint64> cacheTimes(numVertices, uint64(0));
+    uint64 timeStamp = cacheSize + 1;
+
+    Array<bool> emitted(numTriangles, false);
+    Array<uint32> output(numIndices);
+    uint64 numOutput = 0;
+
+    // Vertices of recently emitted triangles, for recovering from dead-ends
+    GrowableList<uint32> deadEndStack(numIndices);
+    GrowableList<uint32> candidates(64);
+
+    int64 fanningVertex = 0;
+    uint64 cursor = 1;
+    while(fanningVertex >= 0)
+    {
+        candidates.RemoveAll();
+
+        // Emit all of the remaining triangles around the fanning vertex
+        const uint32 fanVtx = uint32(fanningVertex);
+        for(uint32 adjIdx = adjacencyOffsets[fanVtx]; adjIdx < adjacencyOffsets[fanVtx + 1]; ++adjIdx)
+        {
+            const uint32 triIdx = adjacency[adjIdx];
+            if(emitted[triIdx])
+                continue;
+
+            for(uint64 corner = 0; corner < 3; ++corner)
+            {
+                const uint32 vtxIdx = indices[triIdx * 3 + corner];
+                output[numOutput++] = vtxIdx;
+                deadEndStack.Add(vtxIdx);
+                candidates.Add(vtxIdx);
+                --liveCounts[vtxIdx];
+
+                if(timeStamp - cacheTimes[vtxIdx] > cacheSize)
+                    cacheTimes[vtxIdx] = timeStamp++;
+            }
+
+            emitted[triIdx] = true;
+        }
+
+        // Pick the next fanning vertex from the ones just used: prefer the vertex that's been in the
+        // cache the longest, as long as it will still be in the cache once its remaining triangles are
+        // emitted. Each remaining triangle can add at most 2 new vertices.
+        fanningVertex = -1;
+        uint64 bestPriority = 0;
+        for(uint64 i = 0; i < candidates.Count(); ++i)
+        {
+            const uint32 vtxIdx = candidates[i];
+            if(liveCounts[vtxIdx] == 0)
+                continue;
+
+            uint64 priority = 1;
+            const uint64 age = timeStamp - cacheTimes[vtxIdx];
+            if(age + 2 * liveCounts[vtxIdx] <= cacheSize)
+                priority = age + 1;
+
+            if(priority > bestPriority)
+            {
+                bestPriority = priority;
+                fanningVertex = vtxIdx;
+            }
+        }
+
+        // Dead-end: back up through recently used vertices, and then fall back to scanning in order
+        while(fanningVertex < 0 && deadEndStack.Count() > 0)
+        {
+            const uint32 vtxIdx = deadEndStack[deadEndStack.Count() - 1];
+            deadEndStack.Remove(deadEndStack.Count() - 1);
+            if(liveCounts[vtxIdx] > 0)
+                fanningVertex = vtxIdx;
+        }
+
+        while(fanningVertex < 0 && cursor < numVertices)
+        {
+            if(liveCounts[cursor] > 0)
+                fanningVertex = int64(cursor);
+            ++cursor;
+        }
+    }
+
+    Assert_(numOutput == numIndices);
+    memcpy(indices, output.Data(), numIndices * sizeof(uint32));
+}
+
+uint64 ComputeVertexFetchRemap(const uint32* indices, uint64 numIndices, uint64 numVertices, uint32* remap)
+{
+    for(uint64 i = 0; i < numVertices; ++i)
+        remap[i] = uint32(-1);
+
+    uint32 numUsed = 0;
+    for(uint64 i = 0; i < numIndices; ++i)
+    {
+        Assert_(indices[i] < numVertices);
+        if(remap[indices[i]] == uint32(-1))
+            remap[indices[i]] = numUsed++;
+    }
+
+    uint32 nextUnused = numUsed;
+    for(uint64 i = 0; i < numVertices; ++i)
+    {
+        if(remap[i] == uint32(-1))
+            remap[i] = nextUnused++;
+    }
+
+    return numUsed;
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,42 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "..\\PCH.h"
+
+namespace SampleFramework12
+{
+
+// Size of the FIFO cache used for simulating the post-transform vertex cache
+static const uint32 DefaultVertexCacheSize = 16;
+
+struct VertexCacheStats
+{
+    float ACMR = 0.0f;      // Average cache miss ratio: transformed vertices per triangle, between 0.5 and 3
+    float ATVR = 0.0f;      // Average transform to vertex ratio: transformed vertices per vertex, 1 is ideal
+};
+
+// Simulates a FIFO post-transform vertex cache for a triangle list
+VertexCacheStats AnalyzeVertexCache(const uint32* indices, uint64 numIndices, uint64 numVertices,
+                                    uint32 cacheSize = DefaultVertexCacheSize);
+
+// Reorders the triangles in a triangle list for the post-transform vertex cache using Tipsify
+// (Sander et al., "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw"). The
+// triangles are emitted in fans around vertices that are likely to still be in the cache, which
+// also keeps them spatially coherent.
+void OptimizeVertexCache(uint32* indices, uint64 numIndices, uint64 numVertices,
+                         uint32 cacheSize = DefaultVertexCacheSize);
+
+// Computes a remapping that puts the vertices in the order that the triangle list first uses
+// them, so that vertex fetches walk forward through memory. Unused vertices go at the end.
+// Returns the number of used vertices.
+uint64 ComputeVertexFetchRemap(const uint32* indices, uint64 numIndices, uint64 numVertices, uint32* remap);
+
+}
\ No newline at end of file
@@ -137,6 +137,7 @@ typedef uint32_t bool32;
 #include <vector>
 #include <memory>
 #include <map>
+#include <unordered_map>
 #include <cmath>
 #include <sstream>
 #include <fstream>
@@ -42,6 +42,8 @@ public:
         file.Read(size, data);
     }
 
+    uint64 FileSize() const { return file.Size(); }
+
     static bool IsReadSerializer() { return true; }
     static bool IsWriteSerializer() { return false; }
 };
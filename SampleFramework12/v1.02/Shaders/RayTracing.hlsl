@@ -19,6 +19,44 @@ struct MeshVertex
     float3 Bitangent;
 };
 
+// Matches CompactMeshVertex on the CPU side
+struct CompactMeshVertex
+{
+    uint2 Position;         // 16-bit SNORM xyz within the model bounds, bitangent sign in w
+    uint Normal;            // Octahedral, 16-bit SNORM
+    uint Tangent;           // Octahedral, 16-bit SNORM
+    uint UV;                // Half-precision
+};
+
+float2 UnpackSNorm16x2(in uint packed)
+{
+    const int2 signExtended = int2(packed << 16, packed) >> 16;
+    return max(signExtended / 32767.0f, -1.0f);
+}
+
+float3 DecodeOctahedral(in float2 encoded)
+{
+    float3 dir = float3(encoded, 1.0f - abs(encoded.x) - abs(encoded.y));
+    if(dir.z < 0.0f)
+        dir.xy = (1.0f - abs(dir.yx)) * float2(dir.x >= 0.0f ? 1.0f : -1.0f, dir.y >= 0.0f ? 1.0f : -1.0f);
+    return normalize(dir);
+}
+
+MeshVertex DecodeCompactVertex(in CompactMeshVertex vertex, in float3 positionScale, in float3 positionOffset)
+{
+    const float2 positionXY = UnpackSNorm16x2(vertex.Position.x);
+    const float2 positionZW = UnpackSNorm16x2(vertex.Position.y);
+
+    MeshVertex result;
+    result.Position = float3(positionXY, positionZW.x) * positionScale + positionOffset;
+    result.Normal = DecodeOctahedral(UnpackSNorm16x2(vertex.Normal));
+    result.Tangent = DecodeOctahedral(UnpackSNorm16x2(vertex.Tangent));
+    result.Bitangent = cross(result.Normal, result.Tangent) * (positionZW.y < 0.0f ? -1.0f : 1.0f);
+    result.UV = float2(f16tof32(vertex.UV), f16tof32(vertex.UV >> 16));
+
+    return result;
+}
+
 float BarycentricLerp(in float v0, in float v1, in float v2, in float3 barycentrics)
 {
     return v0 * barycentrics.x + v1 * barycentrics.y + v2 * barycentrics.z;
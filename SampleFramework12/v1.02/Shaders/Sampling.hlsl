@@ -330,5 +330,62 @@ float2 SampleCMJ2D(uint sampleIdx, uint numSamplesX, uint numSamplesY, uint patt
     return float2((sx + (sy + jx) / numSamplesY) / numSamplesX, (sampleIdx + jy) / N);
 }
 
+// Integer hash with good avalanche behavior ("lowbias32" by Chris Wellons)
+uint SobolHash(uint x)
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+uint SobolHashCombine(uint seed, uint value)
+{
+    return seed ^ (SobolHash(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2));
+}
+
+// Bit permutation from [Laine and Karras 2011] with the constants from [Burley 2020]. Applying it to a
+// bit-reversed value and reversing the result approximates a base-2 Owen scramble.
+uint LaineKarrasPermutation(uint x, uint seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47c;
+    x ^= x * 0xb82f1e52;
+    x ^= x * 0xc7afe638;
+    x ^= x * 0x8d22f6e6;
+    return x;
+}
+
+// The second dimension of the Sobol sequence in bit-reversed form, the first one is just the index
+uint SobolDimension1Reversed(uint index)
+{
+    index ^= (index >> 1) & 0x55555555;
+    index ^= (index >> 2) & 0x33333333;
+    index ^= (index >> 4) & 0x0F0F0F0F;
+    index ^= (index >> 8) & 0x00FF00FF;
+    index ^= (index >> 16) & 0x0000FFFF;
+    return index;
+}
+
+// Same as SampleSobol2D() with the scrambling seed for the pair of dimensions already computed
+float2 SampleSobol2DFromSeed(uint sampleIdx, uint dimSeed)
+{
+    const uint shuffledIdx = reversebits(LaineKarrasPermutation(reversebits(sampleIdx), dimSeed));
+    const uint x = reversebits(LaineKarrasPermutation(shuffledIdx, SobolHashCombine(dimSeed, 0)));
+    const uint y = reversebits(LaineKarrasPermutation(SobolDimension1Reversed(shuffledIdx), SobolHashCombine(dimSeed, 1)));
+    return float2(x >> 8, y >> 8) * (1.0f / 16777216.0f);
+}
+
+// Returns a 2D sample from an Owen-scrambled Sobol sequence, where "dimIdx" selects a pair of
+// dimensions and "seed" selects the scrambling (typically per-pixel). Shuffling the index with a
+// different seed for each pair of dimensions decorrelates them, so the sequence can be padded out
+// to any number of dimensions.
+float2 SampleSobol2D(uint sampleIdx, uint dimIdx, uint seed)
+{
+    return SampleSobol2DFromSeed(sampleIdx, SobolHashCombine(SobolHash(seed), SobolHash(dimIdx)));
+}
+
 
 #endif // SAMPLING_HLSL_
\ No newline at end of file
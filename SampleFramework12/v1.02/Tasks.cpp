@@ -0,0 +1,75 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#include "PCH.h"
+
+#include "Tasks.h"
+#include "Assert.h"
+
+namespace SampleFramework12
+{
+
+namespace Tasks
+{
+
+static enki::TaskScheduler* scheduler = nullptr;
+
+void Initialize(uint32 numThreads)
+{
+    if(scheduler != nullptr)
+        return;
+
+    scheduler = new enki::TaskScheduler();
+    if(numThreads > 0)
+        scheduler->Initialize(numThreads);
+    else
+        scheduler->Initialize();
+}
+
+void Shutdown()
+{
+    if(scheduler == nullptr)
+        return;
+
+    scheduler->WaitforAllAndShutdown();
+    delete scheduler;
+    scheduler = nullptr;
+}
+
+bool Initialized()
+{
+    return scheduler != nullptr;
+}
+
+enki::TaskScheduler& Scheduler()
+{
+    if(scheduler == nullptr)
+        Initialize();
+    return *scheduler;
+}
+
+uint32 NumThreads()
+{
+    return Scheduler().GetNumTaskThreads();
+}
+
+void ParallelFor(uint32 setSize, const enki::TaskSetFunction& function)
+{
+    if(setSize == 0)
+        return;
+
+    enki::TaskScheduler& taskScheduler = Scheduler();
+    enki::TaskSet taskSet(setSize, function);
+    taskScheduler.AddTaskSetToPipe(&taskSet);
+    taskScheduler.WaitforTaskSet(&taskSet);
+}
+
+}
+
+}
\ No newline at end of file
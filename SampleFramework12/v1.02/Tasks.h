@@ -0,0 +1,36 @@
+//=================================================================================================
+//
+//  MJP's DX12 Sample Framework
+//  http://mynameismjp.wordpress.com/
+//
+//  All code licensed under the MIT license
+//
+//=================================================================================================
+
+#pragma once
+
+#include "PCH.h"
+
+#include "EnkiTS\\TaskScheduler.h"
+
+namespace SampleFramework12
+{
+
+namespace Tasks
+{
+
+// Shared EnkiTS scheduler used for CPU-side work (BVH builds, reference rendering, etc.)
+void Initialize(uint32 numThreads = 0);
+void Shutdown();
+bool Initialized();
+
+enki::TaskScheduler& Scheduler();
+uint32 NumThreads();
+
+// Splits [0, setSize) into ranges and runs them across all task threads, blocking until complete.
+// The function receives the range to process along with the index of the executing thread.
+void ParallelFor(uint32 setSize, const enki::TaskSetFunction& function);
+
+}
+
+}
\ No newline at end of file
@@ -9,6 +9,8 @@
 
 #include "PCH.h"
 
+#include <intrin.h>
+
 #include "Utility.h"
 #include "Exceptions.h"
 #include "App.h"
@@ -67,4 +69,32 @@ std::wstring SampleFrameworkDir()
     return std::wstring(SampleFrameworkDir_);
 }
 
+static bool CheckAVX2Support()
+{
+    int32 info[4] = { };
+    __cpuid(info, 0);
+    if(info[0] < 7)
+        return false;
+
+    __cpuid(info, 1);
+    const bool fma = (info[2] & (1 << 12)) != 0;
+    const bool osxsave = (info[2] & (1 << 27)) != 0;
+    const bool avx = (info[2] & (1 << 28)) != 0;
+    if(fma == false || osxsave == false || avx == false)
+        return false;
+
+    // Make sure that the OS saves the upper half of the YMM registers
+    if((_xgetbv(0) & 0x6) != 0x6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+}
+
+bool CPUSupportsAVX2()
+{
+    static const bool supported = CheckAVX2Support();
+    return supported;
+}
+
 }
\ No newline at end of file
@@ -143,6 +143,9 @@ std::string MakeString(const char* format, ...);
 
 std::wstring SampleFrameworkDir();
 
+// Returns true if the CPU and OS support AVX2 and FMA, so that code written with their intrinsics can run
+bool CPUSupportsAVX2();
+
 // Outputs a string to the debugger output and stdout
 inline void DebugPrint(const std::wstring& str)
 {